@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// running totals of the readings, written by the read loop only and read by the scheduler
+// through a seqlock: the writer never waits, a reader retries while an update is under way.
+// Totals only grow, the average of a period is the difference of two snapshots.
+// An update fills the slot not in use and then publishes it with seq, so the totals can live
+// in a mapped file: whenever the process dies, slot[seq & 1] is complete
+struct aggregate {
+    _Atomic uint64_t seq;   // updates so far
+    struct {
+        _Atomic double sum;
+        _Atomic uint64_t count;
+    } slot[2];
+};
+
+struct aggregate_snapshot {
+    double sum;
+    uint64_t count;
+};
+
+void aggregate_init(struct aggregate *a)
+{
+    atomic_init(&a->seq, 0);
+    for (int i = 0; i < 2; ++i) {
+        atomic_init(&a->slot[i].sum, 0.0);
+        atomic_init(&a->slot[i].count, 0);
+    }
+}
+
+// single writer
+void aggregate_add(struct aggregate *a, double value)
+{
+    uint64_t seq = atomic_load_explicit(&a->seq, memory_order_relaxed);
+    int from = seq & 1, to = from ^ 1;
+    // the slot was published two updates ago, a reader that still holds it must see the
+    // last seq store before any of these
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&a->slot[to].sum, atomic_load_explicit(&a->slot[from].sum, memory_order_relaxed) + value,
+                          memory_order_relaxed);
+    atomic_store_explicit(&a->slot[to].count,
+                          atomic_load_explicit(&a->slot[from].count, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_store_explicit(&a->seq, seq + 1, memory_order_release);
+}
+
+// any number of readers; returns the retries it took, for the benchmark
+unsigned aggregate_read(struct aggregate *a, struct aggregate_snapshot *out)
+{
+    unsigned retries = 0;
+    for (;;) {
+        uint64_t before = atomic_load_explicit(&a->seq, memory_order_acquire);
+        out->sum = atomic_load_explicit(&a->slot[before & 1].sum, memory_order_relaxed);
+        out->count = atomic_load_explicit(&a->slot[before & 1].count, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        // one more update wrote the other slot, but this one may be half rewritten by a second
+        if (atomic_load_explicit(&a->seq, memory_order_relaxed) == before)
+            return retries;
+        retries++;
+    }
+}
+
+// the average between two snapshots, 0 without readings as the logs always had it
+double aggregate_average(const struct aggregate_snapshot *from, const struct aggregate_snapshot *to)
+{
+    uint64_t count = to->count - from->count;
+    return count > 0 ? (to->sum - from->sum) / count : 0.0;
+}
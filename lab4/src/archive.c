@@ -0,0 +1,359 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#    include <windows.h>
+#    include <io.h>
+#else
+#    include <dirent.h>
+#    include <unistd.h>
+#endif
+
+#include "mapped.c"
+
+// a sealed year of a log, <stem>_<year>.arc: its records in time order cut into blocks of
+// ARCHIVE_BLOCK_RECORDS, each block coded on its own as varints of the change of the time
+// step and of the value, behind an index of the span of every block. A range decodes only
+// the blocks it overlaps; a day record takes about 3 bytes instead of 36
+#define ARCHIVE_MAGIC "LAB4ARC1"
+#define ARCHIVE_BLOCK_RECORDS 32
+#define ARCHIVE_SUFFIX ".arc"
+
+struct archive_header {
+    char magic[8];
+    uint32_t block_records;
+    uint32_t blocks;
+    uint32_t records;
+    int32_t year;
+    int64_t first_ms;
+    int64_t last_ms;
+};
+
+struct archive_block {
+    int64_t first_ms;   // time of the first record, not coded in the block
+    int64_t last_ms;
+    uint32_t offset;    // of the block in the file
+    uint32_t size;
+    uint32_t count;
+    uint32_t reserved;
+};
+
+// readings are kept as the text logs print them, in tenths
+struct archive_record {
+    int64_t time_ms;
+    int32_t tenths;
+};
+
+struct archive_records {
+    struct archive_record *items;
+    size_t count;
+    size_t allocated;
+    int failed;
+};
+
+typedef void (*archive_callback)(int64_t time_ms, double value, void *ctx);
+
+struct archive {
+    struct mapped map;
+    const struct archive_header *header;
+    const struct archive_block *index;
+};
+
+void archive_records_add(struct archive_records *r, int64_t time_ms, double value)
+{
+    if (r->count == r->allocated) {
+        size_t allocated = r->allocated ? r->allocated * 2 : 512;
+        struct archive_record *items = (struct archive_record*)realloc(r->items, allocated * sizeof(*items));
+        if (items == NULL) {
+            r->failed = 1;
+            return;
+        }
+        r->items = items;
+        r->allocated = allocated;
+    }
+    r->items[r->count].time_ms = time_ms;
+    r->items[r->count].tenths = (int32_t)(value * 10 + (value < 0 ? -0.5 : 0.5));
+    r->count++;
+}
+
+void archive_records_free(struct archive_records *r)
+{
+    free(r->items);
+    memset(r, 0, sizeof(*r));
+}
+
+// a text record "YYYY-MM-DD hh:mm:ss.sss value" to its local time and value
+int archive_parse_record(const char *record, int64_t *time_ms, double *value)
+{
+    struct tm tm;
+    int ms;
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(record, "%4d-%2d-%2d %2d:%2d:%2d.%3d %lf", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour,
+               &tm.tm_min, &tm.tm_sec, &ms, value) != 8)
+        return -1;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    time_t t = mktime(&tm);
+    if (t == (time_t)-1)
+        return -1;
+    *time_ms = (int64_t)t * 1000 + ms;
+    return 0;
+}
+
+// zigzag, so small negative changes are short too
+static size_t archive_put_varint(unsigned char *out, int64_t v)
+{
+    uint64_t u = ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+    size_t n = 0;
+    while (u >= 0x80) {
+        out[n++] = (unsigned char)(u | 0x80);
+        u >>= 7;
+    }
+    out[n++] = (unsigned char)u;
+    return n;
+}
+
+static const unsigned char *archive_get_varint(const unsigned char *p, const unsigned char *end, int64_t *v)
+{
+    uint64_t u = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char byte = *p++;
+        u |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            *v = (int64_t)(u >> 1) ^ -(int64_t)(u & 1);
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static int archive_compare(const void *a, const void *b)
+{
+    int64_t x = ((const struct archive_record*)a)->time_ms, y = ((const struct archive_record*)b)->time_ms;
+    return (x > y) - (x < y);
+}
+
+// the archive of year at path: written to a temporary file, synced and renamed over path,
+// so path is the whole archive or what it was before, never a part
+int archive_write(const char *path, int year, struct archive_records *records)
+{
+    if (records->failed) {
+        fprintf(stderr, "%s: out of memory\n", path);
+        return -1;
+    }
+    qsort(records->items, records->count, sizeof(struct archive_record), archive_compare);
+
+    uint32_t blocks = (uint32_t)((records->count + ARCHIVE_BLOCK_RECORDS - 1) / ARCHIVE_BLOCK_RECORDS);
+    size_t data_offset = sizeof(struct archive_header) + blocks * sizeof(struct archive_block);
+    // two varints of at most 10 bytes a record
+    unsigned char *data = (unsigned char*)malloc(data_offset + records->count * 20 + 1);
+    if (data == NULL) {
+        perror("malloc (archive)");
+        return -1;
+    }
+    memset(data, 0, data_offset);
+    struct archive_header *header = (struct archive_header*)data;
+    struct archive_block *index = (struct archive_block*)(data + sizeof(struct archive_header));
+    header->block_records = ARCHIVE_BLOCK_RECORDS;
+    header->blocks = blocks;
+    header->records = (uint32_t)records->count;
+    header->year = year;
+    header->first_ms = records->count ? records->items[0].time_ms : 0;
+    header->last_ms = records->count ? records->items[records->count - 1].time_ms : -1;
+    memcpy(header->magic, ARCHIVE_MAGIC, sizeof(header->magic));
+
+    size_t size = data_offset;
+    for (uint32_t b = 0; b < blocks; ++b) {
+        const struct archive_record *rec = records->items + (size_t)b * ARCHIVE_BLOCK_RECORDS;
+        uint32_t count = (uint32_t)(records->count - (size_t)b * ARCHIVE_BLOCK_RECORDS);
+        if (count > ARCHIVE_BLOCK_RECORDS)
+            count = ARCHIVE_BLOCK_RECORDS;
+        index[b].first_ms = rec[0].time_ms;
+        index[b].last_ms = rec[count - 1].time_ms;
+        index[b].offset = (uint32_t)size;
+        index[b].count = count;
+
+        int64_t prev_ms = rec[0].time_ms, prev_step = 0, prev_tenths = 0;
+        for (uint32_t i = 0; i < count; ++i) {
+            if (i > 0) {
+                int64_t step = rec[i].time_ms - prev_ms;
+                size += archive_put_varint(data + size, step - prev_step);
+                prev_step = step;
+                prev_ms = rec[i].time_ms;
+            }
+            size += archive_put_varint(data + size, rec[i].tenths - prev_tenths);
+            prev_tenths = rec[i].tenths;
+        }
+        index[b].size = (uint32_t)(size - index[b].offset);
+    }
+
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.new", path);
+    FILE *file = fopen(tmp, "wb");
+    if (file == NULL) {
+        perror(tmp);
+        free(data);
+        return -1;
+    }
+    int failed = fwrite(data, 1, size, file) != size || fflush(file) != 0;
+#ifdef _WIN32
+    failed = failed || _commit(_fileno(file)) != 0;
+#else
+    failed = failed || fsync(fileno(file)) != 0;
+#endif
+    if (fclose(file) != 0)
+        failed = 1;
+    free(data);
+    if (failed) {
+        perror(tmp);
+        remove(tmp);
+        return -1;
+    }
+#ifdef _WIN32
+    if (!MoveFileEx(tmp, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+#else
+    if (rename(tmp, path) == -1) {
+#endif
+        perror("rename (archive)");
+        return -1;
+    }
+    return 0;
+}
+
+int archive_open(struct archive *a, const char *path)
+{
+    if (mapped_open(&a->map, path, 0, 0) == -1)
+        return -1;
+    a->header = (const struct archive_header*)a->map.addr;
+    a->index = (const struct archive_block*)(a->map.addr + sizeof(struct archive_header));
+    if (a->map.size < sizeof(struct archive_header) ||
+        memcmp(a->header->magic, ARCHIVE_MAGIC, sizeof(a->header->magic)) != 0 ||
+        a->map.size < sizeof(struct archive_header) + (size_t)a->header->blocks * sizeof(struct archive_block)) {
+        fprintf(stderr, "%s: not a log archive\n", path);
+        mapped_close(&a->map);
+        return -1;
+    }
+    return 0;
+}
+
+// records of [from_ms, to_ms) in time order; returns how many
+size_t archive_range(const struct archive *a, int64_t from_ms, int64_t to_ms, archive_callback callback, void *ctx)
+{
+    // the first block that may hold from_ms
+    uint32_t lo = 0, hi = a->header->blocks;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (a->index[mid].last_ms < from_ms)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    size_t found = 0;
+    for (uint32_t b = lo; b < a->header->blocks && a->index[b].first_ms < to_ms; ++b) {
+        const struct archive_block *block = &a->index[b];
+        if ((size_t)block->offset + block->size > a->map.size)
+            break;
+        const unsigned char *p = (const unsigned char*)a->map.addr + block->offset, *end = p + block->size;
+        int64_t time_ms = block->first_ms, step = 0, tenths = 0, change;
+        for (uint32_t i = 0; i < block->count && p != NULL; ++i) {
+            if (i > 0 && (p = archive_get_varint(p, end, &change)) != NULL) {
+                step += change;
+                time_ms += step;
+            }
+            if (p == NULL || (p = archive_get_varint(p, end, &change)) == NULL)
+                break;
+            tenths += change;
+            if (time_ms >= from_ms && time_ms < to_ms) {
+                callback(time_ms, tenths / 10.0, ctx);
+                found++;
+            }
+        }
+    }
+    return found;
+}
+
+void archive_close(struct archive *a)
+{
+    mapped_close(&a->map);
+}
+
+void archive_path(const char *stem, int year, char *out, size_t size)
+{
+    snprintf(out, size, "%s_%04d%s", stem, year, ARCHIVE_SUFFIX);
+}
+
+static int archive_compare_years(const void *a, const void *b)
+{
+    return *(const int*)a - *(const int*)b;
+}
+
+// years with an archive of stem, oldest first, at most max; returns how many
+int archive_years(const char *stem, int *years, int max)
+{
+    // the directory part of stem is listed for files named after the rest
+    const char *slash = strrchr(stem, '/');
+#ifdef _WIN32
+    const char *backslash = strrchr(stem, '\\');
+    if (backslash != NULL && (slash == NULL || backslash > slash))
+        slash = backslash;
+#endif
+    const char *base = slash ? slash + 1 : stem;
+    char dir[512];
+    snprintf(dir, sizeof(dir), "%.*s", slash ? (int)(slash - stem) : 1, slash ? stem : ".");
+    size_t base_len = strlen(base);
+
+    int count = 0;
+#ifdef _WIN32
+    char pattern[600];
+    snprintf(pattern, sizeof(pattern), "%s\\%s_*%s", dir, base, ARCHIVE_SUFFIX);
+    WIN32_FIND_DATA found;
+    HANDLE find = FindFirstFile(pattern, &found);
+    if (find == INVALID_HANDLE_VALUE)
+        return 0;
+    do {
+        const char *name = found.cFileName;
+#else
+    DIR *d = opendir(dir);
+    if (d == NULL)
+        return 0;
+    struct dirent *entry;
+    while ((entry = readdir(d)) != NULL) {
+        const char *name = entry->d_name;
+#endif
+        int year;
+        char suffix[8];
+        if (count < max && strncmp(name, base, base_len) == 0 && name[base_len] == '_' &&
+            sscanf(name + base_len + 1, "%d%7s", &year, suffix) == 2 && strcmp(suffix, ARCHIVE_SUFFIX) == 0)
+            years[count++] = year;
+#ifdef _WIN32
+    } while (FindNextFile(find, &found));
+    FindClose(find);
+#else
+    }
+    closedir(d);
+#endif
+    qsort(years, count, sizeof(int), archive_compare_years);
+    return count;
+}
+
+// only the newest keep years of stem stay
+void archive_prune(const char *stem, int keep)
+{
+    int years[256];
+    int count = archive_years(stem, years, 256);
+    for (int i = 0; i < count - keep; ++i) {
+        char path[512];
+        archive_path(stem, years[i], path, sizeof(path));
+        if (remove(path) == 0)
+            printf("%s: older than the last %d years, removed\n", path, keep);
+        else
+            perror(path);
+    }
+}
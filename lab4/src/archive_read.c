@@ -0,0 +1,146 @@
+#include "archive.c"
+#include "mlog.c"
+#include "tlog.c"
+#include "vclock.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// reads a log together with the years sealed from it, as one: the archives <stem>_<year>.arc
+// next to the live log first, then the live log (text or binary) past the last of them;
+// of an archive only the blocks of the range are decoded. Records are printed like the text logs
+//   archive_read <log_day.txt|log_day.bin> range <from> <to>
+//   archive_read <log_day.txt|log_day.bin> export
+// times are local "YYYY-MM-DD[ HH:MM[:SS]]" or "now" (of TEMP_CLOCK)
+#define RECORD_LENGTH 36
+#define MAX_YEARS 256
+
+struct live_range {
+    int64_t from_ms;
+    int64_t to_ms;
+    size_t found;
+};
+
+static void print_record(int64_t time_ms, double value, void *ctx)
+{
+    (void)ctx;
+    char date[32], record[RECORD_LENGTH + 1];
+    if (vclock_format_ms(time_ms, date, sizeof(date)) == -1)
+        return;
+    int len = snprintf(record, sizeof(record), "%s %.1lf", date, value);
+    memset(record + len, ' ', RECORD_LENGTH - 1 - len);
+    record[RECORD_LENGTH - 1] = '\n';
+    fwrite(record, 1, RECORD_LENGTH, stdout);
+}
+
+static void print_text_record(const char *record, void *ctx)
+{
+    struct live_range *range = (struct live_range*)ctx;
+    int64_t time_ms;
+    double value;
+    if (archive_parse_record(record, &time_ms, &value) == 0 && time_ms >= range->from_ms && time_ms < range->to_ms) {
+        print_record(time_ms, value, NULL);
+        range->found++;
+    }
+}
+
+static int parse_time(const char *s, int64_t *ms)
+{
+    if (strcmp(s, "now") == 0) {
+        *ms = vclock_now_ms();
+        return 0;
+    }
+    if (vclock_parse_date(s, ms) == -1) {
+        fprintf(stderr, "Bad time \"%s\", expected YYYY-MM-DD[ HH:MM[:SS]] or now\n", s);
+        return -1;
+    }
+    return 0;
+}
+
+// the records of the live log in [from_ms, to_ms); a missing log is an empty one
+static size_t read_live(const char *path, int64_t from_ms, int64_t to_ms)
+{
+    char magic[8] = {0};
+    FILE *probe = fopen(path, "rb");
+    if (probe == NULL)
+        return 0;
+    size_t n = fread(magic, 1, sizeof(magic), probe);
+    fclose(probe);
+
+    if (n == sizeof(magic) && memcmp(magic, TLOG_MAGIC, sizeof(magic)) == 0) {
+        struct tlog log;
+        if (tlog_open_read(&log, path) == -1)
+            return 0;
+        int64_t last = tlog_last_ms(&log);
+        size_t found = 0;
+        if (last >= 0 && from_ms <= last)
+            found = tlog_range(&log, from_ms, to_ms < last + 1 ? to_ms : last + 1, print_record, NULL);
+        tlog_close(&log);
+        return found;
+    }
+
+    struct mlog log;
+    if (mlog_open_read(&log, path) == -1)
+        return 0;
+    struct live_range range = {from_ms, to_ms, 0};
+    mlog_each(&log, print_text_record, &range);
+    mlog_close(&log);
+    return range.found;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s <log> range <from> <to>\n"
+                    "       %s <log> export\n", name, name);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    vclock_init();
+
+    int64_t from_ms = 0, to_ms = INT64_MAX;
+    if (strcmp(argv[2], "range") == 0 && argc == 5) {
+        if (parse_time(argv[3], &from_ms) == -1 || parse_time(argv[4], &to_ms) == -1)
+            return EXIT_FAILURE;
+    } else if (strcmp(argv[2], "export") != 0 || argc != 3) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // log_day.txt and log_day.bin are both sealed into log_day_<year>.arc
+    char stem[512];
+    snprintf(stem, sizeof(stem), "%s", argv[1]);
+    char *dot = strrchr(stem, '.');
+    if (dot != NULL && strchr(dot, '/') == NULL)
+        *dot = '\0';
+
+    int years[MAX_YEARS];
+    int count = archive_years(stem, years, MAX_YEARS);
+    int64_t live_from_ms = from_ms;
+    size_t found = 0;
+    for (int i = 0; i < count; ++i) {
+        char path[600];
+        struct archive archive;
+        archive_path(stem, years[i], path, sizeof(path));
+        if (archive_open(&archive, path) == -1)
+            continue;
+        // the index tells whether the year is in the range at all
+        if (archive.header->records > 0) {
+            if (archive.header->first_ms < to_ms && archive.header->last_ms >= from_ms)
+                found += archive_range(&archive, from_ms, to_ms, print_record, NULL);
+            if (archive.header->last_ms + 1 > live_from_ms)
+                live_from_ms = archive.header->last_ms + 1;
+        }
+        archive_close(&archive);
+    }
+    if (live_from_ms < to_ms)
+        found += read_live(argv[1], live_from_ms, to_ms);
+
+    fprintf(stderr, "%zu records, %d archived years\n", found, count);
+    return EXIT_SUCCESS;
+}
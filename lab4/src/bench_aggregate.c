@@ -0,0 +1,181 @@
+#include "aggregate.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef _WIN32
+#    include <fcntl.h>
+#    include <pthread.h>
+#    include <semaphore.h>
+#endif
+
+// one writer adding readings as fast as it can while readers take snapshots in a loop,
+// for the seqlock, a mutex and the named semaphore the logger threads used to share
+//   bench_aggregate [adds] [max readers]
+#define BENCH_ADDS 20000000
+#define BENCH_MAX_READERS 8
+#define BENCH_SEMAPHORE "/bench_aggregate"
+
+#ifdef _WIN32
+int main()
+{
+    fprintf(stderr, "bench_aggregate: POSIX threads only\n");
+    return EXIT_FAILURE;
+}
+#else
+
+double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+enum variant { SEQLOCK, MUTEX, SEMAPHORE };
+static const char *variant_names[] = {"seqlock", "mutex", "semaphore"};
+
+// the locked variants keep the old running average and counter
+struct locked {
+    double avg;
+    uint64_t count;
+    pthread_mutex_t mutex;
+    sem_t *sem;
+};
+
+struct bench {
+    int variant;
+    long adds;
+    struct aggregate seq;
+    struct locked locked;
+    _Atomic int done;
+};
+
+struct reader_result {
+    struct bench *b;
+    unsigned long snapshots;
+    unsigned long retries;
+    unsigned long torn;   // a snapshot whose average is not one the writer ever had
+};
+
+static void locked_add(struct bench *b, double value)
+{
+    struct locked *l = &b->locked;
+    if (b->variant == MUTEX)
+        pthread_mutex_lock(&l->mutex);
+    else
+        sem_wait(l->sem);
+    l->count++;
+    l->avg += (value - l->avg) / l->count;
+    if (b->variant == MUTEX)
+        pthread_mutex_unlock(&l->mutex);
+    else
+        sem_post(l->sem);
+}
+
+static void locked_read(struct bench *b, struct aggregate_snapshot *out)
+{
+    struct locked *l = &b->locked;
+    if (b->variant == MUTEX)
+        pthread_mutex_lock(&l->mutex);
+    else
+        sem_wait(l->sem);
+    out->count = l->count;
+    out->sum = l->avg * l->count;
+    if (b->variant == MUTEX)
+        pthread_mutex_unlock(&l->mutex);
+    else
+        sem_post(l->sem);
+}
+
+// the writer adds 1.0 and 3.0 in turn, so every consistent snapshot has sum 2 * count
+// rounded to the nearest reading
+static void *reader(void *arg)
+{
+    struct reader_result *r = (struct reader_result*)arg;
+    struct bench *b = r->b;
+    while (!atomic_load_explicit(&b->done, memory_order_acquire)) {
+        struct aggregate_snapshot s;
+        if (b->variant == SEQLOCK)
+            r->retries += aggregate_read(&b->seq, &s);
+        else
+            locked_read(b, &s);
+        double expected = 2.0 * s.count - (s.count & 1);
+        if (s.sum < expected - 1e-6 * s.count - 1e-9 || s.sum > expected + 1e-6 * s.count + 1e-9)
+            r->torn++;
+        r->snapshots++;
+    }
+    return NULL;
+}
+
+static void run(int variant, long adds, int readers)
+{
+    struct bench b;
+    memset(&b, 0, sizeof(b));
+    b.variant = variant;
+    b.adds = adds;
+    aggregate_init(&b.seq);
+    atomic_init(&b.done, 0);
+    pthread_mutex_init(&b.locked.mutex, NULL);
+    sem_unlink(BENCH_SEMAPHORE);
+    b.locked.sem = sem_open(BENCH_SEMAPHORE, O_CREAT, 0600, 1);
+    if (b.locked.sem == SEM_FAILED) {
+        perror("sem_open");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_t threads[BENCH_MAX_READERS];
+    struct reader_result results[BENCH_MAX_READERS];
+    memset(results, 0, sizeof(results));
+    for (int i = 0; i < readers; ++i) {
+        results[i].b = &b;
+        if (pthread_create(&threads[i], NULL, reader, &results[i]) != 0) {
+            perror("pthread_create");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    double start = now_sec();
+    for (long i = 0; i < adds; ++i) {
+        double value = (i & 1) ? 3.0 : 1.0;
+        if (variant == SEQLOCK)
+            aggregate_add(&b.seq, value);
+        else
+            locked_add(&b, value);
+    }
+    double sec = now_sec() - start;
+    atomic_store_explicit(&b.done, 1, memory_order_release);
+
+    unsigned long snapshots = 0, retries = 0, torn = 0;
+    for (int i = 0; i < readers; ++i) {
+        pthread_join(threads[i], NULL);
+        snapshots += results[i].snapshots;
+        retries += results[i].retries;
+        torn += results[i].torn;
+    }
+    printf("%-10s %2d readers %8.1f ns/add %10.2f M snapshots/s %8.3f retries/snapshot %lu torn\n",
+           variant_names[variant], readers, sec * 1e9 / adds, snapshots / sec / 1e6,
+           snapshots ? (double)retries / snapshots : 0.0, torn);
+
+    sem_close(b.locked.sem);
+    sem_unlink(BENCH_SEMAPHORE);
+    pthread_mutex_destroy(&b.locked.mutex);
+}
+
+int main(int argc, char *argv[])
+{
+    long adds = argc > 1 ? atol(argv[1]) : BENCH_ADDS;
+    int max_readers = argc > 2 ? atoi(argv[2]) : 4;
+    if (adds <= 0 || max_readers < 0 || max_readers > BENCH_MAX_READERS) {
+        fprintf(stderr, "usage: %s [adds] [readers, up to %d]\n", argv[0], BENCH_MAX_READERS);
+        return EXIT_FAILURE;
+    }
+
+    for (int variant = SEQLOCK; variant <= SEMAPHORE; ++variant) {
+        for (int readers = 0; readers <= max_readers; readers = readers ? readers * 2 : 1)
+            run(variant, adds, readers);
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "aggregate.c"
+#include "mapped.c"
+#include "sched.c"
+
+// a small mapped file keeping the running totals and where each period started, so a
+// restarted main goes on with the periods under way instead of starting them empty.
+// The read loop adds straight into the mapped totals, a period is marked when it is logged;
+// nothing is written out but the pages the kernel already has, synced once a period
+#define CHECKPOINT_MAGIC "LAB4CKP1"
+
+// a period that started at start, when the totals were sum and count
+struct checkpoint_mark {
+    int64_t start;
+    double sum;
+    uint64_t count;
+};
+
+// marks are written like the totals: the new one to the other slot, then published by seq
+struct checkpoint_period {
+    struct sched_period period;
+    _Atomic uint32_t seq;   // 0 before the first mark
+    struct checkpoint_mark marks[2];
+};
+
+struct checkpoint_file {
+    char magic[8];
+    uint32_t size;   // of this struct, another layout starts over
+    uint32_t reserved;
+    struct aggregate totals;
+    struct checkpoint_period periods[SCHED_MAX_JOBS];
+};
+
+struct checkpoint {
+    struct mapped map;
+    struct checkpoint_file *file;
+};
+
+int checkpoint_open(struct checkpoint *c, const char *path)
+{
+    if (mapped_open(&c->map, path, sizeof(struct checkpoint_file), 1) == -1)
+        return -1;
+    c->file = (struct checkpoint_file*)c->map.addr;
+    if (memcmp(c->file->magic, CHECKPOINT_MAGIC, sizeof(c->file->magic)) != 0 ||
+        c->file->size != sizeof(struct checkpoint_file)) {
+        memset(c->file, 0, sizeof(struct checkpoint_file));
+        aggregate_init(&c->file->totals);
+        c->file->size = sizeof(struct checkpoint_file);
+        memcpy(c->file->magic, CHECKPOINT_MAGIC, sizeof(c->file->magic));
+    }
+    return 0;
+}
+
+// the last mark of the i-th period, -1 if there is none or it was kept for another period
+int checkpoint_load(struct checkpoint *c, int i, struct sched_period period, struct checkpoint_mark *out)
+{
+    struct checkpoint_period *p = &c->file->periods[i];
+    uint32_t seq = atomic_load_explicit(&p->seq, memory_order_acquire);
+    if (seq == 0 || p->period.unit != period.unit || p->period.seconds != period.seconds)
+        return -1;
+    *out = p->marks[seq & 1];
+    return 0;
+}
+
+// the i-th period now starts at start with these totals, on disk when this returns
+void checkpoint_mark(struct checkpoint *c, int i, struct sched_period period, time_t start,
+                     const struct aggregate_snapshot *totals)
+{
+    struct checkpoint_period *p = &c->file->periods[i];
+    uint32_t seq = atomic_load_explicit(&p->seq, memory_order_relaxed);
+    if (p->period.unit != period.unit || p->period.seconds != period.seconds) {
+        seq = 0;
+        atomic_store_explicit(&p->seq, 0, memory_order_release);
+        p->period = period;
+    }
+    struct checkpoint_mark *mark = &p->marks[(seq + 1) & 1];
+    mark->start = (int64_t)start;
+    mark->sum = totals->sum;
+    mark->count = totals->count;
+    atomic_store_explicit(&p->seq, seq + 1, memory_order_release);
+    mapped_sync(&c->map, c->map.addr, c->map.size);
+}
+
+void checkpoint_close(struct checkpoint *c)
+{
+    mapped_sync(&c->map, c->map.addr, c->map.size);
+    mapped_close(&c->map);
+}
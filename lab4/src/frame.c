@@ -0,0 +1,261 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// wire format of one reading: $<seq>,<value>*<crc>\n
+// seq  - decimal uint32, incremented by the sender for every frame
+// crc  - CRC-16/CCITT-FALSE of the bytes between '$' and '*', 4 hex digits
+#define FRAME_START '$'
+#define FRAME_CRC_SEP '*'
+#define FRAME_END '\n'
+#define FRAME_MAX_LEN 64
+#define FRAME_BUFFER_SIZE 4096
+
+struct frame {
+    uint32_t seq;
+    double value;
+};
+
+struct frame_stats {
+    unsigned long frames;
+    unsigned long crc_errors;
+    unsigned long malformed;
+    unsigned long gaps;
+    unsigned long dropped;
+    unsigned long restarts;
+    unsigned long discarded;
+};
+
+struct frame_parser {
+    char buf[FRAME_BUFFER_SIZE];
+    size_t len;
+    int has_seq;
+    uint32_t next_seq;
+    struct frame_stats stats;
+};
+
+typedef void (*frame_callback)(const struct frame *frame, void *ctx);
+
+static uint16_t frame_crc_table[256];
+static int frame_crc_ready = 0;
+
+// table is filled once, concurrent first calls write the same values
+static void frame_crc_init()
+{
+    for (int i = 0; i < 256; ++i) {
+        uint16_t crc = (uint16_t)(i << 8);
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        frame_crc_table[i] = crc;
+    }
+    frame_crc_ready = 1;
+}
+
+uint16_t frame_crc16(const char *data, size_t len)
+{
+    if (!frame_crc_ready)
+        frame_crc_init();
+
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; ++i)
+        crc = (uint16_t)(crc << 8) ^ frame_crc_table[(crc >> 8) ^ (unsigned char)data[i]];
+    return crc;
+}
+
+int frame_encode(char *out, size_t size, uint32_t seq, double value)
+{
+    int len = snprintf(out, size, "%c%u,%.1f", FRAME_START, seq, value);
+    if (len < 0 || (size_t)len + 7 > size)
+        return -1;
+    uint16_t crc = frame_crc16(out + 1, len - 1);
+    len += snprintf(out + len, size - len, "%c%04X%c", FRAME_CRC_SEP, crc, FRAME_END);
+    return len;
+}
+
+void frame_parser_init(struct frame_parser *p)
+{
+    memset(p, 0, sizeof(*p));
+}
+
+static int frame_hex(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+// parse "<seq>,<value>" in place, the field bytes are never copied
+static int frame_fields(const char *s, const char *end, struct frame *frame)
+{
+    uint32_t seq = 0;
+    const char *c = s;
+    if (c == end || *c < '0' || *c > '9')
+        return -1;
+    while (c < end && *c >= '0' && *c <= '9')
+        seq = seq * 10 + (uint32_t)(*c++ - '0');
+    if (c == end || *c++ != ',')
+        return -1;
+
+    int negative = 0;
+    if (c < end && (*c == '-' || *c == '+'))
+        negative = *c++ == '-';
+
+    // digits go into an integer mantissa, one division gives the nearest double
+    const char *digits = c;
+    int64_t mantissa = 0;
+    double scale = 1.0;
+    while (c < end && *c >= '0' && *c <= '9')
+        mantissa = mantissa * 10 + (*c++ - '0');
+    if (c < end && *c == '.') {
+        ++c;
+        while (c < end && *c >= '0' && *c <= '9') {
+            mantissa = mantissa * 10 + (*c++ - '0');
+            scale *= 10.0;
+        }
+    }
+    if (c != end || c == digits || c - digits > 18)
+        return -1;
+
+    frame->seq = seq;
+    frame->value = (negative ? -mantissa : mantissa) / scale;
+    return 0;
+}
+
+static void frame_track_seq(struct frame_parser *p, uint32_t seq)
+{
+    if (p->has_seq && seq != p->next_seq) {
+        uint32_t missing = seq - p->next_seq;
+        if (missing < 0x80000000u) {
+            p->stats.gaps++;
+            p->stats.dropped += missing;
+        } else {
+            // sender went back in sequence, it was restarted
+            p->stats.restarts++;
+        }
+    }
+    p->has_seq = 1;
+    p->next_seq = seq + 1;
+}
+
+// parse complete frames of data, returns number of bytes consumed
+size_t frame_parse(struct frame_parser *p, const char *data, size_t len, frame_callback cb, void *ctx)
+{
+    const char *pos = data;
+    const char *end = data + len;
+
+    while (pos < end) {
+        const char *start = memchr(pos, FRAME_START, end - pos);
+        if (start == NULL) {
+            p->stats.discarded += end - pos;
+            return len;
+        }
+        p->stats.discarded += start - pos;
+
+        const char *limit = end - start > FRAME_MAX_LEN ? start + FRAME_MAX_LEN : end;
+        const char *stop = memchr(start + 1, FRAME_END, limit - start - 1);
+        if (stop == NULL) {
+            if (limit == end)
+                return start - data;
+            // no terminator within the max frame length
+            p->stats.malformed++;
+            pos = start + 1;
+            continue;
+        }
+
+        // a new start inside the frame means the previous one was cut off
+        const char *restart = memchr(start + 1, FRAME_START, stop - start - 1);
+        if (restart != NULL) {
+            p->stats.malformed++;
+            pos = restart;
+            continue;
+        }
+        pos = stop + 1;
+
+        const char *sep = stop - 5;
+        if (sep <= start || *sep != FRAME_CRC_SEP) {
+            p->stats.malformed++;
+            continue;
+        }
+
+        int crc = 0;
+        for (int i = 1; i <= 4; ++i) {
+            int h = frame_hex(sep[i]);
+            if (h < 0) {
+                crc = -1;
+                break;
+            }
+            crc = (crc << 4) | h;
+        }
+        if (crc < 0) {
+            p->stats.malformed++;
+            continue;
+        }
+        if (frame_crc16(start + 1, sep - start - 1) != crc) {
+            p->stats.crc_errors++;
+            continue;
+        }
+
+        struct frame frame;
+        if (frame_fields(start + 1, sep, &frame) != 0) {
+            p->stats.malformed++;
+            continue;
+        }
+
+        frame_track_seq(p, frame.seq);
+        p->stats.frames++;
+        cb(&frame, ctx);
+    }
+    return len;
+}
+
+// free space for read() straight into the parser buffer
+char *frame_parser_space(struct frame_parser *p, size_t *avail)
+{
+    *avail = sizeof(p->buf) - p->len;
+    return p->buf + p->len;
+}
+
+// parse the n bytes added after the buffered tail, keeps the new unfinished tail
+void frame_parser_commit(struct frame_parser *p, size_t n, frame_callback cb, void *ctx)
+{
+    p->len += n;
+    size_t used = frame_parse(p, p->buf, p->len, cb, ctx);
+    if (used > 0) {
+        memmove(p->buf, p->buf + used, p->len - used);
+        p->len -= used;
+    }
+}
+
+// parse bytes from the caller's buffer, only a partial frame at the end is copied
+void frame_parser_feed(struct frame_parser *p, const char *data, size_t len, frame_callback cb, void *ctx)
+{
+    // finish the frame left over from the previous call first
+    while (p->len > 0 && len > 0) {
+        size_t n = len < FRAME_MAX_LEN ? len : FRAME_MAX_LEN;
+        const char *stop = memchr(data, FRAME_END, n);
+        if (stop != NULL)
+            n = stop - data + 1;
+        memcpy(p->buf + p->len, data, n);
+        data += n;
+        len -= n;
+        frame_parser_commit(p, n, cb, ctx);
+    }
+    if (len == 0)
+        return;
+
+    size_t used = frame_parse(p, data, len, cb, ctx);
+    size_t rest = len - used;
+    if (rest > sizeof(p->buf))
+        rest = sizeof(p->buf);
+    memcpy(p->buf, data + len - rest, rest);
+    p->len = rest;
+}
+
+void frame_print_stats(const char *name, const struct frame_stats *s)
+{
+    printf("%s: frames %lu, crc errors %lu, malformed %lu, gaps %lu, dropped %lu, restarts %lu, discarded bytes %lu\n",
+           name, s->frames, s->crc_errors, s->malformed, s->gaps, s->dropped, s->restarts, s->discarded);
+}
@@ -1,4 +1,12 @@
 #include "serial.c"
+#include "frame.c"
+#include "vclock.c"
+#include "mlog.c"
+#include "tlog.c"
+#include "sched.c"
+#include "aggregate.c"
+#include "checkpoint.c"
+#include "archive.c"
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
@@ -8,7 +16,6 @@
 #else
 #    include <termios.h>
 #    include <pthread.h>
-#    include <semaphore.h>
 #    include <sys/time.h>
 #    include <string.h>
 #    include <signal.h>
@@ -16,40 +23,70 @@
 
 #ifdef _WIN32
 #    define PORT_RD "COM9"
-#    define SemaphoreWait(sem) WaitForSingleObject(sem, INFINITE);
-#    define SemaphorePost(sem) ReleaseSemaphore(sem, 1, NULL)
-#    define sleep(x) Sleep(x * 1000)
 #else
 #    define PORT_RD "/dev/pts/4"
-#    define SemaphoreWait(sem) sem_wait(sem)
-#    define SemaphorePost(sem) sem_post(sem)
-#    define sleep(x) sleep(x)
 #endif
 
 #define LOG_FILE_NAME "log.txt"
 #define LOG_FILE_NAME_HOUR "log_hour.txt"
 #define LOG_FILE_NAME_DAY "log_day.txt"
-#define FILE_LAST_RECORD "tmp/tmp.txt"
-
-#define SEMAPHORE_OBJECT_NAME "/my_semaphore"
+#define LOG_FILE_NAME_MONTH "log_month.txt"
+#define FILE_LAST_RECORD "tmp/tmp.txt"   // only read to convert logs of older versions
+#define FILE_CHECKPOINT "tmp/checkpoint.bin"   // running totals and period starts for a restart
+
+// TEMP_LOG_FORMAT=binary keeps the logs as time-indexed slots instead of text records,
+// tlog_read reads them back by time and exports them as text
+#define LOG_FORMAT_ENV "TEMP_LOG_FORMAT"
+#define LOG_BIN_NAME "log.bin"
+#define LOG_BIN_NAME_HOUR "log_hour.bin"
+#define LOG_BIN_NAME_DAY "log_day.bin"
+#define LOG_BIN_NAME_MONTH "log_month.bin"
+
+// more averaged periods besides hour, day and month, e.g. "15m,4h" for log_15m.txt and
+// log_4h.txt; each must divide a day
+#define PERIODS_ENV "TEMP_PERIODS"
+
+// at a new year the day log is sealed into log_day_<year>.arc before it starts over, the
+// archives of the last TEMP_ARCHIVE_YEARS years are kept (0: none, the log is just emptied);
+// archive_read reads them together with the live log
+#define ARCHIVE_YEARS_ENV "TEMP_ARCHIVE_YEARS"
+#define ARCHIVE_YEARS 10
+#define LOG_ARCHIVE_DAY "log_day"
 
 #define RECORD_LENGTH 36
 
 #define SEC_IN_HOUR 3600
 #define SEC_IN_DAY 86400
 #define HOURS_IN_MONTH 720
+#define DAYS_IN_YEAR 366
+#define DAYS_IN_MONTH 31
+
+// slots of each ring: a day of readings, a month of hours, a year of days, ten years of
+// months; binary month slots are 28 days, so no two months share one
+#define LOG_CAPACITY (SEC_IN_DAY * 1000 / PORT_SPEED_MS)
+#define LOG_CAPACITY_HOUR HOURS_IN_MONTH
+#define LOG_CAPACITY_DAY DAYS_IN_YEAR
+#define LOG_CAPACITY_MONTH 131
+#define MONTH_SLOT_MS (28 * SEC_IN_DAY * 1000LL)
+
+struct log_file {
+    int binary;
+    struct mlog text;
+    struct tlog index;
+};
 
-struct thr_data {
-    FILE *file;
-    time_t *next;
-    double *avg;
-    int *counter;
-    int *last_record_pos;
-#ifdef _WIN32
-    HANDLE thr_sem;
-#else
-    sem_t *thr_sem;
-#endif
+// the average of a scheduler period, written to its own log when the period ends
+struct rollup {
+    struct log_file log;
+    struct aggregate *totals;
+    struct aggregate_snapshot last;   // totals when the period started
+    struct checkpoint *checkpoint;
+    int index;   // of the period in the checkpoint
+    struct sched_period period;
+    int yearly;   // the log starts over every year
+    int year;
+    const char *archive;   // stem of the archives of past years
+    int archive_years;
 };
 
 volatile unsigned char need_exit = 0;
@@ -70,125 +107,39 @@ void sig_handler(int sig)
 }
 #endif
 
-// get current time in YYYY-MM-DD hh:mm:ss.sss
-char *get_time(char *date, size_t size)
+// time of the clock in YYYY-MM-DD hh:mm:ss.sss
+char *get_time(int64_t time_ms, char *date, size_t size)
 {
-#ifdef _WIN32
-    SYSTEMTIME st;
-    GetLocalTime(&st);
-    snprintf(date, size, "%04d-%02d-%02d %02d:%02d:%02d.%03d",
-        st.wYear, st.wMonth, st.wDay, st.wHour,
-        st.wMinute, st.wSecond, st.wMilliseconds);
-#else
-    struct timeval tv;
-    struct tm *tmp;
-
-    if (gettimeofday(&tv, NULL) != 0) {
-        perror("gettimeofday");
-        exit(EXIT_FAILURE);
-    }
-    tmp = localtime(&tv.tv_sec);
-    if (tmp == NULL) {
+    if (vclock_format_ms(time_ms, date, size) == -1) {
         perror("localtime");
         exit(EXIT_FAILURE);
     }
-
-    if (strftime(date, size, "%Y-%m-%d %H:%M:%S", tmp) == 0) {
-        perror("strftime");
-        exit(EXIT_FAILURE);
-    }
-
-    char ms[5];
-    sprintf(ms, ".%03ld", tv.tv_usec / 1000);
-    strcat(date, ms);
-#endif
     return date;
 }
 
-#ifdef _WIN32
-DWORD get_offset(int line_number)
+int local_year(time_t t)
 {
-    if (line_number <= 0)
-        return 0;
-    return (line_number - 1) * RECORD_LENGTH;
-}
-#else
-int get_offset(FILE *file, int line_number)
-{
-    if (line_number == 0)
-        return 0;
-
-    long offset = (line_number - 1) * RECORD_LENGTH;
-    if (fseek(file, offset, SEEK_SET) != 0) {
-        return -1;
-    }
-    return ftell(file);
-}
-#endif
-
-
+    struct tm local_time;
 #ifdef _WIN32
-void write_log(HANDLE file, const char* record, int size, int first_opened, int *last_record_pos, const int CYCLE, int index, HANDLE sem)
-{
-    DWORD offset;
-    if (first_opened && last_record_pos[index] < CYCLE) {
-        offset = get_offset(last_record_pos[index] + 1);
-        SetFilePointer(file, offset, NULL, FILE_BEGIN);
-    } else if (last_record_pos[index] >= CYCLE || last_record_pos[index] == 0) {
-        SemaphoreWait(sem);
-        last_record_pos[index] = 0;
-        SemaphorePost(sem);
-
-        SetFilePointer(file, 0, NULL, FILE_BEGIN);
-    }
-    WriteFile(file, record, size, NULL, NULL);
-
-    SemaphoreWait(sem);
-    last_record_pos[index] = last_record_pos[index] + 1;
-    SemaphorePost(sem);
-}
+    localtime_s(&local_time, &t);
 #else
-void write_log(FILE* file, const char *record, int size, int first_opened, int *last_record_pos, const int CYCLE, int index, sem_t *sem)
-{
-    int offset;
-    if (first_opened && last_record_pos[index] < CYCLE) {
-        offset = get_offset(file, last_record_pos[index] + 1);
-        fseek(file, offset, SEEK_SET);
-    }
-    else if (last_record_pos[index] >= CYCLE || last_record_pos[index] == 0) {
-        SemaphoreWait(sem);
-        last_record_pos[index] = 0;
-        SemaphorePost(sem);
-
-        fseek(file, 0, SEEK_SET);
-    }
-    fwrite(record, sizeof(char), size, file);
-
-    SemaphoreWait(sem);
-    last_record_pos[index] = last_record_pos[index] + 1;
-    SemaphorePost(sem);
-}
+    localtime_r(&t, &local_time);
 #endif
-
-#ifdef _WIN32
-int is_file_empty(HANDLE hFile)
-{
-    LARGE_INTEGER fileSize;
-    if (!GetFileSizeEx(hFile, &fileSize)) {
-        perror("GetFileSizeEx (tmp_file)");
-        exit(EXIT_FAILURE);
-    }
-    return fileSize.QuadPart == 0;
+    return local_time.tm_year + 1900;
 }
-#else
-int is_file_empty(FILE *file)
+
+// cursors of the rings from before the logs carried them in a header, read once to convert
+// old log files: the next slot of log.txt and log_hour.txt, -1 when unknown
+void read_legacy_cursors(long cursor[2])
 {
-    fseek(file, 0, SEEK_END);
-    long size = ftell(file);
-    rewind(file);
-    return size == 0;
+    cursor[0] = cursor[1] = -1;
+    FILE *file = fopen(FILE_LAST_RECORD, "r");
+    if (file == NULL)
+        return;
+    if (fscanf(file, "%ld %ld", &cursor[0], &cursor[1]) != 2)
+        cursor[0] = cursor[1] = -1;
+    fclose(file);
 }
-#endif
 
 void make_fixed_record(char* fixed_record, char *record, int record_len)
 {
@@ -198,271 +149,198 @@ void make_fixed_record(char* fixed_record, char *record, int record_len)
     memcpy(fixed_record, record, copy_len);
 }
 
-#ifndef _WIN32
-void free_resources(FILE* file1, FILE* file2, FILE* file3, FILE* file4, int* fd)
+int log_open(struct log_file *log, int binary, const char *text_name, const char *bin_name, uint32_t capacity,
+             int64_t period_ms, long legacy_cursor)
 {
-    if (file1 != NULL) fclose(file1);
-    if (file2 != NULL) fclose(file2);
-    if (file3 != NULL) fclose(file3);
-    if (file4 != NULL) fclose(file4);
-    if (fd != NULL) close(*fd);
-    sem_unlink(SEMAPHORE_OBJECT_NAME);
+    log->binary = binary;
+    if (binary)
+        return tlog_open(&log->index, bin_name, period_ms, capacity);
+    return mlog_open(&log->text, text_name, RECORD_LENGTH, capacity, legacy_cursor);
 }
-#endif
 
-#ifdef _WIN32
-void read_last_records(HANDLE file, int *value1, int *value2)
+// a text record is stamped with stamp_ms, when it was read or its period ended, a binary
+// one goes to the slot of the period it covers, starting at period_ms
+void log_write(struct log_file *log, int64_t period_ms, int64_t stamp_ms, double value)
 {
-    char buffer[256] = {0};
-    DWORD bytesRead;
-    if (!ReadFile(file, buffer, sizeof(buffer) - 1, &bytesRead, NULL)) {
-        perror("ReadFile (tmp_file)");
-        exit(EXIT_FAILURE);
+    if (log->binary) {
+        tlog_put(&log->index, period_ms, value);
+        return;
     }
-    buffer[bytesRead] = '\0';
 
-    if (sscanf(buffer, "%d %d", value1, value2) != 2) {
-        perror("sscanf (tmp_file)");
-        exit(EXIT_FAILURE);
-    }
-}
-#endif
-
-#ifdef _WIN32
-DWORD WINAPI thr_routine_hour(void *args)
-{
-    struct thr_data *params = (struct thr_data*)args;
+    // get record
     char curr_time[24];
-    char record[RECORD_LENGTH];
-    int first_opened = 1;
-    while (!need_exit) {
-        time_t current_time = time(NULL);
-        if (current_time >= *params->next) {
+    char record[255];
+    get_time(stamp_ms, curr_time, sizeof(curr_time));
+    int record_len = snprintf(record, sizeof(record), "%s %.1lf", curr_time, value);
 
-            // change next
-            SemaphoreWait(params->thr_sem);
-            *params->next += SEC_IN_HOUR;
-            SemaphorePost(params->thr_sem);
+    // get fixed-sized record
+    char fixed_record[RECORD_LENGTH];
+    make_fixed_record(fixed_record, record, record_len);
 
-            SemaphoreWait(params->thr_sem);
-            double avg = *params->avg;
-            SemaphorePost(params->thr_sem);
+    mlog_append(&log->text, fixed_record);
+}
 
-            // get record
-            get_time(curr_time, sizeof(curr_time));
-            int record_len = snprintf(record, sizeof(record), "%s %.1lf", curr_time, avg);
+static void seal_text_record(const char *record, void *ctx)
+{
+    int64_t time_ms;
+    double value;
+    if (archive_parse_record(record, &time_ms, &value) == 0)
+        archive_records_add((struct archive_records*)ctx, time_ms, value);
+}
 
-            // get fixed-sized record
-            char fixed_record[RECORD_LENGTH];
-            make_fixed_record(fixed_record, record, record_len);
+static void seal_reading(int64_t time_ms, double value, void *ctx)
+{
+    archive_records_add((struct archive_records*)ctx, time_ms, value);
+}
 
-            write_log(params->file, fixed_record, sizeof(fixed_record), first_opened, params->last_record_pos, HOURS_IN_MONTH, 1, params->thr_sem);
-            first_opened = 0;
+static int64_t year_start_ms(int year)
+{
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = year - 1900;
+    tm.tm_mday = 1;
+    tm.tm_isdst = -1;
+    return (int64_t)mktime(&tm) * 1000;
+}
 
-            SemaphoreWait(params->thr_sem);
-            *params->avg = 0.0;
-            SemaphorePost(params->thr_sem);
+// the records of year into the archive of stem, then only the newest keep years are left;
+// -1 if it cannot be written, the log must not be emptied then
+int log_seal(struct log_file *log, const char *stem, int year, int keep)
+{
+    struct archive_records records;
+    memset(&records, 0, sizeof(records));
+    if (log->binary)
+        tlog_range(&log->index, year_start_ms(year), year_start_ms(year + 1), seal_reading, &records);
+    else
+        mlog_each(&log->text, seal_text_record, &records);
+
+    char path[256];
+    archive_path(stem, year, path, sizeof(path));
+    int status = archive_write(path, year, &records);
+    if (status == 0) {
+        printf("%s: %zu records sealed\n", path, records.count);
+        archive_prune(stem, keep);
+    }
+    archive_records_free(&records);
+    return status;
+}
 
-            SemaphoreWait(params->thr_sem);
-            *params->counter = 0;
-            SemaphorePost(params->thr_sem);
-        }
-        sleep(1);
-    }
-    return 0;
+// a binary log needs no restart, last year's slots are told apart by their generation
+void log_restart(struct log_file *log)
+{
+    if (!log->binary)
+        mlog_restart(&log->text);
 }
-#else
-void* thr_routine_hour(void *args)
+
+void log_close(struct log_file *log)
 {
-    struct thr_data *params = (struct thr_data*)args;
-    char curr_time[24];
-    char record[RECORD_LENGTH];
-    int first_opened = 1;
-    while (!need_exit) {
-        time_t current_time = time(NULL);
-        if (current_time >= *params->next) {
+    if (log->binary)
+        tlog_close(&log->index);
+    else
+        mlog_close(&log->text);
+}
 
-            // change next
-            SemaphoreWait(params->thr_sem);
-            *params->next += SEC_IN_HOUR;
-            SemaphorePost(params->thr_sem);
+struct reader_ctx {
+    struct log_file *log;
+    struct aggregate *totals;
+};
 
-            SemaphoreWait(params->thr_sem);
-            double avg = *params->avg;
-            SemaphorePost(params->thr_sem);
+// one complete frame from the port: log it and update running averages
+void on_reading(const struct frame *frame, void *args)
+{
+    struct reader_ctx *ctx = (struct reader_ctx*)args;
+    int64_t now_ms = vclock_now_ms();
+    log_write(ctx->log, now_ms, now_ms, frame->value);
+    aggregate_add(ctx->totals, frame->value);
+}
 
-            // get record
-            get_time(curr_time, sizeof(curr_time));
-            int record_len = snprintf(record, sizeof(record), "%s %.1lf", curr_time, avg);
+// scheduler job: the period [start, end) is over, log its average and start the next one
+void on_period_end(time_t start, time_t end, void *args)
+{
+    struct rollup *r = (struct rollup*)args;
 
-            // get fixed-sized record
-            char fixed_record[RECORD_LENGTH];
-            make_fixed_record(fixed_record, record, record_len);
+    struct aggregate_snapshot now;
+    aggregate_read(r->totals, &now);
+    double avg = aggregate_average(&r->last, &now);
+    r->last = now;
 
-            write_log(params->file, fixed_record, sizeof(fixed_record), first_opened, params->last_record_pos, HOURS_IN_MONTH, 1, params->thr_sem);
-            first_opened = 0;
+    // a new year starts the log over, with the first period that begins in it; last year is
+    // sealed into its archive first, a log that cannot be sealed is kept as it is
+    if (r->yearly) {
+        int curr_year = local_year(start);
+        if (r->year != 0 && curr_year != r->year &&
+            (r->archive_years == 0 || log_seal(&r->log, r->archive, r->year, r->archive_years) == 0))
+            log_restart(&r->log);
+        r->year = curr_year;
+    }
 
-            SemaphoreWait(params->thr_sem);
-            *params->avg = 0.0;
-            SemaphorePost(params->thr_sem);
+    log_write(&r->log, (int64_t)start * 1000, (int64_t)end * 1000, avg);
 
-            SemaphoreWait(params->thr_sem);
-            *params->counter = 0;
-            SemaphorePost(params->thr_sem);
-        }
-        sleep(1);
-    }
-    return 0;
+    // a crash before the mark logs this period once more on the restart, never loses it
+    checkpoint_mark(r->checkpoint, r->index, r->period, end, &now);
 }
-#endif
 
-#ifdef _WIN32
-DWORD WINAPI thr_routine_day(void *args)
+// continue the period a previous run was in, from the checkpoint; one that ended while
+// main was not running is logged with the readings it had, the next starts now.
+// Returns the start of the period
+time_t resume_rollup(struct rollup *r, time_t now)
 {
-    struct thr_data *params = (struct thr_data*)args;
-    char curr_time[24];
-    char record[RECORD_LENGTH];
-    int first_opened = 1;
-    int log_year;
-    while (!need_exit) {
-        time_t current_time = time(NULL);
-        if (current_time >= *params->next) {
-
-            // get current_year
-            struct tm local_time;
-            localtime_s(&local_time, &current_time);
-            int curr_year = local_time.tm_year + 1900;
-
-            if (first_opened) {
-                log_year = curr_year;
-            } else if (curr_year != log_year) {
-
-                CloseHandle(params->file);
-                params->file = CreateFile(
-                    LOG_FILE_NAME_DAY,
-                    GENERIC_WRITE,
-                    FILE_SHARE_READ,
-                    NULL,
-                    CREATE_ALWAYS,
-                    FILE_ATTRIBUTE_NORMAL,
-                    NULL
-                );
-                if (params->file == INVALID_HANDLE_VALUE) {
-                    perror("Error reopening log_file_day");
-                    exit(EXIT_FAILURE);
-                }
-
-                CloseHandle(params->file);
-                params->file = CreateFile(LOG_FILE_NAME_DAY,
-                              FILE_APPEND_DATA,
-                              FILE_SHARE_READ,
-                              NULL,
-                              OPEN_ALWAYS,
-                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_WRITE_THROUGH,
-                              NULL);
-                if (params->file == INVALID_HANDLE_VALUE) {
-                    perror("Error reopening log_file_day");
-                    exit(EXIT_FAILURE);
-                }
-                log_year = curr_year;
-            }
-
-            // change next
-            SemaphoreWait(params->thr_sem);
-            *params->next += SEC_IN_DAY;
-            SemaphorePost(params->thr_sem);
-
-            SemaphoreWait(params->thr_sem);
-            double avg = *params->avg;
-            SemaphorePost(params->thr_sem);
-
-            // get record
-            get_time(curr_time, sizeof(curr_time));
-            int record_len = snprintf(record, sizeof(record), "%s %.1lf", curr_time, avg);
-
-            // get fixed-sized record
-            char fixed_record[RECORD_LENGTH];
-            make_fixed_record(fixed_record, record, record_len);
-
-            WriteFile(params->file, fixed_record, sizeof(fixed_record), NULL, NULL);
-            first_opened = 0;
-
-            SemaphoreWait(params->thr_sem);
-            *params->avg = 0.0;
-            SemaphorePost(params->thr_sem);
-
-            SemaphoreWait(params->thr_sem);
-            *params->counter = 0;
-            SemaphorePost(params->thr_sem);
-        }
-        sleep(1);
-    }
-    return 0;
+    struct checkpoint_mark mark;
+    aggregate_read(r->totals, &r->last);
+    if (checkpoint_load(r->checkpoint, r->index, r->period, &mark) == -1 || mark.start > now) {
+        checkpoint_mark(r->checkpoint, r->index, r->period, now, &r->last);
+        return now;
+    }
+
+    time_t start = (time_t)mark.start;
+    r->last.sum = mark.sum;
+    r->last.count = mark.count;
+    // the period logged before this one began in the year of the second before it
+    r->year = local_year(start - 1);
+    time_t end = sched_boundary(r->period, start);
+    if (end > now)
+        return start;
+    on_period_end(start, end, r);
+    checkpoint_mark(r->checkpoint, r->index, r->period, now, &r->last);
+    return now;
 }
-#else
-void* thr_routine_day(void *args)
+
+// periods of TEMP_PERIODS into rollups after the first count, returns the new count
+int add_rollups(struct rollup *rollups, struct sched_period *periods, int count, int binary)
 {
-    struct thr_data *params = (struct thr_data*)args;
-    char curr_time[24];
-    char record[RECORD_LENGTH];
-    int first_opened = 1;
-    int log_year;
-    while (!need_exit) {
-        time_t current_time = time(NULL);
-        if (current_time >= *params->next) {
-
-            // get current_year
-            struct tm *local_time = localtime(&current_time);
-            int curr_year = local_time->tm_year + 1900;
-
-            if (first_opened) {
-                log_year = curr_year;
-            } else if (curr_year != log_year) {
-                params->file = freopen(LOG_FILE_NAME_DAY, "w", params->file);
-                if (params->file == NULL) {
-                    perror("Error reopening log_file_day (w)");
-                    exit(EXIT_FAILURE);
-                }
-                params->file = freopen(LOG_FILE_NAME_DAY, "a+", params->file);
-                if (params->file == NULL) {
-                    perror("Error reopening log_file_day (a+)");
-                    exit(EXIT_FAILURE);
-                }
-                setvbuf(params->file, NULL, _IONBF, 0);
-                log_year = curr_year;
-            }
-
-            // change next
-            SemaphoreWait(params->thr_sem);
-            *params->next += SEC_IN_DAY;
-            SemaphorePost(params->thr_sem);
-
-            SemaphoreWait(params->thr_sem);
-            double avg = *params->avg;
-            SemaphorePost(params->thr_sem);
-
-            // get record
-            get_time(curr_time, sizeof(curr_time));
-            int record_len = snprintf(record, sizeof(record), "%s %.1lf", curr_time, avg);
-
-            // get fixed-sized record
-            char fixed_record[RECORD_LENGTH];
-            make_fixed_record(fixed_record, record, record_len);
-
-            fwrite(fixed_record, sizeof(char), sizeof(fixed_record), params->file);
-            first_opened = 0;
-
-            SemaphoreWait(params->thr_sem);
-            *params->avg = 0.0;
-            SemaphorePost(params->thr_sem);
-
-            SemaphoreWait(params->thr_sem);
-            *params->counter = 0;
-            SemaphorePost(params->thr_sem);
+    const char *env = getenv(PERIODS_ENV);
+    if (env == NULL || *env == '\0')
+        return count;
+
+    char list[256];
+    snprintf(list, sizeof(list), "%s", env);
+    for (char *spec = strtok(list, ", "); spec != NULL; spec = strtok(NULL, ", ")) {
+        struct sched_period period;
+        if (sched_parse_period(spec, &period) == -1 || period.unit != SCHED_SECONDS ||
+            SEC_IN_DAY % period.seconds != 0) {
+            fprintf(stderr, "%s: \"%s\" is not a period dividing a day, like 15m or 4h\n", PERIODS_ENV, spec);
+            return -1;
         }
-        sleep(1);
-    }
-    return 0;
+        if (count == SCHED_MAX_JOBS) {
+            fprintf(stderr, "%s: more than %d periods\n", PERIODS_ENV, SCHED_MAX_JOBS);
+            return -1;
+        }
+        char text_name[64], bin_name[64];
+        snprintf(text_name, sizeof(text_name), "log_%s.txt", spec);
+        snprintf(bin_name, sizeof(bin_name), "log_%s.bin", spec);
+        // a month of periods
+        uint32_t capacity = (uint32_t)(DAYS_IN_MONTH * SEC_IN_DAY / period.seconds);
+        if (log_open(&rollups[count].log, binary, text_name, bin_name, capacity, period.seconds * 1000LL, -1) == -1)
+            return -1;
+        periods[count++] = period;
+    }
+    return count;
+}
+
+#ifndef _WIN32
+void free_resources(int* fd)
+{
+    if (fd != NULL) close(*fd);
 }
 #endif
 
@@ -488,116 +366,51 @@ int main(int argc, char *argv[])
     }
 #endif
 
-    // stores last record position in log_file and log_file_hour
-#ifdef _WIN32
-    HANDLE tmp_file = CreateFile(
-        FILE_LAST_RECORD,
-        GENERIC_READ | GENERIC_WRITE,
-        FILE_SHARE_READ,
-        NULL,
-        OPEN_ALWAYS,
-        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_WRITE_THROUGH,
-        NULL);
-    if (tmp_file == NULL) {
-        perror("CreateFile (tmp_file)");
-        exit(EXIT_FAILURE);
-    }
-#else
-    FILE* tmp_file = fopen(FILE_LAST_RECORD, "r+");
-    if (tmp_file == NULL) {
-        perror("fopen (tmp_file)");
-        exit(EXIT_FAILURE);
-    }
-    setvbuf(tmp_file, NULL, _IONBF, 0);
-#endif
-
-    // get last record position
-    int last_record_pos[2] = {0, 0};
-    if (!is_file_empty(tmp_file)) {
-#ifdef _WIN32
-        read_last_records(tmp_file, &last_record_pos[0], &last_record_pos[1]);
-#else
-        fscanf(tmp_file, "%d", &last_record_pos[0]);
-        fscanf(tmp_file, "%d", &last_record_pos[1]);
-#endif
-    }
+    // record stamps and hour/day boundaries, TEMP_CLOCK can make them virtual
+    vclock_init();
 
-    // open log files
-#ifdef _WIN32
-    HANDLE log_file = CreateFile(
-        LOG_FILE_NAME,
-        GENERIC_WRITE,
-        FILE_SHARE_READ,
-        NULL,
-        OPEN_ALWAYS,
-        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_WRITE_THROUGH,
-        NULL
-    );
-    if (log_file == INVALID_HANDLE_VALUE) {
-        perror("CreateFile (log_file)");
-        exit(EXIT_FAILURE);
-    }
+    // map log files, each keeps its own cursor in its header page
+    long legacy_cursor[2];
+    read_legacy_cursors(legacy_cursor);
 
-    HANDLE log_file_hour = CreateFile(
-        LOG_FILE_NAME_HOUR,
-        GENERIC_WRITE,
-        FILE_SHARE_READ,
-        NULL,
-        OPEN_ALWAYS,
-        FILE_ATTRIBUTE_NORMAL | FILE_FLAG_WRITE_THROUGH,
-        NULL
-    );
-    if (log_file_hour == INVALID_HANDLE_VALUE) {
-        perror("CreateFile (log_file_hour)");
+    const char *format = getenv(LOG_FORMAT_ENV);
+    int binary = format != NULL && strcmp(format, "binary") == 0;
+    if (format != NULL && *format != '\0' && !binary && strcmp(format, "text") != 0) {
+        fprintf(stderr, "%s: expected text or binary, not \"%s\"\n", LOG_FORMAT_ENV, format);
         exit(EXIT_FAILURE);
     }
 
-    HANDLE log_file_day = CreateFile(LOG_FILE_NAME_DAY,
-                              FILE_APPEND_DATA,
-                              FILE_SHARE_READ,
-                              NULL,
-                              OPEN_ALWAYS,
-                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_WRITE_THROUGH,
-                              NULL);
-    if (log_file_day == INVALID_HANDLE_VALUE) {
-        perror("CreateFile (log_file_day)");
-        exit(EXIT_FAILURE);
-    }
-#else
-    FILE* log_file = fopen(LOG_FILE_NAME, "r+");
-    if (log_file == NULL) {
-        perror("fopen (log_file)");
-        exit(EXIT_FAILURE);
+    int archive_years = ARCHIVE_YEARS;
+    const char *archive_env = getenv(ARCHIVE_YEARS_ENV);
+    if (archive_env != NULL && *archive_env != '\0') {
+        char *end;
+        archive_years = (int)strtol(archive_env, &end, 10);
+        if (*end != '\0' || archive_years < 0) {
+            fprintf(stderr, "%s: expected a number of years, not \"%s\"\n", ARCHIVE_YEARS_ENV, archive_env);
+            exit(EXIT_FAILURE);
+        }
     }
-    setvbuf(log_file, NULL, _IONBF, 0);
 
-    FILE* log_file_hour = fopen(LOG_FILE_NAME_HOUR, "r+");
-    if (log_file_hour == NULL) {
-        perror("fopen (log_file_hour)");
+    // readings, then the averages of every period
+    struct log_file log_file;
+    struct rollup rollups[SCHED_MAX_JOBS];
+    struct sched_period periods[SCHED_MAX_JOBS] = {{SCHED_HOUR, 0}, {SCHED_DAY, 0}, {SCHED_MONTH, 0}};
+    memset(rollups, 0, sizeof(rollups));
+    rollups[1].yearly = 1;
+    rollups[1].archive = LOG_ARCHIVE_DAY;
+    rollups[1].archive_years = archive_years;
+    if (log_open(&log_file, binary, LOG_FILE_NAME, LOG_BIN_NAME, LOG_CAPACITY, PORT_SPEED_MS, legacy_cursor[0]) == -1 ||
+        log_open(&rollups[0].log, binary, LOG_FILE_NAME_HOUR, LOG_BIN_NAME_HOUR, LOG_CAPACITY_HOUR,
+                 SEC_IN_HOUR * 1000, legacy_cursor[1]) == -1 ||
+        log_open(&rollups[1].log, binary, LOG_FILE_NAME_DAY, LOG_BIN_NAME_DAY, LOG_CAPACITY_DAY,
+                 SEC_IN_DAY * 1000LL, -1) == -1 ||
+        log_open(&rollups[2].log, binary, LOG_FILE_NAME_MONTH, LOG_BIN_NAME_MONTH, LOG_CAPACITY_MONTH,
+                 MONTH_SLOT_MS, -1) == -1) {
         exit(EXIT_FAILURE);
     }
-    setvbuf(log_file_hour, NULL, _IONBF, 0);
-
-    FILE* log_file_day = fopen(LOG_FILE_NAME_DAY, "a");
-    if (log_file_day == NULL) {
-        perror("fopen (log_file_day)");
+    int rollup_count = add_rollups(rollups, periods, 3, binary);
+    if (rollup_count == -1)
         exit(EXIT_FAILURE);
-    }
-    setvbuf(log_file_day, NULL, _IONBF, 0);
-#endif
-
-    // open or create new semaphore
-#ifdef _WIN32
-    HANDLE sem;
-    sem = CreateSemaphore(
-        NULL,
-        1,
-        1,
-        SEMAPHORE_OBJECT_NAME
-    );
-#else
-    sem_t *sem = sem_open(SEMAPHORE_OBJECT_NAME, O_CREAT, 0777, 1);
-#endif
 
     // configure port
 #ifdef _WIN32
@@ -629,112 +442,75 @@ int main(int argc, char *argv[])
     int fd = open(port_rd, O_RDONLY | O_NOCTTY | O_NDELAY);
     if (fd == -1) {
         perror("open port");
-        free_resources(log_file, log_file_hour, log_file_day, tmp_file, NULL);
+        free_resources(NULL);
         exit(EXIT_FAILURE);
     }
 
     // flush port
     if (tcflush(fd, TCIFLUSH) == -1) {
         perror("tcflush");
-        free_resources(log_file, log_file_hour, log_file_day, tmp_file, &fd);
+        free_resources(&fd);
         exit(EXIT_FAILURE);
     }
 #endif
 
-    int count_hour = 0, count_day = 0;
-    double avg_hour = 0.0, avg_day = 0.0;
-
-    // set timer for log_hour and log_day
-    time_t start_time = time(NULL);
-    time_t next_hour = start_time + SEC_IN_HOUR;
-    time_t next_day = start_time + SEC_IN_DAY;
-
-    // create new thread (hour logger)
-#ifdef _WIN32
-    struct thr_data params_hour = {log_file_hour, &next_hour, &avg_hour, &count_hour, last_record_pos, sem};
-    HANDLE thr_hour = CreateThread(
-        NULL,
-        0,
-        thr_routine_hour,
-        &params_hour,
-        0,
-        NULL
-    );
-    if (thr_hour == NULL) {
-        perror("CreateThread (thr_hour)");
+    // the read loop adds every reading, each period takes its share of the totals;
+    // both live in the checkpoint so a restart goes on where the last run stopped
+    struct checkpoint checkpoint;
+    if (checkpoint_open(&checkpoint, FILE_CHECKPOINT) == -1)
         exit(EXIT_FAILURE);
-    }
-#else
-    struct thr_data params_hour = {log_file_hour, &next_hour, &avg_hour, &count_hour, last_record_pos, sem};
-    pthread_t thr_hour;
-    int status = pthread_create(&thr_hour, NULL, thr_routine_hour, &params_hour);
-    if (status != 0) {
-        perror("pthread_create (thr_hour)");
-        free_resources(log_file, log_file_hour, log_file_day, tmp_file, &fd);
+    struct aggregate *totals = &checkpoint.file->totals;
+
+    // one thread for every period, asleep until the next boundary of any of them
+    struct sched sched;
+    if (sched_init(&sched) == -1)
         exit(EXIT_FAILURE);
+    time_t now = vclock_now();
+    for (int i = 0; i < rollup_count; ++i) {
+        rollups[i].totals = totals;
+        rollups[i].checkpoint = &checkpoint;
+        rollups[i].index = i;
+        rollups[i].period = periods[i];
+        time_t start = resume_rollup(&rollups[i], now);
+        if (sched_add(&sched, periods[i], start, on_period_end, &rollups[i]) == -1)
+            exit(EXIT_FAILURE);
     }
-#endif
-
-    // create new thread (day logger)
 #ifdef _WIN32
-    struct thr_data params_day = {log_file_day, &next_day, &avg_day, &count_day, NULL, sem};
-    HANDLE thr_day = CreateThread(
+    HANDLE thr_sched = CreateThread(
         NULL,
         0,
-        thr_routine_day,
-        &params_day,
+        sched_thread,
+        &sched,
         0,
         NULL
     );
-    if (thr_day == NULL) {
-        perror("CreateThread (thr_day)");
+    if (thr_sched == NULL) {
+        perror("CreateThread (thr_sched)");
         exit(EXIT_FAILURE);
     }
 #else
-    struct thr_data params_day = {log_file_day, &next_day, &avg_day, &count_day, NULL, sem};
-    pthread_t thr_day;
-    status = pthread_create(&thr_day, NULL, thr_routine_day, &params_day);
+    pthread_t thr_sched;
+    int status = pthread_create(&thr_sched, NULL, sched_thread, &sched);
     if (status != 0) {
-        perror("pthread_create (thr_day)");
-        free_resources(log_file, log_file_hour, log_file_day, tmp_file, &fd);
+        perror("pthread_create (thr_sched)");
+        free_resources(&fd);
         exit(EXIT_FAILURE);
     }
 #endif
 
-    char curr_time[24];
-    char buffer[255];
-    char record[255];
-    int record_len;
-    double cur_temp;
+    // frames may arrive split or merged, the parser buffers partial ones
+    struct frame_parser parser;
+    frame_parser_init(&parser);
+    struct reader_ctx reader = {&log_file, totals};
 
-    int first_opened = 1;
 #ifdef _WIN32
     while (!need_exit) {
+        size_t avail;
+        char *space = frame_parser_space(&parser, &avail);
         DWORD bytesRead;
-        if (ReadFile(fd, buffer, sizeof(buffer), &bytesRead, NULL)) {
-            if (bytesRead > 0) {
-
-                // get record
-                get_time(curr_time, sizeof(curr_time));
-                record_len = snprintf(record, sizeof(record), "%s %.*s", curr_time, (int)bytesRead, buffer);
-
-                // get fixed-sized record
-                char fixed_record[RECORD_LENGTH];
-                make_fixed_record(fixed_record, record, record_len);
-
-                write_log(log_file, fixed_record, sizeof(fixed_record), first_opened, last_record_pos, SEC_IN_DAY * 1000 / PORT_SPEED_MS, 0, sem);
-                first_opened = 0;
-
-                // find avg_hour
-                cur_temp = atof(buffer);
-                count_hour++;
-                avg_hour += (cur_temp - avg_hour) / count_hour;
-
-                // find avg_day
-                cur_temp = atof(buffer);
-                count_day++;
-                avg_day += (cur_temp - avg_day) / count_day;
-            }
+        if (ReadFile(fd, space, (DWORD)avail, &bytesRead, NULL)) {
+            if (bytesRead > 0)
+                frame_parser_commit(&parser, bytesRead, on_reading, &reader);
         } else {
             perror("ReadFile (pd)");
             break;
@@ -742,63 +518,35 @@ int main(int argc, char *argv[])
     }
 #else
     while (!need_exit) {
-        ssize_t bytesRead = read(fd, buffer, sizeof(buffer));
-        if (bytesRead > 0) {
-
-            // get record
-            get_time(curr_time, sizeof(curr_time));
-            record_len = snprintf(record, sizeof(record), "%s %.*s", curr_time, (int)bytesRead, buffer);
-
-            // get fixed-sized record
-            char fixed_record[RECORD_LENGTH];
-            make_fixed_record(fixed_record, record, record_len);
-
-            write_log(log_file, fixed_record, sizeof(fixed_record), first_opened, last_record_pos, SEC_IN_DAY * 1000 / PORT_SPEED_MS, 0, sem);
-            first_opened = 0;
-
-            // find avg_hour
-            cur_temp = atof(buffer);
-            count_hour++;
-            avg_hour += (cur_temp - avg_hour) / count_hour;
-
-            // find avg_day
-            cur_temp = atof(buffer);
-            count_day++;
-            avg_day += (cur_temp - avg_day) / count_day;
-        }
+        size_t avail;
+        char *space = frame_parser_space(&parser, &avail);
+        ssize_t bytesRead = read(fd, space, avail);
+        if (bytesRead > 0)
+            frame_parser_commit(&parser, bytesRead, on_reading, &reader);
     }
 #endif
 
-#ifdef _WIN32
-    WaitForSingleObject(thr_hour, INFINITE);
-    CloseHandle(thr_hour);
-    WaitForSingleObject(thr_day, INFINITE);
-    CloseHandle(thr_day);
-#else
-    pthread_join(thr_hour, NULL);
-    pthread_join(thr_day, NULL);
-#endif
+    frame_print_stats(PORT_RD, &parser.stats);
 
-    // save last record position
+    sched_stop(&sched);
 #ifdef _WIN32
-    SetFilePointer(tmp_file, 0, NULL, FILE_BEGIN);
-    int len = snprintf(buffer, sizeof(buffer), "%d\n%d\n", last_record_pos[0], last_record_pos[1]);
-    WriteFile(tmp_file, buffer, len, NULL, NULL);
+    WaitForSingleObject(thr_sched, INFINITE);
+    CloseHandle(thr_sched);
 #else
-    fseek(tmp_file, 0, SEEK_SET);
-    fprintf(tmp_file, "%d\n", last_record_pos[0]);
-    fprintf(tmp_file, "%d\n", last_record_pos[1]);
+    pthread_join(thr_sched, NULL);
 #endif
+    printf("scheduler: %lu wakeups, %lu periods logged\n", sched.wakeups, sched.runs);
+    sched_close(&sched);
+    checkpoint_close(&checkpoint);
+
+    log_close(&log_file);
+    for (int i = 0; i < rollup_count; ++i)
+        log_close(&rollups[i].log);
 
 #ifdef _WIN32
-    CloseHandle(tmp_file);
-    CloseHandle(log_file);
-    CloseHandle(log_file_hour);
-    CloseHandle(log_file_day);
-    CloseHandle(sem);
     CloseHandle(fd);
 #else
-    free_resources(log_file, log_file_hour, log_file_day, tmp_file, &fd);
+    free_resources(&fd);
 #endif
     return 0;
 }
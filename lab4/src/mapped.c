@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <unistd.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#endif
+
+// a file mapped whole into memory, shared with every process that maps it
+struct mapped {
+    char *addr;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE map;
+#else
+    int fd;
+#endif
+};
+
+// writable: the file is created if missing and allocated up to size, never grown by
+// a store; read-only (size 0): the file as it is
+int mapped_open(struct mapped *m, const char *path, size_t size, int writable)
+{
+    memset(m, 0, sizeof(*m));
+#ifdef _WIN32
+    m->file = CreateFile(path, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                         FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, writable ? OPEN_ALWAYS : OPEN_EXISTING,
+                         FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m->file == INVALID_HANDLE_VALUE) {
+        perror(path);
+        return -1;
+    }
+    if (!writable) {
+        LARGE_INTEGER file_size;
+        GetFileSizeEx(m->file, &file_size);
+        size = (size_t)file_size.QuadPart;
+    }
+    m->map = size > 0 ? CreateFileMapping(m->file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY,
+                                          (DWORD)((uint64_t)size >> 32), (DWORD)size, NULL) : NULL;
+    m->addr = m->map ? (char*)MapViewOfFile(m->map, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size) : NULL;
+    if (m->addr == NULL) {
+        fprintf(stderr, "Cannot map %s\n", path);
+        if (m->map != NULL)
+            CloseHandle(m->map);
+        CloseHandle(m->file);
+        return -1;
+    }
+#else
+    m->fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (m->fd == -1) {
+        perror(path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(m->fd, &st) == -1) {
+        perror(path);
+        close(m->fd);
+        return -1;
+    }
+    if (!writable) {
+        size = (size_t)st.st_size;
+    } else if ((size_t)st.st_size < size && posix_fallocate(m->fd, 0, (off_t)size) != 0) {
+        perror("fallocate");
+        close(m->fd);
+        return -1;
+    }
+    void *addr = size > 0 ? mmap(NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, m->fd, 0)
+                          : MAP_FAILED;
+    if (addr == MAP_FAILED) {
+        fprintf(stderr, "Cannot map %s\n", path);
+        close(m->fd);
+        return -1;
+    }
+    m->addr = (char*)addr;
+#endif
+    m->size = size;
+    return 0;
+}
+
+// write back the pages of [addr, addr + len), addr on a page boundary
+void mapped_sync(struct mapped *m, void *addr, size_t len)
+{
+#ifdef _WIN32
+    FlushViewOfFile(addr, len);
+    FlushFileBuffers(m->file);
+#else
+    (void)m;
+    if (msync(addr, len, MS_SYNC) == -1)
+        perror("msync");
+#endif
+}
+
+void mapped_close(struct mapped *m)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(m->addr);
+    CloseHandle(m->map);
+    CloseHandle(m->file);
+#else
+    munmap(m->addr, m->size);
+    close(m->fd);
+#endif
+}
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#    include <windows.h>
+#endif
+
+#include "mapped.c"
+#include "vclock.c"
+
+// a log is a preallocated ring of fixed text records behind one header page, mapped into
+// memory: an append is a memcpy and one atomic store, the cursor lives in the file itself
+#define MLOG_MAGIC "LAB4LOG1"
+#define MLOG_HEADER_SIZE 4096
+#define MLOG_SYNC_MS 10000   // dirty pages are flushed at most this long after an append
+
+struct mlog_header {
+    char magic[8];
+    uint32_t record_length;
+    uint32_t capacity;
+    // records appended since the log was created: the next slot is appended % capacity and
+    // the generation (times the ring was restarted or wrapped) appended / capacity
+    _Atomic uint64_t appended;
+};
+
+struct mlog {
+    struct mapped map;
+    struct mlog_header *header;
+    char *records;
+    int writable;
+    int64_t synced_ms;
+};
+
+uint64_t mlog_cursor(const struct mlog *log)
+{
+    return atomic_load_explicit(&log->header->appended, memory_order_acquire) % log->header->capacity;
+}
+
+uint64_t mlog_generation(const struct mlog *log)
+{
+    return atomic_load_explicit(&log->header->appended, memory_order_acquire) / log->header->capacity;
+}
+
+// records of a log written by older versions (plain records from offset 0, the ring
+// cursor in a separate file) are moved behind a header; legacy_cursor < 0 for an
+// append-only log
+static int mlog_migrate(const char *path, uint32_t record_length, uint32_t capacity, long legacy_cursor)
+{
+    FILE *old = fopen(path, "rb");
+    if (old == NULL) {
+        perror(path);
+        return -1;
+    }
+    fseek(old, 0, SEEK_END);
+    long bytes = ftell(old);
+    rewind(old);
+    uint32_t count = (uint32_t)(bytes / record_length);
+    if (count > capacity)
+        count = capacity;
+
+    char *data = malloc(((size_t)count + 1) * record_length);
+    if (data == NULL || fread(data, record_length, count, old) != count) {
+        perror(path);
+        fclose(old);
+        free(data);
+        return -1;
+    }
+    fclose(old);
+
+    static char page[MLOG_HEADER_SIZE];
+    struct mlog_header *h = (struct mlog_header*)page;
+    memset(page, 0, sizeof(page));
+    memcpy(h->magic, MLOG_MAGIC, sizeof(h->magic));
+    h->record_length = record_length;
+    h->capacity = capacity;
+    // a full ring wrapped at least once, it continues at its cursor
+    uint64_t appended = count;
+    if (legacy_cursor >= 0 && count == capacity)
+        appended = capacity + (uint64_t)legacy_cursor % capacity;
+    else if (legacy_cursor >= 0 && (uint64_t)legacy_cursor < count)
+        appended = (uint64_t)legacy_cursor;
+    atomic_init(&h->appended, appended);
+
+    // written next to the old file and renamed over it, a crash keeps one of the two
+    char tmp[512];
+    snprintf(tmp, sizeof(tmp), "%s.new", path);
+    FILE *out = fopen(tmp, "wb");
+    int failed = out == NULL || fwrite(page, 1, sizeof(page), out) != sizeof(page) ||
+                 fwrite(data, record_length, count, out) != count;
+    // the rest of the ring as empty slots
+    memset(data, ' ', record_length - 1);
+    data[record_length - 1] = '\n';
+    for (uint32_t i = count; i < capacity && !failed; ++i)
+        failed = fwrite(data, record_length, 1, out) != 1;
+    if (out != NULL && fclose(out) != 0)
+        failed = 1;
+    free(data);
+    if (failed) {
+        perror(tmp);
+        return -1;
+    }
+#ifdef _WIN32
+    if (!MoveFileEx(tmp, path, MOVEFILE_REPLACE_EXISTING)) {
+#else
+    if (rename(tmp, path) == -1) {
+#endif
+        perror("rename (log)");
+        return -1;
+    }
+    printf("%s: moved %u records behind a log header\n", path, count);
+    return 0;
+}
+
+// map the log at path, created and preallocated for capacity records when empty
+int mlog_open(struct mlog *log, const char *path, uint32_t record_length, uint32_t capacity, long legacy_cursor)
+{
+    log->writable = 1;
+    log->synced_ms = vclock_real_ms();
+
+    // an older plain log is converted first
+    FILE *probe = fopen(path, "rb");
+    if (probe != NULL) {
+        char magic[8];
+        size_t n = fread(magic, 1, sizeof(magic), probe);
+        fclose(probe);
+        if (n > 0 && (n < sizeof(magic) || memcmp(magic, MLOG_MAGIC, sizeof(magic)) != 0) &&
+            mlog_migrate(path, record_length, capacity, legacy_cursor) == -1)
+            return -1;
+    }
+
+    if (mapped_open(&log->map, path, MLOG_HEADER_SIZE + (size_t)record_length * capacity, 1) == -1)
+        return -1;
+
+    log->header = (struct mlog_header*)log->map.addr;
+    log->records = log->map.addr + MLOG_HEADER_SIZE;
+    if (memcmp(log->header->magic, MLOG_MAGIC, sizeof(log->header->magic)) != 0) {
+        memset(log->records, ' ', log->map.size - MLOG_HEADER_SIZE);
+        for (uint32_t i = 0; i < capacity; ++i)
+            log->records[(size_t)(i + 1) * record_length - 1] = '\n';
+        log->header->record_length = record_length;
+        log->header->capacity = capacity;
+        atomic_store_explicit(&log->header->appended, 0, memory_order_relaxed);
+        // the magic last, a log is only valid once its header is complete
+        atomic_thread_fence(memory_order_release);
+        memcpy(log->header->magic, MLOG_MAGIC, sizeof(log->header->magic));
+    } else if (log->header->record_length != record_length || log->header->capacity != capacity) {
+        fprintf(stderr, "%s: log of %u records of %u bytes, expected %u of %u\n", path, log->header->capacity,
+                log->header->record_length, capacity, record_length);
+        mapped_close(&log->map);
+        return -1;
+    }
+    return 0;
+}
+
+// map an existing log read-only, as it is
+int mlog_open_read(struct mlog *log, const char *path)
+{
+    if (mapped_open(&log->map, path, 0, 0) == -1)
+        return -1;
+    log->header = (struct mlog_header*)log->map.addr;
+    log->records = log->map.addr + MLOG_HEADER_SIZE;
+    log->writable = 0;
+    if (log->map.size < MLOG_HEADER_SIZE || memcmp(log->header->magic, MLOG_MAGIC, sizeof(log->header->magic)) != 0 ||
+        log->header->record_length == 0 || log->header->capacity == 0 ||
+        log->map.size < MLOG_HEADER_SIZE + (size_t)log->header->record_length * log->header->capacity) {
+        fprintf(stderr, "%s: not a log with a header\n", path);
+        mapped_close(&log->map);
+        return -1;
+    }
+    return 0;
+}
+
+typedef void (*mlog_callback)(const char *record, void *ctx);
+
+// every record of the ring oldest first, slots never written or blanked by a restart skipped
+void mlog_each(const struct mlog *log, mlog_callback callback, void *ctx)
+{
+    uint64_t appended = atomic_load_explicit(&log->header->appended, memory_order_acquire);
+    uint32_t capacity = log->header->capacity;
+    uint64_t first = appended > capacity ? appended - capacity : 0;
+    for (uint64_t i = first; i < appended; ++i) {
+        const char *rec = log->records + (i % capacity) * log->header->record_length;
+        if (rec[0] != ' ')
+            callback(rec, ctx);
+    }
+}
+
+// records first, then the header page, so a synced cursor never points past synced records
+void mlog_sync(struct mlog *log)
+{
+    mapped_sync(&log->map, log->records, log->map.size - MLOG_HEADER_SIZE);
+    mapped_sync(&log->map, log->header, MLOG_HEADER_SIZE);
+    log->synced_ms = vclock_real_ms();
+}
+
+// one writer per log; readers that see the new cursor also see the record
+void mlog_append(struct mlog *log, const char *record)
+{
+    uint64_t appended = atomic_load_explicit(&log->header->appended, memory_order_relaxed);
+    memcpy(log->records + (appended % log->header->capacity) * log->header->record_length, record,
+           log->header->record_length);
+    atomic_store_explicit(&log->header->appended, appended + 1, memory_order_release);
+
+    if (vclock_real_ms() - log->synced_ms >= MLOG_SYNC_MS)
+        mlog_sync(log);
+}
+
+// empty the ring and start the next generation, e.g. the day log at a new year
+void mlog_restart(struct mlog *log)
+{
+    uint32_t capacity = log->header->capacity;
+    uint64_t appended = atomic_load_explicit(&log->header->appended, memory_order_relaxed);
+    for (uint32_t i = 0; i < capacity; ++i) {
+        char *rec = log->records + (size_t)i * log->header->record_length;
+        memset(rec, ' ', log->header->record_length - 1);
+        rec[log->header->record_length - 1] = '\n';
+    }
+    atomic_store_explicit(&log->header->appended, (appended / capacity + 1) * capacity, memory_order_release);
+    mlog_sync(log);
+}
+
+void mlog_close(struct mlog *log)
+{
+    if (log->writable)
+        mlog_sync(log);
+    mapped_close(&log->map);
+}
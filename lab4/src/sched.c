@@ -0,0 +1,271 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#    include <windows.h>
+#else
+#    include <errno.h>
+#    include <poll.h>
+#    include <unistd.h>
+#    include <sys/timerfd.h>
+#endif
+
+#include "vclock.c"
+
+// one thread runs every periodic job: it sleeps on a single absolute timer armed for the
+// earliest boundary of any job and wakes only when one is due, or to stop
+#define SCHED_MAX_JOBS 16
+#define SCHED_HOUR_SEC 3600
+#define SCHED_DAY_SEC 86400
+
+// hour, day and month follow the local calendar (23 and 25 hour days included);
+// seconds periods are counted from local midnight
+enum sched_unit { SCHED_SECONDS, SCHED_HOUR, SCHED_DAY, SCHED_MONTH };
+
+struct sched_period {
+    int32_t unit;
+    int32_t seconds;   // SCHED_SECONDS only
+};
+
+// a job is run with the period that just ended, [start, end) of the clock
+typedef void (*sched_callback)(time_t start, time_t end, void *ctx);
+
+struct sched_job {
+    struct sched_period period;
+    sched_callback run;
+    void *ctx;
+    time_t start;
+    time_t due;
+};
+
+struct sched {
+    struct sched_job jobs[SCHED_MAX_JOBS];
+    int count;
+    unsigned long wakeups;
+    unsigned long runs;
+#ifdef _WIN32
+    HANDLE timer;
+    HANDLE stop;
+#else
+    int timer_fd;
+    int stop_fd[2];
+#endif
+};
+
+static int sched_local(time_t t, struct tm *tm)
+{
+#ifdef _WIN32
+    return localtime_s(tm, &t) == 0 ? 0 : -1;
+#else
+    return localtime_r(&t, tm) != NULL ? 0 : -1;
+#endif
+}
+
+// the first boundary of the period after t
+time_t sched_boundary(struct sched_period period, time_t t)
+{
+    struct tm tm;
+    if (sched_local(t, &tm) == -1)
+        return t + SCHED_DAY_SEC;
+    tm.tm_sec = 0;
+    tm.tm_min = 0;
+    tm.tm_isdst = -1;
+    if (period.unit == SCHED_HOUR) {
+        tm.tm_hour += 1;
+    } else {
+        tm.tm_hour = 0;
+        if (period.unit == SCHED_MONTH) {
+            tm.tm_mday = 1;
+            tm.tm_mon += 1;
+        } else if (period.unit == SCHED_DAY) {
+            tm.tm_mday += 1;
+        }
+    }
+    time_t next = mktime(&tm);
+
+    if (period.unit == SCHED_SECONDS) {
+        // next is this midnight; the last period of a day ends at the next midnight
+        struct tm midnight;
+        sched_local(next, &midnight);
+        midnight.tm_mday += 1;
+        midnight.tm_isdst = -1;
+        time_t tomorrow = mktime(&midnight);
+        next += ((t - next) / period.seconds + 1) * period.seconds;
+        if (next > tomorrow)
+            next = tomorrow;
+    }
+    // the hour repeated when DST ends maps back onto itself
+    while (next <= t)
+        next += SCHED_HOUR_SEC;
+    return next;
+}
+
+// "hour", "day", "month", or "<n>s", "<n>m", "<n>h"
+int sched_parse_period(const char *s, struct sched_period *period)
+{
+    period->seconds = 0;
+    if (strcmp(s, "hour") == 0) {
+        period->unit = SCHED_HOUR;
+        return 0;
+    }
+    if (strcmp(s, "day") == 0) {
+        period->unit = SCHED_DAY;
+        return 0;
+    }
+    if (strcmp(s, "month") == 0) {
+        period->unit = SCHED_MONTH;
+        return 0;
+    }
+    char *end;
+    long n = strtol(s, &end, 10);
+    int scale = strcmp(end, "s") == 0 ? 1 : strcmp(end, "m") == 0 ? 60 : strcmp(end, "h") == 0 ? 3600 : 0;
+    if (end == s || n <= 0 || scale == 0 || n * scale > SCHED_DAY_SEC)
+        return -1;
+    period->unit = SCHED_SECONDS;
+    period->seconds = (int32_t)(n * scale);
+    return 0;
+}
+
+int sched_init(struct sched *s)
+{
+    memset(s, 0, sizeof(*s));
+#ifdef _WIN32
+    s->timer = CreateWaitableTimer(NULL, TRUE, NULL);
+    s->stop = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (s->timer == NULL || s->stop == NULL) {
+        perror("CreateWaitableTimer (sched)");
+        return -1;
+    }
+#else
+    s->timer_fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC);
+    if (s->timer_fd == -1) {
+        perror("timerfd_create");
+        return -1;
+    }
+    if (pipe(s->stop_fd) == -1) {
+        perror("pipe (sched)");
+        close(s->timer_fd);
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+// before the thread starts; the first period runs from start, now or when an earlier run
+// began it, to the first boundary after start
+int sched_add(struct sched *s, struct sched_period period, time_t start, sched_callback run, void *ctx)
+{
+    if (s->count == SCHED_MAX_JOBS) {
+        fprintf(stderr, "More than %d scheduled jobs\n", SCHED_MAX_JOBS);
+        return -1;
+    }
+    struct sched_job *job = &s->jobs[s->count++];
+    job->period = period;
+    job->run = run;
+    job->ctx = ctx;
+    job->start = start;
+    job->due = sched_boundary(period, job->start);
+    return 0;
+}
+
+// block until the clock reaches due, 1 when woken to stop
+static int sched_wait(struct sched *s, time_t due)
+{
+    int64_t real_us = vclock_to_real_us((int64_t)due * 1000);
+#ifdef _WIN32
+    LARGE_INTEGER when;
+    when.QuadPart = (real_us + 11644473600000000LL) * 10;   // 100 ns since 1601
+    SetWaitableTimer(s->timer, &when, 0, NULL, NULL, FALSE);
+    HANDLE handles[2] = {s->stop, s->timer};
+    return WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0;
+#else
+    struct itimerspec when = {{0, 0}, {(time_t)(real_us / 1000000), (long)(real_us % 1000000) * 1000}};
+    // a step of the system clock cancels the timer, so it is armed again for the new time
+    if (timerfd_settime(s->timer_fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &when, NULL) == -1) {
+        perror("timerfd_settime");
+        return 1;
+    }
+    struct pollfd fds[2] = {{s->stop_fd[0], POLLIN, 0}, {s->timer_fd, POLLIN, 0}};
+    while (poll(fds, 2, -1) == -1) {
+        if (errno != EINTR) {
+            perror("poll (sched)");
+            return 1;
+        }
+    }
+    if (fds[0].revents)
+        return 1;
+    uint64_t expirations;
+    if (read(s->timer_fd, &expirations, sizeof(expirations)) == -1 && errno != ECANCELED)
+        perror("read (timerfd)");
+    return 0;
+#endif
+}
+
+void sched_run(struct sched *s)
+{
+    while (s->count > 0) {
+        time_t earliest = s->jobs[0].due;
+        for (int i = 1; i < s->count; ++i) {
+            if (s->jobs[i].due < earliest)
+                earliest = s->jobs[i].due;
+        }
+        if (sched_wait(s, earliest))
+            break;
+        s->wakeups++;
+
+        // every job due by now, a clock that jumped ahead runs each once for the time missed
+        time_t now = vclock_now();
+        for (int i = 0; i < s->count; ++i) {
+            struct sched_job *job = &s->jobs[i];
+            if (job->due > now)
+                continue;
+            job->run(job->start, job->due, job->ctx);
+            s->runs++;
+            job->start = job->due;
+            job->due = sched_boundary(job->period, now);
+        }
+    }
+}
+
+#ifdef _WIN32
+DWORD WINAPI sched_thread(void *args)
+{
+    sched_run((struct sched*)args);
+    return 0;
+}
+#else
+void* sched_thread(void *args)
+{
+    sched_run((struct sched*)args);
+    return NULL;
+}
+#endif
+
+// wake the thread to return, jobs of periods not over yet are not run
+void sched_stop(struct sched *s)
+{
+#ifdef _WIN32
+    SetEvent(s->stop);
+#else
+    char byte = 0;
+    if (write(s->stop_fd[1], &byte, 1) == -1)
+        perror("write (sched)");
+#endif
+}
+
+void sched_close(struct sched *s)
+{
+#ifdef _WIN32
+    CloseHandle(s->timer);
+    CloseHandle(s->stop);
+#else
+    close(s->timer_fd);
+    close(s->stop_fd[0]);
+    close(s->stop_fd[1]);
+#endif
+}
@@ -1,4 +1,6 @@
 #include "serial.c"
+#include "frame.c"
+#include "vclock.c"
 
 #include <stdio.h>
 #include <string.h>
@@ -25,6 +27,9 @@ int main(int argc, char *argv[])
 {
     srand(time(0));
 
+    // one frame per second of the clock, as many per real second as TEMP_CLOCK speeds it up
+    vclock_init();
+
     // configure port
 #ifdef _WIN32
     HANDLE hSerial = CreateFile(
@@ -60,26 +65,27 @@ int main(int argc, char *argv[])
 
     // generate random initial temp
     double temp = init_rand_temp(-50, 50);
-    char data[10];
-    sprintf(data, "%.1f", temp);
+    uint32_t seq = 0;
+    char data[FRAME_MAX_LEN];
+    int len = frame_encode(data, sizeof(data), seq++, temp);
 
 #ifdef _WIN32
     while (1) {
         DWORD bytes_written;
-        if (!WriteFile(hSerial, data, strlen(data), &bytes_written, NULL)) {
+        if (!WriteFile(hSerial, data, len, &bytes_written, NULL)) {
             perror("WriteFile");
             break;
         }
         temp += rand_temp_change(-0.2, 0.2);
-        sprintf(data, "%.1f", temp);
-        Sleep(PORT_SPEED_MS);
+        len = frame_encode(data, sizeof(data), seq++, temp);
+        vclock_sleep_ms(PORT_SPEED_MS);
     }
 #else
     while(1) {
-        write(fd, data, strlen(data));
+        write(fd, data, len);
         temp += rand_temp_change(-0.2, 0.2);
-        sprintf(data, "%.1f", temp);
-        usleep(PORT_SPEED_MS * 1000);
+        len = frame_encode(data, sizeof(data), seq++, temp);
+        vclock_sleep_ms(PORT_SPEED_MS);
     }
 #endif
     return 0;
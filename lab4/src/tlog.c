@@ -0,0 +1,226 @@
+#pragma once
+
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "mapped.c"
+#include "vclock.c"
+
+// a time-indexed log: the slot of a reading is fixed by its time, (t / period) mod cycle,
+// so a time or a range is read by offset arithmetic instead of a scan. A slot also keeps
+// the lap (t / period) / cycle it was written in; a lap that does not match the one asked
+// for is a stale slot from an earlier cycle, or one never written. Rewriting a period keeps
+// its lap, so a slot is also a seqlock: seq is odd while a store is under way
+#define TLOG_MAGIC "LAB4TLG1"
+#define TLOG_HEADER_SIZE 4096
+#define TLOG_SYNC_MS 10000
+#define TLOG_READ_SPINS 4096  // seq odd this long: the writer died mid-store
+
+struct tlog_header {
+    char magic[8];
+    uint32_t slot_size;
+    uint32_t cycle;
+    int64_t period_ms;
+};
+
+struct tlog_slot {
+    _Atomic uint32_t seq;          // stores begun and finished
+    _Atomic uint32_t generation;   // lap + 1, 0 while the slot is empty
+    _Atomic uint32_t offset_ms;    // time of the reading within its period
+    uint32_t reserved;
+    _Atomic double value;
+};
+
+struct tlog {
+    struct mapped map;
+    struct tlog_header *header;
+    struct tlog_slot *slots;
+    int writable;
+    int64_t synced_ms;
+};
+
+static int64_t tlog_tick(const struct tlog *log, int64_t time_ms)
+{
+    int64_t p = log->header->period_ms;
+    return time_ms >= 0 ? time_ms / p : (time_ms - p + 1) / p;
+}
+
+// generation of a slot with its reading, 0 when empty or left half written
+static uint32_t tlog_load(const struct tlog_slot *slot, uint32_t *offset_ms, double *value)
+{
+    uint32_t stuck = 0;
+    for (int spins = 0; spins < TLOG_READ_SPINS;) {
+        uint32_t before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (before & 1) {
+            // only a store that never moves on counts against the reader
+            spins = before == stuck ? spins + 1 : 0;
+            stuck = before;
+            sched_yield();
+            continue;
+        }
+        uint32_t generation = atomic_load_explicit(&slot->generation, memory_order_relaxed);
+        *offset_ms = atomic_load_explicit(&slot->offset_ms, memory_order_relaxed);
+        *value = atomic_load_explicit(&slot->value, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == before)
+            return generation;
+    }
+    return 0;
+}
+
+static int tlog_check(const char *path, const struct tlog_header *h)
+{
+    if (memcmp(h->magic, TLOG_MAGIC, sizeof(h->magic)) != 0 || h->slot_size != sizeof(struct tlog_slot) ||
+        h->cycle == 0 || h->period_ms <= 0) {
+        fprintf(stderr, "%s: not a time-indexed log\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+// map the log at path for writing, created for cycle slots of period_ms when new
+int tlog_open(struct tlog *log, const char *path, int64_t period_ms, uint32_t cycle)
+{
+    if (mapped_open(&log->map, path, TLOG_HEADER_SIZE + sizeof(struct tlog_slot) * (size_t)cycle, 1) == -1)
+        return -1;
+    log->header = (struct tlog_header*)log->map.addr;
+    log->slots = (struct tlog_slot*)(log->map.addr + TLOG_HEADER_SIZE);
+    log->writable = 1;
+    log->synced_ms = vclock_real_ms();
+
+    // a new file is zero-filled: every slot starts empty
+    if (memcmp(log->header->magic, TLOG_MAGIC, sizeof(log->header->magic)) != 0) {
+        log->header->slot_size = sizeof(struct tlog_slot);
+        log->header->cycle = cycle;
+        log->header->period_ms = period_ms;
+        atomic_thread_fence(memory_order_release);
+        memcpy(log->header->magic, TLOG_MAGIC, sizeof(log->header->magic));
+    } else if (tlog_check(path, log->header) == -1) {
+        mapped_close(&log->map);
+        return -1;
+    } else if (log->header->cycle != cycle || log->header->period_ms != period_ms) {
+        fprintf(stderr, "%s: log of %u slots of %lld ms, expected %u of %lld\n", path, log->header->cycle,
+                (long long)log->header->period_ms, cycle, (long long)period_ms);
+        mapped_close(&log->map);
+        return -1;
+    } else {
+        // a store the last writer did not finish leaves its slot empty
+        for (uint32_t i = 0; i < cycle; ++i) {
+            struct tlog_slot *slot = &log->slots[i];
+            uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+            if (seq & 1) {
+                atomic_store_explicit(&slot->generation, 0, memory_order_relaxed);
+                atomic_store_explicit(&slot->seq, seq + 1, memory_order_release);
+            }
+        }
+    }
+    return 0;
+}
+
+// map an existing log read-only, its period and cycle come from the header
+int tlog_open_read(struct tlog *log, const char *path)
+{
+    if (mapped_open(&log->map, path, 0, 0) == -1)
+        return -1;
+    log->header = (struct tlog_header*)log->map.addr;
+    log->slots = (struct tlog_slot*)(log->map.addr + TLOG_HEADER_SIZE);
+    log->writable = 0;
+    if (log->map.size < TLOG_HEADER_SIZE || tlog_check(path, log->header) == -1 ||
+        log->map.size < TLOG_HEADER_SIZE + sizeof(struct tlog_slot) * (size_t)log->header->cycle) {
+        if (log->map.size >= TLOG_HEADER_SIZE)
+            fprintf(stderr, "%s: truncated\n", path);
+        mapped_close(&log->map);
+        return -1;
+    }
+    return 0;
+}
+
+void tlog_sync(struct tlog *log)
+{
+    mapped_sync(&log->map, log->map.addr, log->map.size);
+    log->synced_ms = vclock_real_ms();
+}
+
+// the reading at time_ms replaces whatever its slot held; one writer per log
+void tlog_put(struct tlog *log, int64_t time_ms, double value)
+{
+    int64_t tick = tlog_tick(log, time_ms);
+    struct tlog_slot *slot = &log->slots[tick % log->header->cycle];
+
+    // a reader racing the store sees seq odd or changed and reads the slot again
+    uint32_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&slot->generation, (uint32_t)(tick / log->header->cycle + 1), memory_order_relaxed);
+    atomic_store_explicit(&slot->offset_ms, (uint32_t)(time_ms - tick * log->header->period_ms),
+                          memory_order_relaxed);
+    atomic_store_explicit(&slot->value, value, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+
+    if (vclock_real_ms() - log->synced_ms >= TLOG_SYNC_MS)
+        tlog_sync(log);
+}
+
+// the reading of the period holding time_ms: 0 and its exact time and value, -1 when that
+// period was never written or its slot has since been reused
+int tlog_get(const struct tlog *log, int64_t time_ms, int64_t *at_ms, double *value)
+{
+    int64_t tick = tlog_tick(log, time_ms);
+    const struct tlog_slot *slot = &log->slots[tick % log->header->cycle];
+    uint32_t offset_ms;
+    double v;
+    if (tlog_load(slot, &offset_ms, &v) != (uint32_t)(tick / log->header->cycle + 1))
+        return -1;
+    *at_ms = tick * log->header->period_ms + offset_ms;
+    *value = v;
+    return 0;
+}
+
+typedef void (*tlog_callback)(int64_t time_ms, double value, void *ctx);
+
+// readings of [from_ms, to_ms) in time order, one slot per period; returns how many;
+// only the last cycle is held, older periods are skipped as stale
+size_t tlog_range(const struct tlog *log, int64_t from_ms, int64_t to_ms, tlog_callback callback, void *ctx)
+{
+    size_t found = 0;
+    int64_t first = tlog_tick(log, from_ms), last = tlog_tick(log, to_ms - 1);
+    if (last - first >= log->header->cycle)
+        first = last - log->header->cycle + 1;
+    for (int64_t tick = first; tick <= last; ++tick) {
+        int64_t at_ms;
+        double value;
+        if (tlog_get(log, tick * log->header->period_ms, &at_ms, &value) == 0 && at_ms >= from_ms && at_ms < to_ms) {
+            callback(at_ms, value, ctx);
+            found++;
+        }
+    }
+    return found;
+}
+
+// latest written period, for reading a log "up to now" without a clock; -1 if empty
+int64_t tlog_last_ms(const struct tlog *log)
+{
+    int64_t last = -1;
+    for (uint32_t i = 0; i < log->header->cycle; ++i) {
+        uint32_t offset_ms;
+        double value;
+        uint32_t generation = tlog_load(&log->slots[i], &offset_ms, &value);
+        if (generation == 0)
+            continue;
+        int64_t tick = (int64_t)(generation - 1) * log->header->cycle + i;
+        int64_t at_ms = tick * log->header->period_ms + offset_ms;
+        if (at_ms > last)
+            last = at_ms;
+    }
+    return last;
+}
+
+void tlog_close(struct tlog *log)
+{
+    if (log->writable)
+        tlog_sync(log);
+    mapped_close(&log->map);
+}
@@ -0,0 +1,90 @@
+#include "tlog.c"
+#include "vclock.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// reads the binary logs main writes with TEMP_LOG_FORMAT=binary, by time: a lookup is one
+// slot, a range one slot per period; records are printed like the text logs
+//   tlog_read <log.bin> at <time>
+//   tlog_read <log.bin> range <from> <to>
+//   tlog_read <log.bin> export
+// times are local "YYYY-MM-DD[ HH:MM[:SS]]" or "now" (of TEMP_CLOCK)
+#define RECORD_LENGTH 36
+
+static void print_record(int64_t time_ms, double value, void *ctx)
+{
+    (void)ctx;
+    char date[32], record[RECORD_LENGTH + 1];
+    if (vclock_format_ms(time_ms, date, sizeof(date)) == -1)
+        return;
+    int len = snprintf(record, sizeof(record), "%s %.1lf", date, value);
+    memset(record + len, ' ', RECORD_LENGTH - 1 - len);
+    record[RECORD_LENGTH - 1] = '\n';
+    fwrite(record, 1, RECORD_LENGTH, stdout);
+}
+
+static int parse_time(const char *s, int64_t *ms)
+{
+    if (strcmp(s, "now") == 0) {
+        *ms = vclock_now_ms();
+        return 0;
+    }
+    if (vclock_parse_date(s, ms) == -1) {
+        fprintf(stderr, "Bad time \"%s\", expected YYYY-MM-DD[ HH:MM[:SS]] or now\n", s);
+        return -1;
+    }
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "usage: %s <log.bin> at <time>\n"
+                    "       %s <log.bin> range <from> <to>\n"
+                    "       %s <log.bin> export\n", name, name, name);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    vclock_init();
+
+    struct tlog log;
+    if (tlog_open_read(&log, argv[1]) == -1)
+        return EXIT_FAILURE;
+
+    int status = EXIT_SUCCESS;
+    if (strcmp(argv[2], "at") == 0 && argc == 4) {
+        int64_t t, at_ms;
+        double value;
+        if (parse_time(argv[3], &t) == -1) {
+            status = EXIT_FAILURE;
+        } else if (tlog_get(&log, t, &at_ms, &value) == -1) {
+            fprintf(stderr, "%s: no reading for %s\n", argv[1], argv[3]);
+            status = EXIT_FAILURE;
+        } else {
+            print_record(at_ms, value, NULL);
+        }
+    } else if (strcmp(argv[2], "range") == 0 && argc == 5) {
+        int64_t from, to;
+        if (parse_time(argv[3], &from) == -1 || parse_time(argv[4], &to) == -1)
+            status = EXIT_FAILURE;
+        else
+            tlog_range(&log, from, to, print_record, NULL);
+    } else if (strcmp(argv[2], "export") == 0 && argc == 3) {
+        // the whole cycle up to the newest reading, oldest first
+        int64_t last = tlog_last_ms(&log);
+        if (last >= 0)
+            tlog_range(&log, last - log.header->period_ms * log.header->cycle + 1, last + 1, print_record, NULL);
+    } else {
+        usage(argv[0]);
+        status = EXIT_FAILURE;
+    }
+
+    tlog_close(&log);
+    return status;
+}
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#    include <windows.h>
+#endif
+
+// the time the logs key off: record stamps and the hour/day boundaries; TEMP_CLOCK selects it,
+// so a month of hourly and daily rollups can be run in under an hour
+//   real                          the system clock (default)
+//   offset:<seconds>              the system clock shifted, e.g. offset:-86400
+//   offset:<YYYY-MM-DD[ HH:MM:SS]> shifted so it starts at that local time
+//   fast:<rate>[@<date>]          rate seconds per real second, from now or from date
+#define VCLOCK_ENV "TEMP_CLOCK"
+
+enum vclock_mode { VCLOCK_REAL, VCLOCK_OFFSET, VCLOCK_FAST };
+
+// virtual = virtual_origin + (real - real_origin) * rate
+struct vclock {
+    int32_t mode;
+    double rate;
+    int64_t real_origin_ms;
+    int64_t virtual_origin_ms;
+};
+
+static struct vclock vclock_state = {VCLOCK_REAL, 1.0, 0, 0};
+
+int64_t vclock_real_us()
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int64_t vclock_real_ms()
+{
+    return vclock_real_us() / 1000;
+}
+
+// local "YYYY-MM-DD[ HH:MM[:SS]]" (or with a T) to unix ms
+static int vclock_parse_date(const char *s, int64_t *out)
+{
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    int n = sscanf(s, "%4d-%2d-%2d%*1[ T]%2d:%2d:%2d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour,
+                   &tm.tm_min, &tm.tm_sec);
+    if (n != 3 && n < 5)
+        return -1;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    time_t t = mktime(&tm);
+    if (t == (time_t)-1)
+        return -1;
+    *out = (int64_t)t * 1000;
+    return 0;
+}
+
+int vclock_parse(struct vclock *c, const char *spec)
+{
+    int64_t real = vclock_real_ms();
+    c->mode = VCLOCK_REAL;
+    c->rate = 1.0;
+    c->real_origin_ms = c->virtual_origin_ms = real;
+
+    if (strcmp(spec, "real") == 0)
+        return 0;
+
+    if (strncmp(spec, "offset:", 7) == 0) {
+        const char *value = spec + 7;
+        c->mode = VCLOCK_OFFSET;
+        if (vclock_parse_date(value, &c->virtual_origin_ms) == 0)
+            return 0;
+        char *end;
+        double seconds = strtod(value, &end);
+        if (end == value || *end != '\0')
+            return -1;
+        c->virtual_origin_ms = real + (int64_t)(seconds * 1000);
+        return 0;
+    }
+
+    if (strncmp(spec, "fast:", 5) == 0) {
+        char *end;
+        c->mode = VCLOCK_FAST;
+        c->rate = strtod(spec + 5, &end);
+        if (end == spec + 5 || c->rate <= 0 || c->rate > 1e6)
+            return -1;
+        if (*end == '@')
+            return vclock_parse_date(end + 1, &c->virtual_origin_ms);
+        return *end == '\0' ? 0 : -1;
+    }
+    return -1;
+}
+
+// once at start, before any thread reads the clock
+void vclock_init()
+{
+    const char *spec = getenv(VCLOCK_ENV);
+    if (spec == NULL || *spec == '\0')
+        return;
+    if (vclock_parse(&vclock_state, spec) == -1) {
+        fprintf(stderr, "%s: expected real, offset:<seconds|date> or fast:<rate>[@<date>], not \"%s\"\n",
+                VCLOCK_ENV, spec);
+        exit(EXIT_FAILURE);
+    }
+}
+
+int64_t vclock_now_ms()
+{
+    const struct vclock *c = &vclock_state;
+    int64_t real_us = vclock_real_us();
+    if (c->mode == VCLOCK_REAL)
+        return real_us / 1000;
+    if (c->mode == VCLOCK_OFFSET)
+        return c->virtual_origin_ms + (real_us / 1000 - c->real_origin_ms);
+    // from microseconds, so a fast clock still tells apart samples a real ms apart
+    return c->virtual_origin_ms + (int64_t)((real_us - c->real_origin_ms * 1000) * c->rate / 1000);
+}
+
+time_t vclock_now()
+{
+    int64_t ms = vclock_now_ms();
+    return (time_t)(ms >= 0 ? ms / 1000 : (ms - 999) / 1000);
+}
+
+// real time at which the clock shows virtual_ms, for timers on the system clock
+int64_t vclock_to_real_ms(int64_t virtual_ms)
+{
+    const struct vclock *c = &vclock_state;
+    if (c->mode == VCLOCK_REAL)
+        return virtual_ms;
+    return c->real_origin_ms + (int64_t)((virtual_ms - c->virtual_origin_ms) / c->rate);
+}
+
+// local "YYYY-MM-DD hh:mm:ss.sss" of a clock reading, as the logs stamp it; -1 if out of range
+int vclock_format_ms(int64_t ms, char *out, size_t size)
+{
+    time_t t = (time_t)(ms >= 0 ? ms / 1000 : (ms - 999) / 1000);
+    struct tm tm;
+#ifdef _WIN32
+    if (localtime_s(&tm, &t) != 0)
+#else
+    if (localtime_r(&t, &tm) == NULL)
+#endif
+        return -1;
+    size_t len = strftime(out, size, "%Y-%m-%d %H:%M:%S", &tm);
+    if (len == 0 || len + 5 > size)
+        return -1;
+    snprintf(out + len, size - len, ".%03d", (int)(ms - (int64_t)t * 1000));
+    return 0;
+}
+
+// the same in us, rounded up: the clock has reached virtual_ms by then
+int64_t vclock_to_real_us(int64_t virtual_ms)
+{
+    const struct vclock *c = &vclock_state;
+    if (c->mode == VCLOCK_REAL)
+        return virtual_ms * 1000;
+    double us = (virtual_ms - c->virtual_origin_ms) * 1000 / c->rate;
+    int64_t whole = (int64_t)us;
+    return c->real_origin_ms * 1000 + whole + (us > whole);
+}
+
+// sleep ms of clock time, ms / rate of real time
+void vclock_sleep_ms(int64_t ms)
+{
+    int64_t real_us = (int64_t)(ms * 1000 / vclock_state.rate);
+#ifdef _WIN32
+    Sleep((DWORD)(real_us / 1000 > 0 ? real_us / 1000 : 1));
+#else
+    struct timespec ts = {(time_t)(real_us / 1000000), (long)(real_us % 1000000) * 1000};
+    nanosleep(&ts, NULL);
+#endif
+}
@@ -102,6 +102,11 @@ plot(new QwtPlot(this))
     "text-align: center;"
     "}");
 
+    sensorBox = new QSpinBox(this);
+    sensorBox->setRange(1, 9999);
+    sensorBox->setPrefix("Sensor ");
+    connect(sensorBox, QOverload<int>::of(&QSpinBox::valueChanged), this, &MainWindow::onCurrentMinuteButtonRequest);
+
     currentMinuteButton = new QPushButton("Current", this);
     connect(currentMinuteButton, &QPushButton::clicked, this, &MainWindow::onCurrentMinuteButtonRequest);
 
@@ -149,6 +154,7 @@ plot(new QwtPlot(this))
     QVBoxLayout *mainLayout = new QVBoxLayout(this);
 
     mainLayout->addWidget(temperatureLabel, 0, Qt::AlignHCenter);
+    mainLayout->addWidget(sensorBox, 0, Qt::AlignHCenter);
     mainLayout->addWidget(currentMinuteButton);
 
     QHBoxLayout *bottomLayout = new QHBoxLayout();
@@ -177,6 +183,7 @@ void MainWindow::onRequestData()
     QUrl url("http://127.0.0.1:8080");
     QNetworkRequest request(url);
     request.setRawHeader("X-Client-Type", "qt-app");
+    request.setRawHeader("sensor", QByteArray::number(sensorBox->value()));
     request.setRawHeader("action", "current");
     networkManager->get(request);
 }
@@ -188,6 +195,7 @@ void MainWindow::onGraphRequest()
     QUrl url("http://127.0.0.1:8080");
     QNetworkRequest request(url);
     request.setRawHeader("X-Client-Type", "qt-app");
+    request.setRawHeader("sensor", QByteArray::number(sensorBox->value()));
     request.setRawHeader("action", "hourly_day");
     networkManager->get(request);
 }
@@ -199,6 +207,7 @@ void MainWindow::onWeekGraphRequest()
     QUrl url("http://127.0.0.1:8080");
     QNetworkRequest request(url);
     request.setRawHeader("X-Client-Type", "qt-app");
+    request.setRawHeader("sensor", QByteArray::number(sensorBox->value()));
     request.setRawHeader("action", "hourly_week");
     networkManager->get(request);
 }
@@ -210,6 +219,7 @@ void MainWindow::onMonthGraphRequest()
     QUrl url("http://127.0.0.1:8080");
     QNetworkRequest request(url);
     request.setRawHeader("X-Client-Type", "qt-app");
+    request.setRawHeader("sensor", QByteArray::number(sensorBox->value()));
     request.setRawHeader("action", "hourly_month");
     networkManager->get(request);
 }
@@ -221,6 +231,7 @@ void MainWindow::onDailyWeekGraphRequest()
     QUrl url("http://127.0.0.1:8080");
     QNetworkRequest request(url);
     request.setRawHeader("X-Client-Type", "qt-app");
+    request.setRawHeader("sensor", QByteArray::number(sensorBox->value()));
     request.setRawHeader("action", "daily_week");
     networkManager->get(request);
 }
@@ -232,6 +243,7 @@ void MainWindow::onDailyMonthGraphRequest()
     QUrl url("http://127.0.0.1:8080");
     QNetworkRequest request(url);
     request.setRawHeader("X-Client-Type", "qt-app");
+    request.setRawHeader("sensor", QByteArray::number(sensorBox->value()));
     request.setRawHeader("action", "daily_month");
     networkManager->get(request);
 }
@@ -243,6 +255,7 @@ void MainWindow::onDailyYearGraphRequest()
     QUrl url("http://127.0.0.1:8080");
     QNetworkRequest request(url);
     request.setRawHeader("X-Client-Type", "qt-app");
+    request.setRawHeader("sensor", QByteArray::number(sensorBox->value()));
     request.setRawHeader("action", "daily_year");
     networkManager->get(request);
 }
@@ -256,6 +269,7 @@ void MainWindow::onCurrentMinuteRequest()
     QUrl url("http://127.0.0.1:8080");
     QNetworkRequest request(url);
     request.setRawHeader("X-Client-Type", "qt-app");
+    request.setRawHeader("sensor", QByteArray::number(sensorBox->value()));
     request.setRawHeader("action", "current_minute");
     networkManager->get(request);
 }
@@ -267,6 +281,7 @@ void MainWindow::onCurrentMinuteButtonRequest()
     QUrl url("http://127.0.0.1:8080");
     QNetworkRequest request(url);
     request.setRawHeader("X-Client-Type", "qt-app");
+    request.setRawHeader("sensor", QByteArray::number(sensorBox->value()));
     request.setRawHeader("action", "current_minute");
     networkManager->get(request);
 }
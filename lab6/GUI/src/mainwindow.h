@@ -4,6 +4,7 @@
 #include <QVBoxLayout>
 #include <QPushButton>
 #include <QLabel>
+#include <QSpinBox>
 #include <QNetworkReply>
 #include <QJsonArray>
 #include <QJsonObject>
@@ -40,6 +41,7 @@ private slots:
 private:
     QNetworkAccessManager *networkManager;
     QLabel *temperatureLabel;
+    QSpinBox *sensorBox;
     QPushButton *graphButton;
     QPushButton *weekGraphButton;
     QPushButton *monthGraphButton;
@@ -0,0 +1,108 @@
+#include "frame.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_FRAMES 2000000
+#define BENCH_MAX_CHUNK 256
+
+struct bench_ctx {
+    unsigned long frames;
+    double sum;
+};
+
+void on_frame(const struct frame *frame, void *ctx)
+{
+    struct bench_ctx *bench = (struct bench_ctx*)ctx;
+    bench->frames++;
+    bench->sum += frame->value;
+}
+
+double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void report(const char *name, struct frame_parser *p, struct bench_ctx *ctx, size_t bytes, double sec)
+{
+    printf("%-28s %10.0f frames/sec %8.1f MB/s  (%lu frames, %.3f s)\n",
+           name, ctx->frames / sec, bytes / sec / 1e6, ctx->frames, sec);
+    frame_print_stats("  stats", &p->stats);
+}
+
+int main(int argc, char *argv[])
+{
+    int frames = argc > 1 ? atoi(argv[1]) : BENCH_FRAMES;
+    srand(1);
+
+    // encode a stream of frames, every 1000th is corrupted and every 5000th is lost
+    size_t size = (size_t)frames * 32;
+    char *stream = malloc(size);
+    if (stream == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t len = 0;
+    double temp = 20.0;
+    for (int i = 0; i < frames; ++i) {
+        temp += ((double)rand() / RAND_MAX) * 0.4 - 0.2;
+        char frame[FRAME_MAX_LEN];
+        int n = frame_encode(frame, sizeof(frame), (uint32_t)i, deci_from_double(temp));
+        if (i % 5000 == 4999)
+            continue;
+        if (i % 1000 == 999)
+            frame[2] ^= 0x01;
+        memcpy(stream + len, frame, n);
+        len += n;
+    }
+
+    struct frame_parser parser;
+    struct bench_ctx ctx;
+    double start;
+
+    // whole buffer at once
+    frame_parser_init(&parser);
+    memset(&ctx, 0, sizeof(ctx));
+    start = now_sec();
+    frame_parser_feed(&parser, stream, len, on_frame, &ctx);
+    report("feed, single buffer", &parser, &ctx, len, now_sec() - start);
+
+    // random chunks, frames are split and merged across calls
+    size_t *chunks = malloc(sizeof(size_t) * len);
+    size_t nchunks = 0;
+    for (size_t off = 0; off < len; ) {
+        size_t n = 1 + rand() % BENCH_MAX_CHUNK;
+        if (n > len - off)
+            n = len - off;
+        chunks[nchunks++] = n;
+        off += n;
+    }
+
+    frame_parser_init(&parser);
+    memset(&ctx, 0, sizeof(ctx));
+    start = now_sec();
+    for (size_t i = 0, off = 0; i < nchunks; off += chunks[i++])
+        frame_parser_feed(&parser, stream + off, chunks[i], on_frame, &ctx);
+    report("feed, random chunks", &parser, &ctx, len, now_sec() - start);
+
+    // read() path: chunks land directly in the parser buffer
+    frame_parser_init(&parser);
+    memset(&ctx, 0, sizeof(ctx));
+    start = now_sec();
+    for (size_t i = 0, off = 0; i < nchunks; off += chunks[i++]) {
+        size_t avail;
+        char *space = frame_parser_space(&parser, &avail);
+        memcpy(space, stream + off, chunks[i]);
+        frame_parser_commit(&parser, chunks[i], on_frame, &ctx);
+    }
+    report("space/commit, random chunks", &parser, &ctx, len, now_sec() - start);
+
+    free(chunks);
+    free(stream);
+    return 0;
+}
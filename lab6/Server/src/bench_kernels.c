@@ -0,0 +1,138 @@
+#include "kernels.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// one cache-resident array (the live ring's last 5 minutes) and one the size of a day of samples
+#define BENCH_SMALL 300
+#define BENCH_LARGE (1 << 20)
+#define BENCH_BYTES (1 << 30)   // bytes each kernel reads per measurement
+
+double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// results go here so the calls are not optimized away
+volatile double sink;
+
+void report(const char *level, const char *kernel, size_t n, size_t width, double sec, size_t reps)
+{
+    printf("%-7s %-12s %8zu x %zu B %8.2f GB/s\n", level, kernel, n, width, (double)n * width * reps / sec / 1e9);
+}
+
+void bench_level(const char *level, const struct kernels *k, const double *f, const int16_t *q, size_t n)
+{
+    size_t reps = BENCH_BYTES / (n * sizeof(double));
+    double lo, hi, start;
+
+    start = now_sec();
+    for (size_t r = 0; r < reps; ++r)
+        sink = k->sum_f64(f, n);
+    report(level, "sum f64", n, sizeof(double), now_sec() - start, reps);
+
+    start = now_sec();
+    for (size_t r = 0; r < reps; ++r) {
+        k->minmax_f64(f, n, &lo, &hi);
+        sink = lo + hi;
+    }
+    report(level, "minmax f64", n, sizeof(double), now_sec() - start, reps);
+
+    start = now_sec();
+    for (size_t r = 0; r < reps; ++r)
+        sink = k->sqdev_f64(f, n, 20.0);
+    report(level, "sqdev f64", n, sizeof(double), now_sec() - start, reps);
+
+    reps = BENCH_BYTES / (n * sizeof(int16_t));
+    start = now_sec();
+    for (size_t r = 0; r < reps; ++r)
+        sink = (double)k->sum_i16(q, n);
+    report(level, "sum i16", n, sizeof(int16_t), now_sec() - start, reps);
+
+    int16_t qlo, qhi;
+    start = now_sec();
+    for (size_t r = 0; r < reps; ++r) {
+        k->minmax_i16(q, n, &qlo, &qhi);
+        sink = qlo + qhi;
+    }
+    report(level, "minmax i16", n, sizeof(int16_t), now_sec() - start, reps);
+}
+
+// every level must agree with the scalar kernels before its speed means anything
+int check_level(const char *level, const struct kernels *k, const double *f, const int16_t *q, size_t n)
+{
+    const struct kernels *s = kernels_at(KERNEL_SCALAR);
+    for (size_t len = 0; len <= n; len += len < 64 ? 1 : 997) {
+        double lo, hi, slo, shi;
+        int16_t qlo, qhi, sqlo, sqhi;
+        double sum = k->sum_f64(f, len), ssum = s->sum_f64(f, len);
+        double sq = k->sqdev_f64(f, len, 20.0), ssq = s->sqdev_f64(f, len, 20.0);
+        int bad = k->sum_i16(q, len) != s->sum_i16(q, len) ||
+                  sum - ssum > 1e-9 * (len + 1) || ssum - sum > 1e-9 * (len + 1) ||
+                  sq - ssq > 1e-9 * (len + 1) || ssq - sq > 1e-9 * (len + 1);
+        if (len > 0) {
+            k->minmax_f64(f, len, &lo, &hi);
+            s->minmax_f64(f, len, &slo, &shi);
+            k->minmax_i16(q, len, &qlo, &qhi);
+            s->minmax_i16(q, len, &sqlo, &sqhi);
+            bad |= lo != slo || hi != shi || qlo != sqlo || qhi != sqhi;
+        }
+        if (bad) {
+            fprintf(stderr, "%s kernels disagree with scalar at %zu values\n", level, len);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t large = argc > 1 ? (size_t)atol(argv[1]) : BENCH_LARGE;
+    srand(1);
+
+    // a random walk around 20 C, as doubles and as fixed-point tenths
+    double *f = malloc(sizeof(double) * large);
+    int16_t *q = malloc(sizeof(int16_t) * large);
+    if (f == NULL || q == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    double temp = 20.0;
+    for (size_t i = 0; i < large; ++i) {
+        temp += ((double)rand() / RAND_MAX) * 0.4 - 0.2;
+        f[i] = temp;
+        q[i] = (int16_t)(temp * 10);
+    }
+
+    printf("dispatch picks %s\n", kernels()->name);
+    for (int level = KERNEL_SCALAR; level < KERNEL_LEVELS; ++level) {
+        const struct kernels *k = kernels_at((enum kernel_level)level);
+        if (k == NULL) {
+            printf("%-7s not supported here\n", level == KERNEL_SSE2 ? "sse2" : "avx2");
+            continue;
+        }
+        if (check_level(k->name, k, f, q, large < 20000 ? large : 20000) == -1)
+            exit(EXIT_FAILURE);
+        bench_level(k->name, k, f, q, BENCH_SMALL);
+        bench_level(k->name, k, f, q, large);
+    }
+
+    // per-minute min/max over a day of secondly samples, through the dispatched kernels
+    size_t day = large < 86400 ? large : 86400;
+    double mins[1440], maxs[1440];
+    size_t reps = BENCH_BYTES / (day * sizeof(double));
+    double start = now_sec();
+    for (size_t r = 0; r < reps; ++r) {
+        kernel_bucket_minmax(f, day, 60, mins, maxs);
+        sink = mins[0];
+    }
+    report(kernels()->name, "bucket 60s", day, sizeof(double), now_sec() - start, reps);
+
+    free(f);
+    free(q);
+    return 0;
+}
@@ -0,0 +1,238 @@
+#include "sqlite3.h"
+#include "calendar.h"
+#include "tsdb.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define BENCH_DAYS 7
+#define BENCH_SENSORS 4
+#define BENCH_QUERIES 200
+#define BENCH_DIR "bench_tsdb.d"
+#define BENCH_DB "bench_tsdb.db"
+
+double now_sec()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+long file_size(const char *path)
+{
+    struct stat st;
+    return stat(path, &st) == 0 ? (long)st.st_size : 0;
+}
+
+void execute(sqlite3 *db, const char *sql)
+{
+    char *err = NULL;
+    if (sqlite3_exec(db, sql, 0, 0, &err) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", err);
+        sqlite3_free(err);
+        exit(EXIT_FAILURE);
+    }
+}
+
+struct scan_ctx {
+    uint64_t count;
+    double sum;
+    uint64_t hash;
+};
+
+// order independent, catches any changed bit of a time or value
+uint64_t sample_hash(int64_t time_ms, decicelsius value)
+{
+    uint64_t h = (((uint64_t)(uint16_t)value << 48) ^ (uint64_t)time_ms) * 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 29);
+}
+
+void on_sample(int64_t time_ms, decicelsius value, void *ctx)
+{
+    struct scan_ctx *scan = (struct scan_ctx*)ctx;
+    scan->count++;
+    scan->sum += deci_to_double(value);
+    scan->hash += sample_hash(time_ms, value);
+}
+
+int main(int argc, char *argv[])
+{
+    int days = argc > 1 ? atoi(argv[1]) : BENCH_DAYS;
+    int sensors = argc > 2 ? atoi(argv[2]) : BENCH_SENSORS;
+    long per_sensor = (long)days * 86400;
+    srand(1);
+
+    for (int s = 1; s <= sensors; ++s) {
+        char path[300];
+        tsdb_series_path(BENCH_DIR, s, path, sizeof(path));
+        remove(path);
+    }
+    remove(BENCH_DB);
+    remove(BENCH_DB "-journal");
+
+    // same schema as the server's temp_all
+    sqlite3 *db;
+    if (sqlite3_open(BENCH_DB, &db) != SQLITE_OK) {
+        fprintf(stderr, "Cannot open database: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+    execute(db, "CREATE TABLE temp_all(sensor_id INTEGER NOT NULL DEFAULT 1, date DATETIME DEFAULT CURRENT_TIMESTAMP, "
+                "temp REAL, PRIMARY KEY (sensor_id, date)) WITHOUT ROWID;");
+    execute(db, "CREATE INDEX temp_all_date ON temp_all(date);");
+    sqlite3_stmt *insert;
+    sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO temp_all (sensor_id, date, temp) VALUES (?, ?, ?);", -1, &insert, 0);
+
+    static struct tsdb ts;
+    if (tsdb_open(&ts, BENCH_DIR) == -1)
+        return 1;
+
+    // 1 Hz per sensor with a few ms of jitter, a random walk in 0.1 steps
+    int64_t start_ms = (int64_t)(next_day_boundary(time(NULL)) - (time_t)days * 86400 - 86400) * 1000;
+    decicelsius *temp = malloc(sizeof(decicelsius) * sensors);
+    for (int s = 0; s < sensors; ++s)
+        temp[s] = 200 + s * 50;
+
+    struct scan_ctx expected = {0, 0.0, 0};
+    double tsdb_sec = 0, sqlite_sec = 0;
+    uint64_t offset = 0;
+    char date[32];
+
+    execute(db, "BEGIN;");
+    for (long i = 0; i < per_sensor; ++i) {
+        int64_t second_ms = start_ms + i * 1000;
+        if (i % 3600 == 0 && i > 0) {
+            double t0 = now_sec();
+            tsdb_seal_all(&ts);
+            tsdb_sec += now_sec() - t0;
+
+            t0 = now_sec();
+            execute(db, "COMMIT; BEGIN;");
+            sqlite_sec += now_sec() - t0;
+        }
+
+        for (int s = 0; s < sensors; ++s) {
+            temp[s] += (rand() % 3) - 1;
+            decicelsius value = temp[s];
+            int64_t time_ms = second_ms + rand() % 20;
+            on_sample(time_ms, value, &expected);
+
+            double t0 = now_sec();
+            tsdb_append(&ts, s + 1, time_ms, value, offset++);
+            double t1 = now_sec();
+
+            format_local_ms(time_ms, date, sizeof(date));
+            sqlite3_bind_int(insert, 1, s + 1);
+            sqlite3_bind_text(insert, 2, date, -1, SQLITE_STATIC);
+            sqlite3_bind_double(insert, 3, deci_to_double(value));
+            sqlite3_step(insert);
+            sqlite3_reset(insert);
+            double t2 = now_sec();
+
+            tsdb_sec += t1 - t0;
+            sqlite_sec += t2 - t1;
+        }
+    }
+    execute(db, "COMMIT;");
+    tsdb_close(&ts);
+    sqlite3_finalize(insert);
+
+    long tsdb_bytes = 0;
+    for (int s = 1; s <= sensors; ++s) {
+        char path[300];
+        tsdb_series_path(BENCH_DIR, s, path, sizeof(path));
+        tsdb_bytes += file_size(path);
+    }
+    long sqlite_bytes = file_size(BENCH_DB);
+
+    printf("%d days x %d sensors at 1 Hz: %llu samples\n", days, sensors, (unsigned long long)expected.count);
+    printf("write   sqlite %8.3f s   tsdb %8.3f s\n", sqlite_sec, tsdb_sec);
+    printf("disk    sqlite %10ld bytes (%.2f B/sample)   tsdb %10ld bytes (%.2f B/sample)   %.1fx smaller\n",
+           sqlite_bytes, (double)sqlite_bytes / expected.count,
+           tsdb_bytes, (double)tsdb_bytes / expected.count, (double)sqlite_bytes / tsdb_bytes);
+
+    // every sample must come back bit-exact
+    struct scan_ctx check = {0, 0.0, 0};
+    for (int s = 1; s <= sensors; ++s) {
+        struct tsdb_reader r;
+        tsdb_reader_open(&r, BENCH_DIR, s);
+        tsdb_scan(&r, INT64_MIN, INT64_MAX, on_sample, &check);
+        tsdb_reader_close(&r);
+    }
+    printf("verify  %s (%llu of %llu samples read back)\n",
+           check.count == expected.count && check.hash == expected.hash ? "ok" : "MISMATCH",
+           (unsigned long long)check.count, (unsigned long long)expected.count);
+
+    // random windows: aggregates and full row scans
+    sqlite3_stmt *agg, *rows;
+    sqlite3_prepare_v2(db, "SELECT COUNT(*), MIN(temp), MAX(temp), SUM(temp) FROM temp_all "
+                           "WHERE sensor_id = ? AND date >= ? AND date < ?;", -1, &agg, 0);
+    sqlite3_prepare_v2(db, "SELECT date, temp FROM temp_all WHERE sensor_id = ? AND date >= ? AND date < ?;", -1, &rows, 0);
+
+    const long windows[] = {3600, 86400};
+    const char *names[] = {"1 hour", "1 day"};
+    for (int w = 0; w < 2; ++w) {
+        double sqlite_agg = 0, tsdb_agg = 0, sqlite_scan = 0, tsdb_scan_sec = 0;
+        int mismatches = 0;
+        for (int q = 0; q < BENCH_QUERIES; ++q) {
+            int s = 1 + rand() % sensors;
+            long first = rand() % (per_sensor - windows[w]);
+            int64_t from = start_ms + first * 1000;
+            int64_t to = from + windows[w] * 1000;
+            char from_date[32], to_date[32];
+            format_local_ms(from, from_date, sizeof(from_date));
+            format_local_ms(to, to_date, sizeof(to_date));
+
+            double t0 = now_sec();
+            sqlite3_bind_int(agg, 1, s);
+            sqlite3_bind_text(agg, 2, from_date, -1, SQLITE_STATIC);
+            sqlite3_bind_text(agg, 3, to_date, -1, SQLITE_STATIC);
+            sqlite3_step(agg);
+            uint64_t sqlite_count = (uint64_t)sqlite3_column_int64(agg, 0);
+            sqlite3_reset(agg);
+            double t1 = now_sec();
+
+            struct tsdb_reader r;
+            tsdb_reader_open(&r, BENCH_DIR, s);
+            struct tsdb_summary sum;
+            tsdb_aggregate(&r, from, to, &sum);
+            double t2 = now_sec();
+
+            sqlite3_bind_int(rows, 1, s);
+            sqlite3_bind_text(rows, 2, from_date, -1, SQLITE_STATIC);
+            sqlite3_bind_text(rows, 3, to_date, -1, SQLITE_STATIC);
+            struct scan_ctx sqlite_rows = {0, 0.0, 0};
+            while (sqlite3_step(rows) == SQLITE_ROW) {
+                sqlite_rows.count++;
+                sqlite_rows.sum += sqlite3_column_double(rows, 1);
+            }
+            sqlite3_reset(rows);
+            double t3 = now_sec();
+
+            struct scan_ctx tsdb_rows = {0, 0.0, 0};
+            tsdb_scan(&r, from, to, on_sample, &tsdb_rows);
+            tsdb_reader_close(&r);
+            double t4 = now_sec();
+
+            if (sum.count != sqlite_count || tsdb_rows.count != sqlite_rows.count)
+                mismatches++;
+            sqlite_agg += t1 - t0;
+            tsdb_agg += t2 - t1;
+            sqlite_scan += t3 - t2;
+            tsdb_scan_sec += t4 - t3;
+        }
+        printf("%-7s aggregate sqlite %8.3f ms  tsdb %8.3f ms  %6.1fx | scan sqlite %8.3f ms  tsdb %8.3f ms  %6.1fx%s\n",
+               names[w],
+               sqlite_agg * 1e3 / BENCH_QUERIES, tsdb_agg * 1e3 / BENCH_QUERIES, sqlite_agg / tsdb_agg,
+               sqlite_scan * 1e3 / BENCH_QUERIES, tsdb_scan_sec * 1e3 / BENCH_QUERIES, sqlite_scan / tsdb_scan_sec,
+               mismatches ? "  (count mismatch)" : "");
+    }
+
+    sqlite3_finalize(agg);
+    sqlite3_finalize(rows);
+    sqlite3_close(db);
+    free(temp);
+    return 0;
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define SEC_IN_MINUTE 60
+#define SEC_IN_HOUR 3600
+#define SEC_IN_DAY 86400
+
+void local_tm(time_t t, struct tm *tm)
+{
+#ifdef _WIN32
+    localtime_s(tm, &t);
+#else
+    localtime_r(&t, tm);
+#endif
+}
+
+// start of the next local hour
+time_t next_hour_boundary(time_t now)
+{
+    struct tm tm;
+    local_tm(now, &tm);
+    tm.tm_min = 0;
+    tm.tm_sec = 0;
+    tm.tm_hour += 1;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+// next local midnight
+time_t next_day_boundary(time_t now)
+{
+    struct tm tm;
+    local_tm(now, &tm);
+    tm.tm_hour = 0;
+    tm.tm_min = 0;
+    tm.tm_sec = 0;
+    tm.tm_mday += 1;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+// local midnight one day before a day boundary, days around DST changes are not 24h
+time_t prev_day_boundary(time_t boundary)
+{
+    struct tm tm;
+    local_tm(boundary, &tm);
+    tm.tm_mday -= 1;
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+// same format as DATETIME('now', 'localtime')
+char *format_local(time_t t, char *date, size_t size)
+{
+    struct tm tm;
+    local_tm(t, &tm);
+    strftime(date, size, "%Y-%m-%d %H:%M:%S", &tm);
+    return date;
+}
+
+// same format as STRFTIME('%Y-%m-%d %H:%M:%f', 'now', 'localtime')
+char *format_local_ms(int64_t ms, char *date, size_t size)
+{
+    format_local((time_t)(ms / 1000), date, size);
+    size_t len = strlen(date);
+    snprintf(date + len, size - len, ".%03d", (int)(ms % 1000));
+    return date;
+}
+
+// start of the next minute, minutes are aligned the same in every time zone
+time_t next_minute_boundary(time_t now)
+{
+    return now - now % 60 + 60;
+}
+
+// seconds since 1970-01-01 00:00 of a civil date and time, no time zone applied
+int64_t civil_seconds(int year, int month, int day, int hour, int min, int sec)
+{
+    // days from civil date (proleptic gregorian)
+    int64_t y = year - (month <= 2);
+    int64_t m = month;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + day - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    int64_t days = era * 146097 + doe - 719468;
+
+    return days * 86400 + hour * 3600 + min * 60 + sec;
+}
+
+// local wall clock in seconds since 1970-01-01 00:00 wall clock, which is what
+// strftime('%s', date) returns for the local dates stored in the tables
+int64_t local_wall_seconds(time_t t)
+{
+    struct tm tm;
+    local_tm(t, &tm);
+    return civil_seconds(tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+}
+
+// inverse of local_wall_seconds, the result compares as a string with stored dates
+char *format_wall(int64_t wall, char *date, size_t size)
+{
+    time_t t = (time_t)wall;
+    struct tm tm;
+#ifdef _WIN32
+    gmtime_s(&tm, &t);
+#else
+    gmtime_r(&t, &tm);
+#endif
+    strftime(date, size, "%Y-%m-%d %H:%M:%S", &tm);
+    return date;
+}
+
+// instant of a local wall-clock second, an hour repeated when the clock goes back maps to one of its two
+time_t wall_time(int64_t wall)
+{
+    time_t t = (time_t)wall;
+    struct tm tm;
+#ifdef _WIN32
+    gmtime_s(&tm, &t);
+#else
+    gmtime_r(&t, &tm);
+#endif
+    tm.tm_isdst = -1;
+    return mktime(&tm);
+}
+
+// "YYYY-MM-DD HH:MM:SS[.mmm]" of a stored date -> wall-clock milliseconds
+int64_t parse_wall_ms(const unsigned char *d, int len)
+{
+#define D2(i) ((d[i] - '0') * 10 + (d[i + 1] - '0'))
+    int64_t ms = civil_seconds(D2(0) * 100 + D2(2), D2(5), D2(8), D2(11), D2(14), D2(17)) * 1000;
+    if (len >= 23 && d[19] == '.')
+        ms += (d[20] - '0') * 100 + D2(21);
+#undef D2
+    return ms;
+}
+
+// inverse of parse_wall_ms with milliseconds, 23 characters and a '\0' without strftime
+char *format_wall_ms(int64_t wall_ms, char *date)
+{
+    int64_t days = wall_ms / 1000 / SEC_IN_DAY, ms = wall_ms % (SEC_IN_DAY * 1000LL);
+    if (ms < 0) {
+        days--;
+        ms += SEC_IN_DAY * 1000LL;
+    }
+    // civil date of a day number, the inverse of civil_seconds
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int64_t doe = days - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    int day = (int)(doy - (153 * mp + 2) / 5 + 1);
+    int month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    int year = (int)(yoe + era * 400 + (month <= 2));
+
+    int clock[3] = {(int)(ms / 3600000), (int)(ms / 60000 % 60), (int)(ms / 1000 % 60)};
+    int parts[4] = {year / 100, year % 100, month, day};
+    char *p = date;
+    for (int i = 0; i < 4; ++i) {
+        *p++ = (char)('0' + parts[i] / 10);
+        *p++ = (char)('0' + parts[i] % 10);
+        if (i >= 1 && i < 3)
+            *p++ = '-';
+    }
+    for (int i = 0; i < 3; ++i) {
+        *p++ = i == 0 ? ' ' : ':';
+        *p++ = (char)('0' + clock[i] / 10);
+        *p++ = (char)('0' + clock[i] % 10);
+    }
+    *p++ = '.';
+    *p++ = (char)('0' + ms % 1000 / 100);
+    *p++ = (char)('0' + ms % 100 / 10);
+    *p++ = (char)('0' + ms % 10);
+    *p = '\0';
+    return date;
+}
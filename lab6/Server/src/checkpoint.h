@@ -0,0 +1,199 @@
+#pragma once
+
+#include "sqlite3.h"
+#include "live.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifdef _WIN32
+#    include <windows.h>
+#else
+#    include <poll.h>
+#    include <unistd.h>
+#    include <sys/eventfd.h>
+#    include <sys/stat.h>
+#endif
+
+// WAL checkpoints off the ingest path: the writer connection runs with wal_autocheckpoint = 0,
+// so a commit never copies pages back into the db; a thread with its own connection runs
+// PASSIVE checkpoints, which copy what no reader still needs and never wait for a lock.
+// A writer that commits all the time keeps PASSIVE from ever catching up, and the WAL only
+// starts over once a checkpoint did: past CHECKPOINT_RESTART_BYTES one RESTART waits for
+// the writer between two commits, copies the frames since the last checkpoint and lets the
+// next commit start the WAL over
+#define CHECKPOINT_INTERVAL_MS 1000
+#define CHECKPOINT_RESTART_BYTES (16 << 20)
+#define CHECKPOINT_BUSY_MS 1000      // longest a RESTART waits for the writer, and the writer for it
+#define WAL_SIZE_LIMIT (64 << 20)   // journal_size_limit, the WAL shrinks back to this once reset
+
+struct checkpointer {
+    sqlite3 *db;
+    char wal_path[256];
+    struct wal_metrics *metrics;
+    unsigned long failures;
+    unsigned long restarts;
+    int restart_frames;   // frames of CHECKPOINT_RESTART_BYTES
+    int pending;          // frames left in the WAL by the last checkpoint
+#ifdef _WIN32
+    HANDLE event;
+#else
+    int event_fd;
+#endif
+};
+
+static int64_t checkpoint_now_us()
+{
+    struct timespec ts;
+#ifdef _WIN32
+    timespec_get(&ts, TIME_UTC);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t checkpoint_wal_bytes(const char *path)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesEx(path, GetFileExInfoStandard, &data))
+        return 0;
+    return ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+#else
+    struct stat st;
+    return stat(path, &st) == 0 ? (uint64_t)st.st_size : 0;
+#endif
+}
+
+int checkpointer_open(struct checkpointer *c, const char *db_path, struct wal_metrics *metrics)
+{
+    c->metrics = metrics;
+    c->failures = 0;
+    c->restarts = 0;
+    c->pending = 0;
+    snprintf(c->wal_path, sizeof(c->wal_path), "%s-wal", db_path);
+    if (sqlite3_open(db_path, &c->db) != SQLITE_OK) {
+        fprintf(stderr, "Checkpointer: %s\n", sqlite3_errmsg(c->db));
+        sqlite3_close(c->db);
+        return -1;
+    }
+    // a connection that never read the database has no WAL open, its checkpoints do nothing
+    sqlite3_stmt *stmt = NULL;
+    if (sqlite3_exec(c->db, "SELECT 1 FROM sqlite_master LIMIT 1;", NULL, NULL, NULL) != SQLITE_OK ||
+        sqlite3_prepare_v2(c->db, "PRAGMA page_size;", -1, &stmt, NULL) != SQLITE_OK ||
+        sqlite3_step(stmt) != SQLITE_ROW) {
+        sqlite3_finalize(stmt);
+        fprintf(stderr, "Checkpointer: %s\n", sqlite3_errmsg(c->db));
+        sqlite3_close(c->db);
+        return -1;
+    }
+    c->restart_frames = CHECKPOINT_RESTART_BYTES / sqlite3_column_int(stmt, 0);
+    sqlite3_finalize(stmt);
+    sqlite3_busy_timeout(c->db, CHECKPOINT_BUSY_MS);
+#ifdef _WIN32
+    c->event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (c->event == NULL) {
+        fprintf(stderr, "CreateEvent failed\n");
+        sqlite3_close(c->db);
+        return -1;
+    }
+#else
+    c->event_fd = eventfd(0, EFD_CLOEXEC);
+    if (c->event_fd == -1) {
+        perror("eventfd");
+        sqlite3_close(c->db);
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+// one PASSIVE checkpoint, or RESTART once the WAL outgrew CHECKPOINT_RESTART_BYTES; its
+// latency and what is left in the WAL go to the metrics
+void checkpoint_once(struct checkpointer *c)
+{
+    int frames = 0, copied = 0;
+    int restart = c->pending > c->restart_frames;
+    int64_t start = checkpoint_now_us();
+    int res = sqlite3_wal_checkpoint_v2(c->db, NULL, restart ? SQLITE_CHECKPOINT_RESTART : SQLITE_CHECKPOINT_PASSIVE,
+                                        &frames, &copied);
+    uint64_t us = (uint64_t)(checkpoint_now_us() - start);
+
+    struct wal_metrics *m = c->metrics;
+    if (res != SQLITE_OK && res != SQLITE_BUSY) {
+        if (c->failures++ == 0)
+            fprintf(stderr, "Checkpoint failed: %s\n", sqlite3_errmsg(c->db));
+        return;
+    }
+    // -1 frames: the connection is not in WAL mode, nothing was checkpointed
+    if (res == SQLITE_OK && frames < 0) {
+        if (c->failures++ == 0)
+            fprintf(stderr, "Checkpoint failed: the database is not in WAL mode\n");
+        return;
+    }
+    c->pending = frames;
+    if (restart && res == SQLITE_OK)
+        c->restarts++;
+    atomic_store_explicit(&m->wal_frames, frames > 0 ? (uint64_t)frames : 0, memory_order_relaxed);
+    atomic_store_explicit(&m->copied_frames, copied > 0 ? (uint64_t)copied : 0, memory_order_relaxed);
+    atomic_store_explicit(&m->wal_bytes, checkpoint_wal_bytes(c->wal_path), memory_order_relaxed);
+    if (res == SQLITE_BUSY || copied < frames)
+        atomic_fetch_add_explicit(&m->busy, 1, memory_order_relaxed);
+    atomic_store_explicit(&m->last_us, us, memory_order_relaxed);
+    if (us > atomic_load_explicit(&m->max_us, memory_order_relaxed))
+        atomic_store_explicit(&m->max_us, us, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->total_us, us, memory_order_relaxed);
+    atomic_fetch_add_explicit(&m->checkpoints, 1, memory_order_relaxed);
+}
+
+// checkpoints every CHECKPOINT_INTERVAL_MS until checkpointer_stop, then a last one
+void checkpointer_run(struct checkpointer *c)
+{
+    for (;;) {
+#ifdef _WIN32
+        if (WaitForSingleObject(c->event, CHECKPOINT_INTERVAL_MS) == WAIT_OBJECT_0)
+            break;
+#else
+        struct pollfd pfd = {c->event_fd, POLLIN, 0};
+        if (poll(&pfd, 1, CHECKPOINT_INTERVAL_MS) > 0)
+            break;
+#endif
+        checkpoint_once(c);
+    }
+    checkpoint_once(c);
+}
+
+void checkpointer_stop(struct checkpointer *c)
+{
+#ifdef _WIN32
+    SetEvent(c->event);
+#else
+    uint64_t one = 1;
+    if (write(c->event_fd, &one, sizeof(one)) == -1)
+        perror("write (checkpointer)");
+#endif
+}
+
+void checkpointer_close(struct checkpointer *c)
+{
+#ifdef _WIN32
+    CloseHandle(c->event);
+#else
+    close(c->event_fd);
+#endif
+    sqlite3_close(c->db);
+}
+
+void checkpointer_print_stats(const struct checkpointer *c)
+{
+    const struct wal_metrics *m = c->metrics;
+    uint64_t n = atomic_load(&m->checkpoints);
+    printf("checkpoint: %llu run, %lu restarts, %llu stopped by readers, %lu failed, latency avg %.1f us, max %llu us, "
+           "wal %llu bytes\n",
+           (unsigned long long)n, c->restarts, (unsigned long long)atomic_load(&m->busy), c->failures,
+           n ? (double)atomic_load(&m->total_us) / n : 0.0, (unsigned long long)atomic_load(&m->max_us),
+           (unsigned long long)atomic_load(&m->wal_bytes));
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "sqlite3.h"
+#include "calendar.h"
+#include "vclock.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// read side of temp.cgi: the server runs one request at a time and each in its own process,
+// so the pool is a single read-only connection shared by every section of a page, opened on
+// first use, with its prepared statements kept until db_close_reader
+#define DB_PATH "temperature.db"
+#define DB_STATEMENT_CACHE 32
+
+struct db_cached_statement {
+    char *sql;
+    sqlite3_stmt *stmt;
+};
+
+struct db_reader {
+    sqlite3 *db;
+    struct db_cached_statement cache[DB_STATEMENT_CACHE];
+    int count;
+    int next_evict;
+};
+
+static struct db_reader db_reader_state;
+
+// the shared read-only connection, NULL if the db cannot be opened
+sqlite3 *db_reader()
+{
+    struct db_reader *r = &db_reader_state;
+    if (r->db != NULL)
+        return r->db;
+    if (sqlite3_open_v2(DB_PATH, &r->db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(r->db));
+        sqlite3_close(r->db);
+        r->db = NULL;
+    }
+    return r->db;
+}
+
+// prepared statement for sql, reused when the same text was prepared before; callers
+// sqlite3_reset it when done so no read transaction stays open and holds back checkpoints
+sqlite3_stmt *db_statement(sqlite3 *db, const char *sql)
+{
+    struct db_reader *r = &db_reader_state;
+    for (int i = 0; i < r->count; ++i) {
+        if (strcmp(r->cache[i].sql, sql) == 0) {
+            sqlite3_reset(r->cache[i].stmt);
+            sqlite3_clear_bindings(r->cache[i].stmt);
+            return r->cache[i].stmt;
+        }
+    }
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v3(db, sql, -1, SQLITE_PREPARE_PERSISTENT, &stmt, 0) != SQLITE_OK) {
+        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
+        return NULL;
+    }
+
+    struct db_cached_statement *slot;
+    if (r->count < DB_STATEMENT_CACHE) {
+        slot = &r->cache[r->count++];
+    } else {
+        slot = &r->cache[r->next_evict];
+        r->next_evict = (r->next_evict + 1) % DB_STATEMENT_CACHE;
+        sqlite3_finalize(slot->stmt);
+        sqlite3_free(slot->sql);
+    }
+    slot->sql = sqlite3_mprintf("%s", sql);
+    slot->stmt = stmt;
+    return stmt;
+}
+
+// "now" of the queries as a local date, so they follow the server's clock
+void db_bind_now(sqlite3_stmt *stmt, int index)
+{
+    char now[20];
+    format_local(vclock_now(), now, sizeof(now));
+    sqlite3_bind_text(stmt, index, now, -1, SQLITE_TRANSIENT);
+}
+
+void db_close_reader()
+{
+    struct db_reader *r = &db_reader_state;
+    for (int i = 0; i < r->count; ++i) {
+        sqlite3_finalize(r->cache[i].stmt);
+        sqlite3_free(r->cache[i].sql);
+    }
+    r->count = 0;
+    r->next_evict = 0;
+    sqlite3_close(r->db);
+    r->db = NULL;
+}
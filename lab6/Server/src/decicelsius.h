@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// canonical sample value: tenths of a degree Celsius in an int16, the resolution the
+// sensors send; INT16_MIN is kept free as "no value" so every valid value can be negated
+typedef int16_t decicelsius;
+
+#define DECI_INVALID INT16_MIN
+#define DECI_MIN (-INT16_MAX)
+#define DECI_MAX INT16_MAX
+#define DECI_MAX_LEN 8   // "-3276.7" and the terminating zero
+
+// parse [+|-]digits[.digits] in [s, end), more than one decimal is rounded half away from
+// zero; no locale, no strtod; -1 if malformed or out of range
+int deci_parse(const char *s, const char *end, decicelsius *out)
+{
+    const char *c = s;
+    int negative = 0;
+    if (c < end && (*c == '-' || *c == '+'))
+        negative = *c++ == '-';
+
+    const char *digits = c;
+    int32_t tenths = 0;
+    while (c < end && *c >= '0' && *c <= '9') {
+        tenths = tenths * 10 + (*c++ - '0');
+        if (tenths > DECI_MAX)
+            return -1;
+    }
+    int integral = (int)(c - digits);
+    tenths *= 10;
+
+    int decimals = 0;
+    if (c < end && *c == '.') {
+        ++c;
+        for (; c < end && *c >= '0' && *c <= '9'; ++c, ++decimals) {
+            if (decimals == 0)
+                tenths += *c - '0';
+            else if (decimals == 1 && *c >= '5')
+                tenths += 1;
+        }
+    }
+    if (c != end || integral + decimals == 0 || tenths > DECI_MAX)
+        return -1;
+
+    *out = (decicelsius)(negative ? -tenths : tenths);
+    return 0;
+}
+
+int deci_parse_str(const char *s, decicelsius *out)
+{
+    const char *end = s;
+    while (*end != '\0')
+        ++end;
+    return deci_parse(s, end, out);
+}
+
+// "-12.3", always one decimal; out needs DECI_MAX_LEN bytes, returns the length without the zero
+int deci_format(decicelsius value, char *out)
+{
+    int32_t v = value;
+    char digits[8];
+    int n = 0, len = 0;
+    if (v < 0) {
+        out[len++] = '-';
+        v = -v;
+    }
+    do {
+        digits[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v > 0 || n < 2);
+
+    while (n > 1)
+        out[len++] = digits[--n];
+    out[len++] = '.';
+    out[len++] = digits[0];
+    out[len] = '\0';
+    return len;
+}
+
+double deci_to_double(decicelsius value)
+{
+    return value / 10.0;
+}
+
+// nearest value, clamped to the valid range
+decicelsius deci_from_double(double value)
+{
+    double tenths = value * 10.0;
+    tenths += tenths < 0 ? -0.5 : 0.5;
+    if (tenths >= DECI_MAX)
+        return DECI_MAX;
+    if (tenths <= DECI_MIN)
+        return DECI_MIN;
+    return (decicelsius)(int32_t)tenths;
+}
@@ -0,0 +1,350 @@
+#pragma once
+
+#include "sqlite3.h"
+#include "calendar.h"
+#include "policy.h"
+#include "raw.h"
+#include "dbconn.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+// rows of one sensor and tier within [from, to), streamed out of one statement per source
+// (raw samples read the tsdb blocks between two temp_all ranges): memory stays at one
+// output buffer (and one column block) however long the range is
+//
+// csv: "sensor_id,date,temp,samples" header, one row per line
+// columnar: [export_header] then blocks of [export_block][time_ms x rows][temp x rows][samples x rows],
+// little endian, a block of 0 rows ends the file so a cut stream is detectable
+#define EXPORT_BUFFER (1 << 20)
+#define EXPORT_BLOCK_ROWS 65536
+#define EXPORT_MAGIC 0x58453654u   // "T6EX"
+#define EXPORT_VERSION 1
+
+enum export_format { EXPORT_CSV, EXPORT_COLUMNAR };
+
+struct export_header {
+    uint32_t magic;
+    uint32_t version;
+    int32_t sensor_id;
+    int32_t resolution;   // seconds per bucket, 0 for raw samples
+};
+
+struct export_block {
+    uint32_t rows;
+    uint32_t reserved;
+};
+
+struct export_request {
+    int sensor_id;
+    const struct tier *tier;
+    int64_t from;   // wall-clock seconds, [from, to)
+    int64_t to;
+    enum export_format format;
+};
+
+// "2026-10-01", "2026-10-01T12:00" or "2026-10-01 12:00:05" -> wall-clock seconds, -1 if malformed
+int64_t parse_export_date(const char *text)
+{
+    int year, month, day, hour = 0, min = 0, sec = 0, n = 0;
+    if (sscanf(text, "%4d-%2d-%2d%n", &year, &month, &day, &n) != 3)
+        return -1;
+    text += n;
+    if (*text == 'T' || *text == ' ')
+        text++;
+    else if (strncmp(text, "%20", 3) == 0)
+        text += 3;
+    if (*text != '\0' && *text != '&' && sscanf(text, "%2d:%2d:%2d", &hour, &min, &sec) < 2)
+        return -1;
+    if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || min > 59 || sec > 59)
+        return -1;
+    return civil_seconds(year, month, day, hour, min, sec);
+}
+
+// "tier=1h&from=2026-10-01&to=2026-10-02&span=7d&format=bin" of the export route, the range
+// defaults to the span (a day) before now, the tier to raw samples, the format to csv
+int parse_export_query(const char *query, int sensor_id, int64_t span, struct export_request *req)
+{
+    const struct policy *p = current_policy();
+    req->sensor_id = sensor_id;
+    req->tier = &p->tiers[0];
+    req->to = local_wall_seconds(vclock_now()) + 1;
+    req->from = -1;
+    req->format = EXPORT_CSV;
+    if (query == NULL)
+        query = "";
+
+    const char *param = strstr(query, "tier=");
+    if (param != NULL) {
+        char name[8];
+        snprintf(name, sizeof(name), "%.*s", (int)strcspn(param + strlen("tier="), "&"), param + strlen("tier="));
+        req->tier = NULL;
+        for (int i = 0; i < p->count; ++i) {
+            if (strcmp(p->tiers[i].name, name) == 0)
+                req->tier = &p->tiers[i];
+        }
+        if (req->tier == NULL) {
+            fprintf(stderr, "Unknown tier: %s\n", name);
+            return -1;
+        }
+    }
+    param = strstr(query, "to=");
+    if (param != NULL && (req->to = parse_export_date(param + strlen("to="))) == -1) {
+        fprintf(stderr, "Bad date: %s\n", param);
+        return -1;
+    }
+    param = strstr(query, "from=");
+    if (param != NULL && (req->from = parse_export_date(param + strlen("from="))) == -1) {
+        fprintf(stderr, "Bad date: %s\n", param);
+        return -1;
+    }
+    if (req->from == -1)
+        req->from = req->to - span;
+    param = strstr(query, "format=");
+    if (param != NULL && strncmp(param + strlen("format="), "bin", 3) == 0)
+        req->format = EXPORT_COLUMNAR;
+    return 0;
+}
+
+// temperatures are kept to a tenth, printed without snprintf
+static char *export_put_tenths(char *out, double value)
+{
+    long long tenths = llround(value * 10);
+    if (tenths < 0) {
+        *out++ = '-';
+        tenths = -tenths;
+    }
+    char digits[24];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + tenths % 10);
+        tenths /= 10;
+    } while (tenths > 0);
+    if (n == 1)
+        digits[n++] = '0';
+    while (n > 1)
+        *out++ = digits[--n];
+    *out++ = '.';
+    *out++ = digits[0];
+    return out;
+}
+
+static char *export_put_uint(char *out, unsigned long long v)
+{
+    char digits[24];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + v % 10);
+        v /= 10;
+    } while (v > 0);
+    while (n > 0)
+        *out++ = digits[--n];
+    return out;
+}
+
+static double export_now()
+{
+#ifdef _WIN32
+    LARGE_INTEGER freq, counter;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+static int export_write(FILE *out, const void *data, size_t size)
+{
+    if (size > 0 && fwrite(data, 1, size, out) != size) {
+        perror("export write");
+        return -1;
+    }
+    return 0;
+}
+
+static int export_flush_block(FILE *out, uint32_t rows, const int64_t *times, const double *temps, const uint32_t *samples)
+{
+    struct export_block block = {rows, 0};
+    if (export_write(out, &block, sizeof(block)) == -1 ||
+        export_write(out, times, rows * sizeof(int64_t)) == -1 ||
+        export_write(out, temps, rows * sizeof(double)) == -1 ||
+        export_write(out, samples, rows * sizeof(uint32_t)) == -1)
+        return -1;
+    return 0;
+}
+
+// output of one export: rows are formatted into buffer or gathered into column blocks
+struct export_writer {
+    FILE *out;
+    enum export_format format;
+    int sensor_id;
+    char *buffer;
+    size_t used;
+    int64_t *times;
+    double *temps;
+    uint32_t *samples;
+    uint32_t block_rows;
+    int64_t rows;
+    int failed;
+};
+
+// one row, date is its stored text or NULL to print it from wall_ms
+static void export_row(struct export_writer *w, const unsigned char *date, int date_len, int64_t wall_ms,
+                       double temp, uint32_t count)
+{
+    if (w->failed)
+        return;
+    w->rows++;
+
+    if (w->format == EXPORT_COLUMNAR) {
+        if (date != NULL) {
+            if (date_len < 19)
+                return;
+            wall_ms = parse_wall_ms(date, date_len);
+        }
+        w->times[w->block_rows] = wall_ms;
+        w->temps[w->block_rows] = temp;
+        w->samples[w->block_rows] = count;
+        if (++w->block_rows == EXPORT_BLOCK_ROWS) {
+            w->failed = export_flush_block(w->out, w->block_rows, w->times, w->temps, w->samples);
+            w->block_rows = 0;
+        }
+        return;
+    }
+
+    char formatted[24];
+    if (date == NULL) {
+        date = (const unsigned char*)format_wall_ms(wall_ms, formatted);
+        date_len = 23;
+    }
+    // a row is at most ~80 bytes, flush before the buffer could overflow
+    if (w->used + 128 + (size_t)date_len > EXPORT_BUFFER) {
+        w->failed = export_write(w->out, w->buffer, w->used);
+        w->used = 0;
+    }
+    char *p = export_put_uint(w->buffer + w->used, (unsigned long long)w->sensor_id);
+    *p++ = ',';
+    memcpy(p, date, (size_t)date_len);
+    p += date_len;
+    *p++ = ',';
+    p = export_put_tenths(p, temp);
+    *p++ = ',';
+    p = export_put_uint(p, count);
+    *p++ = '\n';
+    w->used = (size_t)(p - w->buffer);
+}
+
+static void export_raw_sample(int64_t wall_ms, double temp, void *ctx)
+{
+    export_row((struct export_writer*)ctx, NULL, 0, wall_ms, temp, 1);
+}
+
+// rows of a tier table, one statement in date order
+static int export_tier_rows(sqlite3 *db, const struct export_request *req, struct export_writer *w)
+{
+    char sql[256];
+    snprintf(sql, sizeof(sql),
+        "SELECT date, avg_temp, samples FROM %s WHERE sensor_id = ?1 AND date >= ?2 AND date < ?3 ORDER BY date;",
+        req->tier->table);
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK) {
+        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    char from_date[20], to_date[20];
+    format_wall(req->from, from_date, sizeof(from_date));
+    format_wall(req->to, to_date, sizeof(to_date));
+    sqlite3_bind_int(stmt, 1, req->sensor_id);
+    sqlite3_bind_text(stmt, 2, from_date, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, to_date, -1, SQLITE_STATIC);
+
+    int res;
+    while (!w->failed && (res = sqlite3_step(stmt)) == SQLITE_ROW) {
+        export_row(w, sqlite3_column_text(stmt, 0), sqlite3_column_bytes(stmt, 0), 0,
+                   sqlite3_column_double(stmt, 1), (uint32_t)sqlite3_column_int64(stmt, 2));
+    }
+    if (!w->failed && res != SQLITE_DONE) {
+        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
+        w->failed = 1;
+    }
+    sqlite3_finalize(stmt);
+    return w->failed ? -1 : 0;
+}
+
+// stream the requested rows oldest first, raw samples from the tsdb with the open tail from
+// temp_all; returns the row count or -1
+int64_t export_range(sqlite3 *db, const struct export_request *req, FILE *out)
+{
+    static char buffer[EXPORT_BUFFER];
+    static int64_t times[EXPORT_BLOCK_ROWS];
+    static double temps[EXPORT_BLOCK_ROWS];
+    static uint32_t samples[EXPORT_BLOCK_ROWS];
+    struct export_writer w = {out, req->format, req->sensor_id, buffer, 0, times, temps, samples, 0, 0, 0};
+
+    if (req->format == EXPORT_CSV) {
+        w.used = (size_t)snprintf(buffer, sizeof(buffer), "sensor_id,date,temp,samples\n");
+    } else {
+        struct export_header header = {EXPORT_MAGIC, EXPORT_VERSION, req->sensor_id, req->tier->resolution};
+        w.failed = export_write(out, &header, sizeof(header));
+    }
+
+    if (!w.failed && req->tier->resolution == 0) {
+        struct raw_source raw;
+        raw_open(&raw, req->sensor_id);
+        if (raw_scan(db, &raw, req->from, req->to, export_raw_sample, &w) == -1)
+            w.failed = 1;
+        raw_close(&raw);
+    } else if (!w.failed) {
+        export_tier_rows(db, req, &w);
+    }
+
+    if (!w.failed && req->format == EXPORT_CSV)
+        w.failed = export_write(out, buffer, w.used);
+    if (!w.failed && req->format == EXPORT_COLUMNAR) {
+        if (w.block_rows > 0)
+            w.failed = export_flush_block(out, w.block_rows, times, temps, samples);
+        if (!w.failed)
+            w.failed = export_flush_block(out, 0, times, temps, samples);
+    }
+    if (!w.failed && fflush(out) != 0) {
+        perror("export write");
+        w.failed = 1;
+    }
+    return w.failed ? -1 : w.rows;
+}
+
+// export route of temp.cgi: the data is the whole response, throughput goes to the server log
+int print_export(const char *query, int sensor_id, int64_t span)
+{
+    struct export_request req;
+    if (parse_export_query(query, sensor_id, span, &req) == -1)
+        return 1;
+
+    sqlite3 *db = db_reader();
+    if (db == NULL)
+        return 1;
+#ifdef _WIN32
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    double t0 = export_now();
+    int64_t rows = export_range(db, &req, stdout);
+    double sec = export_now() - t0;
+    if (rows == -1)
+        return 1;
+    fprintf(stderr, "export: %lld rows of %s in %.3f s (%.2f M rows/s)\n",
+            (long long)rows, req.tier->resolution == 0 ? "tsdb" : req.tier->table, sec, sec > 0 ? rows / sec / 1e6 : 0.0);
+    return 0;
+}
@@ -2,6 +2,10 @@
 
 #include <stdio.h>
 #include "sqlite3.h"
+#include "calendar.h"
+#include "live.h"
+#include "policy.h"
+#include "dbconn.h"
 #include <string.h>
 #include <json-c/json.h>
 
@@ -33,40 +37,71 @@ void print_html_header()
     printf("<body>\n");
 }
 
-void print_html_navigation()
+void print_html_navigation(int sensor_id)
 {
     printf("<nav class=\"navigation\">\n");
-    printf("<a href=\"/secondly_1min\">Last 5 Minutes</a>\n");
-    printf("<a href=\"/hourly_day\">Hourly Average</a>\n");
-    printf("<a href=\"/daily_week\">Daily Average</a>\n");
+    printf("<a href=\"/secondly_1min?sensor=%d\">Last 5 Minutes</a>\n", sensor_id);
+    printf("<a href=\"/hourly_day?sensor=%d\">Hourly Average</a>\n", sensor_id);
+    printf("<a href=\"/daily_week?sensor=%d\">Daily Average</a>\n", sensor_id);
+    printf("<a href=\"/percentiles?sensor=%d\">Percentiles</a>\n", sensor_id);
+    printf("<a href=\"/window?sensor=%d\">Window</a>\n", sensor_id);
     printf("</nav>\n");
 }
 
-void print_daily_navigation(const char *active_page)
+void print_sensor_navigation(const char *active_page, int sensor_id)
+{
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+
+    db = db_reader();
+    if (db == NULL) {
+        exit(1);
+    }
+
+    const char *sql = "SELECT id, name FROM sensors ORDER BY id;";
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
+        exit(1);
+    }
+
+    const char *page = (active_page == NULL || strcmp(active_page, "/") == 0) ? "/" : active_page;
+
+    printf("<div class=\"navigation\">\n");
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        int id = sqlite3_column_int(stmt, 0);
+        const char *name = (const char *)sqlite3_column_text(stmt, 1);
+        printf("<a href=\"%s?sensor=%d\" class=\"%s\">%s</a>\n", page, id, id == sensor_id ? "active" : "", name ? name : "");
+    }
+    printf("</div>\n");
+
+    sqlite3_reset(stmt);
+}
+
+void print_daily_navigation(const char *active_page, int sensor_id)
 {
     printf("<div class=\"navigation\">\n");
-    printf("<a href=\"/daily_week\" class=\"%s\">week</a>\n", strcmp(active_page, "/daily_week") == 0 ? "active" : "");
-    printf("<a href=\"/daily_month\" class=\"%s\">month</a>\n", strcmp(active_page, "/daily_month") == 0 ? "active" : "");
-    printf("<a href=\"/daily_3month\" class=\"%s\">3 months</a>\n", strcmp(active_page, "/daily_3month") == 0 ? "active" : "");
-    printf("<a href=\"/daily_6month\" class=\"%s\">6 months</a>\n", strcmp(active_page, "/daily_6month") == 0 ? "active" : "");
-    printf("<a href=\"/daily_year\" class=\"%s\">year</a>\n", strcmp(active_page, "/daily_year") == 0 ? "active" : "");
+    printf("<a href=\"/daily_week?sensor=%d\" class=\"%s\">week</a>\n", sensor_id, strcmp(active_page, "/daily_week") == 0 ? "active" : "");
+    printf("<a href=\"/daily_month?sensor=%d\" class=\"%s\">month</a>\n", sensor_id, strcmp(active_page, "/daily_month") == 0 ? "active" : "");
+    printf("<a href=\"/daily_3month?sensor=%d\" class=\"%s\">3 months</a>\n", sensor_id, strcmp(active_page, "/daily_3month") == 0 ? "active" : "");
+    printf("<a href=\"/daily_6month?sensor=%d\" class=\"%s\">6 months</a>\n", sensor_id, strcmp(active_page, "/daily_6month") == 0 ? "active" : "");
+    printf("<a href=\"/daily_year?sensor=%d\" class=\"%s\">year</a>\n", sensor_id, strcmp(active_page, "/daily_year") == 0 ? "active" : "");
     printf("</div>\n");
 }
 
-void print_hourly_navigation(const char *active_page)
+void print_hourly_navigation(const char *active_page, int sensor_id)
 {
     printf("<div class=\"navigation\">\n");
-    printf("<a href=\"/hourly_day\" class=\"%s\">Day</a>\n", strcmp(active_page, "/hourly_day") == 0 ? "active" : "");
-    printf("<a href=\"/hourly_week\" class=\"%s\">Week</a>\n", strcmp(active_page, "/hourly_week") == 0 ? "active" : "");
-    printf("<a href=\"/hourly_month\" class=\"%s\">Month</a>\n", strcmp(active_page, "/hourly_month") == 0 ? "active" : "");
+    printf("<a href=\"/hourly_day?sensor=%d\" class=\"%s\">Day</a>\n", sensor_id, strcmp(active_page, "/hourly_day") == 0 ? "active" : "");
+    printf("<a href=\"/hourly_week?sensor=%d\" class=\"%s\">Week</a>\n", sensor_id, strcmp(active_page, "/hourly_week") == 0 ? "active" : "");
+    printf("<a href=\"/hourly_month?sensor=%d\" class=\"%s\">Month</a>\n", sensor_id, strcmp(active_page, "/hourly_month") == 0 ? "active" : "");
     printf("</div>\n");
 }
 
-void print_secondly_navigation(const char *active_page)
+void print_secondly_navigation(const char *active_page, int sensor_id)
 {
     printf("<div class=\"navigation\">\n");
-    printf("<a href=\"/secondly_1min\" class=\"%s\">1 min</a>\n", strcmp(active_page, "/secondly_1min") == 0 ? "active" : "");
-    printf("<a href=\"/secondly_5min\" class=\"%s\">5 min</a>\n", strcmp(active_page, "/secondly_5min") == 0 ? "active" : "");
+    printf("<a href=\"/secondly_1min?sensor=%d\" class=\"%s\">1 min</a>\n", sensor_id, strcmp(active_page, "/secondly_1min") == 0 ? "active" : "");
+    printf("<a href=\"/secondly_5min?sensor=%d\" class=\"%s\">5 min</a>\n", sensor_id, strcmp(active_page, "/secondly_5min") == 0 ? "active" : "");
     printf("</div>\n");
 }
 
@@ -76,74 +111,85 @@ void print_html_footer()
     printf("</html>\n");
 }
 
-void print_current_temperature()
+void print_current_block(decicelsius curr_temp)
+{
+    char temp[DECI_MAX_LEN];
+    deci_format(curr_temp, temp);
+    printf("<div class=\"container\">\n");
+    printf("<h1>Temperature Dashboard</h1>\n");
+    printf("<p class=\"current-temp\">Current Temperature: %s &deg;C</p>\n", temp);
+    printf("</div>\n");
+}
+
+void print_current_temperature(int sensor_id)
 {
+    // newest sample straight from the server's shared memory, SQL only if it is not running
+    struct live_sample last;
+    if (live_read_last(sensor_id, &last, 1) > 0) {
+        print_current_block(last.value);
+        return;
+    }
+
     sqlite3 *db;
     sqlite3_stmt *stmt;
     char *err_msg = 0;
 
-    int res = sqlite3_open("temperature.db", &db);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+    db = db_reader();
+    if (db == NULL) {
         exit(1);
     }
 
-    const char *sql = "SELECT temp FROM temp_all ORDER BY date DESC LIMIT 1;";
-    res = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
+    const char *sql = "SELECT temp FROM temp_all WHERE sensor_id = ? ORDER BY date DESC LIMIT 1;";
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
         exit(1);
     }
+    sqlite3_bind_int(stmt, 1, sensor_id);
 
-    double curr_temp = 0.0;
+    decicelsius curr_temp = 0;
     if (sqlite3_step(stmt) == SQLITE_ROW) {
-        curr_temp = sqlite3_column_double(stmt, 0);
+        curr_temp = deci_from_double(sqlite3_column_double(stmt, 0));
     }
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    sqlite3_reset(stmt);
 
-    printf("<div class=\"container\">\n");
-    printf("<h1>Temperature Dashboard</h1>\n");
-    printf("<p class=\"current-temp\">Current Temperature: %.1f &deg;C</p>\n", curr_temp);
-    printf("</div>\n");
+    print_current_block(curr_temp);
 }
 
-void print_daily_week(const char *active_page)
+void print_daily_week(const char *active_page, int sensor_id)
 {
     sqlite3 *db;
     sqlite3_stmt *stmt;
 
-    int res = sqlite3_open("temperature.db", &db);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+    db = db_reader();
+    if (db == NULL) {
         exit(1);
     }
+    open_tier_view(db, "daily", sensor_id, SEC_IN_DAY, 7 * SEC_IN_DAY);
 
     const char *sql =
     "WITH numbered_data AS ("
     "    SELECT ROW_NUMBER() OVER (ORDER BY date DESC) AS row_num, "
     "           strftime('%Y-%m-%d', date) AS date, "
     "           avg_temp "
-    "    FROM temp_day "
+    "    FROM daily "
+    "    WHERE sensor_id = ? "
     ") "
     "SELECT row_num, date, avg_temp "
     "FROM numbered_data "
     "ORDER BY row_num "
     "LIMIT 7;";
 
-    res = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
         exit(1);
     }
+    sqlite3_bind_int(stmt, 1, sensor_id);
 
     printf("<div class=\"container\">\n");
     printf("<h2>Daily Average Temperature</h2>\n");
     printf("<table style=\"border-collapse: collapse; width: 100%;\">\n");
 
-    print_daily_navigation(active_page);
+    print_daily_navigation(active_page, sensor_id);
 
     printf("<thead><tr style=\"background-color: #0078D7; color: white;\">\n");
     printf("<th style=\"text-align:left; padding: 10px; border: 1px solid #ddd;\">#</th>");
@@ -168,45 +214,44 @@ void print_daily_week(const char *active_page)
     printf("</table>\n");
     printf("</div>\n");
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    sqlite3_reset(stmt);
 }
 
-void print_daily_month(const char *active_page)
+void print_daily_month(const char *active_page, int sensor_id)
 {
     sqlite3 *db;
     sqlite3_stmt *stmt;
 
-    int res = sqlite3_open("temperature.db", &db);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+    db = db_reader();
+    if (db == NULL) {
         exit(1);
     }
+    open_tier_view(db, "daily", sensor_id, SEC_IN_DAY, 30 * SEC_IN_DAY);
 
     const char *sql =
     "WITH numbered_data AS ("
     "    SELECT ROW_NUMBER() OVER (ORDER BY date DESC) AS row_num, "
     "           strftime('%Y-%m-%d', date) AS date, "
     "           avg_temp "
-    "    FROM temp_day "
+    "    FROM daily "
+    "    WHERE sensor_id = ? "
     ") "
     "SELECT row_num, date, avg_temp "
     "FROM numbered_data "
     "ORDER BY row_num "
     "LIMIT 30;";
 
-    res = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
         exit(1);
     }
+    sqlite3_bind_int(stmt, 1, sensor_id);
 
     printf("<div class=\"container\">\n");
     printf("<h2>Daily Average Temperature</h2>\n");
     printf("<table style=\"border-collapse: collapse; width: 100%;\">\n");
 
-    print_daily_navigation(active_page);
+    print_daily_navigation(active_page, sensor_id);
 
     printf("<thead><tr style=\"background-color: #0078D7; color: white;\">\n");
     printf("<th style=\"text-align:left; padding: 10px; border: 1px solid #ddd;\">#</th>");
@@ -231,45 +276,44 @@ void print_daily_month(const char *active_page)
     printf("</table>\n");
     printf("</div>\n");
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    sqlite3_reset(stmt);
 }
 
-void print_daily_3month(const char *active_page)
+void print_daily_3month(const char *active_page, int sensor_id)
 {
     sqlite3 *db;
     sqlite3_stmt *stmt;
 
-    int res = sqlite3_open("temperature.db", &db);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+    db = db_reader();
+    if (db == NULL) {
         exit(1);
     }
+    open_tier_view(db, "daily", sensor_id, SEC_IN_DAY, 90 * SEC_IN_DAY);
 
     const char *sql =
     "WITH numbered_data AS ("
     "    SELECT ROW_NUMBER() OVER (ORDER BY date DESC) AS row_num, "
     "           strftime('%Y-%m-%d', date) AS date, "
     "           avg_temp "
-    "    FROM temp_day "
+    "    FROM daily "
+    "    WHERE sensor_id = ? "
     ") "
     "SELECT row_num, date, avg_temp "
     "FROM numbered_data "
     "ORDER BY row_num "
     "LIMIT 90;";
 
-    res = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
         exit(1);
     }
+    sqlite3_bind_int(stmt, 1, sensor_id);
 
     printf("<div class=\"container\">\n");
     printf("<h2>Daily Average Temperature</h2>\n");
     printf("<table style=\"border-collapse: collapse; width: 100%;\">\n");
 
-    print_daily_navigation(active_page);
+    print_daily_navigation(active_page, sensor_id);
 
     printf("<thead><tr style=\"background-color: #0078D7; color: white;\">\n");
     printf("<th style=\"text-align:left; padding: 10px; border: 1px solid #ddd;\">#</th>");
@@ -294,45 +338,44 @@ void print_daily_3month(const char *active_page)
     printf("</table>\n");
     printf("</div>\n");
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    sqlite3_reset(stmt);
 }
 
-void print_daily_6month(const char *active_page)
+void print_daily_6month(const char *active_page, int sensor_id)
 {
     sqlite3 *db;
     sqlite3_stmt *stmt;
 
-    int res = sqlite3_open("temperature.db", &db);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+    db = db_reader();
+    if (db == NULL) {
         exit(1);
     }
+    open_tier_view(db, "daily", sensor_id, SEC_IN_DAY, 180 * SEC_IN_DAY);
 
     const char *sql =
     "WITH numbered_data AS ("
     "    SELECT ROW_NUMBER() OVER (ORDER BY date DESC) AS row_num, "
     "           strftime('%Y-%m-%d', date) AS date, "
     "           avg_temp "
-    "    FROM temp_day "
+    "    FROM daily "
+    "    WHERE sensor_id = ? "
     ") "
     "SELECT row_num, date, avg_temp "
     "FROM numbered_data "
     "ORDER BY row_num "
     "LIMIT 180;";
 
-    res = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
         exit(1);
     }
+    sqlite3_bind_int(stmt, 1, sensor_id);
 
     printf("<div class=\"container\">\n");
     printf("<h2>Daily Average Temperature</h2>\n");
     printf("<table style=\"border-collapse: collapse; width: 100%;\">\n");
 
-    print_daily_navigation(active_page);
+    print_daily_navigation(active_page, sensor_id);
 
     printf("<thead><tr style=\"background-color: #0078D7; color: white;\">\n");
     printf("<th style=\"text-align:left; padding: 10px; border: 1px solid #ddd;\">#</th>");
@@ -357,45 +400,44 @@ void print_daily_6month(const char *active_page)
     printf("</table>\n");
     printf("</div>\n");
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    sqlite3_reset(stmt);
 }
 
-void print_daily_year(const char *active_page)
+void print_daily_year(const char *active_page, int sensor_id)
 {
     sqlite3 *db;
     sqlite3_stmt *stmt;
 
-    int res = sqlite3_open("temperature.db", &db);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+    db = db_reader();
+    if (db == NULL) {
         exit(1);
     }
+    open_tier_view(db, "daily", sensor_id, SEC_IN_DAY, 366 * SEC_IN_DAY);
 
     const char *sql =
     "WITH numbered_data AS ("
     "    SELECT ROW_NUMBER() OVER (ORDER BY date DESC) AS row_num, "
     "           strftime('%Y-%m-%d', date) AS date, "
     "           avg_temp "
-    "    FROM temp_day "
+    "    FROM daily "
+    "    WHERE sensor_id = ? "
     ") "
     "SELECT row_num, date, avg_temp "
     "FROM numbered_data "
     "ORDER BY row_num "
     "LIMIT 366;";
 
-    res = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
         exit(1);
     }
+    sqlite3_bind_int(stmt, 1, sensor_id);
 
     printf("<div class=\"container\">\n");
     printf("<h2>Daily Average Temperature</h2>\n");
     printf("<table style=\"border-collapse: collapse; width: 100%;\">\n");
 
-    print_daily_navigation(active_page);
+    print_daily_navigation(active_page, sensor_id);
 
     printf("<thead><tr style=\"background-color: #0078D7; color: white;\">\n");
     printf("<th style=\"text-align:left; padding: 10px; border: 1px solid #ddd;\">#</th>");
@@ -420,45 +462,44 @@ void print_daily_year(const char *active_page)
     printf("</table>\n");
     printf("</div>\n");
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    sqlite3_reset(stmt);
 }
 
-void print_hourly_month_avg(const char *active_page)
+void print_hourly_month_avg(const char *active_page, int sensor_id)
 {
     sqlite3 *db;
     sqlite3_stmt *stmt;
     char *err_msg = 0;
 
-    int res = sqlite3_open("temperature.db", &db);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+    db = db_reader();
+    if (db == NULL) {
         exit(1);
     }
+    open_tier_view(db, "hourly", sensor_id, SEC_IN_HOUR, 31 * SEC_IN_DAY);
 
     const char *sql =
     "WITH numbered_data AS ("
     "    SELECT ROW_NUMBER() OVER (ORDER BY date DESC) AS row_num, "
     "           strftime('%Y-%m-%d %H:%M:%S', date) AS datetime, "
     "           avg_temp "
-    "    FROM temp_hour "
+    "    FROM hourly "
+    "    WHERE sensor_id = ? "
     ") "
     "SELECT row_num, datetime, avg_temp "
     "FROM numbered_data "
     "ORDER BY row_num;";
 
-    res = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
         exit(1);
     }
+    sqlite3_bind_int(stmt, 1, sensor_id);
 
     printf("<div class=\"container\">\n");
     printf("<h2>Hourly Average Temperature</h2>\n");
     printf("<table style=\"border-collapse: collapse; width: 100%;\">\n");
 
-    print_hourly_navigation(active_page);
+    print_hourly_navigation(active_page, sensor_id);
 
     printf("<thead><tr style=\"background-color: #0078D7; color: white;\">\n");
     printf("<th style=\"text-align:left; padding: 10px; border: 1px solid #ddd;\">#</th>");
@@ -484,46 +525,45 @@ void print_hourly_month_avg(const char *active_page)
     printf("</table>\n");
     printf("</div>\n");
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    sqlite3_reset(stmt);
 }
 
-void print_hourly_day_avg(const char *active_page)
+void print_hourly_day_avg(const char *active_page, int sensor_id)
 {
     sqlite3 *db;
     sqlite3_stmt *stmt;
     char *err_msg = 0;
 
-    int res = sqlite3_open("temperature.db", &db);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+    db = db_reader();
+    if (db == NULL) {
         exit(1);
     }
+    open_tier_view(db, "hourly", sensor_id, SEC_IN_HOUR, SEC_IN_DAY);
 
     const char *sql =
     "WITH numbered_data AS ("
     "    SELECT ROW_NUMBER() OVER (ORDER BY date DESC) AS row_num, "
     "           strftime('%Y-%m-%d %H:%M:%S', date) AS datetime, "
     "           avg_temp "
-    "    FROM temp_hour "
+    "    FROM hourly "
+    "    WHERE sensor_id = ? "
     ") "
     "SELECT row_num, datetime, avg_temp "
     "FROM numbered_data "
     "ORDER BY row_num "
     "LIMIT 24;";
 
-    res = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
         exit(1);
     }
+    sqlite3_bind_int(stmt, 1, sensor_id);
 
     printf("<div class=\"container\">\n");
     printf("<h2>Hourly Average Temperature</h2>\n");
     printf("<table style=\"border-collapse: collapse; width: 100%;\">\n");
 
-    print_hourly_navigation(active_page);
+    print_hourly_navigation(active_page, sensor_id);
 
     printf("<thead><tr style=\"background-color: #0078D7; color: white;\">\n");
     printf("<th style=\"text-align:left; padding: 10px; border: 1px solid #ddd;\">#</th>");
@@ -549,46 +589,45 @@ void print_hourly_day_avg(const char *active_page)
     printf("</table>\n");
     printf("</div>\n");
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    sqlite3_reset(stmt);
 }
 
-void print_hourly_week_avg(const char *active_page)
+void print_hourly_week_avg(const char *active_page, int sensor_id)
 {
     sqlite3 *db;
     sqlite3_stmt *stmt;
     char *err_msg = 0;
 
-    int res = sqlite3_open("temperature.db", &db);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+    db = db_reader();
+    if (db == NULL) {
         exit(1);
     }
+    open_tier_view(db, "hourly", sensor_id, SEC_IN_HOUR, 7 * SEC_IN_DAY);
 
     const char *sql =
     "WITH numbered_data AS ("
     "    SELECT ROW_NUMBER() OVER (ORDER BY date DESC) AS row_num, "
     "           strftime('%Y-%m-%d %H:%M:%S', date) AS datetime, "
     "           avg_temp "
-    "    FROM temp_hour "
+    "    FROM hourly "
+    "    WHERE sensor_id = ? "
     ") "
     "SELECT row_num, datetime, avg_temp "
     "FROM numbered_data "
     "ORDER BY row_num "
     "LIMIT 168;";
 
-    res = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
         exit(1);
     }
+    sqlite3_bind_int(stmt, 1, sensor_id);
 
     printf("<div class=\"container\">\n");
     printf("<h2>Hourly Average Temperature</h2>\n");
     printf("<table style=\"border-collapse: collapse; width: 100%;\">\n");
 
-    print_hourly_navigation(active_page);
+    print_hourly_navigation(active_page, sensor_id);
 
     printf("<thead><tr style=\"background-color: #0078D7; color: white;\">\n");
     printf("<th style=\"text-align:left; padding: 10px; border: 1px solid #ddd;\">#</th>");
@@ -613,19 +652,65 @@ void print_hourly_week_avg(const char *active_page)
     printf("</table>\n");
     printf("</div>\n");
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    sqlite3_reset(stmt);
+}
+
+// newest first, same table as the SQL version
+void print_live_secondly(const char *title, const char *active_page, int sensor_id,
+                         const struct live_sample *samples, int count)
+{
+    printf("<div class=\"container\">\n");
+    printf("<h2>%s</h2>\n", title);
+
+    struct live_stats stats;
+    if (live_read_summary(sensor_id, count, &stats) > 0)
+        printf("<p>Min %.1f °C, average %.2f °C, max %.1f °C, standard deviation %.2f °C over %d samples</p>\n",
+               stats.min, stats.mean, stats.max, stats.stddev, stats.count);
+
+    printf("<table style=\"border-collapse: collapse; width: 100%%;\">\n");
+
+    print_secondly_navigation(active_page, sensor_id);
+
+    printf("<thead><tr style=\"background-color: #0078D7; color: white;\">\n");
+    printf("<th style=\"text-align:left; padding: 10px; border: 1px solid #ddd;\">#</th>");
+    printf("<th style=\"text-align:left; padding: 10px; border: 1px solid #ddd;\">Date and Time</th>");
+    printf("<th style=\"text-align:right; padding: 10px; border: 1px solid #ddd;\">Temperature (°C)</th>");
+    printf("</tr></thead>\n");
+
+    printf("<tbody>\n");
+
+    char datetime[32], temp[DECI_MAX_LEN];
+    for (int i = 0; i < count; ++i) {
+        const struct live_sample *sample = &samples[count - 1 - i];
+        format_local(sample->time_ms / 1000, datetime, sizeof(datetime));
+        deci_format(sample->value, temp);
+
+        printf("<tr>\n");
+        printf("<td style=\"padding: 8px; text-align:left; border: 1px solid #ddd;\">%d</td>", i + 1);
+        printf("<td style=\"padding: 8px; text-align:left; border: 1px solid #ddd;\">%s</td>", datetime);
+        printf("<td style=\"padding: 8px; text-align:right; border: 1px solid #ddd;\">%s</td></tr>\n", temp);
+    }
+
+    printf("</tbody>\n");
+    printf("</table>\n");
+    printf("</div>\n");
 }
 
-void print_secondly_minute(const char *active_page)
+void print_secondly_minute(const char *active_page, int sensor_id)
 {
+    struct live_sample samples[60];
+    int count = live_read_last(sensor_id, samples, 60);
+    if (count > 0) {
+        print_live_secondly("Last Minute Temperature Records", active_page, sensor_id, samples, count);
+        return;
+    }
+
     sqlite3 *db;
     sqlite3_stmt *stmt;
     char *err_msg = 0;
 
-    int res = sqlite3_open("temperature.db", &db);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+    db = db_reader();
+    if (db == NULL) {
         exit(1);
     }
 
@@ -635,24 +720,24 @@ void print_secondly_minute(const char *active_page)
     "           strftime('%Y-%m-%d %H:%M:%S', date) AS datetime, "
     "           temp "
     "    FROM temp_all "
+    "    WHERE sensor_id = ? "
     ") "
     "SELECT row_num, datetime, temp "
     "FROM numbered_data "
     "ORDER BY row_num "
     "LIMIT 60;";
 
-    res = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
         exit(1);
     }
+    sqlite3_bind_int(stmt, 1, sensor_id);
 
     printf("<div class=\"container\">\n");
     printf("<h2>Last Minute Temperature Records</h2>\n");
     printf("<table style=\"border-collapse: collapse; width: 100%;\">\n");
 
-    print_secondly_navigation(active_page);
+    print_secondly_navigation(active_page, sensor_id);
 
     printf("<thead><tr style=\"background-color: #0078D7; color: white;\">\n");
     printf("<th style=\"text-align:left; padding: 10px; border: 1px solid #ddd;\">#</th>");
@@ -678,19 +763,24 @@ void print_secondly_minute(const char *active_page)
     printf("</table>\n");
     printf("</div>\n");
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    sqlite3_reset(stmt);
 }
 
-void print_secondly_5minutes(const char *active_page)
+void print_secondly_5minutes(const char *active_page, int sensor_id)
 {
+    struct live_sample samples[300];
+    int count = live_read_last(sensor_id, samples, 300);
+    if (count > 0) {
+        print_live_secondly("Last 5 Minutes Temperature Records", active_page, sensor_id, samples, count);
+        return;
+    }
+
     sqlite3 *db;
     sqlite3_stmt *stmt;
     char *err_msg = 0;
 
-    int res = sqlite3_open("temperature.db", &db);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+    db = db_reader();
+    if (db == NULL) {
         exit(1);
     }
 
@@ -700,24 +790,24 @@ void print_secondly_5minutes(const char *active_page)
     "           strftime('%Y-%m-%d %H:%M:%S', date) AS datetime, "
     "           temp "
     "    FROM temp_all "
+    "    WHERE sensor_id = ? "
     ") "
     "SELECT row_num, datetime, temp "
     "FROM numbered_data "
     "ORDER BY row_num "
     "LIMIT 300;";
 
-    res = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
         exit(1);
     }
+    sqlite3_bind_int(stmt, 1, sensor_id);
 
     printf("<div class=\"container\">\n");
     printf("<h2>Last 5 Minutes Temperature Records</h2>\n");
     printf("<table style=\"border-collapse: collapse; width: 100%;\">\n");
 
-    print_secondly_navigation(active_page);
+    print_secondly_navigation(active_page, sensor_id);
 
     printf("<thead><tr style=\"background-color: #0078D7; color: white;\">\n");
     printf("<th style=\"text-align:left; padding: 10px; border: 1px solid #ddd;\">#</th>");
@@ -743,6 +833,153 @@ void print_secondly_5minutes(const char *active_page)
     printf("</table>\n");
     printf("</div>\n");
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    sqlite3_reset(stmt);
+}
+
+void print_percentile_navigation(int64_t span, int sensor_id)
+{
+    static const char *spans[] = {"1d", "7d", "30d", "365d"};
+    static const char *names[] = {"Day", "Week", "Month", "Year"};
+    printf("<div class=\"navigation\">\n");
+    for (int i = 0; i < 4; ++i) {
+        printf("<a href=\"/percentiles?sensor=%d&span=%s\" class=\"%s\">%s</a>\n",
+               sensor_id, spans[i], parse_duration(spans[i]) == span ? "active" : "", names[i]);
+    }
+    printf("</div>\n");
+}
+
+// percentiles over the last span seconds, merged from rollup sketches
+void print_percentiles(int sensor_id, int64_t span)
+{
+    sqlite3 *db;
+
+    db = db_reader();
+    if (db == NULL) {
+        exit(1);
+    }
+
+    struct percentiles p;
+    if (query_percentiles(db, sensor_id, span, &p) == -1) {
+        exit(1);
+    }
+
+    printf("<div class=\"container\">\n");
+    printf("<h2>Temperature Percentiles</h2>\n");
+    printf("<table style=\"border-collapse: collapse; width: 100%%;\">\n");
+
+    print_percentile_navigation(span, sensor_id);
+
+    printf("<thead><tr style=\"background-color: #0078D7; color: white;\">\n");
+    printf("<th style=\"text-align:left; padding: 10px; border: 1px solid #ddd;\">Since %s (%lld samples, %s tier)</th>",
+           p.from, (long long)p.count, p.tier->name);
+    printf("<th style=\"text-align:right; padding: 10px; border: 1px solid #ddd;\">Temperature (°C)</th>");
+    printf("</tr></thead>\n");
+
+    printf("<tbody>\n");
+    if (p.count > 0) {
+        printf("<tr><td style=\"padding: 8px; text-align:left; border: 1px solid #ddd;\">min</td>");
+        printf("<td style=\"padding: 8px; text-align:right; border: 1px solid #ddd;\">%.1f</td></tr>\n", p.min);
+        for (int i = 0; i < PERCENTILE_COUNT; ++i) {
+            printf("<tr><td style=\"padding: 8px; text-align:left; border: 1px solid #ddd;\">p%d</td>",
+                   (int)(percentile_ranks[i] * 100 + 0.5));
+            printf("<td style=\"padding: 8px; text-align:right; border: 1px solid #ddd;\">%.1f</td></tr>\n", p.values[i]);
+        }
+        printf("<tr><td style=\"padding: 8px; text-align:left; border: 1px solid #ddd;\">max</td>");
+        printf("<td style=\"padding: 8px; text-align:right; border: 1px solid #ddd;\">%.1f</td></tr>\n", p.max);
+    }
+    printf("</tbody>\n");
+    printf("</table>\n");
+    printf("</div>\n");
+}
+
+// wal size and checkpoint latency of the running server
+void print_wal_metrics()
+{
+    printf("<div class=\"container\">\n");
+    printf("<h2>Database</h2>\n");
+
+    struct wal_metrics m;
+    if (live_read_wal(&m) == -1) {
+        printf("<p>Server is not running.</p>\n");
+        printf("</div>\n");
+        return;
+    }
+
+    uint64_t checkpoints = atomic_load(&m.checkpoints);
+    printf("<table style=\"border-collapse: collapse; width: 100%%;\">\n");
+    printf("<tbody>\n");
+    printf("<tr><td style=\"padding: 8px; border: 1px solid #ddd;\">WAL size</td>"
+           "<td style=\"padding: 8px; text-align:right; border: 1px solid #ddd;\">%.1f KiB</td></tr>\n",
+           atomic_load(&m.wal_bytes) / 1024.0);
+    printf("<tr><td style=\"padding: 8px; border: 1px solid #ddd;\">WAL frames (copied)</td>"
+           "<td style=\"padding: 8px; text-align:right; border: 1px solid #ddd;\">%llu (%llu)</td></tr>\n",
+           (unsigned long long)atomic_load(&m.wal_frames), (unsigned long long)atomic_load(&m.copied_frames));
+    printf("<tr><td style=\"padding: 8px; border: 1px solid #ddd;\">Checkpoints (stopped by readers)</td>"
+           "<td style=\"padding: 8px; text-align:right; border: 1px solid #ddd;\">%llu (%llu)</td></tr>\n",
+           (unsigned long long)checkpoints, (unsigned long long)atomic_load(&m.busy));
+    printf("<tr><td style=\"padding: 8px; border: 1px solid #ddd;\">Checkpoint latency last / avg / max</td>"
+           "<td style=\"padding: 8px; text-align:right; border: 1px solid #ddd;\">%llu / %llu / %llu us</td></tr>\n",
+           (unsigned long long)atomic_load(&m.last_us),
+           (unsigned long long)(checkpoints ? atomic_load(&m.total_us) / checkpoints : 0),
+           (unsigned long long)atomic_load(&m.max_us));
+    printf("</tbody>\n");
+    printf("</table>\n");
+    printf("</div>\n");
+}
+
+void print_window_navigation(int64_t span, int sensor_id)
+{
+    static const char *spans[] = {"1h", "1d", "7d", "30d"};
+    static const char *names[] = {"Hour", "Day", "Week", "Month"};
+    printf("<div class=\"navigation\">\n");
+    for (int i = 0; i < 4; ++i) {
+        printf("<a href=\"/window?sensor=%d&span=%s\" class=\"%s\">%s</a>\n",
+               sensor_id, spans[i], parse_duration(spans[i]) == span ? "active" : "", names[i]);
+    }
+    printf("</div>\n");
+}
+
+// count, average and extremes over the last span seconds
+void print_window_stats(int sensor_id, int64_t span)
+{
+    sqlite3 *db;
+
+    db = db_reader();
+    if (db == NULL) {
+        exit(1);
+    }
+
+    struct window_stats w;
+    const char *source;
+    if (query_window(db, sensor_id, span, &w, &source) == -1) {
+        exit(1);
+    }
+
+    char from[20];
+    format_wall(w.from * SEC_IN_MINUTE, from, sizeof(from));
+
+    printf("<div class=\"container\">\n");
+    printf("<h2>Window Statistics</h2>\n");
+    printf("<table style=\"border-collapse: collapse; width: 100%%;\">\n");
+
+    print_window_navigation(span, sensor_id);
+
+    printf("<thead><tr style=\"background-color: #0078D7; color: white;\">\n");
+    printf("<th style=\"text-align:left; padding: 10px; border: 1px solid #ddd;\">Since %s (%lld samples, %s)</th>",
+           from, (long long)w.count, source);
+    printf("<th style=\"text-align:right; padding: 10px; border: 1px solid #ddd;\">Temperature (°C)</th>");
+    printf("</tr></thead>\n");
+
+    printf("<tbody>\n");
+    if (w.count > 0) {
+        printf("<tr><td style=\"padding: 8px; text-align:left; border: 1px solid #ddd;\">min</td>");
+        printf("<td style=\"padding: 8px; text-align:right; border: 1px solid #ddd;\">%.1f</td></tr>\n", w.min);
+        printf("<tr><td style=\"padding: 8px; text-align:left; border: 1px solid #ddd;\">average</td>");
+        printf("<td style=\"padding: 8px; text-align:right; border: 1px solid #ddd;\">%.1f</td></tr>\n", w.sum / w.count);
+        printf("<tr><td style=\"padding: 8px; text-align:left; border: 1px solid #ddd;\">max</td>");
+        printf("<td style=\"padding: 8px; text-align:right; border: 1px solid #ddd;\">%.1f</td></tr>\n", w.max);
+    }
+    printf("</tbody>\n");
+    printf("</table>\n");
+    printf("</div>\n");
 }
@@ -0,0 +1,520 @@
+#include "sqlite3.h"
+#include "calendar.h"
+#include "policy.h"
+#include "sketch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <unistd.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#endif
+
+// lab4 logs: "YYYY-MM-DD HH:MM:SS.mmm V.V" padded with spaces to 35 bytes and '\n'.
+// Current versions map each log as a ring of preallocated slots behind a header page that
+// holds the cursor (log_day.txt is emptied every year); older ones wrote the records from
+// offset 0, log.txt and log_hour.txt as rings whose cursors are the two lines of tmp/tmp.txt
+#define LAB4_RECORD_LENGTH 36
+#define LAB4_MAGIC "LAB4LOG1"
+#define LAB4_HEADER_SIZE 4096
+#define LAB4_DATE_LENGTH 23
+#define LAB4_LOG "log.txt"
+#define LAB4_LOG_HOUR "log_hour.txt"
+#define LAB4_LOG_DAY "log_day.txt"
+#define LAB4_CURSORS "tmp/tmp.txt"
+
+struct lab4_header {
+    char magic[8];
+    uint32_t record_length;
+    uint32_t capacity;
+    uint64_t appended;   // the cursor is appended % capacity
+};
+
+// most rows per transaction
+#define IMPORT_BATCH (1 << 20)
+
+double now_sec()
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+struct mapped_file {
+    const char *data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE map;
+#endif
+};
+
+// read-only mapping of a whole file, an empty mapping if it is missing
+int map_file(const char *path, struct mapped_file *m)
+{
+    memset(m, 0, sizeof(*m));
+#ifdef _WIN32
+    m->file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+    if (m->file == INVALID_HANDLE_VALUE)
+        return -1;
+    LARGE_INTEGER size;
+    GetFileSizeEx(m->file, &size);
+    m->size = (size_t)size.QuadPart;
+    if (m->size == 0)
+        return 0;
+    m->map = CreateFileMapping(m->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    m->data = m->map ? (const char*)MapViewOfFile(m->map, FILE_MAP_READ, 0, 0, 0) : NULL;
+    if (m->data == NULL) {
+        fprintf(stderr, "Cannot map %s\n", path);
+        return -1;
+    }
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd == -1)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    m->size = (size_t)st.st_size;
+    void *addr = mmap(NULL, m->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        perror(path);
+        return -1;
+    }
+    // one front-to-back pass per segment of the ring
+    madvise(addr, m->size, MADV_SEQUENTIAL);
+    m->data = (const char*)addr;
+#endif
+    return 0;
+}
+
+void unmap_file(struct mapped_file *m)
+{
+#ifdef _WIN32
+    if (m->data != NULL)
+        UnmapViewOfFile(m->data);
+    if (m->map != NULL)
+        CloseHandle(m->map);
+    if (m->file != INVALID_HANDLE_VALUE && m->file != NULL)
+        CloseHandle(m->file);
+#else
+    if (m->data != NULL)
+        munmap((void*)m->data, m->size);
+#endif
+}
+
+// ---parser--- //
+
+// per 8-byte word of the date: which bytes are digits and which are fixed separators
+struct date_masks {
+    uint64_t digit[3];
+    uint64_t sep[3];
+    uint64_t sep_value[3];
+};
+
+static struct date_masks date_masks;
+
+void init_date_masks()
+{
+    const char *pattern = "0000-00-00 00:00:00.000 ";
+    memset(&date_masks, 0, sizeof(date_masks));
+    for (int i = 0; i < 24; ++i) {
+        uint64_t byte = (uint64_t)0xFF << (8 * (i % 8));
+        if (pattern[i] == '0') {
+            date_masks.digit[i / 8] |= byte;
+        } else {
+            date_masks.sep[i / 8] |= byte;
+            date_masks.sep_value[i / 8] |= (uint64_t)(unsigned char)pattern[i] << (8 * (i % 8));
+        }
+    }
+}
+
+static uint64_t load64(const char *p)
+{
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+// the 24 bytes of date and separator are checked 8 at a time (little endian):
+// a byte is a digit when (b ^ '0') <= 9, i.e. adding 0x76 to its low 7 bits leaves bit 7 clear
+static int valid_date(const char *record)
+{
+    uint64_t bad = 0;
+    for (int i = 0; i < 3; ++i) {
+        uint64_t w = load64(record + 8 * i);
+        uint64_t x = (w ^ 0x3030303030303030ULL) & date_masks.digit[i];
+        uint64_t t = (x & 0x7F7F7F7F7F7F7F7FULL) + 0x7676767676767676ULL;
+        bad |= (t | x) & date_masks.digit[i] & 0x8080808080808080ULL;
+        bad |= (w & date_masks.sep[i]) ^ date_masks.sep_value[i];
+    }
+    return bad == 0;
+}
+
+// value after the date in tenths, "-12.3", "7.0" or "105.25" (rounded down to tenths)
+static int parse_tenths(const char *p, const char *end, int32_t *tenths)
+{
+    int negative = *p == '-';
+    p += negative;
+    int32_t v = 0;
+    int digits = 0;
+    while (p < end && (unsigned)(*p - '0') <= 9) {
+        v = v * 10 + (*p++ - '0');
+        digits++;
+    }
+    if (digits == 0 || digits > 6 || p + 1 >= end || *p != '.' || (unsigned)(p[1] - '0') > 9)
+        return -1;
+    v = v * 10 + (p[1] - '0');
+    *tenths = negative ? -v : v;
+    return 0;
+}
+
+// date digits are validated already, so they convert without checks
+static int64_t record_wall(const char *d)
+{
+#define D2(i) ((d[i] - '0') * 10 + (d[i + 1] - '0'))
+    return civil_seconds(D2(0) * 100 + D2(2), D2(5), D2(8), D2(11), D2(14), D2(17));
+#undef D2
+}
+
+struct record {
+    const char *date;   // into the mapping, LAB4_DATE_LENGTH bytes
+    int32_t tenths;
+};
+
+struct parsed_log {
+    struct record *records;
+    size_t count;
+    size_t skipped;
+    int64_t first_wall;
+    int64_t last_wall;
+};
+
+// parse slots [from, to) of a log in file order
+static void parse_slots(const char *data, size_t from, size_t to, struct parsed_log *log)
+{
+    for (size_t slot = from; slot < to; ++slot) {
+        const char *rec = data + slot * LAB4_RECORD_LENGTH;
+        int32_t tenths;
+        // a slot not written yet
+        if (rec[0] == ' ')
+            continue;
+        if (!valid_date(rec) || rec[LAB4_RECORD_LENGTH - 1] != '\n' ||
+            parse_tenths(rec + LAB4_DATE_LENGTH + 1, rec + LAB4_RECORD_LENGTH - 1, &tenths) == -1) {
+            log->skipped++;
+            continue;
+        }
+        int64_t wall = record_wall(rec);
+        if (log->count == 0 || wall < log->first_wall)
+            log->first_wall = wall;
+        if (log->count == 0 || wall > log->last_wall)
+            log->last_wall = wall;
+        log->records[log->count].date = rec;
+        log->records[log->count].tenths = tenths;
+        log->count++;
+    }
+}
+
+// records of a mapped log oldest first: a ring that wrapped continues at its cursor
+void parse_log(const char *data, size_t slots, long cursor, struct parsed_log *log)
+{
+    memset(log, 0, sizeof(*log));
+    log->records = (struct record*)malloc(sizeof(struct record) * (slots ? slots : 1));
+    if (log->records == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t start = cursor > 0 && (size_t)cursor < slots ? (size_t)cursor : 0;
+    parse_slots(data, start, slots, log);
+    parse_slots(data, 0, start, log);
+}
+
+// ---loader--- //
+
+void execute(sqlite3 *db, const char *sql)
+{
+    char *err = NULL;
+    if (sqlite3_exec(db, sql, 0, 0, &err) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", err);
+        sqlite3_free(err);
+        sqlite3_close(db);
+        exit(EXIT_FAILURE);
+    }
+}
+
+sqlite3_stmt *prepare(sqlite3 *db, const char *sql)
+{
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        exit(EXIT_FAILURE);
+    }
+    return stmt;
+}
+
+void step(sqlite3 *db, sqlite3_stmt *stmt)
+{
+    if (sqlite3_step(stmt) != SQLITE_DONE) {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(db));
+        sqlite3_close(db);
+        exit(EXIT_FAILURE);
+    }
+    sqlite3_reset(stmt);
+}
+
+// raw records go to temp_all with their millisecond date bound straight from the mapping
+void load_raw(sqlite3 *db, int sensor_id, const struct parsed_log *log)
+{
+    sqlite3_stmt *insert = prepare(db, "INSERT OR REPLACE INTO temp_all (sensor_id, date, temp) VALUES (?, ?, ?);");
+    sqlite3_bind_int(insert, 1, sensor_id);
+
+    execute(db, "BEGIN;");
+    for (size_t i = 0; i < log->count; ++i) {
+        if (i > 0 && i % IMPORT_BATCH == 0)
+            execute(db, "COMMIT; BEGIN;");
+        sqlite3_bind_text(insert, 2, log->records[i].date, LAB4_DATE_LENGTH, SQLITE_STATIC);
+        sqlite3_bind_double(insert, 3, log->records[i].tenths / 10.0);
+        step(db, insert);
+    }
+    execute(db, "COMMIT;");
+    sqlite3_finalize(insert);
+}
+
+// any sample of the sensor already stored in wall-clock seconds [from, to]
+int has_raw_rows(sqlite3 *db, int sensor_id, int64_t from, int64_t to)
+{
+    char from_date[20], to_date[20];
+    format_wall(from, from_date, sizeof(from_date));
+    format_wall(to + 1, to_date, sizeof(to_date));
+    sqlite3_stmt *stmt = prepare(db, "SELECT 1 FROM temp_all WHERE sensor_id = ? AND date >= ? AND date < ? LIMIT 1;");
+    sqlite3_bind_int(stmt, 1, sensor_id);
+    sqlite3_bind_text(stmt, 2, from_date, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, to_date, -1, SQLITE_STATIC);
+    int found = sqlite3_step(stmt) == SQLITE_ROW;
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+// buckets of the first tier straight from the parsed records, no GROUP BY over the raw rows;
+// only valid when nothing else is stored in the range and the records are in time order
+int load_first_tier(sqlite3 *db, int sensor_id, const struct tier *t, const struct parsed_log *log)
+{
+    for (size_t i = 1; i < log->count; ++i) {
+        if (memcmp(log->records[i - 1].date, log->records[i].date, LAB4_DATE_LENGTH) > 0)
+            return -1;
+    }
+
+    char sql[256], date[20];
+    snprintf(sql, sizeof(sql),
+        "INSERT OR REPLACE INTO %s (sensor_id, date, avg_temp, samples, sum_temp, sketch) VALUES (?, ?, ?, ?, ?, ?);",
+        t->table);
+    sqlite3_stmt *insert = prepare(db, sql);
+    sqlite3_bind_int(insert, 1, sensor_id);
+
+    static struct sketch sketch;
+    static unsigned char encoded[SKETCH_MAX_ENCODED];
+    execute(db, "BEGIN;");
+    for (size_t i = 0; i < log->count;) {
+        int64_t wall = record_wall(log->records[i].date);
+        int64_t bucket = wall - wall % t->resolution;
+        int64_t sum = 0;
+        sketch_init(&sketch);
+        for (; i < log->count; ++i) {
+            wall = record_wall(log->records[i].date);
+            if (wall - wall % t->resolution != bucket)
+                break;
+            sum += log->records[i].tenths;
+            sketch_add(&sketch, log->records[i].tenths / 10.0);
+        }
+
+        format_wall(bucket, date, sizeof(date));
+        double sum_temp = sum / 10.0;
+        sqlite3_bind_text(insert, 2, date, -1, SQLITE_STATIC);
+        sqlite3_bind_double(insert, 3, round(sum_temp / sketch.count * 10) / 10);
+        sqlite3_bind_int64(insert, 4, (sqlite3_int64)sketch.count);
+        sqlite3_bind_double(insert, 5, sum_temp);
+        sqlite3_bind_blob(insert, 6, encoded, (int)sketch_encode(&sketch, encoded), SQLITE_STATIC);
+        step(db, insert);
+    }
+    execute(db, "COMMIT;");
+    sqlite3_finalize(insert);
+    return 0;
+}
+
+// lab4 rollups are written once their period ended, not on calendar boundaries, so each
+// lands in the bucket holding the middle of its period; buckets already built stay
+void load_rollups(sqlite3 *db, int sensor_id, const struct tier *t, const struct parsed_log *log)
+{
+    char sql[256], date[20];
+    snprintf(sql, sizeof(sql),
+        "INSERT OR IGNORE INTO %s (sensor_id, date, avg_temp, samples, sum_temp) VALUES (?, ?, ?, 1, ?);", t->table);
+    sqlite3_stmt *insert = prepare(db, sql);
+    sqlite3_bind_int(insert, 1, sensor_id);
+
+    execute(db, "BEGIN;");
+    for (size_t i = 0; i < log->count; ++i) {
+        int64_t middle = record_wall(log->records[i].date) - t->resolution / 2;
+        format_wall(middle - middle % t->resolution, date, sizeof(date));
+        sqlite3_bind_text(insert, 2, date, -1, SQLITE_STATIC);
+        sqlite3_bind_double(insert, 3, log->records[i].tenths / 10.0);
+        sqlite3_bind_double(insert, 4, log->records[i].tenths / 10.0);
+        step(db, insert);
+    }
+    execute(db, "COMMIT;");
+    sqlite3_finalize(insert);
+}
+
+const struct tier *find_tier(const struct policy *p, int resolution)
+{
+    for (int i = 0; i < p->count; ++i) {
+        if (p->tiers[i].resolution == resolution)
+            return &p->tiers[i];
+    }
+    return NULL;
+}
+
+void read_cursors(const char *dir, long cursor[2])
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, LAB4_CURSORS);
+    cursor[0] = cursor[1] = 0;
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return;
+    if (fscanf(file, "%ld %ld", &cursor[0], &cursor[1]) < 1)
+        fprintf(stderr, "%s: no cursors, reading logs in file order\n", path);
+    fclose(file);
+}
+
+struct import_stats {
+    size_t records;
+    size_t skipped;
+    double parse_sec;
+    double load_sec;
+};
+
+void import_log(sqlite3 *db, const struct policy *p, const char *dir, const char *name, long cursor,
+                int resolution, int sensor_id, struct import_stats *stats)
+{
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    struct mapped_file m;
+    if (map_file(path, &m) == -1) {
+        fprintf(stderr, "%s: missing, skipped\n", path);
+        return;
+    }
+
+    // a log with a header carries its own cursor, tmp/tmp.txt is from older versions
+    const char *data = m.data;
+    size_t slots = m.size / LAB4_RECORD_LENGTH;
+    struct lab4_header header;
+    if (m.size >= LAB4_HEADER_SIZE && memcmp(m.data, LAB4_MAGIC, sizeof(header.magic)) == 0) {
+        memcpy(&header, m.data, sizeof(header));
+        if (header.record_length != LAB4_RECORD_LENGTH || header.capacity == 0) {
+            fprintf(stderr, "%s: records of %u bytes, skipped\n", path, header.record_length);
+            unmap_file(&m);
+            return;
+        }
+        data += LAB4_HEADER_SIZE;
+        slots = (m.size - LAB4_HEADER_SIZE) / LAB4_RECORD_LENGTH;
+        if (slots > header.capacity)
+            slots = header.capacity;
+        cursor = (long)(header.appended % header.capacity);
+    }
+
+    double t0 = now_sec();
+    struct parsed_log log;
+    parse_log(data, slots, cursor, &log);
+    double t1 = now_sec();
+
+    if (resolution == 0) {
+        int fresh = log.count > 0 && !has_raw_rows(db, sensor_id, log.first_wall, log.last_wall);
+        load_raw(db, sensor_id, &log);
+
+        // tiers of the imported range are built right away, the compactor only moves forward
+        int first = 1;
+        if (fresh && p->count > 1 && load_first_tier(db, sensor_id, &p->tiers[1], &log) == 0)
+            first = 2;
+        execute(db, "BEGIN;");
+        for (int i = first; i < p->count && log.count > 0; ++i) {
+            int r = p->tiers[i].resolution;
+            if (fold_tier(db, p, i, log.first_wall - log.first_wall % r, log.last_wall - log.last_wall % r + r) == -1) {
+                sqlite3_close(db);
+                exit(EXIT_FAILURE);
+            }
+        }
+        execute(db, "COMMIT;");
+    } else {
+        const struct tier *t = find_tier(p, resolution);
+        if (t != NULL)
+            load_rollups(db, sensor_id, t, &log);
+        else
+            fprintf(stderr, "%s: the policy has no %d s tier, skipped\n", path, resolution);
+    }
+    double t2 = now_sec();
+
+    printf("%-40s %9zu records, %zu skipped\n", path, log.count, log.skipped);
+    stats->records += log.count;
+    stats->skipped += log.skipped;
+    stats->parse_sec += t1 - t0;
+    stats->load_sec += t2 - t1;
+
+    free(log.records);
+    unmap_file(&m);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <sensor id> <lab4 dir>... (run next to the server, with the server stopped)\n", argv[0]);
+        return 1;
+    }
+    int sensor_id = atoi(argv[1]);
+    init_date_masks();
+
+    sqlite3 *db;
+    if (sqlite3_open_v2("temperature.db", &db, SQLITE_OPEN_READWRITE, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Cannot open temperature.db, start the server once to create it\n");
+        return 1;
+    }
+    // a failed import is simply run again, no need to fsync every batch
+    execute(db, "PRAGMA synchronous = OFF;");
+    if (sketch_register(db) == -1) {
+        sqlite3_close(db);
+        return 1;
+    }
+
+    struct policy policy;
+    load_policy(&policy, POLICY_CONFIG);
+
+    struct import_stats stats = {0, 0, 0, 0};
+    double t0 = now_sec();
+    for (int i = 2; i < argc; ++i) {
+        long cursor[2];
+        read_cursors(argv[i], cursor);
+        import_log(db, &policy, argv[i], LAB4_LOG, cursor[0], 0, sensor_id, &stats);
+        import_log(db, &policy, argv[i], LAB4_LOG_HOUR, cursor[1], SEC_IN_HOUR, sensor_id, &stats);
+        import_log(db, &policy, argv[i], LAB4_LOG_DAY, 0, SEC_IN_DAY, sensor_id, &stats);
+    }
+    double total = now_sec() - t0;
+    sqlite3_close(db);
+
+    printf("%zu records (%zu skipped) in %.3f s: parse %.1f M records/s, load %.2f M records/s, total %.2f M records/s\n",
+           stats.records, stats.skipped, total,
+           stats.parse_sec > 0 ? stats.records / stats.parse_sec / 1e6 : 0.0,
+           stats.load_sec > 0 ? stats.records / stats.load_sec / 1e6 : 0.0,
+           total > 0 ? stats.records / total / 1e6 : 0.0);
+    return 0;
+}
@@ -0,0 +1,375 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "decicelsius.h"
+
+#ifdef _WIN32
+#    include <windows.h>
+#    include <direct.h>
+#else
+#    include <errno.h>
+#    include <fcntl.h>
+#    include <unistd.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#endif
+
+// append-only sample journal: fixed-size records in preallocated, mmap'd segments
+// segment k holds records [k * JOURNAL_SEGMENT_RECORDS, (k + 1) * JOURNAL_SEGMENT_RECORDS)
+#define JOURNAL_DIR "journal"
+#define JOURNAL_SEGMENT_RECORDS (1 << 18)
+#define JOURNAL_SEGMENT_SIZE ((size_t)JOURNAL_SEGMENT_RECORDS * sizeof(struct journal_record))
+
+// group sync: msync once this many records or this much time is pending
+#define JOURNAL_SYNC_RECORDS 256
+#define JOURNAL_SYNC_MS 1000
+
+struct journal_record {
+    int64_t time_ms;     // capture time, ms since epoch
+    decicelsius value;
+    int16_t sensor_id;   // sensors.conf ids are below 32768
+    uint32_t crc;        // CRC-32 of the fields above, zero-filled space never matches
+};
+
+_Static_assert(sizeof(struct journal_record) == 16, "journal record must stay 16 bytes");
+
+struct journal_segment {
+    uint64_t index;
+    struct journal_record *records;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE map;
+#else
+    int fd;
+#endif
+};
+
+// written by the reader thread only, head is published to the db writer
+struct journal {
+    char dir[256];
+    struct journal_segment seg;
+    _Atomic uint64_t head;
+    uint64_t synced;
+    int64_t last_sync_ms;
+    unsigned long syncs;
+    double sync_sum_us;
+    double sync_max_us;
+};
+
+// read side of the db writer, removes segments once nothing needs them anymore
+struct journal_reader {
+    const char *dir;
+    struct journal_segment seg;
+    int mapped;
+    uint64_t trimmed;
+    unsigned long corrupt;
+};
+
+static uint32_t journal_crc_table[256];
+static int journal_crc_ready = 0;
+
+static void journal_crc_init()
+{
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        journal_crc_table[i] = crc;
+    }
+    journal_crc_ready = 1;
+}
+
+uint32_t journal_crc32(const void *data, size_t len)
+{
+    if (!journal_crc_ready)
+        journal_crc_init();
+
+    const unsigned char *p = (const unsigned char*)data;
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < len; ++i)
+        crc = (crc >> 8) ^ journal_crc_table[(crc ^ p[i]) & 0xFF];
+    return crc ^ 0xFFFFFFFFu;
+}
+
+int journal_record_valid(const struct journal_record *rec)
+{
+    return rec->crc == journal_crc32(rec, offsetof(struct journal_record, crc));
+}
+
+int64_t journal_clock_ms()
+{
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void journal_segment_path(const char *dir, uint64_t index, char *path, size_t size)
+{
+    snprintf(path, size, "%s/%012llu.jnl", dir, (unsigned long long)index);
+}
+
+int journal_segment_exists(const char *dir, uint64_t index)
+{
+    char path[300];
+    journal_segment_path(dir, index, path, sizeof(path));
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+        return 0;
+    fclose(file);
+    return 1;
+}
+
+void journal_segment_remove(const char *dir, uint64_t index)
+{
+    char path[300];
+    journal_segment_path(dir, index, path, sizeof(path));
+    remove(path);
+}
+
+// map segment index, new segments are preallocated to their full size
+int journal_map(const char *dir, uint64_t index, int writable, struct journal_segment *seg)
+{
+    char path[300];
+    journal_segment_path(dir, index, path, sizeof(path));
+    seg->index = index;
+
+#ifdef _WIN32
+    seg->file = CreateFile(path, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                           FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                           writable ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (seg->file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "%s: CreateFile failed\n", path);
+        return -1;
+    }
+
+    LARGE_INTEGER size;
+    size.QuadPart = JOURNAL_SEGMENT_SIZE;
+    seg->map = CreateFileMapping(seg->file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY,
+                                 size.HighPart, size.LowPart, NULL);
+    if (seg->map == NULL) {
+        fprintf(stderr, "%s: CreateFileMapping failed\n", path);
+        CloseHandle(seg->file);
+        return -1;
+    }
+
+    seg->records = MapViewOfFile(seg->map, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, JOURNAL_SEGMENT_SIZE);
+    if (seg->records == NULL) {
+        fprintf(stderr, "%s: MapViewOfFile failed\n", path);
+        CloseHandle(seg->map);
+        CloseHandle(seg->file);
+        return -1;
+    }
+#else
+    seg->fd = open(path, writable ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC, 0644);
+    if (seg->fd == -1) {
+        perror(path);
+        return -1;
+    }
+
+    if (writable) {
+        // reserve the blocks up front so appends never extend the file
+        int err = posix_fallocate(seg->fd, 0, JOURNAL_SEGMENT_SIZE);
+        if (err != 0) {
+            fprintf(stderr, "%s: fallocate: %s\n", path, strerror(err));
+            close(seg->fd);
+            return -1;
+        }
+    }
+
+    void *addr = mmap(NULL, JOURNAL_SEGMENT_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                      MAP_SHARED, seg->fd, 0);
+    if (addr == MAP_FAILED) {
+        perror("mmap (journal)");
+        close(seg->fd);
+        return -1;
+    }
+    seg->records = (struct journal_record*)addr;
+#endif
+    return 0;
+}
+
+void journal_unmap(struct journal_segment *seg)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(seg->records);
+    CloseHandle(seg->map);
+    CloseHandle(seg->file);
+#else
+    munmap(seg->records, JOURNAL_SEGMENT_SIZE);
+    close(seg->fd);
+#endif
+    seg->records = NULL;
+}
+
+// open for appending after the last valid record, records below keep are no longer
+// needed and applied is the db's replay position
+int journal_open(struct journal *j, const char *dir, uint64_t keep, uint64_t applied)
+{
+    memset(j, 0, sizeof(*j));
+    snprintf(j->dir, sizeof(j->dir), "%s", dir);
+#ifdef _WIN32
+    _mkdir(dir);
+#else
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+        perror(dir);
+        return -1;
+    }
+#endif
+
+    // older segments were fully applied, left over if the last run stopped before removing them
+    uint64_t index = keep / JOURNAL_SEGMENT_RECORDS;
+    for (uint64_t old = index; old > 0 && journal_segment_exists(dir, old - 1); --old)
+        journal_segment_remove(dir, old - 1);
+
+    // newest segment at or after the one holding the replay position
+    while (journal_segment_exists(dir, index + 1))
+        ++index;
+
+    if (journal_map(dir, index, 1, &j->seg) == -1)
+        return -1;
+
+    // records are appended in order, the first invalid one is the end of the journal
+    uint64_t n = 0;
+    while (n < JOURNAL_SEGMENT_RECORDS && journal_record_valid(&j->seg.records[n]))
+        ++n;
+
+    uint64_t head = index * JOURNAL_SEGMENT_RECORDS + n;
+    if (head < applied)
+        head = applied;
+    atomic_store_explicit(&j->head, head, memory_order_release);
+    j->synced = head;
+    j->last_sync_ms = journal_clock_ms();
+    return 0;
+}
+
+void journal_sync(struct journal *j, int force)
+{
+    uint64_t head = atomic_load_explicit(&j->head, memory_order_relaxed);
+    if (head == j->synced)
+        return;
+
+    int64_t now = journal_clock_ms();
+    if (!force && head - j->synced < JOURNAL_SYNC_RECORDS && now - j->last_sync_ms < JOURNAL_SYNC_MS)
+        return;
+
+    // only the part of the current segment written since the last sync, earlier segments
+    // were synced when they were closed
+    uint64_t first = j->seg.index * JOURNAL_SEGMENT_RECORDS;
+    uint64_t from = j->synced > first ? j->synced - first : 0;
+    uint64_t to = head - first;
+
+    struct timespec start, end;
+    timespec_get(&start, TIME_UTC);
+#ifdef _WIN32
+    FlushViewOfFile(&j->seg.records[from], (to - from) * sizeof(struct journal_record));
+#else
+    // msync wants a page-aligned start
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t offset = from * sizeof(struct journal_record) / page * page;
+    size_t length = to * sizeof(struct journal_record) - offset;
+    if (msync((char*)j->seg.records + offset, length, MS_SYNC) == -1)
+        perror("msync (journal)");
+#endif
+    timespec_get(&end, TIME_UTC);
+
+    double us = (end.tv_sec - start.tv_sec) * 1e6 + (end.tv_nsec - start.tv_nsec) / 1e3;
+    j->syncs++;
+    j->sync_sum_us += us;
+    if (us > j->sync_max_us)
+        j->sync_max_us = us;
+    j->synced = head;
+    j->last_sync_ms = now;
+}
+
+// memcpy into the mapped segment, offset receives the record's journal position
+int journal_append(struct journal *j, int64_t time_ms, int sensor_id, decicelsius value, uint64_t *offset)
+{
+    uint64_t head = atomic_load_explicit(&j->head, memory_order_relaxed);
+    uint64_t index = head / JOURNAL_SEGMENT_RECORDS;
+    if (index != j->seg.index) {
+        journal_sync(j, 1);
+        journal_unmap(&j->seg);
+        if (journal_map(j->dir, index, 1, &j->seg) == -1)
+            return -1;
+    }
+
+    struct journal_record rec;
+    rec.time_ms = time_ms;
+    rec.value = value;
+    rec.sensor_id = (int16_t)sensor_id;
+    rec.crc = journal_crc32(&rec, offsetof(struct journal_record, crc));
+    memcpy(&j->seg.records[head % JOURNAL_SEGMENT_RECORDS], &rec, sizeof(rec));
+
+    atomic_store_explicit(&j->head, head + 1, memory_order_release);
+    *offset = head;
+    return 0;
+}
+
+void journal_close(struct journal *j)
+{
+    journal_sync(j, 1);
+    journal_unmap(&j->seg);
+}
+
+void journal_print_stats(struct journal *j)
+{
+    printf("journal: head %llu, %lu syncs, msync avg %.1f us, max %.1f us\n",
+           (unsigned long long)atomic_load(&j->head), j->syncs,
+           j->syncs ? j->sync_sum_us / j->syncs : 0.0, j->sync_max_us);
+}
+
+void journal_reader_init(struct journal_reader *r, const char *dir, uint64_t keep)
+{
+    memset(r, 0, sizeof(*r));
+    r->dir = dir;
+    r->trimmed = keep / JOURNAL_SEGMENT_RECORDS;
+}
+
+// remove the segments that hold only records below keep
+void journal_trim(struct journal_reader *r, uint64_t keep)
+{
+    uint64_t index = keep / JOURNAL_SEGMENT_RECORDS;
+    for (; r->trimmed < index; ++r->trimmed) {
+        if (r->mapped && r->seg.index == r->trimmed) {
+            journal_unmap(&r->seg);
+            r->mapped = 0;
+        }
+        journal_segment_remove(r->dir, r->trimmed);
+    }
+}
+
+// record at offset or NULL if it is damaged, offset must be below the journal head
+const struct journal_record *journal_read(struct journal_reader *r, uint64_t offset)
+{
+    uint64_t index = offset / JOURNAL_SEGMENT_RECORDS;
+    if (!r->mapped || r->seg.index != index) {
+        if (r->mapped) {
+            journal_unmap(&r->seg);
+            r->mapped = 0;
+        }
+        if (journal_map(r->dir, index, 0, &r->seg) == -1)
+            return NULL;
+        r->mapped = 1;
+    }
+
+    const struct journal_record *rec = &r->seg.records[offset % JOURNAL_SEGMENT_RECORDS];
+    if (!journal_record_valid(rec)) {
+        r->corrupt++;
+        return NULL;
+    }
+    return rec;
+}
+
+void journal_reader_close(struct journal_reader *r)
+{
+    if (r->mapped)
+        journal_unmap(&r->seg);
+    r->mapped = 0;
+}
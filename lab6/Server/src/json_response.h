@@ -2,79 +2,92 @@
 
 #include <stdio.h>
 #include "sqlite3.h"
+#include "calendar.h"
+#include "live.h"
+#include "policy.h"
+#include "dbconn.h"
 #include <json-c/json.h>
 
-void get_current_temp()
+void print_current_json(decicelsius curr_temp)
 {
+    char tempStr[DECI_MAX_LEN];
+    deci_format(curr_temp, tempStr);
+
+    struct json_object *response_json = json_object_new_object();
+    json_object_object_add(response_json, "current_temp", json_object_new_string(tempStr));
+
+    const char *json_string = json_object_to_json_string(response_json);
+
+    printf("%s\n", json_string);
+
+    json_object_put(response_json);
+}
+
+void get_current_temp(int sensor_id)
+{
+    // newest sample straight from the server's shared memory, SQL only if it is not running
+    struct live_sample last;
+    if (live_read_last(sensor_id, &last, 1) > 0) {
+        print_current_json(last.value);
+        return;
+    }
+
     sqlite3 *db;
     sqlite3_stmt *stmt;
     char *err_msg = 0;
 
-    int res = sqlite3_open("temperature.db", &db);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+    db = db_reader();
+    if (db == NULL) {
         exit(1);
     }
 
-    const char *sql = "SELECT temp FROM temp_all ORDER BY date DESC LIMIT 1;";
-    res = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
+    const char *sql = "SELECT temp FROM temp_all WHERE sensor_id = ? ORDER BY date DESC LIMIT 1;";
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
         exit(1);
     }
+    sqlite3_bind_int(stmt, 1, sensor_id);
 
-    double curr_temp = 0.0;
+    decicelsius curr_temp = 0;
     if (sqlite3_step(stmt) == SQLITE_ROW) {
-        curr_temp = sqlite3_column_double(stmt, 0);
+        curr_temp = deci_from_double(sqlite3_column_double(stmt, 0));
     }
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
-
-    char tempStr[16];
-    snprintf(tempStr, sizeof(tempStr), "%.1f", curr_temp);
-
-    struct json_object *response_json = json_object_new_object();
-    json_object_object_add(response_json, "current_temp", json_object_new_string(tempStr));
-
-    const char *json_string = json_object_to_json_string(response_json);
-
-    printf("%s\n", json_string);
+    sqlite3_reset(stmt);
 
-    json_object_put(response_json);
+    print_current_json(curr_temp);
 }
 
-void get_hourly_day_avg()
+void get_hourly_day_avg(int sensor_id)
 {
     sqlite3 *db;
     sqlite3_stmt *stmt;
     char *err_msg = 0;
 
-    int res = sqlite3_open("temperature.db", &db);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+    db = db_reader();
+    if (db == NULL) {
         return;
     }
+    open_tier_view(db, "hourly", sensor_id, SEC_IN_HOUR, SEC_IN_DAY);
 
     const char *sql =
     "WITH hourly_data AS ("
     "    SELECT strftime('%Y-%m-%d %H:%M:%S', date) AS datetime, "
     "           avg_temp "
-    "    FROM temp_hour "
-    "    WHERE date >= datetime('now', 'localtime', 'start of day') "
-    "      AND date < datetime('now', 'localtime', 'start of day', '+1 day') "
+    "    FROM hourly "
+    "    WHERE sensor_id = ? AND date >= datetime(?2, 'start of day') "
+    "      AND date < datetime(?2, 'start of day', '+1 day') "
     "    ORDER BY date ASC"
     ") "
     "SELECT datetime, avg_temp "
     "FROM hourly_data;";
 
-    res = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
         return;
     }
+    sqlite3_bind_int(stmt, 1, sensor_id);
+    db_bind_now(stmt, 2);
 
     json_object *jsonArray = json_object_new_array();
     int has_data = 0;
@@ -95,8 +108,7 @@ void get_hourly_day_avg()
         json_object_array_add(jsonArray, jsonObj);
     }
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    sqlite3_reset(stmt);
 
     if (!has_data) {
         json_object_put(jsonArray);
@@ -109,35 +121,35 @@ void get_hourly_day_avg()
     json_object_put(jsonArray);
 }
 
-void get_hourly_weekly_avg()
+void get_hourly_weekly_avg(int sensor_id)
 {
     sqlite3 *db;
     sqlite3_stmt *stmt;
     char *err_msg = 0;
 
-    int res = sqlite3_open("temperature.db", &db);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+    db = db_reader();
+    if (db == NULL) {
         return;
     }
+    open_tier_view(db, "hourly", sensor_id, SEC_IN_HOUR, 7 * SEC_IN_DAY);
 
     const char *sql =
     "WITH weekly_data AS ("
     "    SELECT strftime('%Y-%m-%d %H:%M:%S', date) AS datetime, "
     "           avg_temp "
-    "    FROM temp_hour "
-    "    WHERE date >= datetime('now', 'localtime', '-7 days') "
+    "    FROM hourly "
+    "    WHERE sensor_id = ? AND date >= datetime(?2, '-7 days') "
     "    ORDER BY date ASC"
     ") "
     "SELECT datetime, avg_temp "
     "FROM weekly_data;";
 
-    res = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
         return;
     }
+    sqlite3_bind_int(stmt, 1, sensor_id);
+    db_bind_now(stmt, 2);
 
     json_object *jsonArray = json_object_new_array();
     int has_data = 0;
@@ -159,8 +171,7 @@ void get_hourly_weekly_avg()
         json_object_array_add(jsonArray, jsonObj);
     }
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    sqlite3_reset(stmt);
 
     if (!has_data) {
         json_object_put(jsonArray);
@@ -173,35 +184,35 @@ void get_hourly_weekly_avg()
     json_object_put(jsonArray);
 }
 
-void get_hourly_month_avg()
+void get_hourly_month_avg(int sensor_id)
 {
     sqlite3 *db;
     sqlite3_stmt *stmt;
     char *err_msg = 0;
 
-    int res = sqlite3_open("temperature.db", &db);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+    db = db_reader();
+    if (db == NULL) {
         return;
     }
+    open_tier_view(db, "hourly", sensor_id, SEC_IN_HOUR, 31 * SEC_IN_DAY);
 
     const char *sql =
     "WITH monthly_data AS ("
     "    SELECT strftime('%Y-%m-%d %H:%M:%S', date) AS datetime, "
     "           avg_temp "
-    "    FROM temp_hour "
-    "    WHERE date >= datetime('now', 'localtime', '-30 days') "
+    "    FROM hourly "
+    "    WHERE sensor_id = ? AND date >= datetime(?2, '-30 days') "
     "    ORDER BY date ASC"
     ") "
     "SELECT datetime, avg_temp "
     "FROM monthly_data;";
 
-    res = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
         return;
     }
+    sqlite3_bind_int(stmt, 1, sensor_id);
+    db_bind_now(stmt, 2);
 
     json_object *jsonArray = json_object_new_array();
     int has_data = 0;
@@ -223,8 +234,7 @@ void get_hourly_month_avg()
         json_object_array_add(jsonArray, jsonObj);
     }
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    sqlite3_reset(stmt);
 
     if (!has_data) {
         json_object_put(jsonArray);
@@ -237,37 +247,37 @@ void get_hourly_month_avg()
     json_object_put(jsonArray);
 }
 
-void get_daily_week_avg()
+void get_daily_week_avg(int sensor_id)
 {
     sqlite3 *db;
     sqlite3_stmt *stmt;
     char *err_msg = 0;
 
-    int res = sqlite3_open("temperature.db", &db);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+    db = db_reader();
+    if (db == NULL) {
         return;
     }
+    open_tier_view(db, "daily", sensor_id, SEC_IN_DAY, 7 * SEC_IN_DAY);
 
     const char *sql =
     "WITH daily_data AS ("
     "    SELECT strftime('%Y-%m-%d', date) AS date, "
     "           avg(avg_temp) AS avg_temp "
-    "    FROM temp_day "
-    "    WHERE date >= date('now', 'localtime', '-7 days') "
-    "      AND date <= date('now', 'localtime') "
+    "    FROM daily "
+    "    WHERE sensor_id = ? AND date >= date(?2, '-7 days') "
+    "      AND date <= date(?2) "
     "    GROUP BY strftime('%Y-%m-%d', date) "
     "    ORDER BY date ASC"
     ") "
     "SELECT date, avg_temp "
     "FROM daily_data;";
 
-    res = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
         return;
     }
+    sqlite3_bind_int(stmt, 1, sensor_id);
+    db_bind_now(stmt, 2);
 
     json_object *jsonArray = json_object_new_array();
     int has_data = 0;
@@ -289,8 +299,7 @@ void get_daily_week_avg()
         json_object_array_add(jsonArray, jsonObj);
     }
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    sqlite3_reset(stmt);
 
     if (!has_data) {
         json_object_put(jsonArray);
@@ -303,37 +312,37 @@ void get_daily_week_avg()
     json_object_put(jsonArray);
 }
 
-void get_daily_month_avg()
+void get_daily_month_avg(int sensor_id)
 {
     sqlite3 *db;
     sqlite3_stmt *stmt;
     char *err_msg = 0;
 
-    int res = sqlite3_open("temperature.db", &db);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+    db = db_reader();
+    if (db == NULL) {
         return;
     }
+    open_tier_view(db, "daily", sensor_id, SEC_IN_DAY, 30 * SEC_IN_DAY);
 
     const char *sql =
     "WITH daily_data AS ("
     "    SELECT strftime('%Y-%m-%d', date) AS date, "
     "           avg(avg_temp) AS avg_temp "
-    "    FROM temp_day "
-    "    WHERE date >= date('now', 'localtime', '-30 days') "
-    "      AND date <= date('now', 'localtime') "
+    "    FROM daily "
+    "    WHERE sensor_id = ? AND date >= date(?2, '-30 days') "
+    "      AND date <= date(?2) "
     "    GROUP BY strftime('%Y-%m-%d', date) "
     "    ORDER BY date ASC"
     ") "
     "SELECT date, avg_temp "
     "FROM daily_data;";
 
-    res = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
         return;
     }
+    sqlite3_bind_int(stmt, 1, sensor_id);
+    db_bind_now(stmt, 2);
 
     json_object *jsonArray = json_object_new_array();
     int has_data = 0;
@@ -354,8 +363,7 @@ void get_daily_month_avg()
         json_object_array_add(jsonArray, jsonObj);
     }
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    sqlite3_reset(stmt);
 
     if (!has_data) {
         json_object_put(jsonArray);
@@ -368,37 +376,37 @@ void get_daily_month_avg()
     json_object_put(jsonArray);
 }
 
-void get_daily_year_avg()
+void get_daily_year_avg(int sensor_id)
 {
     sqlite3 *db;
     sqlite3_stmt *stmt;
     char *err_msg = 0;
 
-    int res = sqlite3_open("temperature.db", &db);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+    db = db_reader();
+    if (db == NULL) {
         return;
     }
+    open_tier_view(db, "daily", sensor_id, SEC_IN_DAY, 366 * SEC_IN_DAY);
 
     const char *sql =
     "WITH daily_data AS ("
     "    SELECT strftime('%Y-%m-%d', date) AS date, "
     "           avg(avg_temp) AS avg_temp "
-    "    FROM temp_day "
-    "    WHERE date >= date('now', 'localtime', '-366 days') "
-    "      AND date <= date('now', 'localtime') "
+    "    FROM daily "
+    "    WHERE sensor_id = ? AND date >= date(?2, '-366 days') "
+    "      AND date <= date(?2) "
     "    GROUP BY strftime('%Y-%m-%d', date) "
     "    ORDER BY date ASC"
     ") "
     "SELECT date, avg_temp "
     "FROM daily_data;";
 
-    res = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
         return;
     }
+    sqlite3_bind_int(stmt, 1, sensor_id);
+    db_bind_now(stmt, 2);
 
     json_object *jsonArray = json_object_new_array();
     int has_data = 0;
@@ -419,8 +427,7 @@ void get_daily_year_avg()
         json_object_array_add(jsonArray, jsonObj);
     }
 
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    sqlite3_reset(stmt);
 
     if (!has_data) {
         json_object_put(jsonArray);
@@ -433,15 +440,33 @@ void get_daily_year_avg()
     json_object_put(jsonArray);
 }
 
-void get_last_60_seconds()
+void get_last_60_seconds(int sensor_id)
 {
+    struct live_sample samples[60];
+    int count = live_read_last(sensor_id, samples, 60);
+    if (count > 0) {
+        json_object *jsonArray = json_object_new_array();
+        char date[32], temp[DECI_MAX_LEN];
+        for (int i = 0; i < count; ++i) {
+            format_local_ms(samples[i].time_ms, date, sizeof(date));
+            deci_format(samples[i].value, temp);
+
+            json_object *jsonObj = json_object_new_object();
+            json_object_object_add(jsonObj, "DATE", json_object_new_string(date));
+            json_object_object_add(jsonObj, "TEMP", json_object_new_string(temp));
+            json_object_array_add(jsonArray, jsonObj);
+        }
+        printf("%s\n", json_object_to_json_string(jsonArray));
+        json_object_put(jsonArray);
+        return;
+    }
+
     sqlite3 *db;
     sqlite3_stmt *stmt;
     char *err_msg = 0;
 
-    int res = sqlite3_open("temperature.db", &db);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+    db = db_reader();
+    if (db == NULL) {
         return;
     }
 
@@ -450,17 +475,17 @@ void get_last_60_seconds()
     "FROM ( "
     "    SELECT date, temp "
     "    FROM temp_all "
+    "    WHERE sensor_id = ? "
     "    ORDER BY date DESC "
     "    LIMIT 60 "
     ") AS last_60 "
     "ORDER BY date ASC;";
 
-    res = sqlite3_prepare_v2(db, sql, -1, &stmt, 0);
-    if (res != SQLITE_OK) {
-        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
-        sqlite3_close(db);
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
         return;
     }
+    sqlite3_bind_int(stmt, 1, sensor_id);
 
     json_object *jsonArray = json_object_new_array();
     int has_data = 0;
@@ -480,8 +505,7 @@ void get_last_60_seconds()
         }
         json_object_array_add(jsonArray, jsonObj);
     }
-    sqlite3_finalize(stmt);
-    sqlite3_close(db);
+    sqlite3_reset(stmt);
 
     if (!has_data) {
         json_object_put(jsonArray);
@@ -493,3 +517,142 @@ void get_last_60_seconds()
 
     json_object_put(jsonArray);
 }
+
+void get_sensors()
+{
+    sqlite3 *db;
+    sqlite3_stmt *stmt;
+
+    db = db_reader();
+    if (db == NULL) {
+        return;
+    }
+
+    const char *sql = "SELECT id, name, port FROM sensors ORDER BY id;";
+    stmt = db_statement(db, sql);
+    if (stmt == NULL) {
+        return;
+    }
+
+    json_object *jsonArray = json_object_new_array();
+
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char *name = (const char*)sqlite3_column_text(stmt, 1);
+        const char *port = (const char*)sqlite3_column_text(stmt, 2);
+
+        json_object *jsonObj = json_object_new_object();
+        json_object_object_add(jsonObj, "ID", json_object_new_int(sqlite3_column_int(stmt, 0)));
+        json_object_object_add(jsonObj, "NAME", json_object_new_string(name ? name : ""));
+        json_object_object_add(jsonObj, "PORT", json_object_new_string(port ? port : ""));
+        json_object_array_add(jsonArray, jsonObj);
+    }
+
+    sqlite3_reset(stmt);
+
+    const char *jsonStr = json_object_to_json_string(jsonArray);
+    printf("%s\n", jsonStr);
+
+    json_object_put(jsonArray);
+}
+
+// percentiles over the last span seconds, merged from rollup sketches
+void get_percentiles(int sensor_id, int64_t span)
+{
+    sqlite3 *db;
+
+    db = db_reader();
+    if (db == NULL) {
+        return;
+    }
+
+    struct percentiles p;
+    if (query_percentiles(db, sensor_id, span, &p) == -1) {
+        return;
+    }
+
+    json_object *jsonObj = json_object_new_object();
+    json_object_object_add(jsonObj, "FROM", json_object_new_string(p.from));
+    json_object_object_add(jsonObj, "TIER", json_object_new_string(p.tier->name));
+    json_object_object_add(jsonObj, "COUNT", json_object_new_int64(p.count));
+    if (p.count > 0) {
+        char temp[32];
+        snprintf(temp, sizeof(temp), "%.1f", p.min);
+        json_object_object_add(jsonObj, "MIN", json_object_new_string(temp));
+        for (int i = 0; i < PERCENTILE_COUNT; ++i) {
+            char key[8];
+            snprintf(key, sizeof(key), "P%d", (int)(percentile_ranks[i] * 100 + 0.5));
+            snprintf(temp, sizeof(temp), "%.1f", p.values[i]);
+            json_object_object_add(jsonObj, key, json_object_new_string(temp));
+        }
+        snprintf(temp, sizeof(temp), "%.1f", p.max);
+        json_object_object_add(jsonObj, "MAX", json_object_new_string(temp));
+    }
+
+    const char *jsonStr = json_object_to_json_string(jsonObj);
+    printf("%s\n", jsonStr);
+
+    json_object_put(jsonObj);
+}
+
+// wal size and checkpoint latency of the running server, empty object when it is not running
+void get_wal_metrics()
+{
+    json_object *jsonObj = json_object_new_object();
+    struct wal_metrics m;
+    if (live_read_wal(&m) == 0) {
+        uint64_t checkpoints = atomic_load(&m.checkpoints);
+        json_object_object_add(jsonObj, "WAL_BYTES", json_object_new_int64((int64_t)atomic_load(&m.wal_bytes)));
+        json_object_object_add(jsonObj, "WAL_FRAMES", json_object_new_int64((int64_t)atomic_load(&m.wal_frames)));
+        json_object_object_add(jsonObj, "COPIED_FRAMES", json_object_new_int64((int64_t)atomic_load(&m.copied_frames)));
+        json_object_object_add(jsonObj, "CHECKPOINTS", json_object_new_int64((int64_t)checkpoints));
+        json_object_object_add(jsonObj, "BUSY", json_object_new_int64((int64_t)atomic_load(&m.busy)));
+        json_object_object_add(jsonObj, "LAST_US", json_object_new_int64((int64_t)atomic_load(&m.last_us)));
+        json_object_object_add(jsonObj, "MAX_US", json_object_new_int64((int64_t)atomic_load(&m.max_us)));
+        json_object_object_add(jsonObj, "AVG_US", json_object_new_int64(
+            checkpoints ? (int64_t)(atomic_load(&m.total_us) / checkpoints) : 0));
+    }
+
+    const char *jsonStr = json_object_to_json_string(jsonObj);
+    printf("%s\n", jsonStr);
+
+    json_object_put(jsonObj);
+}
+
+// count, average and extremes over the last span seconds
+void get_window_stats(int sensor_id, int64_t span)
+{
+    sqlite3 *db;
+
+    db = db_reader();
+    if (db == NULL) {
+        return;
+    }
+
+    struct window_stats w;
+    const char *source;
+    if (query_window(db, sensor_id, span, &w, &source) == -1) {
+        return;
+    }
+
+    char from[20];
+    format_wall(w.from * SEC_IN_MINUTE, from, sizeof(from));
+
+    json_object *jsonObj = json_object_new_object();
+    json_object_object_add(jsonObj, "FROM", json_object_new_string(from));
+    json_object_object_add(jsonObj, "SOURCE", json_object_new_string(source));
+    json_object_object_add(jsonObj, "COUNT", json_object_new_int64(w.count));
+    if (w.count > 0) {
+        char temp[32];
+        snprintf(temp, sizeof(temp), "%.1f", w.min);
+        json_object_object_add(jsonObj, "MIN", json_object_new_string(temp));
+        snprintf(temp, sizeof(temp), "%.1f", w.sum / w.count);
+        json_object_object_add(jsonObj, "AVG", json_object_new_string(temp));
+        snprintf(temp, sizeof(temp), "%.1f", w.max);
+        json_object_object_add(jsonObj, "MAX", json_object_new_string(temp));
+    }
+
+    const char *jsonStr = json_object_to_json_string(jsonObj);
+    printf("%s\n", jsonStr);
+
+    json_object_put(jsonObj);
+}
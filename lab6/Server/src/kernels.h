@@ -0,0 +1,449 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// aggregation kernels over contiguous sample arrays, doubles and fixed-point int16, in
+// AVX2, SSE2 and scalar versions; kernels() picks the best one the CPU runs, once
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#    define KERNEL_X86 1
+#    include <immintrin.h>
+#    ifdef _MSC_VER
+#        include <intrin.h>
+#        define KERNEL_TARGET(isa)
+#    else
+#        define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#    endif
+#endif
+
+enum kernel_level {
+    KERNEL_SCALAR,
+    KERNEL_SSE2,
+    KERNEL_AVX2,
+    KERNEL_LEVELS,
+};
+
+struct kernels {
+    const char *name;
+    double (*sum_f64)(const double *v, size_t n);
+    void (*minmax_f64)(const double *v, size_t n, double *min, double *max);  // n > 0
+    double (*sqdev_f64)(const double *v, size_t n, double mean);              // sum of (v - mean)^2
+    int64_t (*sum_i16)(const int16_t *v, size_t n);
+    int64_t (*sumsq_i16)(const int16_t *v, size_t n);   // exact, v must not hold INT16_MIN
+    void (*minmax_i16)(const int16_t *v, size_t n, int16_t *min, int16_t *max);  // n > 0
+};
+
+// ---scalar--- //
+
+static double scalar_sum_f64(const double *v, size_t n)
+{
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        s0 += v[i];
+        s1 += v[i + 1];
+        s2 += v[i + 2];
+        s3 += v[i + 3];
+    }
+    for (; i < n; ++i)
+        s0 += v[i];
+    return (s0 + s1) + (s2 + s3);
+}
+
+static void scalar_minmax_f64(const double *v, size_t n, double *min, double *max)
+{
+    double lo = v[0], hi = v[0];
+    for (size_t i = 1; i < n; ++i) {
+        lo = v[i] < lo ? v[i] : lo;
+        hi = v[i] > hi ? v[i] : hi;
+    }
+    *min = lo;
+    *max = hi;
+}
+
+static double scalar_sqdev_f64(const double *v, size_t n, double mean)
+{
+    double s0 = 0, s1 = 0;
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        double d0 = v[i] - mean, d1 = v[i + 1] - mean;
+        s0 += d0 * d0;
+        s1 += d1 * d1;
+    }
+    for (; i < n; ++i)
+        s0 += (v[i] - mean) * (v[i] - mean);
+    return s0 + s1;
+}
+
+static int64_t scalar_sum_i16(const int16_t *v, size_t n)
+{
+    int64_t s = 0;
+    for (size_t i = 0; i < n; ++i)
+        s += v[i];
+    return s;
+}
+
+static int64_t scalar_sumsq_i16(const int16_t *v, size_t n)
+{
+    int64_t s = 0;
+    for (size_t i = 0; i < n; ++i)
+        s += (int32_t)v[i] * v[i];
+    return s;
+}
+
+static void scalar_minmax_i16(const int16_t *v, size_t n, int16_t *min, int16_t *max)
+{
+    int16_t lo = v[0], hi = v[0];
+    for (size_t i = 1; i < n; ++i) {
+        lo = v[i] < lo ? v[i] : lo;
+        hi = v[i] > hi ? v[i] : hi;
+    }
+    *min = lo;
+    *max = hi;
+}
+
+static const struct kernels scalar_kernels = {
+    "scalar", scalar_sum_f64, scalar_minmax_f64, scalar_sqdev_f64, scalar_sum_i16, scalar_sumsq_i16, scalar_minmax_i16,
+};
+
+#ifdef KERNEL_X86
+
+// int16 sums go through int32 lanes (madd adds pairs), flushed to int64 before they can overflow
+#define KERNEL_I16_FLUSH 16384
+
+// ---sse2--- //
+
+KERNEL_TARGET("sse2") static double sse2_sum_f64(const double *v, size_t n)
+{
+    __m128d a0 = _mm_setzero_pd(), a1 = _mm_setzero_pd(), a2 = _mm_setzero_pd(), a3 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        a0 = _mm_add_pd(a0, _mm_loadu_pd(v + i));
+        a1 = _mm_add_pd(a1, _mm_loadu_pd(v + i + 2));
+        a2 = _mm_add_pd(a2, _mm_loadu_pd(v + i + 4));
+        a3 = _mm_add_pd(a3, _mm_loadu_pd(v + i + 6));
+    }
+    __m128d a = _mm_add_pd(_mm_add_pd(a0, a1), _mm_add_pd(a2, a3));
+    double lanes[2];
+    _mm_storeu_pd(lanes, a);
+    return lanes[0] + lanes[1] + scalar_sum_f64(v + i, n - i);
+}
+
+KERNEL_TARGET("sse2") static void sse2_minmax_f64(const double *v, size_t n, double *min, double *max)
+{
+    if (n < 4) {
+        scalar_minmax_f64(v, n, min, max);
+        return;
+    }
+    __m128d lo0 = _mm_loadu_pd(v), hi0 = lo0, lo1 = _mm_loadu_pd(v + 2), hi1 = lo1;
+    size_t i = 4;
+    for (; i + 4 <= n; i += 4) {
+        __m128d x0 = _mm_loadu_pd(v + i), x1 = _mm_loadu_pd(v + i + 2);
+        lo0 = _mm_min_pd(lo0, x0);
+        hi0 = _mm_max_pd(hi0, x0);
+        lo1 = _mm_min_pd(lo1, x1);
+        hi1 = _mm_max_pd(hi1, x1);
+    }
+    double l[2], h[2];
+    _mm_storeu_pd(l, _mm_min_pd(lo0, lo1));
+    _mm_storeu_pd(h, _mm_max_pd(hi0, hi1));
+    double lo = l[0] < l[1] ? l[0] : l[1], hi = h[0] > h[1] ? h[0] : h[1];
+    for (; i < n; ++i) {
+        lo = v[i] < lo ? v[i] : lo;
+        hi = v[i] > hi ? v[i] : hi;
+    }
+    *min = lo;
+    *max = hi;
+}
+
+KERNEL_TARGET("sse2") static double sse2_sqdev_f64(const double *v, size_t n, double mean)
+{
+    __m128d m = _mm_set1_pd(mean), a0 = _mm_setzero_pd(), a1 = _mm_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128d d0 = _mm_sub_pd(_mm_loadu_pd(v + i), m), d1 = _mm_sub_pd(_mm_loadu_pd(v + i + 2), m);
+        a0 = _mm_add_pd(a0, _mm_mul_pd(d0, d0));
+        a1 = _mm_add_pd(a1, _mm_mul_pd(d1, d1));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, _mm_add_pd(a0, a1));
+    return lanes[0] + lanes[1] + scalar_sqdev_f64(v + i, n - i, mean);
+}
+
+KERNEL_TARGET("sse2") static int64_t sse2_sum_i16(const int16_t *v, size_t n)
+{
+    const __m128i ones = _mm_set1_epi16(1);
+    int64_t total = 0;
+    size_t i = 0;
+    while (i + 8 <= n) {
+        __m128i acc = _mm_setzero_si128();
+        for (size_t k = 0; k < KERNEL_I16_FLUSH && i + 8 <= n; ++k, i += 8)
+            acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(v + i)), ones));
+        int32_t lanes[4];
+        _mm_storeu_si128((__m128i*)lanes, acc);
+        total += (int64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+    return total + scalar_sum_i16(v + i, n - i);
+}
+
+// madd gives x0^2 + x1^2 per int32 lane, below 2^31 without INT16_MIN; widened every step
+KERNEL_TARGET("sse2") static int64_t sse2_sumsq_i16(const int16_t *v, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(v + i));
+        __m128i sq = _mm_madd_epi16(x, x);
+        // lanes are non-negative, zero-extending to int64 is exact
+        acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(sq, zero));
+        acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(sq, zero));
+    }
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, acc);
+    return lanes[0] + lanes[1] + scalar_sumsq_i16(v + i, n - i);
+}
+
+KERNEL_TARGET("sse2") static void sse2_minmax_i16(const int16_t *v, size_t n, int16_t *min, int16_t *max)
+{
+    if (n < 8) {
+        scalar_minmax_i16(v, n, min, max);
+        return;
+    }
+    __m128i lo = _mm_loadu_si128((const __m128i*)v), hi = lo;
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*)(v + i));
+        lo = _mm_min_epi16(lo, x);
+        hi = _mm_max_epi16(hi, x);
+    }
+    int16_t l[8], h[8];
+    _mm_storeu_si128((__m128i*)l, lo);
+    _mm_storeu_si128((__m128i*)h, hi);
+    int16_t rmin, rmax;
+    scalar_minmax_i16(l, 8, &rmin, &rmax);
+    *min = rmin;
+    scalar_minmax_i16(h, 8, &rmin, &rmax);
+    *max = rmax;
+    if (i < n) {
+        scalar_minmax_i16(v + i, n - i, &rmin, &rmax);
+        *min = rmin < *min ? rmin : *min;
+        *max = rmax > *max ? rmax : *max;
+    }
+}
+
+static const struct kernels sse2_kernels = {
+    "sse2", sse2_sum_f64, sse2_minmax_f64, sse2_sqdev_f64, sse2_sum_i16, sse2_sumsq_i16, sse2_minmax_i16,
+};
+
+// ---avx2--- //
+
+KERNEL_TARGET("avx2") static double avx2_hsum(__m256d a)
+{
+    __m128d s = _mm_add_pd(_mm256_castpd256_pd128(a), _mm256_extractf128_pd(a, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+}
+
+KERNEL_TARGET("avx2") static double avx2_sum_f64(const double *v, size_t n)
+{
+    __m256d a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd(), a2 = _mm256_setzero_pd(), a3 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        a0 = _mm256_add_pd(a0, _mm256_loadu_pd(v + i));
+        a1 = _mm256_add_pd(a1, _mm256_loadu_pd(v + i + 4));
+        a2 = _mm256_add_pd(a2, _mm256_loadu_pd(v + i + 8));
+        a3 = _mm256_add_pd(a3, _mm256_loadu_pd(v + i + 12));
+    }
+    double s = avx2_hsum(_mm256_add_pd(_mm256_add_pd(a0, a1), _mm256_add_pd(a2, a3)));
+    for (; i < n; ++i)
+        s += v[i];
+    return s;
+}
+
+KERNEL_TARGET("avx2") static void avx2_minmax_f64(const double *v, size_t n, double *min, double *max)
+{
+    if (n < 8) {
+        scalar_minmax_f64(v, n, min, max);   // before any ymm register is dirty
+        return;
+    }
+    __m256d lo0 = _mm256_loadu_pd(v), hi0 = lo0, lo1 = _mm256_loadu_pd(v + 4), hi1 = lo1;
+    size_t i = 8;
+    for (; i + 8 <= n; i += 8) {
+        __m256d x0 = _mm256_loadu_pd(v + i), x1 = _mm256_loadu_pd(v + i + 4);
+        lo0 = _mm256_min_pd(lo0, x0);
+        hi0 = _mm256_max_pd(hi0, x0);
+        lo1 = _mm256_min_pd(lo1, x1);
+        hi1 = _mm256_max_pd(hi1, x1);
+    }
+    double l[4], h[4];
+    _mm256_storeu_pd(l, _mm256_min_pd(lo0, lo1));
+    _mm256_storeu_pd(h, _mm256_max_pd(hi0, hi1));
+    double lo = l[0], hi = h[0];
+    for (int j = 1; j < 4; ++j) {
+        lo = l[j] < lo ? l[j] : lo;
+        hi = h[j] > hi ? h[j] : hi;
+    }
+    for (; i < n; ++i) {
+        lo = v[i] < lo ? v[i] : lo;
+        hi = v[i] > hi ? v[i] : hi;
+    }
+    *min = lo;
+    *max = hi;
+}
+
+KERNEL_TARGET("avx2") static double avx2_sqdev_f64(const double *v, size_t n, double mean)
+{
+    __m256d m = _mm256_set1_pd(mean), a0 = _mm256_setzero_pd(), a1 = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256d d0 = _mm256_sub_pd(_mm256_loadu_pd(v + i), m), d1 = _mm256_sub_pd(_mm256_loadu_pd(v + i + 4), m);
+        a0 = _mm256_add_pd(a0, _mm256_mul_pd(d0, d0));
+        a1 = _mm256_add_pd(a1, _mm256_mul_pd(d1, d1));
+    }
+    double s = avx2_hsum(_mm256_add_pd(a0, a1));
+    for (; i < n; ++i)
+        s += (v[i] - mean) * (v[i] - mean);
+    return s;
+}
+
+KERNEL_TARGET("avx2") static int64_t avx2_sum_i16(const int16_t *v, size_t n)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    int64_t total = 0;
+    size_t i = 0;
+    while (i + 16 <= n) {
+        __m256i acc = _mm256_setzero_si256();
+        for (size_t k = 0; k < KERNEL_I16_FLUSH && i + 16 <= n; ++k, i += 16)
+            acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i*)(v + i)), ones));
+        __m256i wide = _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(acc)),
+                                        _mm256_cvtepi32_epi64(_mm256_extracti128_si256(acc, 1)));
+        int64_t lanes[4];
+        _mm256_storeu_si256((__m256i*)lanes, wide);
+        total += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+    for (; i < n; ++i)
+        total += v[i];
+    return total;
+}
+
+KERNEL_TARGET("avx2") static int64_t avx2_sumsq_i16(const int16_t *v, size_t n)
+{
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(v + i));
+        __m256i sq = _mm256_madd_epi16(x, x);
+        acc = _mm256_add_epi64(acc, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(sq)));
+        acc = _mm256_add_epi64(acc, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(sq, 1)));
+    }
+    int64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, acc);
+    int64_t total = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    for (; i < n; ++i)
+        total += (int32_t)v[i] * v[i];
+    return total;
+}
+
+KERNEL_TARGET("avx2") static void avx2_minmax_i16(const int16_t *v, size_t n, int16_t *min, int16_t *max)
+{
+    if (n < 16) {
+        scalar_minmax_i16(v, n, min, max);
+        return;
+    }
+    __m256i lo = _mm256_loadu_si256((const __m256i*)v), hi = lo;
+    size_t i = 16;
+    for (; i + 16 <= n; i += 16) {
+        __m256i x = _mm256_loadu_si256((const __m256i*)(v + i));
+        lo = _mm256_min_epi16(lo, x);
+        hi = _mm256_max_epi16(hi, x);
+    }
+    int16_t l[16], h[16];
+    _mm256_storeu_si256((__m256i*)l, lo);
+    _mm256_storeu_si256((__m256i*)h, hi);
+    int16_t rmin = l[0], rmax = h[0];
+    for (int j = 1; j < 16; ++j) {
+        rmin = l[j] < rmin ? l[j] : rmin;
+        rmax = h[j] > rmax ? h[j] : rmax;
+    }
+    for (; i < n; ++i) {
+        rmin = v[i] < rmin ? v[i] : rmin;
+        rmax = v[i] > rmax ? v[i] : rmax;
+    }
+    *min = rmin;
+    *max = rmax;
+}
+
+static const struct kernels avx2_kernels = {
+    "avx2", avx2_sum_f64, avx2_minmax_f64, avx2_sqdev_f64, avx2_sum_i16, avx2_sumsq_i16, avx2_minmax_i16,
+};
+
+static int kernel_cpu_has(enum kernel_level level)
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    if (level == KERNEL_SSE2)
+        return (info[3] >> 26) & 1;
+    // avx2 also needs the OS to save ymm registers
+    if (!((info[2] >> 27) & 1) || (_xgetbv(0) & 6) != 6)
+        return 0;
+    __cpuidex(info, 7, 0);
+    return (info[1] >> 5) & 1;
+#else
+    __builtin_cpu_init();
+    return level == KERNEL_SSE2 ? __builtin_cpu_supports("sse2") : __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+// kernels of one level, NULL when this CPU or build cannot run them
+const struct kernels *kernels_at(enum kernel_level level)
+{
+    if (level == KERNEL_SCALAR)
+        return &scalar_kernels;
+#ifdef KERNEL_X86
+    if (kernel_cpu_has(level))
+        return level == KERNEL_SSE2 ? &sse2_kernels : &avx2_kernels;
+#endif
+    return NULL;
+}
+
+// best kernels of this CPU, concurrent first calls pick the same ones
+const struct kernels *kernels()
+{
+    static const struct kernels *best = NULL;
+    if (best == NULL) {
+        const struct kernels *k = NULL;
+        for (int level = KERNEL_LEVELS - 1; k == NULL; --level)
+            k = kernels_at((enum kernel_level)level);
+        best = k;
+    }
+    return best;
+}
+
+// ---helpers--- //
+
+double kernel_mean(const double *v, size_t n)
+{
+    return n > 0 ? kernels()->sum_f64(v, n) / n : 0;
+}
+
+// population variance, two passes so large means do not cancel the digits that matter
+double kernel_variance(const double *v, size_t n)
+{
+    if (n == 0)
+        return 0;
+    const struct kernels *k = kernels();
+    double mean = k->sum_f64(v, n) / n;
+    return k->sqdev_f64(v, n, mean) / n;
+}
+
+// min and max of every run of width values, the last one may be shorter; returns the bucket count
+size_t kernel_bucket_minmax(const double *v, size_t n, size_t width, double *mins, double *maxs)
+{
+    const struct kernels *k = kernels();
+    size_t buckets = 0;
+    for (size_t i = 0; i < n; i += width, ++buckets)
+        k->minmax_f64(v + i, n - i < width ? n - i : width, &mins[buckets], &maxs[buckets]);
+    return buckets;
+}
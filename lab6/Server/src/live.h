@@ -0,0 +1,358 @@
+#pragma once
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "decicelsius.h"
+#include "kernels.h"
+#include "vclock.h"
+
+#ifdef _WIN32
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <unistd.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#endif
+
+// last 24 hours of raw samples per sensor in shared memory, written by the server's
+// reader thread and read lock-free by request handlers and temp.cgi
+#ifdef _WIN32
+#    define LIVE_NAME "Local\\lab6_temperature_live"
+#else
+#    define LIVE_NAME "/lab6_temperature_live"
+#endif
+#define LIVE_MAGIC 0x4556494Cu
+#define LIVE_SLOTS 86400
+#define LIVE_MAX_SERIES 64
+
+struct live_sample {
+    int64_t time_ms;
+    decicelsius value;
+};
+
+// seq is odd while the writer updates the series (seqlock); times and values are kept
+// in separate arrays so aggregates run the vector kernels straight over the ring
+struct live_series {
+    _Alignas(64) _Atomic uint32_t seq;
+    int32_t sensor_id;
+    _Atomic uint64_t count;
+    _Alignas(64) int64_t times[LIVE_SLOTS];
+    _Alignas(64) decicelsius values[LIVE_SLOTS];
+};
+
+struct live_stats {
+    int count;
+    double min;
+    double max;
+    double mean;
+    double stddev;
+};
+
+// WAL state published by the server's checkpoint thread, the only writer
+struct wal_metrics {
+    _Atomic uint64_t wal_bytes;      // size of the -wal file after the last checkpoint
+    _Atomic uint64_t wal_frames;     // frames in the WAL at the last checkpoint
+    _Atomic uint64_t copied_frames;  // of them already copied into the db
+    _Atomic uint64_t checkpoints;
+    _Atomic uint64_t busy;           // checkpoints that stopped at a frame a reader still used
+    _Atomic uint64_t last_us;        // checkpoint latency
+    _Atomic uint64_t max_us;
+    _Atomic uint64_t total_us;
+};
+
+struct live_shm {
+    _Atomic uint32_t magic;
+    _Atomic int32_t series_count;
+    struct wal_metrics wal;
+    struct vclock clock;   // the server's, temp.cgi reads "now" from it too
+    struct live_series series[LIVE_MAX_SERIES];
+};
+
+struct live {
+    struct live_shm *shm;
+#ifdef _WIN32
+    HANDLE map;
+#else
+    int fd;
+#endif
+};
+
+static int live_map(struct live *l, int create)
+{
+    size_t size = sizeof(struct live_shm);
+#ifdef _WIN32
+    if (create) {
+        l->map = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                   (DWORD)((uint64_t)size >> 32), (DWORD)size, LIVE_NAME);
+    } else {
+        l->map = OpenFileMapping(FILE_MAP_READ, FALSE, LIVE_NAME);
+    }
+    if (l->map == NULL)
+        return -1;
+    l->shm = MapViewOfFile(l->map, create ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+    if (l->shm == NULL) {
+        CloseHandle(l->map);
+        return -1;
+    }
+#else
+    l->fd = shm_open(LIVE_NAME, create ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+    if (l->fd == -1)
+        return -1;
+    // pages are only backed once a series writes to them
+    if (create && ftruncate(l->fd, (off_t)size) == -1) {
+        perror("ftruncate (live)");
+        close(l->fd);
+        return -1;
+    }
+    void *addr = mmap(NULL, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, l->fd, 0);
+    if (addr == MAP_FAILED) {
+        perror("mmap (live)");
+        close(l->fd);
+        return -1;
+    }
+    l->shm = (struct live_shm*)addr;
+#endif
+    return 0;
+}
+
+static void live_unmap(struct live *l)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(l->shm);
+    CloseHandle(l->map);
+#else
+    munmap(l->shm, sizeof(struct live_shm));
+    close(l->fd);
+#endif
+    l->shm = NULL;
+}
+
+// ---writer--- //
+
+int live_create(struct live *l)
+{
+    if (live_map(l, 1) == -1) {
+        fprintf(stderr, "Cannot create shared memory %s\n", LIVE_NAME);
+        return -1;
+    }
+    l->shm->clock = vclock_state;
+    // readable before the first sample, the wal metrics are there from the start
+    atomic_store_explicit(&l->shm->magic, LIVE_MAGIC, memory_order_release);
+    return 0;
+}
+
+// series of a sensor, added on first use
+struct live_series *live_series_get(struct live *l, int sensor_id)
+{
+    int count = atomic_load_explicit(&l->shm->series_count, memory_order_relaxed);
+    for (int i = 0; i < count; ++i) {
+        if (l->shm->series[i].sensor_id == sensor_id)
+            return &l->shm->series[i];
+    }
+    if (count >= LIVE_MAX_SERIES)
+        return NULL;
+
+    struct live_series *s = &l->shm->series[count];
+    s->sensor_id = sensor_id;
+    atomic_store_explicit(&l->shm->series_count, count + 1, memory_order_release);
+    atomic_store_explicit(&l->shm->magic, LIVE_MAGIC, memory_order_release);
+    return s;
+}
+
+void live_publish(struct live_series *s, int64_t time_ms, decicelsius value)
+{
+    uint32_t seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+    uint64_t count = atomic_load_explicit(&s->count, memory_order_relaxed);
+
+    atomic_store_explicit(&s->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    s->times[count % LIVE_SLOTS] = time_ms;
+    s->values[count % LIVE_SLOTS] = value;
+    atomic_store_explicit(&s->count, count + 1, memory_order_relaxed);
+
+    atomic_store_explicit(&s->seq, seq + 2, memory_order_release);
+}
+
+void live_destroy(struct live *l)
+{
+    live_unmap(l);
+#ifndef _WIN32
+    shm_unlink(LIVE_NAME);
+#endif
+}
+
+// ---reader--- //
+
+int live_open(struct live *l)
+{
+    if (live_map(l, 0) == -1)
+        return -1;
+    if (atomic_load_explicit(&l->shm->magic, memory_order_acquire) != LIVE_MAGIC) {
+        live_unmap(l);
+        return -1;
+    }
+    return 0;
+}
+
+void live_close(struct live *l)
+{
+    live_unmap(l);
+}
+
+static struct live_series *live_find(struct live *l, int sensor_id)
+{
+    int count = atomic_load_explicit(&l->shm->series_count, memory_order_acquire);
+    for (int i = 0; i < count; ++i) {
+        if (l->shm->series[i].sensor_id == sensor_id)
+            return &l->shm->series[i];
+    }
+    return NULL;
+}
+
+// copy the newest n samples of a sensor, oldest first, returns how many or -1
+// when the sensor has no series; retried until no write overlapped the copy
+int live_last(struct live *l, int sensor_id, struct live_sample *out, int n)
+{
+    struct live_series *s = live_find(l, sensor_id);
+    if (s == NULL)
+        return -1;
+
+    for (;;) {
+        uint32_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        if (seq & 1)
+            continue;
+
+        uint64_t total = atomic_load_explicit(&s->count, memory_order_relaxed);
+        int take = n;
+        if ((uint64_t)take > total)
+            take = (int)total;
+        if (take > LIVE_SLOTS)
+            take = LIVE_SLOTS;
+
+        uint64_t first = total - take;
+        for (int i = 0; i < take; ++i) {
+            out[i].time_ms = s->times[(first + i) % LIVE_SLOTS];
+            out[i].value = s->values[(first + i) % LIVE_SLOTS];
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&s->seq, memory_order_relaxed) == seq)
+            return take;
+    }
+}
+
+// min, max, mean and standard deviation of the newest n samples, computed in place over the
+// one or two runs of the ring they span; returns -1 when the sensor has no series
+int live_summary(struct live *l, int sensor_id, int n, struct live_stats *out)
+{
+    struct live_series *s = live_find(l, sensor_id);
+    if (s == NULL)
+        return -1;
+
+    const struct kernels *k = kernels();
+    for (;;) {
+        uint32_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        if (seq & 1)
+            continue;
+
+        uint64_t total = atomic_load_explicit(&s->count, memory_order_relaxed);
+        int take = n;
+        if ((uint64_t)take > total)
+            take = (int)total;
+        if (take > LIVE_SLOTS)
+            take = LIVE_SLOTS;
+
+        memset(out, 0, sizeof(*out));
+        out->count = take;
+        if (take > 0) {
+            const decicelsius *run[2];
+            size_t len[2];
+            size_t first = (size_t)((total - take) % LIVE_SLOTS);
+            run[0] = s->values + first;
+            len[0] = first + take <= LIVE_SLOTS ? (size_t)take : LIVE_SLOTS - first;
+            run[1] = s->values;
+            len[1] = take - len[0];
+
+            // integer sums are exact, the variance is E[x^2] - E[x]^2 without cancellation error
+            int64_t sum = 0, sq = 0;
+            decicelsius lo = DECI_MAX, hi = DECI_MIN;
+            for (int r = 0; r < 2; ++r) {
+                if (len[r] == 0)
+                    continue;
+                decicelsius rlo, rhi;
+                k->minmax_i16(run[r], len[r], &rlo, &rhi);
+                lo = rlo < lo ? rlo : lo;
+                hi = rhi > hi ? rhi : hi;
+                sum += k->sum_i16(run[r], len[r]);
+                sq += k->sumsq_i16(run[r], len[r]);
+            }
+            double variance = ((double)sq * take - (double)sum * sum) / ((double)take * take);
+            out->min = deci_to_double(lo);
+            out->max = deci_to_double(hi);
+            out->mean = (double)sum / take / 10.0;
+            out->stddev = variance > 0 ? sqrt(variance) / 10.0 : 0;
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&s->seq, memory_order_relaxed) == seq)
+            return take;
+    }
+}
+
+// one-shot read for a CGI request, -1 if the server is not running
+int live_read_last(int sensor_id, struct live_sample *out, int n)
+{
+    struct live l;
+    if (live_open(&l) == -1)
+        return -1;
+    int count = live_last(&l, sensor_id, out, n);
+    live_close(&l);
+    return count;
+}
+
+// one-shot summary for a CGI request, -1 if the server is not running
+int live_read_summary(int sensor_id, int n, struct live_stats *out)
+{
+    struct live l;
+    if (live_open(&l) == -1)
+        return -1;
+    int count = live_summary(&l, sensor_id, n, out);
+    live_close(&l);
+    return count;
+}
+
+// the clock of the running server, -1 when it is not running
+int live_read_clock(struct vclock *out)
+{
+    struct live l;
+    if (live_open(&l) == -1)
+        return -1;
+    *out = l.shm->clock;
+    live_close(&l);
+    return 0;
+}
+
+// copy of the server's wal metrics, -1 if it is not running
+int live_read_wal(struct wal_metrics *out)
+{
+    struct live l;
+    if (live_open(&l) == -1)
+        return -1;
+    const struct wal_metrics *m = &l.shm->wal;
+    atomic_init(&out->wal_bytes, atomic_load(&m->wal_bytes));
+    atomic_init(&out->wal_frames, atomic_load(&m->wal_frames));
+    atomic_init(&out->copied_frames, atomic_load(&m->copied_frames));
+    atomic_init(&out->checkpoints, atomic_load(&m->checkpoints));
+    atomic_init(&out->busy, atomic_load(&m->busy));
+    atomic_init(&out->last_us, atomic_load(&m->last_us));
+    atomic_init(&out->max_us, atomic_load(&m->max_us));
+    atomic_init(&out->total_us, atomic_load(&m->total_us));
+    live_close(&l);
+    return 0;
+}
@@ -1,5 +1,20 @@
+#ifndef _WIN32
+#    define _GNU_SOURCE // ppoll
+#endif
+
 #include "sqlite3.h"
 #include "serial.h"
+#include "sensors.h"
+#include "calendar.h"
+#include "ring.h"
+#include "journal.h"
+#include "tsdb.h"
+#include "live.h"
+#include "window.h"
+#include "policy.h"
+#include "sketch.h"
+#include "checkpoint.h"
+#include "vclock.h"
 
 #ifdef _WIN32
 #    include <winsock2.h>
@@ -13,6 +28,7 @@
 #    include <signal.h>
 #    include <arpa/inet.h>
 #    include <poll.h>
+#    include "reactor.h"
 #endif
 
 #include <stdio.h>
@@ -20,28 +36,27 @@
 #include <string.h>
 #include <sys/time.h>
 
-#ifdef _WIN32
-#    define PORT_RD "COM9"
-#else
-#    define PORT_RD "/dev/pts/6"
+#ifndef _WIN32
 #    define SOCKET int
 #endif
 
-#define SEC_IN_HOUR 3600
-#define SEC_IN_DAY 86400
-
 #define INTERFACE_IP "127.0.0.1"
 #define PORT 8080
 #define READ_WAIT_MS 50
 #define MAX_CLIENTS 100
 
 struct thr_data {
-    #ifdef _WIN32
-    HANDLE fd;
-    #else
-    int fd;
-    #endif
+    struct sensor_registry *sensors;
     sqlite3 *db;
+    struct ring *ring;
+    struct journal *journal;
+    struct tsdb *tsdb;
+    struct live *live;
+    struct window *window;
+    const struct policy *policy;
+#ifndef _WIN32
+    struct reactor *reactor;
+#endif
 };
 
 volatile unsigned char need_exit = 0;
@@ -57,11 +72,50 @@ BOOL WINAPI console_handler(DWORD signal)
 #else
 void sig_handler(int sig)
 {
-    if (sig == SIGINT)
+    if (sig == SIGINT || sig == SIGTERM)
         need_exit = 1;
 }
 #endif
 
+// exports can be any size and binary: relay the cgi output as it comes, the end of the
+// response is the closed connection
+void stream_cgi(SOCKET client_socket, const char *uri)
+{
+#ifdef _WIN32
+    FILE *cgi = _popen("temp.cgi", "rb");
+#else
+    FILE *cgi = popen("./temp.cgi", "r");
+#endif
+    if (cgi == NULL) {
+        perror("Failed to run CGI script");
+        return;
+    }
+
+    const char *content_type = strstr(uri, "format=bin") != NULL ? "application/octet-stream" : "text/csv";
+    char header[256];
+    int len = snprintf(header, sizeof(header),
+                       "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: %s\r\n"
+                       "Connection: close\r\n"
+                       "\r\n", content_type);
+    int ok = send(client_socket, header, len, 0) == len;
+
+    static char chunk[65536];
+    size_t n;
+    while (ok && (n = fread(chunk, 1, sizeof(chunk), cgi)) > 0) {
+        for (size_t sent = 0; ok && sent < n;) {
+            int res = send(client_socket, chunk + sent, (int)(n - sent), 0);
+            ok = res > 0;
+            sent += ok ? (size_t)res : 0;
+        }
+    }
+#ifdef _WIN32
+    _pclose(cgi);
+#else
+    pclose(cgi);
+#endif
+}
+
 void handle_client(SOCKET client_socket)
 {
     char buffer[1024];
@@ -82,6 +136,7 @@ void handle_client(SOCKET client_socket)
 
     char *action_value = NULL;
     char *client_type_value = NULL;
+    char *sensor_value = "";
     char *header_line = strtok(buffer, "\r\n");
     while (header_line != NULL) {
         if (strncmp(header_line, "action:", strlen("action:")) == 0) {
@@ -90,9 +145,19 @@ void handle_client(SOCKET client_socket)
         else if (strncmp(header_line, "X-Client-Type:", strlen("X-Client-Type:")) == 0) {
             client_type_value = header_line + strlen("X-Client-Type: ");
         }
+        else if (strncmp(header_line, "sensor:", strlen("sensor:")) == 0) {
+            sensor_value = header_line + strlen("sensor: ");
+        }
         header_line = strtok(NULL, "\r\n");
     }
 
+    // sensor header of qt-app, browsers pass ?sensor=N in the uri instead
+#ifdef _WIN32
+    _putenv_s("SENSOR_ID", sensor_value);
+#else
+    setenv("SENSOR_ID", sensor_value, 1);
+#endif
+
     if (client_type_value != NULL && strcmp(client_type_value, "qt-app") == 0) {
         printf("CLIENT_TYPE: qt-app\n");
 
@@ -104,6 +169,16 @@ void handle_client(SOCKET client_socket)
         setenv("CLIENT_TYPE", "qt-app", 1);
 #endif
 
+        if (action_value != NULL && strncmp(action_value, "export", strlen("export")) == 0) {
+            stream_cgi(client_socket, action_value);
+#ifdef _WIN32
+            closesocket(client_socket);
+#else
+            close(client_socket);
+#endif
+            return;
+        }
+
 #ifdef _WIN32
         FILE *cgi = _popen("temp.cgi", "r");
 #else
@@ -165,6 +240,16 @@ void handle_client(SOCKET client_socket)
         setenv("CLIENT_TYPE", "web", 1);
 #endif
 
+        if (strncmp(uri_start, "/export", strlen("/export")) == 0) {
+            stream_cgi(client_socket, uri_start);
+#ifdef _WIN32
+            closesocket(client_socket);
+#else
+            close(client_socket);
+#endif
+            return;
+        }
+
 #ifdef _WIN32
         FILE *cgi = _popen("temp.cgi", "r");
 #else
@@ -218,173 +303,683 @@ void execute_sql(sqlite3 *db, const char *sql)
     }
 }
 
-void prepare_bind_step(sqlite3 *db, const char *sql, sqlite3_stmt **statement, double value, int index)
+sqlite3_stmt *prepare_sql(sqlite3 *db, const char *sql)
 {
-    char *err_msg = 0;
-    int res = sqlite3_prepare_v2(db, sql, -1, statement, 0);
-    if (res == SQLITE_OK) {
-        sqlite3_bind_double(*statement, index, value);
-        int step = sqlite3_step(*statement);
-        if (step != SQLITE_DONE) {
-            fprintf(stderr, "Error: %s\n", sqlite3_errmsg(db));
-            sqlite3_finalize(*statement);
-            sqlite3_close(db);
-            exit(EXIT_FAILURE);
-        }
-    } else {
+    sqlite3_stmt *statement;
+    int res = sqlite3_prepare_v2(db, sql, -1, &statement, 0);
+    if (res != SQLITE_OK) {
         fprintf(stderr, "Error: %s\n", sqlite3_errmsg(db));
         sqlite3_close(db);
         exit(EXIT_FAILURE);
     }
-    sqlite3_finalize(*statement);
+    return statement;
 }
 
-#ifdef _WIN32
-DWORD WINAPI thr_routine_db(void *args)
+void insert_sample(sqlite3 *db, sqlite3_stmt *statement, int sensor_id, const char *date, double value)
 {
-    struct thr_data *params = (struct thr_data*)args;
+    sqlite3_bind_int(statement, 1, sensor_id);
+    sqlite3_bind_text(statement, 2, date, -1, SQLITE_STATIC);
+    sqlite3_bind_double(statement, 3, value);
+    int step = sqlite3_step(statement);
+    if (step != SQLITE_DONE) {
+        fprintf(stderr, "Error: %s\n", sqlite3_errmsg(db));
+        sqlite3_finalize(statement);
+        sqlite3_close(db);
+        exit(EXIT_FAILURE);
+    }
+    sqlite3_reset(statement);
+}
 
-    char buffer[255];
-    double cur_temp;
+int has_column(sqlite3 *db, const char *table, const char *column)
+{
+    char sql[128];
+    snprintf(sql, sizeof(sql), "PRAGMA table_info(%s);", table);
+
+    sqlite3_stmt *statement = prepare_sql(db, sql);
+    int found = 0;
+    while (sqlite3_step(statement) == SQLITE_ROW) {
+        const char *name = (const char*)sqlite3_column_text(statement, 1);
+        if (name != NULL && strcmp(name, column) == 0) {
+            found = 1;
+            break;
+        }
+    }
+    sqlite3_finalize(statement);
+    return found;
+}
+
+int has_table(sqlite3 *db, const char *table)
+{
+    sqlite3_stmt *statement = prepare_sql(db,
+        "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = ?;");
+    sqlite3_bind_text(statement, 1, table, -1, SQLITE_STATIC);
+    int found = sqlite3_step(statement) == SQLITE_ROW;
+    sqlite3_finalize(statement);
+    return found;
+}
 
-    time_t start_all = time(NULL);
-    time_t start_hour = time(NULL);
-    time_t start_day = time(NULL);
+// tables created before sensor_id existed are renamed and copied into the new schema
+void migrate_table(sqlite3 *db, const char *table)
+{
+    if (!has_table(db, table) || has_column(db, table, "sensor_id"))
+        return;
 
+    char sql[256];
+    snprintf(sql, sizeof(sql), "ALTER TABLE %s RENAME TO %s_v1;", table, table);
+    execute_sql(db, sql);
+    printf("Migrating %s to per-sensor schema\n", table);
+}
+
+// rows of the old table belong to the default sensor
+void copy_migrated_table(sqlite3 *db, const char *table, const char *value_column)
+{
+    char sql[256];
+    snprintf(sql, sizeof(sql), "%s_v1", table);
+    if (!has_table(db, sql))
+        return;
+
+    snprintf(sql, sizeof(sql),
+        "INSERT OR REPLACE INTO %s (sensor_id, date, %s) SELECT %d, date, %s FROM %s_v1;",
+        table, value_column, DEFAULT_SENSOR_ID, value_column, table);
+    execute_sql(db, sql);
+
+    snprintf(sql, sizeof(sql), "DROP TABLE %s_v1;", table);
+    execute_sql(db, sql);
+}
+
+void create_tables(sqlite3 *db, const struct policy *policy)
+{
     char *sql;
-    sqlite3_stmt *statement;
 
-    while (!need_exit) {
-        DWORD bytesRead;
-        if (ReadFile(params->fd, buffer, sizeof(buffer), &bytesRead, NULL)) {
-            if (bytesRead > 0) {
-                cur_temp = atof(buffer);
-                sql = "INSERT INTO temp_all (date, temp) VALUES (DATETIME('now', 'localtime'), ?)";
-                prepare_bind_step(params->db, sql, &statement, cur_temp, 1);
-
-                // delete old recors
-                sql = "DELETE FROM temp_all "
-                "WHERE date < DATETIME('now', 'localtime', '-1 day');";
-                execute_sql(params->db, sql);
-
-                // add record to temp_hour
-                time_t now = time(NULL);
-                if (difftime(now, start_hour) >= SEC_IN_HOUR) {
-                    sql = "INSERT INTO temp_hour (date, avg_temp) "
-                    "SELECT DATETIME('now', 'localtime'), "
-                    "ROUND(AVG(temp), 1) FROM temp_all "
-                    "WHERE date >= DATETIME('now', 'localtime', '-1 hour');";
-                    execute_sql(params->db, sql);
-
-                    // delete old records
-                    sql = "DELETE FROM temp_hour "
-                    "WHERE date < DATETIME('now', 'localtime', '-1 month');";
-                    execute_sql(params->db, sql);
-
-                    start_hour = now;
-                }
+    execute_sql(db, "BEGIN;");
 
-                int db_year = -1;
-                struct tm *tm_now = localtime(&now);
-                int curr_year = tm_now->tm_year + 1900;
-
-                // add record to temp_day
-                if (difftime(now, start_day) >= SEC_IN_DAY) {
-                    sql = "INSERT INTO temp_day (date, avg_temp) "
-                    "SELECT DATETIME('now', 'localtime'), "
-                    "ROUND(AVG(temp), 1) FROM temp_all "
-                    "WHERE date >= DATETIME('now', 'localtime', '-1 day');";
-                    execute_sql(params->db, sql);
-
-                    if (curr_year != db_year) {
-                        char *sql = "DELETE FROM temp_day WHERE strftime('%M', date) != strftime('%M', 'now');";
-                        execute_sql(params->db, sql);
-                        db_year = curr_year;
-                    }
+    migrate_table(db, "temp_all");
+    migrate_table(db, "temp_hour");
+    migrate_table(db, "temp_day");
 
-                    start_day = now;
-                }
+    // create table "sensors"
+    sql = "CREATE TABLE IF NOT EXISTS sensors("
+    "id INTEGER PRIMARY KEY,"
+    "name TEXT,"
+    "port TEXT,"
+    "baud INTEGER"
+    ");";
+    execute_sql(db, sql);
+
+    // create table "temp_all", clustered by sensor so each sensor appends to its own range
+    sql = "CREATE TABLE IF NOT EXISTS temp_all("
+    "sensor_id INTEGER NOT NULL DEFAULT 1,"
+    "date DATETIME DEFAULT CURRENT_TIMESTAMP,"
+    "temp REAL,"
+    "PRIMARY KEY (sensor_id, date)"
+    ") WITHOUT ROWID;";
+    execute_sql(db, sql);
+
+    // retention deletes go by date across all sensors
+    sql = "CREATE INDEX IF NOT EXISTS temp_all_date ON temp_all(date);";
+    execute_sql(db, sql);
+
+    // one table per downsampling tier, sum_temp and samples let coarser tiers average exactly,
+    // the sketch answers quantiles of the bucket
+    for (int i = 1; i < policy->count; ++i) {
+        const char *table = policy->tiers[i].table;
+        char buf[512];
+        snprintf(buf, sizeof(buf), "CREATE TABLE IF NOT EXISTS %s("
+        "sensor_id INTEGER NOT NULL DEFAULT 1,"
+        "date DATETIME DEFAULT CURRENT_TIMESTAMP,"
+        "avg_temp REAL,"
+        "samples INTEGER NOT NULL DEFAULT 1,"
+        "sum_temp REAL,"
+        "sketch BLOB,"
+        "PRIMARY KEY (sensor_id, date)"
+        ") WITHOUT ROWID;", table);
+        execute_sql(db, buf);
+
+        // rollups from before the policy weigh every row the same
+        if (!has_column(db, table, "samples")) {
+            snprintf(buf, sizeof(buf), "ALTER TABLE %s ADD COLUMN samples INTEGER NOT NULL DEFAULT 1;", table);
+            execute_sql(db, buf);
+        }
+        if (!has_column(db, table, "sum_temp")) {
+            snprintf(buf, sizeof(buf), "ALTER TABLE %s ADD COLUMN sum_temp REAL;", table);
+            execute_sql(db, buf);
+            snprintf(buf, sizeof(buf), "UPDATE %s SET sum_temp = avg_temp * samples;", table);
+            execute_sql(db, buf);
+        }
+        if (!has_column(db, table, "sketch")) {
+            snprintf(buf, sizeof(buf), "ALTER TABLE %s ADD COLUMN sketch BLOB;", table);
+            execute_sql(db, buf);
+        }
+
+        snprintf(buf, sizeof(buf), "CREATE INDEX IF NOT EXISTS %s_date ON %s(date);", table, table);
+        execute_sql(db, buf);
+    }
+
+    copy_migrated_table(db, "temp_all", "temp");
+    if (has_table(db, "temp_hour"))
+        copy_migrated_table(db, "temp_hour", "avg_temp");
+    if (has_table(db, "temp_day"))
+        copy_migrated_table(db, "temp_day", "avg_temp");
+
+    // journal position up to which temp_all is derived, and where open tsdb blocks begin
+    sql = "CREATE TABLE IF NOT EXISTS journal_state("
+    "id INTEGER PRIMARY KEY CHECK (id = 1),"
+    "applied INTEGER NOT NULL,"
+    "tsdb_from INTEGER NOT NULL DEFAULT 0"
+    ");";
+    execute_sql(db, sql);
+    if (!has_column(db, "journal_state", "tsdb_from")) {
+        execute_sql(db, "ALTER TABLE journal_state ADD COLUMN tsdb_from INTEGER NOT NULL DEFAULT 0;");
+        execute_sql(db, "UPDATE journal_state SET tsdb_from = applied;");
+    }
+    execute_sql(db, "INSERT OR IGNORE INTO journal_state (id, applied) VALUES (1, 0);");
+
+    // every bucket before until is compacted into the tier
+    sql = "CREATE TABLE IF NOT EXISTS tier_state("
+    "tier TEXT PRIMARY KEY,"
+    "until DATETIME NOT NULL"
+    ");";
+    execute_sql(db, sql);
+
+    execute_sql(db, "COMMIT;");
+}
+
+// run sql with [start, end) bound as ?1 and ?2
+void execute_range_sql(sqlite3 *db, const char *sql, const char *start, const char *end)
+{
+    sqlite3_stmt *statement = prepare_sql(db, sql);
+    sqlite3_bind_text(statement, 1, start, -1, SQLITE_STATIC);
+    sqlite3_bind_text(statement, 2, end, -1, SQLITE_STATIC);
+    if (sqlite3_step(statement) != SQLITE_DONE) {
+        fprintf(stderr, "Error: %s\n", sqlite3_errmsg(db));
+        sqlite3_finalize(statement);
+        sqlite3_close(db);
+        exit(EXIT_FAILURE);
+    }
+    sqlite3_finalize(statement);
+}
+
+struct compactor {
+    const struct policy *policy;
+    int64_t until[POLICY_MAX_TIERS];   // wall seconds, -1 before the first compaction
+};
+
+// one wall-clock second from sql, -1 for NULL
+int64_t query_wall(sqlite3 *db, const char *sql)
+{
+    sqlite3_stmt *statement = prepare_sql(db, sql);
+    int64_t wall = -1;
+    if (sqlite3_step(statement) == SQLITE_ROW && sqlite3_column_type(statement, 0) != SQLITE_NULL)
+        wall = sqlite3_column_int64(statement, 0);
+    sqlite3_finalize(statement);
+    return wall;
+}
+
+void load_compactor(sqlite3 *db, struct compactor *c, const struct policy *policy)
+{
+    c->policy = policy;
+    sqlite3_stmt *statement = prepare_sql(db,
+        "SELECT CAST(strftime('%s', until) AS INTEGER) FROM tier_state WHERE tier = ?;");
+    for (int i = 0; i < policy->count; ++i) {
+        c->until[i] = -1;
+        sqlite3_bind_text(statement, 1, policy->tiers[i].name, -1, SQLITE_STATIC);
+        if (sqlite3_step(statement) == SQLITE_ROW)
+            c->until[i] = sqlite3_column_int64(statement, 0);
+        sqlite3_reset(statement);
+    }
+    sqlite3_finalize(statement);
+}
+
+// first bucket a tier without state has to build: after its newest row, so rollups
+// of the fixed hour/day tables are kept, else the first bucket of its source
+int64_t first_bucket(sqlite3 *db, const struct tier *t, const struct tier *source)
+{
+    char sql[256];
+    snprintf(sql, sizeof(sql), "SELECT CAST(strftime('%%s', MAX(date)) AS INTEGER) + %d FROM %s;",
+             t->resolution, t->table);
+    int64_t wall = query_wall(db, sql);
+    if (wall >= 0)
+        return wall;
+
+    snprintf(sql, sizeof(sql), "SELECT CAST(strftime('%%s', MIN(date)) AS INTEGER) FROM %s;", source->table);
+    wall = query_wall(db, sql);
+    return wall >= 0 ? wall - wall % t->resolution : -1;
+}
+
+// fold the complete buckets of every tier from its finer neighbour, then apply retention,
+// rows of a tier are never removed before the next tier has compacted them; samples applied
+// since the last run (wall seconds [touched_from, touched_to]) that are older than what a tier
+// already folded, e.g. from a replayed trace, rebuild their buckets
+void compact(sqlite3 *db, struct compactor *c, time_t now, int64_t touched_from, int64_t touched_to)
+{
+    const struct policy *p = c->policy;
+    char to_date[20], sql[128];
+
+    execute_sql(db, "BEGIN;");
+
+    sqlite3_stmt *store = prepare_sql(db, "INSERT OR REPLACE INTO tier_state (tier, until) VALUES (?, ?);");
+    int64_t source_until = local_wall_seconds(now);
+    for (int i = 1; i < p->count; ++i) {
+        const struct tier *t = &p->tiers[i];
+        const struct tier *source = &p->tiers[i - 1];
+        int64_t to = source_until - source_until % t->resolution;
+        int64_t from = c->until[i];
+        if (from < 0)
+            from = first_bucket(db, t, source);
+        if (from < 0)
+            from = to;
+
+        if (touched_from <= touched_to && c->until[i] >= 0 && touched_from < c->until[i]) {
+            int64_t late_from = touched_from - touched_from % t->resolution;
+            int64_t late_to = touched_to - touched_to % t->resolution + t->resolution;
+            if (late_to > c->until[i])
+                late_to = c->until[i];
+            if (fold_tier(db, p, i, late_from, late_to) == -1) {
+                sqlite3_close(db);
+                exit(EXIT_FAILURE);
+            }
+            // the rebuilt buckets are what the next tier has to refold
+            touched_from = late_from;
+            touched_to = late_to - 1;
+        } else {
+            touched_from = 1;
+            touched_to = 0;
+        }
+
+        if (to > from && fold_tier(db, p, i, from, to) == -1) {
+            sqlite3_close(db);
+            exit(EXIT_FAILURE);
+        }
+
+        if (to > from || c->until[i] < 0) {
+            c->until[i] = to > from ? to : from;
+            format_wall(c->until[i], to_date, sizeof(to_date));
+            sqlite3_bind_text(store, 1, t->name, -1, SQLITE_STATIC);
+            sqlite3_bind_text(store, 2, to_date, -1, SQLITE_STATIC);
+            if (sqlite3_step(store) != SQLITE_DONE) {
+                fprintf(stderr, "Error: %s\n", sqlite3_errmsg(db));
+                sqlite3_close(db);
+                exit(EXIT_FAILURE);
             }
+            sqlite3_reset(store);
+        }
+        source_until = c->until[i];
+    }
+    sqlite3_finalize(store);
+
+    for (int i = 0; i < p->count; ++i) {
+        const struct tier *t = &p->tiers[i];
+        if (t->retention == 0)
+            continue;
+        int64_t cutoff = local_wall_seconds(now - (time_t)t->retention);
+        if (i + 1 < p->count && c->until[i + 1] < cutoff)
+            cutoff = c->until[i + 1];
+        if (cutoff < 0)
+            continue;
+
+        format_wall(cutoff, to_date, sizeof(to_date));
+        snprintf(sql, sizeof(sql), "DELETE FROM %s WHERE date < ?2;", t->table);
+        execute_range_sql(db, sql, NULL, to_date);
+    }
+
+    execute_sql(db, "COMMIT;");
+}
+
+// millisecond dates, several frames of a sensor can arrive within one second
+#define INSERT_SAMPLE_SQL "INSERT OR REPLACE INTO temp_all (sensor_id, date, temp) VALUES (?, ?, ?);"
+#define STORE_APPLIED_SQL "UPDATE journal_state SET applied = ?, tsdb_from = ? WHERE id = 1;"
+
+// most samples committed in one transaction
+#define WRITE_BATCH 4096
+
+struct sample_ctx {
+    struct ring *ring;
+    struct journal *journal;
+    struct live_series *live;
+    int sensor_id;
+    int64_t time_ms;   // arrival time, for frames without their own
+};
+
+// ingest is a memcpy into the journal, the ring only tells the writer where to look
+void on_sample_frame(const struct frame *frame, void *ctx)
+{
+    struct sample_ctx *sample = (struct sample_ctx*)ctx;
+    uint64_t offset;
+    int64_t time_ms = frame->time_ms > 0 ? frame->time_ms : sample->time_ms;
+    if (journal_append(sample->journal, time_ms, sample->sensor_id, frame->value, &offset) == -1)
+        return;
+    if (sample->live != NULL)
+        live_publish(sample->live, time_ms, frame->value);
+    struct ring_entry entry = {time_ms, 0, offset, RING_SAMPLE};
+    ring_push(sample->ring, &entry);
+}
+
+// compaction goes through the ring too, so it runs after every sample of its buckets
+void push_compact(struct ring *ring, struct journal *journal, time_t boundary)
+{
+    struct ring_entry entry = {(int64_t)boundary * 1000, 0, atomic_load(&journal->head), RING_COMPACT};
+    ring_push(ring, &entry);
+    ring_notify(ring);
+}
+
+// applied: temp_all is derived up to here, tsdb_from: tsdb open blocks start here
+void load_journal_state(sqlite3 *db, uint64_t *applied, uint64_t *tsdb_from)
+{
+    sqlite3_stmt *statement = prepare_sql(db, "SELECT applied, tsdb_from FROM journal_state WHERE id = 1;");
+    *applied = *tsdb_from = 0;
+    if (sqlite3_step(statement) == SQLITE_ROW) {
+        *applied = (uint64_t)sqlite3_column_int64(statement, 0);
+        *tsdb_from = (uint64_t)sqlite3_column_int64(statement, 1);
+    }
+    sqlite3_finalize(statement);
+}
+
+struct journal_writer {
+    sqlite3 *db;
+    sqlite3_stmt *insert;
+    sqlite3_stmt *store_applied;
+    struct journal_reader reader;
+    struct tsdb *tsdb;
+    struct window *window;
+    uint64_t applied;
+    int64_t first_ms;   // sample times applied since the last compaction, first_ms > last_ms for none
+    int64_t last_ms;
+};
+
+// derive temp_all rows from journal records [applied, upto), the new replay position
+// is committed in the same transaction so a crash never applies a record twice
+void apply_journal(struct journal_writer *w, uint64_t upto)
+{
+    if (upto <= w->applied)
+        return;
+
+    char date[32];
+    execute_sql(w->db, "BEGIN;");
+    for (; w->applied < upto; ++w->applied) {
+        const struct journal_record *rec = journal_read(&w->reader, w->applied);
+        if (rec == NULL)
+            continue;
+        if (rec->time_ms < w->first_ms)
+            w->first_ms = rec->time_ms;
+        if (rec->time_ms > w->last_ms)
+            w->last_ms = rec->time_ms;
+        format_local_ms(rec->time_ms, date, sizeof(date));
+        insert_sample(w->db, w->insert, rec->sensor_id, date, deci_to_double(rec->value));
+        tsdb_append(w->tsdb, rec->sensor_id, rec->time_ms, rec->value, w->applied);
+        struct window_series *series = window_series_get(w->window, rec->sensor_id);
+        if (series != NULL)
+            window_add(series, local_wall_seconds((time_t)(rec->time_ms / 1000)) / SEC_IN_MINUTE, rec->value);
+    }
+
+    uint64_t tsdb_from = tsdb_replay_from(w->tsdb, w->applied);
+    sqlite3_bind_int64(w->store_applied, 1, (sqlite3_int64)w->applied);
+    sqlite3_bind_int64(w->store_applied, 2, (sqlite3_int64)tsdb_from);
+    if (sqlite3_step(w->store_applied) != SQLITE_DONE) {
+        fprintf(stderr, "Error: %s\n", sqlite3_errmsg(w->db));
+        sqlite3_close(w->db);
+        exit(EXIT_FAILURE);
+    }
+    sqlite3_reset(w->store_applied);
+    execute_sql(w->db, "COMMIT;");
+
+    journal_trim(&w->reader, tsdb_from);
+}
+
+// rebuild the tsdb blocks that were still open when the last run stopped,
+// samples already sealed into a block are skipped by tsdb_append
+void replay_tsdb(struct journal_writer *w, uint64_t from)
+{
+    for (uint64_t offset = from; offset < w->applied; ++offset) {
+        const struct journal_record *rec = journal_read(&w->reader, offset);
+        if (rec != NULL)
+            tsdb_append(w->tsdb, rec->sensor_id, rec->time_ms, rec->value, offset);
+    }
+}
+
+// per-minute buckets of the window index: the 1m tier up to where the compactor got,
+// raw samples after that; everything journaled but not yet applied is added by the replay
+void rebuild_window(sqlite3 *db, struct window *window, const struct compactor *c, struct sensor_registry *reg)
+{
+    int minute_tier = -1;
+    for (int i = 1; i < c->policy->count; ++i) {
+        if (c->policy->tiers[i].resolution == SEC_IN_MINUTE)
+            minute_tier = i;
+    }
+
+    int64_t head = local_wall_seconds(vclock_now()) / SEC_IN_MINUTE;
+    char from[20], until[20], sql[512];
+    format_wall((head - WINDOW_MINUTES + 1) * SEC_IN_MINUTE, from, sizeof(from));
+    int64_t until_wall = minute_tier > 0 && c->until[minute_tier] > 0 ? c->until[minute_tier] : 0;
+    format_wall(until_wall > 0 ? until_wall : (head - WINDOW_MINUTES + 1) * SEC_IN_MINUTE, until, sizeof(until));
+
+    if (until_wall > 0) {
+        snprintf(sql, sizeof(sql),
+            "SELECT CAST(strftime('%%s', date) AS INTEGER) / 60, sum_temp, samples, "
+            "sketch_quantile(sketch, 0), sketch_quantile(sketch, 1) FROM %s "
+            "WHERE sensor_id = ?1 AND date >= ?2 AND date < ?3 "
+            "UNION ALL ", c->policy->tiers[minute_tier].table);
+    } else {
+        sql[0] = '\0';
+    }
+    snprintf(sql + strlen(sql), sizeof(sql) - strlen(sql),
+        "SELECT CAST(strftime('%%s', date) AS INTEGER) / 60 AS minute, SUM(temp), COUNT(*), MIN(temp), MAX(temp) "
+        "FROM temp_all WHERE sensor_id = ?1 AND date >= ?3 GROUP BY minute;");
+    sqlite3_stmt *statement = prepare_sql(db, sql);
+
+    int64_t buckets = 0;
+    for (int i = 0; i < reg->count; ++i) {
+        struct window_series *series = window_series_get(window, reg->sensors[i].id);
+        if (series == NULL)
+            continue;
+        sqlite3_bind_int(statement, 1, reg->sensors[i].id);
+        sqlite3_bind_text(statement, 2, from, -1, SQLITE_STATIC);
+        sqlite3_bind_text(statement, 3, until, -1, SQLITE_STATIC);
+        window_load_begin(series, head);
+        while (sqlite3_step(statement) == SQLITE_ROW) {
+            window_load_bucket(series, sqlite3_column_int64(statement, 0), sqlite3_column_double(statement, 1),
+                               sqlite3_column_int64(statement, 2), sqlite3_column_double(statement, 3),
+                               sqlite3_column_double(statement, 4));
+            buckets++;
         }
+        window_load_end(series);
+        sqlite3_reset(statement);
     }
+    sqlite3_finalize(statement);
+    printf("Window index: %lld minute buckets\n", (long long)buckets);
+}
+
+// db writer: replays what the last run left in the journal, then follows the ring
+void write_samples(struct thr_data *params)
+{
+    struct ring *ring = params->ring;
+    struct journal_writer w;
+    w.db = params->db;
+    w.insert = prepare_sql(w.db, INSERT_SAMPLE_SQL);
+    w.store_applied = prepare_sql(w.db, STORE_APPLIED_SQL);
+    w.tsdb = params->tsdb;
+    w.window = params->window;
+    w.first_ms = INT64_MAX;
+    w.last_ms = INT64_MIN;
+
+    struct compactor compactor;
+    load_compactor(w.db, &compactor, params->policy);
+    rebuild_window(w.db, w.window, &compactor, params->sensors);
+
+    uint64_t tsdb_from;
+    load_journal_state(w.db, &w.applied, &tsdb_from);
+    journal_reader_init(&w.reader, params->journal->dir, tsdb_from < w.applied ? tsdb_from : w.applied);
+    replay_tsdb(&w, tsdb_from);
+
+    uint64_t head = atomic_load(&params->journal->head);
+    if (head > w.applied) {
+        printf("Replaying %llu journal records\n", (unsigned long long)(head - w.applied));
+        while (w.applied < head)
+            apply_journal(&w, head - w.applied > WRITE_BATCH ? w.applied + WRITE_BATCH : head);
+    }
+
+    size_t avail;
+    while ((avail = ring_wait(ring)) > 0) {
+        const struct ring_entry *entry = ring_peek(ring, 0);
+        if (entry->kind == RING_COMPACT) {
+            time_t boundary = (time_t)(entry->time_ms / 1000);
+            apply_journal(&w, entry->offset);
+            // one immutable tsdb block per sensor and hour
+            if (boundary % SEC_IN_HOUR == 0)
+                tsdb_seal_all(w.tsdb);
+            if (w.first_ms <= w.last_ms)
+                compact(w.db, &compactor, boundary, local_wall_seconds((time_t)(w.first_ms / 1000)),
+                        local_wall_seconds((time_t)(w.last_ms / 1000)));
+            else
+                compact(w.db, &compactor, boundary, 1, 0);
+            w.first_ms = INT64_MAX;
+            w.last_ms = INT64_MIN;
+            ring_release(ring, 1);
+            continue;
+        }
+
+        if (avail > WRITE_BATCH)
+            avail = WRITE_BATCH;
+
+        // samples dropped by a full ring are still in the journal range
+        size_t n = 0;
+        uint64_t upto = w.applied;
+        for (; n < avail; ++n) {
+            entry = ring_peek(ring, n);
+            if (entry->kind != RING_SAMPLE)
+                break;
+            upto = entry->offset + 1;
+        }
+        apply_journal(&w, upto);
+        ring_release(ring, n);
+    }
+
+    if (w.reader.corrupt > 0)
+        fprintf(stderr, "journal: %lu damaged records skipped\n", w.reader.corrupt);
+    journal_reader_close(&w.reader);
+    sqlite3_finalize(w.store_applied);
+    sqlite3_finalize(w.insert);
+}
+
+#ifdef _WIN32
+DWORD WINAPI thr_routine_writer(void *args)
+{
+    write_samples((struct thr_data*)args);
     return 0;
 }
-#else
-void* thr_routine_db(void *args)
+
+DWORD WINAPI thr_routine_checkpoint(void *args)
 {
-    struct thr_data *params = (struct thr_data*)args;
+    checkpointer_run((struct checkpointer*)args);
+    return 0;
+}
 
-    char buffer[255];
-    double cur_temp;
+DWORD WINAPI thr_routine_reader(void *args)
+{
+    struct thr_data *params = (struct thr_data*)args;
+    struct sensor *sensor = &params->sensors->sensors[0];
 
-    time_t start_all = time(NULL);
-    time_t start_hour = time(NULL);
-    time_t start_day = time(NULL);
+    time_t next_minute = next_minute_boundary(vclock_now());
 
-    char *sql;
-    sqlite3_stmt *statement;
+    struct sample_ctx ctx = {params->ring, params->journal, live_series_get(params->live, sensor->id), sensor->id, 0};
 
     while (!need_exit) {
-        ssize_t bytesRead = read(params->fd, buffer, sizeof(buffer));
-        if (bytesRead > 0) {
-
-            cur_temp = atof(buffer);
-            sql = "INSERT INTO temp_all (date, temp) VALUES (DATETIME('now', 'localtime'), ?)";
-            prepare_bind_step(params->db, sql, &statement, cur_temp, 1);
-
-            // delete old recors
-            sql = "DELETE FROM temp_all "
-            "WHERE date < DATETIME('now', 'localtime', '-1 day');";
-            execute_sql(params->db, sql);
-
-            // add record to temp_hour
-            time_t now = time(NULL);
-            if (difftime(now, start_hour) >= SEC_IN_HOUR) {
-                sql = "INSERT INTO temp_hour (date, avg_temp) "
-                "SELECT DATETIME('now', 'localtime'), "
-                "ROUND(AVG(temp), 1) FROM temp_all "
-                "WHERE date >= DATETIME('now', 'localtime', '-1 hour');";
-                execute_sql(params->db, sql);
-
-                // delete old records
-                sql = "DELETE FROM temp_hour "
-                "WHERE date < DATETIME('now', 'localtime', '-1 month');";
-                execute_sql(params->db, sql);
-
-                start_hour = now;
+        size_t avail;
+        char *space = frame_parser_space(&sensor->parser, &avail);
+        DWORD bytesRead;
+        if (ReadFile(sensor->fd, space, (DWORD)avail, &bytesRead, NULL)) {
+            if (bytesRead > 0) {
+                ctx.time_ms = vclock_now_ms();
+                frame_parser_commit(&sensor->parser, bytesRead, on_sample_frame, &ctx);
+                journal_sync(params->journal, 0);
+                ring_notify(params->ring);
             }
+        }
 
-            int db_year = -1;
-            struct tm *tm_now = localtime(&now);
-            int curr_year = tm_now->tm_year + 1900;
-
-            // add record to temp_day
-            if (difftime(now, start_day) >= SEC_IN_DAY) {
-                sql = "INSERT INTO temp_day (date, avg_temp) "
-                "SELECT DATETIME('now', 'localtime'), "
-                "ROUND(AVG(temp), 1) FROM temp_all "
-                "WHERE date >= DATETIME('now', 'localtime', '-1 day');";
-                execute_sql(params->db, sql);
-
-                if (curr_year != db_year) {
-                    char *sql = "DELETE FROM temp_day WHERE strftime('%M', date) != strftime('%M', 'now');";
-                    execute_sql(params->db, sql);
-                    db_year = curr_year;
-                }
-
-                start_day = now;
-            }
+        time_t now = vclock_now();
+        if (now >= next_minute) {
+            push_compact(params->ring, params->journal, next_minute);
+            next_minute = next_minute_boundary(now);
         }
     }
     return 0;
 }
+#else
+// ports with data from one epoll wake-up, the writer is woken once for all of them
+void on_sensors_ready(const int *ready, int count, void *args)
+{
+    struct thr_data *params = (struct thr_data*)args;
+    struct sample_ctx ctx = {params->ring, params->journal, NULL, 0, vclock_now_ms()};
+
+    for (int i = 0; i < count; ++i) {
+        struct sensor *sensor = &params->sensors->sensors[ready[i]];
+        ctx.sensor_id = sensor->id;
+        ctx.live = live_series_get(params->live, sensor->id);
+
+        // drain the port straight into its parser, partial frames stay buffered
+        for (;;) {
+            size_t avail;
+            char *space = frame_parser_space(&sensor->parser, &avail);
+            ssize_t bytesRead = read(sensor->fd, space, avail);
+            if (bytesRead == 0 || (bytesRead == -1 && errno != EAGAIN && errno != EINTR)) {
+                // the other end closed the socket or pty, stop watching it
+                fprintf(stderr, "%s: port closed\n", sensor->port);
+                reactor_remove_source(params->reactor, sensor->fd);
+                close(sensor->fd);
+                sensor->fd = -1;
+                break;
+            }
+            if (bytesRead < 0)
+                break;
+            frame_parser_commit(&sensor->parser, bytesRead, on_sample_frame, &ctx);
+        }
+    }
+    journal_sync(params->journal, 0);
+    ring_notify(params->ring);
+}
+
+void on_compact_timer(time_t deadline, void *ctx)
+{
+    struct thr_data *params = (struct thr_data*)ctx;
+    push_compact(params->ring, params->journal, deadline);
+}
+
+void* thr_routine_writer(void *args)
+{
+    write_samples((struct thr_data*)args);
+    return NULL;
+}
+
+void* thr_routine_checkpoint(void *args)
+{
+    checkpointer_run((struct checkpointer*)args);
+    return NULL;
+}
+
+// serial reader never touches the db, a slow commit cannot stall read()
+void* thr_routine_reader(void *args)
+{
+    struct thr_data *params = (struct thr_data*)args;
+    struct sensor_registry *reg = params->sensors;
+    struct reactor *reactor = params->reactor;
+
+    // sleeps in epoll_wait until a port has data or a minute boundary passes
+    for (int i = 0; i < reg->count; ++i) {
+        if (reactor_add_source(reactor, reg->sensors[i].fd, i) == -1)
+            exit(EXIT_FAILURE);
+    }
+    if (reactor_add_timer(reactor, "compact", next_minute_boundary, on_compact_timer, params) == -1)
+        exit(EXIT_FAILURE);
+
+    reactor_run(reactor, on_sensors_ready, params);
+    return NULL;
+}
 #endif
 
 int main(int argc, char *argv[])
 {
     srand(time(0));
 
-    // signal SIGINT
+    // signal SIGINT and SIGTERM
     #ifdef _WIN32
     if (!SetConsoleCtrlHandler(console_handler, TRUE)) {
         perror("Error setting handler");
@@ -397,17 +992,29 @@ int main(int argc, char *argv[])
     sigset_t set;
     sigemptyset(&set);
     sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
     act.sa_mask = set;
-    if (sigaction(SIGINT, &act, NULL) == -1) {
+    if (sigaction(SIGINT, &act, NULL) == -1 || sigaction(SIGTERM, &act, NULL) == -1) {
         perror("sigaction");
         exit(EXIT_FAILURE);
     }
     #endif
 
-    // configure port
+    // sample times and rollup boundaries, TEMP_CLOCK can make them virtual
+    vclock_init();
+    char clock_name[80];
+    vclock_describe(&vclock_state, clock_name, sizeof(clock_name));
+    printf("Clock: %s\n", clock_name);
+
+    // load sensors and configure their ports
+    static struct sensor_registry sensors;
+    load_sensors(&sensors, SENSORS_CONFIG);
+    printf("Sensors: %d\n", sensors.count);
+
     #ifdef _WIN32
-    HANDLE fd = CreateFile(
-        PORT_RD,
+    struct sensor *sensor = &sensors.sensors[0];
+    sensor->fd = CreateFile(
+        sensor->port,
         GENERIC_READ,
         0,
         NULL,
@@ -415,68 +1022,33 @@ int main(int argc, char *argv[])
         0,
         NULL
     );
-    if (fd == INVALID_HANDLE_VALUE) {
+    if (sensor->fd == INVALID_HANDLE_VALUE) {
         perror("CreateFile (pd)");
         exit(EXIT_FAILURE);
     }
 
-    if (!configure_port(fd, BAUDRATE_115200)) {
+    if (!configure_port(sensor->fd, baud_rate_from_int(sensor->baud))) {
         perror("configure_port (pd)");
-        CloseHandle(fd);
+        CloseHandle(sensor->fd);
         exit(EXIT_FAILURE);
     }
     #else
-    const char* port_rd = PORT_RD;
-    speed_t baud_rate = BAUDRATE_115200;
-    configure_port(port_rd, baud_rate);
-
-    // open port
-    int fd = open(port_rd, O_RDONLY | O_NOCTTY | O_NDELAY);
-    if (fd == -1) {
-        perror("open port");
-        exit(EXIT_FAILURE);
-    }
-
-    // flush port
-    if (tcflush(fd, TCIFLUSH) == -1) {
-        perror("tcflush");
-        close(fd);
+    if (open_sensors(&sensors) == -1) {
+        close_sensors(&sensors);
         exit(EXIT_FAILURE);
     }
     #endif
 
     sqlite3 *db;
-    sqlite3_stmt *statement;
     char *sql;
 
-    // open db
+    // writer connection, only the db thread uses it once the threads start
     int res = sqlite3_open("temperature.db", &db);
     if (res != SQLITE_OK) {
         fprintf(stderr, "Error: %s\n", sqlite3_errmsg(db));
         exit(EXIT_FAILURE);
     }
 
-    // create table "temp_all"
-    sql = "CREATE TABLE IF NOT EXISTS temp_all("
-    "date DATETIME DEFAULT CURRENT_TIMESTAMP PRIMARY KEY,"
-    "temp REAL"
-    ");";
-    execute_sql(db, sql);
-
-    // create table "temp_hour"
-    sql = "CREATE TABLE IF NOT EXISTS temp_hour("
-    "date DATETIME DEFAULT CURRENT_TIMESTAMP PRIMARY KEY,"
-    "avg_temp REAL"
-    ");";
-    execute_sql(db, sql);
-
-    // create table "temp_day"
-    sql = "CREATE TABLE IF NOT EXISTS temp_day("
-    "date DATETIME DEFAULT CURRENT_TIMESTAMP PRIMARY KEY,"
-    "avg_temp REAL"
-    ");";
-    execute_sql(db, sql);
-
     sql = "PRAGMA journal_mode = WAL;";
     res = sqlite3_exec(db, sql, 0, 0, 0);
     if (res != SQLITE_OK) {
@@ -485,30 +1057,154 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
-    char buffer[255];
-    double cur_temp;
+    // WAL keeps the db consistent, fsync on checkpoint only
+    execute_sql(db, "PRAGMA synchronous = NORMAL;");
+
+    // commits never checkpoint, the checkpoint thread does it on its own connection;
+    // a commit waits out the rare RESTART checkpoint instead of failing
+    execute_sql(db, "PRAGMA wal_autocheckpoint = 0;");
+    sqlite3_busy_timeout(db, CHECKPOINT_BUSY_MS);
+    char pragma[64];
+    snprintf(pragma, sizeof(pragma), "PRAGMA journal_size_limit = %d;", WAL_SIZE_LIMIT);
+    execute_sql(db, pragma);
+
+    // aggregate functions the compactor builds bucket sketches with
+    if (sketch_register(db) == -1) {
+        sqlite3_close(db);
+        exit(EXIT_FAILURE);
+    }
+
+    // downsampling tiers and how long each one is kept
+    struct policy policy;
+    load_policy(&policy, POLICY_CONFIG);
+    printf("Tiers:");
+    for (int i = 0; i < policy.count; ++i)
+        printf(" %s", policy.tiers[i].name);
+    printf("\n");
+
+    create_tables(db, &policy);
+    if (store_sensors(db, &sensors) == -1) {
+        sqlite3_close(db);
+        exit(EXIT_FAILURE);
+    }
+
+    // samples from the reader thread to the db writer thread
+    static struct ring ring;
+    if (ring_init(&ring) == -1) {
+        sqlite3_close(db);
+        exit(EXIT_FAILURE);
+    }
+
+    // raw samples land in the journal first, temp_all and the tsdb are derived from it
+    uint64_t applied, tsdb_from;
+    load_journal_state(db, &applied, &tsdb_from);
+    struct journal journal;
+    if (journal_open(&journal, JOURNAL_DIR, tsdb_from < applied ? tsdb_from : applied, applied) == -1) {
+        sqlite3_close(db);
+        exit(EXIT_FAILURE);
+    }
+
+    // compressed long-term copy of the raw samples
+    static struct tsdb tsdb;
+    if (tsdb_open(&tsdb, TSDB_DIR) == -1) {
+        sqlite3_close(db);
+        exit(EXIT_FAILURE);
+    }
 
-    // create new thread (db_thread)
-    struct thr_data params_db = {fd, db};
+    // latest samples for the hot routes, readable from other processes without SQL
+    struct live live;
+    if (live_create(&live) == -1) {
+        sqlite3_close(db);
+        exit(EXIT_FAILURE);
+    }
+
+    // per-minute sums, counts and extremes for window aggregates in O(log n)
+    static struct window window;
+    if (window_create(&window) == -1) {
+        sqlite3_close(db);
+        exit(EXIT_FAILURE);
+    }
+
+    // passive checkpoints in the background, metrics next to the live samples
+    static struct checkpointer checkpointer;
+    if (checkpointer_open(&checkpointer, "temperature.db", &live.shm->wal) == -1) {
+        sqlite3_close(db);
+        exit(EXIT_FAILURE);
+    }
+
+    // create new threads (db_thread, reader_thread and checkpoint_thread)
     #ifdef _WIN32
+    struct thr_data params_db = {&sensors, db, &ring, &journal, &tsdb, &live, &window, &policy};
     HANDLE thr_db = CreateThread(
         NULL,
         0,
-        thr_routine_db,
+        thr_routine_writer,
         &params_db,
         0,
         NULL);
     if (thr_db == NULL) {
-        perror("CreateThread (thr_day)");
+        perror("CreateThread (thr_db)");
+        exit(EXIT_FAILURE);
+    }
+    HANDLE thr_reader = CreateThread(
+        NULL,
+        0,
+        thr_routine_reader,
+        &params_db,
+        0,
+        NULL);
+    if (thr_reader == NULL) {
+        perror("CreateThread (thr_reader)");
+        exit(EXIT_FAILURE);
+    }
+    HANDLE thr_checkpoint = CreateThread(
+        NULL,
+        0,
+        thr_routine_checkpoint,
+        &checkpointer,
+        0,
+        NULL);
+    if (thr_checkpoint == NULL) {
+        perror("CreateThread (thr_checkpoint)");
         exit(EXIT_FAILURE);
     }
     #else
+    struct reactor reactor;
+    if (reactor_init(&reactor) == -1) {
+        sqlite3_close(db);
+        exit(EXIT_FAILURE);
+    }
+
+    // SIGINT and SIGTERM stay blocked everywhere, the accept loop unblocks them only inside ppoll
+    sigset_t stop_signals;
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &stop_signals, NULL);
+
+    struct thr_data params_db = {&sensors, db, &ring, &journal, &tsdb, &live, &window, &policy, &reactor};
     pthread_t db_thread;
-    int status = pthread_create(&db_thread, NULL, thr_routine_db, &params_db);
+    int status = pthread_create(&db_thread, NULL, thr_routine_writer, &params_db);
     if (status != 0) {
-        perror("pthread_create (thr_day)");
+        perror("pthread_create (db_thread)");
         exit(EXIT_FAILURE);
     }
+    pthread_t reader_thread;
+    status = pthread_create(&reader_thread, NULL, thr_routine_reader, &params_db);
+    if (status != 0) {
+        perror("pthread_create (reader_thread)");
+        exit(EXIT_FAILURE);
+    }
+    pthread_t checkpoint_thread;
+    status = pthread_create(&checkpoint_thread, NULL, thr_routine_checkpoint, &checkpointer);
+    if (status != 0) {
+        perror("pthread_create (checkpoint_thread)");
+        exit(EXIT_FAILURE);
+    }
+    sigset_t wait_signals;
+    pthread_sigmask(SIG_BLOCK, NULL, &wait_signals);
+    sigdelset(&wait_signals, SIGINT);
+    sigdelset(&wait_signals, SIGTERM);
     #endif
 
     // ---SERVER--- //
@@ -587,10 +1283,15 @@ int main(int argc, char *argv[])
         #ifdef _WIN32
         poll_count = WSAPoll(fds, nfds, READ_WAIT_MS);
         #else
-        poll_count = poll(fds, nfds, READ_WAIT_MS);
+        // no timeout, a stop signal can only land inside the wait, so need_exit is never missed
+        poll_count = ppoll(fds, nfds, NULL, &wait_signals);
         #endif
 
         if (poll_count < 0) {
+            #ifndef _WIN32
+            if (errno == EINTR)
+                continue;
+            #endif
             perror("Failed to poll");
             break;
         }
@@ -632,18 +1333,44 @@ int main(int argc, char *argv[])
     }
 
     #ifdef _WIN32
+    WaitForSingleObject(thr_reader, INFINITE);
+    CloseHandle(thr_reader);
+    ring_stop(&ring);
     WaitForSingleObject(thr_db, INFINITE);
     CloseHandle(thr_db);
+    checkpointer_stop(&checkpointer);
+    WaitForSingleObject(thr_checkpoint, INFINITE);
+    CloseHandle(thr_checkpoint);
     closesocket(server_socket);
     WSACleanup();
-    CloseHandle(fd);
+    CloseHandle(sensor->fd);
     #else
+    reactor_stop(&reactor);
+    pthread_join(reader_thread, NULL);
+    ring_stop(&ring);
     pthread_join(db_thread, NULL);
+    checkpointer_stop(&checkpointer);
+    pthread_join(checkpoint_thread, NULL);
     close(server_socket);
-    close(fd);
+    close_sensors(&sensors);
+    reactor_print_stats(&reactor);
+    reactor_close(&reactor);
     #endif
 
+    checkpointer_print_stats(&checkpointer);
+    checkpointer_close(&checkpointer);
     sqlite3_close(db);
 
+    journal_close(&journal);
+    tsdb_close(&tsdb);
+    live_destroy(&live);
+    window_destroy(&window);
+
+    print_sensor_stats(&sensors);
+    ring_print_stats(&ring);
+    journal_print_stats(&journal);
+    tsdb_print_stats(&tsdb);
+    ring_close(&ring);
+
     return 0;
 }
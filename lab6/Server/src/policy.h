@@ -0,0 +1,440 @@
+#pragma once
+
+#include "sqlite3.h"
+#include "calendar.h"
+#include "raw.h"
+#include "sketch.h"
+#include "window.h"
+#include "vclock.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// downsampling tiers, one per line: <resolution> <retention>, finest first, '#' starts a comment
+//   raw 2d
+//   1m  30d
+//   1h  2y
+//   1d  forever
+// durations take s, m, h, d, w or y (365 days), every resolution divides the next one and a day
+#define POLICY_CONFIG "retention.conf"
+#define POLICY_MAX_TIERS 8
+#define POLICY_DEFAULT "raw 2d\n1m 30d\n1h 2y\n1d forever\n"
+
+struct tier {
+    char name[8];
+    char table[32];
+    int resolution;      // bucket width in seconds, 0 for raw samples
+    int64_t retention;   // seconds, 0 keeps rows forever
+};
+
+struct policy {
+    struct tier tiers[POLICY_MAX_TIERS];
+    int count;
+};
+
+// "30d" -> seconds, -1 if malformed
+int64_t parse_duration(const char *text)
+{
+    char *end;
+    long long n = strtoll(text, &end, 10);
+    if (end == text || n <= 0)
+        return -1;
+    int64_t unit;
+    switch (*end) {
+    case 's': unit = 1;             break;
+    case 'm': unit = SEC_IN_MINUTE; break;
+    case 'h': unit = SEC_IN_HOUR;   break;
+    case 'd': unit = SEC_IN_DAY;    break;
+    case 'w': unit = 7 * SEC_IN_DAY;   break;
+    case 'y': unit = 365 * SEC_IN_DAY; break;
+    default:  return -1;
+    }
+    return end[1] == '\0' ? n * unit : -1;
+}
+
+// hourly and daily tiers keep the table names of the fixed rollups they replace
+void tier_table(struct tier *t)
+{
+    if (t->resolution == 0)
+        snprintf(t->table, sizeof(t->table), "temp_all");
+    else if (t->resolution == SEC_IN_HOUR)
+        snprintf(t->table, sizeof(t->table), "temp_hour");
+    else if (t->resolution == SEC_IN_DAY)
+        snprintf(t->table, sizeof(t->table), "temp_day");
+    else
+        snprintf(t->table, sizeof(t->table), "temp_%s", t->name);
+}
+
+// parse a policy text, returns -1 and leaves p unusable on the first bad line
+int parse_policy(struct policy *p, const char *text, const char *source)
+{
+    p->count = 0;
+    while (*text != '\0') {
+        char line[128];
+        size_t len = strcspn(text, "\n");
+        snprintf(line, sizeof(line), "%.*s", (int)(len < sizeof(line) ? len : sizeof(line) - 1), text);
+        text += len + (text[len] == '\n');
+
+        char *comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+
+        char name[8], keep[16];
+        int n = sscanf(line, "%7s %15s", name, keep);
+        if (n <= 0)
+            continue;
+        if (n < 2 || p->count >= POLICY_MAX_TIERS) {
+            fprintf(stderr, "%s: bad tier: %s\n", source, line);
+            return -1;
+        }
+
+        struct tier *t = &p->tiers[p->count];
+        snprintf(t->name, sizeof(t->name), "%s", name);
+        t->resolution = strcmp(name, "raw") == 0 ? 0 : (int)parse_duration(name);
+        t->retention = strcmp(keep, "forever") == 0 ? 0 : parse_duration(keep);
+        for (const char *c = name; *c != '\0'; ++c) {
+            if (!isalnum((unsigned char)*c))
+                t->resolution = -1;
+        }
+
+        // buckets of a tier must be made of whole buckets of the tier before it
+        int prev = p->count > 0 ? p->tiers[p->count - 1].resolution : -1;
+        int valid = t->resolution >= 0 && t->retention >= 0 && t->resolution <= SEC_IN_DAY
+                 && (p->count == 0 ? t->resolution == 0 : t->resolution > prev)
+                 && (t->resolution == 0 || SEC_IN_DAY % t->resolution == 0)
+                 && (prev <= 0 || t->resolution % prev == 0);
+        if (!valid) {
+            fprintf(stderr, "%s: bad tier: %s\n", source, line);
+            return -1;
+        }
+        tier_table(t);
+        p->count++;
+    }
+    if (p->count == 0) {
+        fprintf(stderr, "%s: no tiers\n", source);
+        return -1;
+    }
+    return 0;
+}
+
+// policy from config, the default when the file is missing or malformed
+void load_policy(struct policy *p, const char *path)
+{
+    FILE *file = fopen(path, "r");
+    if (file != NULL) {
+        char text[2048];
+        size_t len = fread(text, 1, sizeof(text) - 1, file);
+        text[len] = '\0';
+        fclose(file);
+        if (parse_policy(p, text, path) == 0)
+            return;
+        fprintf(stderr, "%s: using the default policy\n", path);
+    }
+    parse_policy(p, POLICY_DEFAULT, "default policy");
+}
+
+// policy of this process, loaded on first use
+const struct policy *current_policy()
+{
+    static struct policy policy;
+    if (policy.count == 0)
+        load_policy(&policy, POLICY_CONFIG);
+    return &policy;
+}
+
+// coarsest tier with buckets no wider than resolution that still keeps span seconds,
+// the one keeping the most history when none does
+const struct tier *policy_route(const struct policy *p, int resolution, int64_t span)
+{
+    const struct tier *best = NULL;
+    int best_covers = 0;
+    for (int i = 0; i < p->count; ++i) {
+        const struct tier *t = &p->tiers[i];
+        if (t->resolution > resolution)
+            break;
+        int covers = t->retention == 0 || t->retention >= span;
+        if (best == NULL || covers || (!best_covers && t->retention > best->retention)) {
+            best = t;
+            best_covers = covers;
+        }
+    }
+    return best;
+}
+
+// rebuild the buckets of tier i in wall-clock seconds [from, to) from the rows of tier i - 1
+int fold_tier(sqlite3 *db, const struct policy *p, int i, int64_t from, int64_t to)
+{
+    const struct tier *t = &p->tiers[i];
+    const struct tier *source = &p->tiers[i - 1];
+    int raw = source->resolution == 0;
+
+    char sql[640];
+    snprintf(sql, sizeof(sql),
+        "INSERT OR REPLACE INTO %s (sensor_id, date, avg_temp, samples, sum_temp, sketch) "
+        "SELECT sensor_id, DATETIME(CAST(strftime('%%s', date) AS INTEGER) / %d * %d, 'unixepoch') AS bucket, "
+        "ROUND(SUM(%s) / SUM(%s), 1), SUM(%s), SUM(%s), %s FROM %s "
+        "WHERE date >= ?1 AND date < ?2 "
+        "GROUP BY sensor_id, CAST(strftime('%%s', date) AS INTEGER) / %d;",
+        t->table, t->resolution, t->resolution,
+        raw ? "temp" : "sum_temp", raw ? "1" : "samples", raw ? "1" : "samples", raw ? "temp" : "sum_temp",
+        raw ? "sketch_add(temp)" : "sketch_merge(sketch)", source->table, t->resolution);
+
+    char from_date[20], to_date[20];
+    format_wall(from, from_date, sizeof(from_date));
+    format_wall(to, to_date, sizeof(to_date));
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK) {
+        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    sqlite3_bind_text(stmt, 1, from_date, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 2, to_date, -1, SQLITE_STATIC);
+    int res = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (res != SQLITE_DONE) {
+        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    return 0;
+}
+
+struct raw_buckets {
+    sqlite3_stmt *insert;
+    int sensor_id;
+    int64_t resolution_ms;
+    int64_t bucket;   // wall-clock ms of the bucket being summed, -1 before the first sample
+    double sum;
+    int64_t count;
+};
+
+static void raw_buckets_flush(struct raw_buckets *b)
+{
+    if (b->count == 0)
+        return;
+    char date[20];
+    format_wall(b->bucket / 1000, date, sizeof(date));
+    sqlite3_bind_int(b->insert, 1, b->sensor_id);
+    sqlite3_bind_text(b->insert, 2, date, -1, SQLITE_TRANSIENT);
+    sqlite3_bind_double(b->insert, 3, round(b->sum / b->count * 10) / 10);
+    if (sqlite3_step(b->insert) != SQLITE_DONE)
+        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(sqlite3_db_handle(b->insert)));
+    sqlite3_reset(b->insert);
+    b->sum = 0;
+    b->count = 0;
+}
+
+// samples arrive oldest first, so a bucket is complete once a later one starts
+static void raw_buckets_add(int64_t wall_ms, double temp, void *ctx)
+{
+    struct raw_buckets *b = (struct raw_buckets*)ctx;
+    int64_t bucket = wall_ms - wall_ms % b->resolution_ms;
+    if (bucket != b->bucket) {
+        raw_buckets_flush(b);
+        b->bucket = bucket;
+    }
+    b->sum += temp;
+    b->count++;
+}
+
+// buckets of the sensor's raw samples over the last span seconds into the temp table name
+static int fill_raw_buckets(sqlite3 *db, const char *name, int sensor_id, int resolution, int64_t span)
+{
+    char sql[256];
+    snprintf(sql, sizeof(sql), "CREATE TEMP TABLE %s(sensor_id INTEGER, date TEXT, avg_temp REAL);", name);
+    char *err = NULL;
+    if (sqlite3_exec(db, sql, 0, 0, &err) != SQLITE_OK) {
+        fprintf(stderr, "SQLite error: %s\n", err);
+        sqlite3_free(err);
+        return -1;
+    }
+    snprintf(sql, sizeof(sql), "INSERT INTO temp.%s VALUES (?1, ?2, ?3);", name);
+    struct raw_buckets b = {NULL, sensor_id, (int64_t)resolution * 1000, -1, 0, 0};
+    if (sqlite3_prepare_v2(db, sql, -1, &b.insert, 0) != SQLITE_OK) {
+        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    int64_t to = local_wall_seconds(vclock_now()) + 1;
+    struct raw_source source;
+    raw_open(&source, sensor_id);
+    sqlite3_exec(db, "BEGIN;", 0, 0, 0);
+    int res = raw_scan(db, &source, to - span, to, raw_buckets_add, &b);
+    raw_buckets_flush(&b);
+    sqlite3_exec(db, "COMMIT;", 0, 0, 0);
+    raw_close(&source);
+    sqlite3_finalize(b.insert);
+    return res;
+}
+
+// <name>(sensor_id, date, avg_temp) with buckets of resolution seconds: a temp view of the
+// routed tier, regrouped when that tier is finer; raw samples come from the tsdb and are
+// bucketed into a temp table of the sensor's span instead
+int open_tier_view(sqlite3 *db, const char *name, int sensor_id, int resolution, int64_t span)
+{
+    const struct tier *t = policy_route(current_policy(), resolution, span);
+    // the read connection is shared by the whole request, an earlier section may have routed it
+    // as either a view or a table, dropping it as the other one fails harmlessly
+    char sql[512];
+    snprintf(sql, sizeof(sql), "DROP VIEW IF EXISTS temp.%s;", name);
+    sqlite3_exec(db, sql, 0, 0, 0);
+    snprintf(sql, sizeof(sql), "DROP TABLE IF EXISTS temp.%s;", name);
+    sqlite3_exec(db, sql, 0, 0, 0);
+    if (t->resolution == 0)
+        return fill_raw_buckets(db, name, sensor_id, resolution, span);
+
+    if (t->resolution == resolution) {
+        snprintf(sql, sizeof(sql),
+            "CREATE TEMP VIEW %s AS SELECT sensor_id, date, avg_temp FROM %s;", name, t->table);
+    } else {
+        snprintf(sql, sizeof(sql),
+            "CREATE TEMP VIEW %s AS SELECT sensor_id, "
+            "DATETIME(CAST(strftime('%%s', date) AS INTEGER) / %d * %d, 'unixepoch') AS date, "
+            "ROUND(SUM(sum_temp) / SUM(samples), 1) AS avg_temp FROM %s GROUP BY sensor_id, 2;",
+            name, resolution, resolution, t->table);
+    }
+
+    char *err = NULL;
+    if (sqlite3_exec(db, sql, 0, 0, &err) != SQLITE_OK) {
+        fprintf(stderr, "SQLite error: %s\n", err);
+        sqlite3_free(err);
+        return -1;
+    }
+    return 0;
+}
+
+#define PERCENTILE_COUNT 5
+static const double percentile_ranks[PERCENTILE_COUNT] = {0.05, 0.25, 0.5, 0.75, 0.95};
+
+struct percentiles {
+    const struct tier *tier;
+    char from[20];
+    int64_t count;
+    double min;
+    double max;
+    double values[PERCENTILE_COUNT];
+};
+
+static void percentiles_add(int64_t wall_ms, double temp, void *ctx)
+{
+    (void)wall_ms;
+    sketch_add((struct sketch*)ctx, temp);
+}
+
+// quantiles of a sensor over the last span seconds, merged from the bucket sketches of the
+// coarsest tier with about 24 buckets in the span, raw samples only if no tier is fine enough;
+// buckets still open at the last compaction are not included
+int query_percentiles(sqlite3 *db, int sensor_id, int64_t span, struct percentiles *out)
+{
+    out->tier = policy_route(current_policy(), (int)(span / 24), span);
+    format_local(vclock_now() - (time_t)span, out->from, sizeof(out->from));
+
+    if (out->tier->resolution == 0) {
+        struct sketch s;
+        sketch_init(&s);
+        int64_t to = local_wall_seconds(vclock_now()) + 1;
+        struct raw_source raw;
+        raw_open(&raw, sensor_id);
+        int res = raw_scan(db, &raw, to - span, to, percentiles_add, &s);
+        raw_close(&raw);
+        out->count = (int64_t)s.count;
+        out->min = sketch_quantile(&s, 0);
+        out->max = sketch_quantile(&s, 1);
+        for (int i = 0; i < PERCENTILE_COUNT; ++i)
+            out->values[i] = sketch_quantile(&s, percentile_ranks[i]);
+        return res;
+    }
+
+    if (sketch_register(db) == -1)
+        return -1;
+
+    char sql[512];
+    snprintf(sql, sizeof(sql),
+        "SELECT sketch_count(s), sketch_quantile(s, 0), sketch_quantile(s, 1), "
+        "sketch_quantile(s, ?3), sketch_quantile(s, ?4), sketch_quantile(s, ?5), "
+        "sketch_quantile(s, ?6), sketch_quantile(s, ?7) "
+        "FROM (SELECT sketch_merge(sketch) AS s FROM %s WHERE sensor_id = ?1 AND date >= ?2);",
+        out->tier->table);
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK) {
+        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    sqlite3_bind_int(stmt, 1, sensor_id);
+    sqlite3_bind_text(stmt, 2, out->from, -1, SQLITE_STATIC);
+    for (int i = 0; i < PERCENTILE_COUNT; ++i)
+        sqlite3_bind_double(stmt, 3 + i, percentile_ranks[i]);
+
+    out->count = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        out->count = sqlite3_column_int64(stmt, 0);
+        out->min = sqlite3_column_double(stmt, 1);
+        out->max = sqlite3_column_double(stmt, 2);
+        for (int i = 0; i < PERCENTILE_COUNT; ++i)
+            out->values[i] = sqlite3_column_double(stmt, 3 + i);
+    }
+    sqlite3_finalize(stmt);
+    return 0;
+}
+
+// count, mean and extremes of a sensor over the last span seconds: from the server's minute index
+// in O(log n) when the span fits its horizon, otherwise by scanning the routed tier, raw samples
+// through the tsdb block summaries
+int query_window(sqlite3 *db, int sensor_id, int64_t span, struct window_stats *out, const char **source)
+{
+    int64_t to = local_wall_seconds(vclock_now()) / SEC_IN_MINUTE + 1;
+    int64_t from = to - (span + SEC_IN_MINUTE - 1) / SEC_IN_MINUTE;
+    if (span <= (int64_t)WINDOW_MINUTES * SEC_IN_MINUTE && window_read(sensor_id, from, to, out) == 0) {
+        *source = "index";
+        return 0;
+    }
+
+    const struct tier *t = policy_route(current_policy(), (int)(span / 24), span);
+    *source = t->name;
+    out->from = from;
+    out->to = to;
+    if (t->resolution == 0) {
+        struct raw_source raw;
+        struct tsdb_summary sum;
+        raw_open(&raw, sensor_id);
+        int res = raw_summary(db, &raw, from * SEC_IN_MINUTE, to * SEC_IN_MINUTE, &sum);
+        raw_close(&raw);
+        out->count = (int64_t)sum.count;
+        out->sum = sum.sum;
+        out->min = sum.min;
+        out->max = sum.max;
+        return res;
+    }
+
+    if (sketch_register(db) == -1)
+        return -1;
+    char sql[512];
+    snprintf(sql, sizeof(sql),
+        "SELECT SUM(samples), SUM(sum_temp), sketch_quantile(s, 0), sketch_quantile(s, 1) "
+        "FROM (SELECT SUM(samples) AS samples, SUM(sum_temp) AS sum_temp, sketch_merge(sketch) AS s "
+        "FROM %s WHERE sensor_id = ?1 AND date >= ?2);", t->table);
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK) {
+        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    char from_date[20];
+    format_wall(from * SEC_IN_MINUTE, from_date, sizeof(from_date));
+    sqlite3_bind_int(stmt, 1, sensor_id);
+    sqlite3_bind_text(stmt, 2, from_date, -1, SQLITE_STATIC);
+
+    out->count = 0;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        out->count = sqlite3_column_int64(stmt, 0);
+        out->sum = sqlite3_column_double(stmt, 1);
+        out->min = sqlite3_column_double(stmt, 2);
+        out->max = sqlite3_column_double(stmt, 3);
+    }
+    sqlite3_finalize(stmt);
+    return 0;
+}
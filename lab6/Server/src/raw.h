@@ -0,0 +1,163 @@
+#pragma once
+
+#include "sqlite3.h"
+#include "calendar.h"
+#include "decicelsius.h"
+#include "tsdb.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// raw samples of one sensor for the read routes: the sealed tsdb blocks answer the time they
+// cover, temp_all only the rest, the open block after the last sealed sample and rows older
+// than the first one (imports, runs from before the tsdb). Ranges are wall-clock seconds
+// [from, to) like the tiers, samples come out in wall-clock milliseconds, oldest first
+struct raw_source {
+    int sensor_id;
+    struct tsdb_reader tsdb;
+    int64_t first_ms;        // sealed samples, first_ms > last_ms when there are none
+    int64_t last_ms;
+    char first_date[24];     // the same bounds as temp_all dates, "" without sealed samples
+    char after_date[24];
+    int64_t zone_key;        // quarter hour of the last local offset looked up
+    int64_t zone_offset_ms;
+};
+
+typedef void (*raw_sample_fn)(int64_t wall_ms, double temp, void *ctx);
+
+// a series that cannot be mapped is left to temp_all alone
+void raw_open(struct raw_source *r, int sensor_id)
+{
+    memset(r, 0, sizeof(*r));
+    r->sensor_id = sensor_id;
+    r->first_ms = 0;
+    r->last_ms = -1;
+    r->zone_key = -1;
+    if (tsdb_reader_open(&r->tsdb, TSDB_DIR, sensor_id) == -1) {
+        fprintf(stderr, "tsdb: series %d unreadable, reading temp_all only\n", sensor_id);
+        tsdb_reader_close(&r->tsdb);
+        return;
+    }
+    if (tsdb_sealed_span(&r->tsdb, &r->first_ms, &r->last_ms) > 0) {
+        format_local_ms(r->first_ms, r->first_date, sizeof(r->first_date));
+        format_local_ms(r->last_ms + 1, r->after_date, sizeof(r->after_date));
+    }
+}
+
+void raw_close(struct raw_source *r)
+{
+    tsdb_reader_close(&r->tsdb);
+}
+
+// local offsets only change on a quarter hour, one lookup serves a whole block of samples
+static int64_t raw_wall_ms(struct raw_source *r, int64_t time_ms)
+{
+    int64_t key = time_ms / (15 * SEC_IN_MINUTE * 1000);
+    if (key != r->zone_key) {
+        time_t t = (time_t)(key * 15 * SEC_IN_MINUTE);
+        r->zone_key = key;
+        r->zone_offset_ms = (local_wall_seconds(t) - (int64_t)t) * 1000;
+    }
+    return time_ms + r->zone_offset_ms;
+}
+
+struct raw_emit {
+    struct raw_source *source;
+    raw_sample_fn fn;
+    void *ctx;
+};
+
+static void raw_emit_sample(int64_t time_ms, decicelsius value, void *ctx)
+{
+    struct raw_emit *emit = (struct raw_emit*)ctx;
+    emit->fn(raw_wall_ms(emit->source, time_ms), deci_to_double(value), emit->ctx);
+}
+
+// temp_all rows of [from_date, to_date), nothing when the bounds are crossed
+static int raw_rows(sqlite3 *db, struct raw_source *r, const char *from_date, const char *to_date,
+                    raw_sample_fn fn, void *ctx)
+{
+    if (strcmp(from_date, to_date) >= 0)
+        return 0;
+
+    sqlite3_stmt *stmt;
+    const char *sql = "SELECT date, temp FROM temp_all WHERE sensor_id = ?1 AND date >= ?2 AND date < ?3 ORDER BY date;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK) {
+        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    sqlite3_bind_int(stmt, 1, r->sensor_id);
+    sqlite3_bind_text(stmt, 2, from_date, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, to_date, -1, SQLITE_STATIC);
+
+    int res;
+    while ((res = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int len = sqlite3_column_bytes(stmt, 0);
+        if (len < 19)
+            continue;
+        fn(parse_wall_ms(sqlite3_column_text(stmt, 0), len), sqlite3_column_double(stmt, 1), ctx);
+    }
+    if (res != SQLITE_DONE)
+        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
+    sqlite3_finalize(stmt);
+    return res == SQLITE_DONE ? 0 : -1;
+}
+
+// every sample of [from, to): temp_all rows before the sealed blocks, the blocks, the open tail
+int raw_scan(sqlite3 *db, struct raw_source *r, int64_t from, int64_t to, raw_sample_fn fn, void *ctx)
+{
+    char from_date[20], to_date[20];
+    format_wall(from, from_date, sizeof(from_date));
+    format_wall(to, to_date, sizeof(to_date));
+
+    const char *before = strcmp(to_date, r->first_date) < 0 ? to_date : r->first_date;
+    if (raw_rows(db, r, from_date, before, fn, ctx) == -1)
+        return -1;
+    if (r->first_ms <= r->last_ms) {
+        struct raw_emit emit = {r, fn, ctx};
+        tsdb_scan(&r->tsdb, (int64_t)wall_time(from) * 1000, (int64_t)wall_time(to) * 1000, raw_emit_sample, &emit);
+    }
+    const char *after = strcmp(from_date, r->after_date) > 0 ? from_date : r->after_date;
+    return raw_rows(db, r, after, to_date, fn, ctx);
+}
+
+// count/min/max/sum of [from, to): whole sealed blocks by their headers, temp_all for the rest
+int raw_summary(sqlite3 *db, struct raw_source *r, int64_t from, int64_t to, struct tsdb_summary *out)
+{
+    memset(out, 0, sizeof(*out));
+    if (r->first_ms <= r->last_ms)
+        tsdb_aggregate(&r->tsdb, (int64_t)wall_time(from) * 1000, (int64_t)wall_time(to) * 1000, out);
+
+    sqlite3_stmt *stmt;
+    const char *sql =
+        "SELECT COUNT(*), SUM(temp), MIN(temp), MAX(temp) FROM temp_all "
+        "WHERE sensor_id = ?1 AND date >= ?2 AND date < ?3 AND (date < ?4 OR date >= ?5);";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK) {
+        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    char from_date[20], to_date[20];
+    format_wall(from, from_date, sizeof(from_date));
+    format_wall(to, to_date, sizeof(to_date));
+    sqlite3_bind_int(stmt, 1, r->sensor_id);
+    sqlite3_bind_text(stmt, 2, from_date, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 3, to_date, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 4, r->first_date, -1, SQLITE_STATIC);
+    sqlite3_bind_text(stmt, 5, r->after_date, -1, SQLITE_STATIC);
+
+    int res = sqlite3_step(stmt);
+    if (res == SQLITE_ROW && sqlite3_column_int64(stmt, 0) > 0) {
+        double min = sqlite3_column_double(stmt, 2), max = sqlite3_column_double(stmt, 3);
+        if (out->count == 0 || min < out->min) out->min = min;
+        if (out->count == 0 || max > out->max) out->max = max;
+        out->count += (uint64_t)sqlite3_column_int64(stmt, 0);
+        out->sum += sqlite3_column_double(stmt, 1);
+    }
+    sqlite3_finalize(stmt);
+    if (res != SQLITE_ROW) {
+        fprintf(stderr, "SQLite error: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    return 0;
+}
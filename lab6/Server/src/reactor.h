@@ -0,0 +1,252 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "calendar.h"
+#include "vclock.h"
+
+#define REACTOR_MAX_EVENTS 64
+#define REACTOR_MAX_TIMERS 8
+
+// epoll data: kind in the high bits, source or timer index in the low ones
+#define REACTOR_SOURCE 1ULL
+#define REACTOR_TIMER 2ULL
+#define REACTOR_STOP 3ULL
+#define REACTOR_KIND(data) ((data) >> 32)
+#define REACTOR_INDEX(data) ((int)((data) & 0xFFFFFFFFULL))
+
+typedef time_t (*reactor_next_fn)(time_t now);
+typedef void (*reactor_timer_fn)(time_t deadline, void *ctx);
+typedef void (*reactor_batch_fn)(const int *ready, int count, void *ctx);
+
+struct reactor_latency {
+    unsigned long count;
+    double sum_us;
+    double max_us;
+};
+
+struct reactor_timer {
+    int fd;
+    const char *name;
+    reactor_next_fn next;
+    reactor_timer_fn fn;
+    void *ctx;
+    time_t deadline;
+    struct reactor_latency latency;
+};
+
+struct reactor {
+    int epfd;
+    int stop_fd;
+    struct reactor_timer timers[REACTOR_MAX_TIMERS];
+    int timer_count;
+    unsigned long wakeups;
+    struct reactor_latency batch;
+};
+
+double reactor_elapsed_us(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1e6 + (to->tv_nsec - from->tv_nsec) / 1e3;
+}
+
+void reactor_latency_add(struct reactor_latency *l, double us)
+{
+    l->count++;
+    l->sum_us += us;
+    if (us > l->max_us)
+        l->max_us = us;
+}
+
+int reactor_init(struct reactor *r)
+{
+    memset(r, 0, sizeof(*r));
+    r->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (r->epfd == -1) {
+        perror("epoll_create1");
+        return -1;
+    }
+
+    r->stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (r->stop_fd == -1) {
+        perror("eventfd");
+        return -1;
+    }
+
+    struct epoll_event ev = {.events = EPOLLIN, .data.u64 = REACTOR_STOP << 32};
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->stop_fd, &ev) == -1) {
+        perror("epoll_ctl (stop)");
+        return -1;
+    }
+    return 0;
+}
+
+int reactor_add_source(struct reactor *r, int fd, int index)
+{
+    struct epoll_event ev = {.events = EPOLLIN, .data.u64 = (REACTOR_SOURCE << 32) | (uint32_t)index};
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        perror("epoll_ctl (source)");
+        return -1;
+    }
+    return 0;
+}
+
+// a port that reached its end, it would otherwise be reported readable forever
+void reactor_remove_source(struct reactor *r, int fd)
+{
+    if (epoll_ctl(r->epfd, EPOLL_CTL_DEL, fd, NULL) == -1)
+        perror("epoll_ctl (remove)");
+}
+
+// deadlines are on the (maybe virtual) clock, the timer runs at the matching real time
+static struct timespec reactor_real_deadline(time_t deadline)
+{
+    int64_t ms = vclock_to_real_ms((int64_t)deadline * 1000);
+    struct timespec ts = {(time_t)(ms / 1000), (long)(ms % 1000) * 1000000};
+    return ts;
+}
+
+static int reactor_arm(struct reactor_timer *t)
+{
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value = reactor_real_deadline(t->deadline);
+
+    // cancel on clock changes so the deadline is recomputed from the new wall clock
+    if (timerfd_settime(t->fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &spec, NULL) == -1) {
+        perror("timerfd_settime");
+        return -1;
+    }
+    return 0;
+}
+
+// fires fn at every wall-clock boundary returned by next
+int reactor_add_timer(struct reactor *r, const char *name, reactor_next_fn next, reactor_timer_fn fn, void *ctx)
+{
+    if (r->timer_count >= REACTOR_MAX_TIMERS) {
+        fprintf(stderr, "Too many reactor timers\n");
+        return -1;
+    }
+
+    int index = r->timer_count;
+    struct reactor_timer *t = &r->timers[index];
+    t->fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (t->fd == -1) {
+        perror("timerfd_create");
+        return -1;
+    }
+    t->name = name;
+    t->next = next;
+    t->fn = fn;
+    t->ctx = ctx;
+    t->deadline = next(vclock_now());
+    if (reactor_arm(t) == -1)
+        return -1;
+
+    struct epoll_event ev = {.events = EPOLLIN, .data.u64 = (REACTOR_TIMER << 32) | (uint32_t)index};
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, t->fd, &ev) == -1) {
+        perror("epoll_ctl (timer)");
+        return -1;
+    }
+    r->timer_count++;
+    return 0;
+}
+
+static void reactor_fire(struct reactor_timer *t)
+{
+    uint64_t expirations;
+    if (read(t->fd, &expirations, sizeof(expirations)) == -1) {
+        if (errno == ECANCELED) {
+            // wall clock was set, boundary may have moved
+            t->deadline = t->next(vclock_now());
+            reactor_arm(t);
+        }
+        return;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    struct timespec deadline = reactor_real_deadline(t->deadline);
+    reactor_latency_add(&t->latency, reactor_elapsed_us(&deadline, &now));
+
+    t->fn(t->deadline, t->ctx);
+
+    t->deadline = t->next(t->deadline);
+    reactor_arm(t);
+}
+
+// blocks in epoll_wait until reactor_stop, no wake-ups while ports and timers are idle
+int reactor_run(struct reactor *r, reactor_batch_fn on_ready, void *ctx)
+{
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    int ready[REACTOR_MAX_EVENTS];
+
+    for (;;) {
+        int n = epoll_wait(r->epfd, events, REACTOR_MAX_EVENTS, -1);
+        if (n == -1) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            return -1;
+        }
+        r->wakeups++;
+
+        struct timespec woke;
+        clock_gettime(CLOCK_MONOTONIC, &woke);
+
+        int count = 0;
+        for (int i = 0; i < n; ++i) {
+            uint64_t data = events[i].data.u64;
+            if (REACTOR_KIND(data) == REACTOR_SOURCE)
+                ready[count++] = REACTOR_INDEX(data);
+        }
+        if (count > 0) {
+            on_ready(ready, count, ctx);
+
+            struct timespec done;
+            clock_gettime(CLOCK_MONOTONIC, &done);
+            reactor_latency_add(&r->batch, reactor_elapsed_us(&woke, &done));
+        }
+
+        for (int i = 0; i < n; ++i) {
+            uint64_t data = events[i].data.u64;
+            if (REACTOR_KIND(data) == REACTOR_TIMER)
+                reactor_fire(&r->timers[REACTOR_INDEX(data)]);
+            else if (REACTOR_KIND(data) == REACTOR_STOP)
+                return 0;
+        }
+    }
+}
+
+void reactor_stop(struct reactor *r)
+{
+    uint64_t one = 1;
+    if (write(r->stop_fd, &one, sizeof(one)) == -1)
+        perror("write (reactor stop)");
+}
+
+void reactor_print_stats(struct reactor *r)
+{
+    printf("reactor: %lu wake-ups, batch latency avg %.1f us, max %.1f us\n",
+           r->wakeups, r->batch.count ? r->batch.sum_us / r->batch.count : 0.0, r->batch.max_us);
+    for (int i = 0; i < r->timer_count; ++i) {
+        struct reactor_timer *t = &r->timers[i];
+        printf("timer %s: fired %lu, wake-up latency avg %.1f us, max %.1f us\n",
+               t->name, t->latency.count, t->latency.count ? t->latency.sum_us / t->latency.count : 0.0, t->latency.max_us);
+    }
+}
+
+void reactor_close(struct reactor *r)
+{
+    for (int i = 0; i < r->timer_count; ++i)
+        close(r->timers[i].fd);
+    close(r->stop_fd);
+    close(r->epfd);
+}
@@ -0,0 +1,192 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#    include <windows.h>
+#else
+#    include <errno.h>
+#    include <unistd.h>
+#    include <sys/eventfd.h>
+#endif
+
+// single producer (serial reader) / single consumer (db writer) queue
+#define RING_SIZE 16384
+#define RING_MASK (RING_SIZE - 1)
+#define RING_CACHE_LINE 64
+
+enum ring_kind {
+    RING_SAMPLE,
+    RING_COMPACT,
+};
+
+struct ring_entry {
+    int64_t time_ms;      // capture time, ms since epoch (minute boundary for compaction)
+    int64_t enqueued_ns;  // monotonic, for enqueue-to-commit latency
+    uint64_t offset;      // journal position of the sample, journal head for compaction
+    int32_t kind;
+};
+
+// head and tail live on separate cache lines so reader and writer never share one
+struct ring {
+    _Alignas(RING_CACHE_LINE) _Atomic size_t head;  // written by producer
+    size_t cached_tail;
+    unsigned long pushed;
+    unsigned long overflows;
+
+    _Alignas(RING_CACHE_LINE) _Atomic size_t tail;  // written by consumer
+    size_t cached_head;
+    size_t high_water;
+    unsigned long committed;
+    double latency_sum_us;
+    double latency_max_us;
+
+    _Alignas(RING_CACHE_LINE) _Atomic int stop;
+#ifdef _WIN32
+    HANDLE event;
+#else
+    int event_fd;
+#endif
+
+    _Alignas(RING_CACHE_LINE) struct ring_entry entries[RING_SIZE];
+};
+
+int64_t ring_now_ns()
+{
+    struct timespec ts;
+#ifdef _WIN32
+    timespec_get(&ts, TIME_UTC);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int ring_init(struct ring *r)
+{
+    memset(r, 0, sizeof(*r));
+#ifdef _WIN32
+    r->event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    if (r->event == NULL) {
+        fprintf(stderr, "CreateEvent failed\n");
+        return -1;
+    }
+#else
+    r->event_fd = eventfd(0, EFD_CLOEXEC);
+    if (r->event_fd == -1) {
+        perror("eventfd");
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+void ring_close(struct ring *r)
+{
+#ifdef _WIN32
+    CloseHandle(r->event);
+#else
+    close(r->event_fd);
+#endif
+}
+
+// producer side, never blocks: a full ring drops the entry and counts it,
+// the sample itself stays in the journal and is picked up with the next entry
+int ring_push(struct ring *r, const struct ring_entry *e)
+{
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (head - r->cached_tail >= RING_SIZE) {
+        r->cached_tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+        if (head - r->cached_tail >= RING_SIZE) {
+            r->overflows++;
+            return -1;
+        }
+    }
+
+    r->entries[head & RING_MASK] = *e;
+    r->entries[head & RING_MASK].enqueued_ns = ring_now_ns();
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+
+    r->pushed++;
+    return 0;
+}
+
+// wake the consumer once per batch of pushes, not per entry
+void ring_notify(struct ring *r)
+{
+#ifdef _WIN32
+    SetEvent(r->event);
+#else
+    uint64_t one = 1;
+    if (write(r->event_fd, &one, sizeof(one)) == -1)
+        perror("write (ring notify)");
+#endif
+}
+
+void ring_stop(struct ring *r)
+{
+    atomic_store_explicit(&r->stop, 1, memory_order_release);
+    ring_notify(r);
+}
+
+// consumer side: blocks until entries are available, 0 once stopped and drained
+size_t ring_wait(struct ring *r)
+{
+    for (;;) {
+        size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        r->cached_head = atomic_load_explicit(&r->head, memory_order_acquire);
+        if (r->cached_head != tail) {
+            // fill level as the consumer sees it, the producer never reads tail for stats
+            size_t used = r->cached_head - tail;
+            if (used > r->high_water)
+                r->high_water = used;
+            return used;
+        }
+        if (atomic_load_explicit(&r->stop, memory_order_acquire))
+            return 0;
+
+#ifdef _WIN32
+        WaitForSingleObject(r->event, INFINITE);
+#else
+        uint64_t count;
+        if (read(r->event_fd, &count, sizeof(count)) == -1 && errno != EINTR) {
+            perror("read (ring wait)");
+            return 0;
+        }
+#endif
+    }
+}
+
+// entry at offset i from the consumer position, valid until ring_release
+const struct ring_entry *ring_peek(struct ring *r, size_t i)
+{
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    return &r->entries[(tail + i) & RING_MASK];
+}
+
+// hand n entries back to the producer, their latency ends here
+void ring_release(struct ring *r, size_t n)
+{
+    size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+    int64_t now = ring_now_ns();
+    for (size_t i = 0; i < n; ++i) {
+        double us = (now - r->entries[(tail + i) & RING_MASK].enqueued_ns) / 1e3;
+        r->latency_sum_us += us;
+        if (us > r->latency_max_us)
+            r->latency_max_us = us;
+    }
+    r->committed += n;
+    atomic_store_explicit(&r->tail, tail + n, memory_order_release);
+}
+
+void ring_print_stats(struct ring *r)
+{
+    printf("ring: pushed %lu, committed %lu, overflows %lu, high-water %zu/%d, "
+           "enqueue-to-commit avg %.1f us, max %.1f us\n",
+           r->pushed, r->committed, r->overflows, r->high_water, RING_SIZE,
+           r->committed ? r->latency_sum_us / r->committed : 0.0, r->latency_max_us);
+}
@@ -0,0 +1,266 @@
+#pragma once
+
+#include "sqlite3.h"
+#include "serial.h"
+#include "frame.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#    define PORT_RD "COM9"
+#else
+#    define PORT_RD "/dev/pts/6"
+#    include <netdb.h>
+#    include <sys/socket.h>
+#    include <sys/un.h>
+#endif
+
+// one sensor per line: <id> <name> <port> <baud>, '#' starts a comment
+#define SENSORS_CONFIG "sensors.conf"
+
+#define MAX_SENSORS 256
+#define SENSOR_NAME_LEN 32
+#define SENSOR_PORT_LEN 128
+#define DEFAULT_SENSOR_ID 1
+
+struct sensor {
+    int id;
+    char name[SENSOR_NAME_LEN];
+    char port[SENSOR_PORT_LEN];
+    long baud;
+#ifdef _WIN32
+    HANDLE fd;
+#else
+    int fd;
+#endif
+    struct frame_parser parser;
+};
+
+struct sensor_registry {
+    struct sensor sensors[MAX_SENSORS];
+    int count;
+};
+
+#ifdef _WIN32
+DWORD baud_rate_from_int(long baud)
+{
+    switch (baud) {
+    case 4800:  return BAUDRATE_4800;
+    case 9600:  return BAUDRATE_9600;
+    case 19200: return BAUDRATE_19200;
+    case 38400: return BAUDRATE_38400;
+    case 57600: return BAUDRATE_57600;
+    default:    return BAUDRATE_115200;
+    }
+}
+#else
+speed_t baud_rate_from_int(long baud)
+{
+    switch (baud) {
+    case 4800:  return BAUDRATE_4800;
+    case 9600:  return BAUDRATE_9600;
+    case 19200: return BAUDRATE_19200;
+    case 38400: return BAUDRATE_38400;
+    case 57600: return BAUDRATE_57600;
+    default:    return BAUDRATE_115200;
+    }
+}
+#endif
+
+struct sensor *find_sensor(struct sensor_registry *reg, int id)
+{
+    for (int i = 0; i < reg->count; ++i) {
+        if (reg->sensors[i].id == id)
+            return &reg->sensors[i];
+    }
+    return NULL;
+}
+
+void add_sensor(struct sensor_registry *reg, int id, const char *name, const char *port, long baud)
+{
+    if (reg->count >= MAX_SENSORS) {
+        fprintf(stderr, "Too many sensors, ignoring sensor %d\n", id);
+        return;
+    }
+    if (id < 1 || id > INT16_MAX) {
+        fprintf(stderr, "Sensor id %d out of range 1..%d, ignoring\n", id, INT16_MAX);
+        return;
+    }
+    if (find_sensor(reg, id) != NULL) {
+        fprintf(stderr, "Duplicate sensor id %d, ignoring\n", id);
+        return;
+    }
+
+    struct sensor *s = &reg->sensors[reg->count++];
+    memset(s, 0, sizeof(*s));
+    s->id = id;
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    snprintf(s->port, sizeof(s->port), "%s", port);
+    s->baud = baud;
+    frame_parser_init(&s->parser);
+#ifdef _WIN32
+    s->fd = INVALID_HANDLE_VALUE;
+#else
+    s->fd = -1;
+#endif
+}
+
+// read sensor registry from config, falls back to the single default port
+void load_sensors(struct sensor_registry *reg, const char *path)
+{
+    reg->count = 0;
+
+    FILE *file = fopen(path, "r");
+    if (file != NULL) {
+        char line[512];
+        while (fgets(line, sizeof(line), file) != NULL) {
+            char *comment = strchr(line, '#');
+            if (comment != NULL)
+                *comment = '\0';
+
+            int id;
+            long baud = 115200;
+            char name[SENSOR_NAME_LEN];
+            char port[SENSOR_PORT_LEN];
+            int n = sscanf(line, "%d %31s %127s %ld", &id, name, port, &baud);
+            if (n <= 0)
+                continue;
+            if (n < 3) {
+                fprintf(stderr, "%s: malformed line: %s", path, line);
+                continue;
+            }
+            add_sensor(reg, id, name, port, baud);
+        }
+        fclose(file);
+    }
+
+    if (reg->count == 0)
+        add_sensor(reg, DEFAULT_SENSOR_ID, "default", PORT_RD, 115200);
+}
+
+#ifndef _WIN32
+// "unix:<path>" and "tcp:<host>:<port>" ports are stream sockets carrying the same frames,
+// e.g. from the fleet simulator; the server connects to them like it opens a serial port
+int connect_sensor_socket(const char *port)
+{
+    int fd = -1;
+    if (strncmp(port, "unix:", 5) == 0) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", port + 5);
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd != -1 && connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+            close(fd);
+            fd = -1;
+        }
+    } else {
+        char host[SENSOR_PORT_LEN];
+        snprintf(host, sizeof(host), "%s", port + 4);
+        char *service = strrchr(host, ':');
+        if (service == NULL)
+            return -1;
+        *service++ = '\0';
+
+        struct addrinfo hints, *res;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(host, service, &hints, &res) != 0)
+            return -1;
+        for (struct addrinfo *ai = res; ai != NULL && fd == -1; ai = ai->ai_next) {
+            fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+            if (fd != -1 && connect(fd, ai->ai_addr, ai->ai_addrlen) == -1) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(res);
+    }
+    if (fd != -1)
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+int is_socket_port(const char *port)
+{
+    return strncmp(port, "unix:", 5) == 0 || strncmp(port, "tcp:", 4) == 0;
+}
+
+// configure and open every registered port, non-blocking for the reader poll loop
+int open_sensors(struct sensor_registry *reg)
+{
+    for (int i = 0; i < reg->count; ++i) {
+        struct sensor *s = &reg->sensors[i];
+        if (is_socket_port(s->port)) {
+            s->fd = connect_sensor_socket(s->port);
+            if (s->fd == -1) {
+                perror(s->port);
+                return -1;
+            }
+            continue;
+        }
+
+        configure_port(s->port, baud_rate_from_int(s->baud));
+
+        s->fd = open(s->port, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+        if (s->fd == -1) {
+            perror(s->port);
+            return -1;
+        }
+
+        if (tcflush(s->fd, TCIFLUSH) == -1) {
+            perror("tcflush");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void close_sensors(struct sensor_registry *reg)
+{
+    for (int i = 0; i < reg->count; ++i) {
+        if (reg->sensors[i].fd != -1) {
+            close(reg->sensors[i].fd);
+            reg->sensors[i].fd = -1;
+        }
+    }
+}
+#endif
+
+void print_sensor_stats(struct sensor_registry *reg)
+{
+    for (int i = 0; i < reg->count; ++i)
+        frame_print_stats(reg->sensors[i].name, &reg->sensors[i].parser.stats);
+}
+
+// keep "sensors" table in sync with the registry so routes can list them
+int store_sensors(sqlite3 *db, struct sensor_registry *reg)
+{
+    const char *sql = "INSERT INTO sensors (id, name, port, baud) VALUES (?, ?, ?, ?) "
+    "ON CONFLICT(id) DO UPDATE SET name = excluded.name, port = excluded.port, baud = excluded.baud;";
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK) {
+        fprintf(stderr, "Error: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+
+    for (int i = 0; i < reg->count; ++i) {
+        struct sensor *s = &reg->sensors[i];
+        sqlite3_bind_int(stmt, 1, s->id);
+        sqlite3_bind_text(stmt, 2, s->name, -1, SQLITE_STATIC);
+        sqlite3_bind_text(stmt, 3, s->port, -1, SQLITE_STATIC);
+        sqlite3_bind_int64(stmt, 4, s->baud);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            fprintf(stderr, "Error: %s\n", sqlite3_errmsg(db));
+            sqlite3_finalize(stmt);
+            return -1;
+        }
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    return 0;
+}
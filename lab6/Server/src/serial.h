@@ -73,7 +73,7 @@ void configure_port(const char* port, speed_t baud_rate)
     }
 
     cfsetispeed(&options, baud_rate);
-    cfsetispeed(&options, baud_rate);
+    cfsetospeed(&options, baud_rate);
 
     options.c_cflag |= (CLOCAL | CREAD);
     options.c_cflag &= ~CSIZE;
@@ -82,6 +82,13 @@ void configure_port(const char* port, speed_t baud_rate)
     options.c_cflag &= ~CSTOPB;
     options.c_cflag &= ~CRTSCTS;
 
+    // raw input: frames are delivered as soon as bytes arrive, not per line
+    options.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG | IEXTEN);
+    options.c_iflag &= ~(IXON | IXOFF | IXANY | ICRNL | INLCR | IGNCR | ISTRIP);
+    options.c_oflag &= ~OPOST;
+    options.c_cc[VMIN] = 1;
+    options.c_cc[VTIME] = 0;
+
     if (tcsetattr(fd, TCSANOW, &options) < 0) {
         perror("tcsetattr");
         close(fd);
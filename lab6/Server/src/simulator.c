@@ -1,34 +1,792 @@
 #include "serial.h"
+#include "frame.h"
+#include "decicelsius.h"
 
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
 #ifdef _WIN32
 #    define PORT_WR "COM8"
 #else
-#    define PORT_WR "/dev/pts/5"
+#    include <errno.h>
+#    include <netdb.h>
+#    include <sys/ioctl.h>
+#    include <sys/resource.h>
+#    include <sys/socket.h>
+#    include <sys/un.h>
+#    ifdef __APPLE__
+#        include <util.h>
+#    else
+#        include <pty.h>
+#    endif
 #endif
 
-double init_rand_temp(int min, int max)
+#define SIM_MIN_RATE 1
+#define SIM_MAX_RATE 100000
+#define SIM_REPORT_SEC 10
+#define SIM_BATCH 256             // most frames sent by one write when the sender is behind
+#define SIM_JITTER_BUCKETS 1024   // lateness histogram in us, the last bucket holds the rest
+#define SIM_MAX_FLEET 100000
+#define SIM_MAX_CONF 256          // sensors the server reads from sensors.conf, its MAX_SENSORS
+#define SIM_PORT_LEN 128
+#define WHEEL_SLOTS 4096          // fleet timer wheel, one revolution is ~4 s of 1 ms ticks
+#define WHEEL_TICK_NS 1000000
+#define LAB4_LOG_MAGIC "LAB4LOG1"   // lab4 logs: a header page, then the records
+#define LAB4_LOG_HEADER_SIZE 4096
+
+#ifndef M_PI
+#    define M_PI 3.14159265358979323846
+#endif
+
+enum waveform {
+    WAVE_WALK,    // +-0.2 per sample
+    WAVE_SINE,    // 20 +- 5 C over one cycle
+    WAVE_STEP,    // 20 C and 30 C, half a cycle each
+    WAVE_SPIKE,   // walk with a +-30 C outlier every ~1000 samples
+};
+
+#define WAVE_COUNT 4
+static const char *wave_names[WAVE_COUNT] = {"walk", "sine", "step", "spike"};
+
+struct generator {
+    enum waveform wave;
+    uint64_t rng;
+    long rate;
+    double cycle_sec;
+    decicelsius walk;
+};
+
+// one recorded reading of a replayed trace
+struct trace_sample {
+    int64_t time_ms;   // unix time
+    decicelsius value;
+};
+
+struct trace {
+    struct trace_sample *samples;   // oldest first
+    size_t count;
+};
+
+struct jitter {
+    int64_t first_ns;   // send times of the first and last frame
+    int64_t last_ns;
+    uint64_t frames;
+    uint64_t late;   // frames sent a full period after their deadline
+    double sum_us;
+    double max_us;
+    uint64_t buckets[SIM_JITTER_BUCKETS];
+};
+
+static volatile sig_atomic_t stop = 0;
+
+void on_signal(int sig)
+{
+    (void)sig;
+    stop = 1;
+}
+
+// splitmix64, the same seed gives the same samples on every platform
+uint64_t next_random(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// uniform in [min, max]
+int random_between(uint64_t *state, int min, int max)
+{
+    return min + (int)(next_random(state) % (uint64_t)(max - min + 1));
+}
+
+decicelsius clamp_deci(int32_t value)
+{
+    return (decicelsius)(value < DECI_MIN ? DECI_MIN : value > DECI_MAX ? DECI_MAX : value);
+}
+
+void generator_init(struct generator *g, enum waveform wave, uint64_t seed, long rate, double cycle_sec)
+{
+    g->wave = wave;
+    g->rng = seed;
+    g->rate = rate;
+    g->cycle_sec = cycle_sec;
+    g->walk = (decicelsius)(random_between(&g->rng, -50, 50) * 10);
+}
+
+// sample i of the stream, its time is i / rate seconds after the start
+decicelsius generator_next(struct generator *g, uint64_t i)
+{
+    double phase = fmod((double)i / g->rate, g->cycle_sec) / g->cycle_sec;
+    int noise = random_between(&g->rng, -1, 1);
+
+    switch (g->wave) {
+    case WAVE_SINE:
+        return clamp_deci(200 + (int32_t)lround(50 * sin(2 * M_PI * phase)) + noise);
+    case WAVE_STEP:
+        return clamp_deci((phase < 0.5 ? 200 : 300) + noise);
+    case WAVE_SPIKE:
+        g->walk = clamp_deci(g->walk + random_between(&g->rng, -2, 2));
+        if (next_random(&g->rng) % 1000 == 0)
+            return clamp_deci(g->walk + (next_random(&g->rng) & 1 ? 300 : -300));
+        return g->walk;
+    case WAVE_WALK:
+    default:
+        g->walk = clamp_deci(g->walk + random_between(&g->rng, -2, 2));
+        return g->walk;
+    }
+}
+
+int64_t now_ns()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (int64_t)((double)now.QuadPart * 1e9 / freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// frame i is due i / rate seconds after the start, split so i * 1e9 cannot overflow
+int64_t frame_deadline(int64_t start_ns, uint64_t i, long rate)
+{
+    return start_ns + (int64_t)(i / rate) * 1000000000 + (int64_t)(i % rate) * 1000000000 / rate;
+}
+
+// frame i of a trace is due when its recorded time is reached at speed times real time,
+// speed 0 sends everything at once (the pty's backpressure paces it); without a trace at rate
+int64_t frame_due(const struct trace *t, int64_t start_ns, uint64_t i, long rate, double speed)
+{
+    if (t->count == 0)
+        return frame_deadline(start_ns, i, rate);
+    if (speed <= 0)
+        return start_ns;
+    return start_ns + (int64_t)((t->samples[i].time_ms - t->samples[0].time_ms) * 1e6 / speed);
+}
+
+// absolute deadlines, so time spent writing never adds up into drift
+void sleep_until(int64_t deadline_ns)
+{
+#ifdef _WIN32
+    // Sleep has ms granularity, the rest is spun
+    int64_t left = deadline_ns - now_ns();
+    if (left > 2000000)
+        Sleep((DWORD)(left / 1000000 - 1));
+    while (now_ns() < deadline_ns && !stop)
+        ;
+#else
+    struct timespec ts = {(time_t)(deadline_ns / 1000000000), (long)(deadline_ns % 1000000000)};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR && !stop)
+        ;
+#endif
+}
+
+void jitter_add(struct jitter *j, int64_t sent_ns, int64_t late_ns, int64_t period_ns)
 {
-    double temp = rand() % (max - min + 1) + min;
-    return temp;
+    double us = late_ns / 1e3;
+    if (j->frames++ == 0)
+        j->first_ns = sent_ns;
+    j->last_ns = sent_ns;
+    j->sum_us += us;
+    if (us > j->max_us)
+        j->max_us = us;
+    if (late_ns >= period_ns)
+        j->late++;
+    long bucket = (long)us;
+    j->buckets[bucket < SIM_JITTER_BUCKETS ? bucket : SIM_JITTER_BUCKETS - 1]++;
 }
 
-double rand_temp_change(double min, double max)
+// upper bound of the bucket holding the q-th quantile
+long jitter_quantile(const struct jitter *j, double q)
 {
-    return ((double)rand() / RAND_MAX) * (max - min) + min;
+    uint64_t rank = (uint64_t)(q * j->frames), seen = 0;
+    for (long b = 0; b < SIM_JITTER_BUCKETS; ++b) {
+        seen += j->buckets[b];
+        if (seen > rank)
+            return b + 1;
+    }
+    return SIM_JITTER_BUCKETS;
+}
+
+// achieved rate over the intervals between the first and last frame
+void print_report(const char *what, const struct jitter *j, long rate)
+{
+    double sec = (j->last_ns - j->first_ns) / 1e9;
+    printf("%s: %llu frames in %.2f s, %.1f Hz of %ld Hz, jitter avg %.1f us, p50 <%ld us, p99 <%ld us, "
+           "max %.1f us, %llu late by a period or more\n",
+           what, (unsigned long long)j->frames, sec, sec > 0 ? (j->frames - 1) / sec : 0.0, rate,
+           j->frames ? j->sum_us / j->frames : 0.0, jitter_quantile(j, 0.5), jitter_quantile(j, 0.99),
+           j->max_us, (unsigned long long)j->late);
+    fflush(stdout);
+}
+
+// ---fleet--- //
+
+#ifndef _WIN32
+struct fleet_sensor {
+    struct generator gen;
+    char port[SIM_PORT_LEN];   // as the server's sensors.conf names it
+    int fd;                    // pty master or accepted client, -1 while a socket has no client
+    int listen_fd;             // socket transports only, else -1
+    int slave;                 // ptys only, kept open so the pty outlives server restarts
+    int64_t phase_ns;          // first frame, spread over one period
+    double period_ns;          // nominal period stretched by this sensor's clock skew
+    uint64_t i;                // next frame
+    int64_t due_tick;
+    int next;                  // next sensor in the same wheel slot, -1 ends the list
+};
+
+struct fleet_stats {
+    uint64_t sent;
+    uint64_t dropped;   // reader too slow (full buffer) or gone mid-write
+    uint64_t unread;    // socket sensors without a client yet
+};
+
+// hashed timer wheel: a sensor sits in the slot of its next due tick, entries more than one
+// revolution ahead stay put until their tick comes round, so firing costs O(due sensors)
+struct wheel {
+    int64_t start_ns;
+    int head[WHEEL_SLOTS];
+};
+
+int64_t fleet_due_ns(const struct wheel *w, const struct fleet_sensor *s, uint64_t i)
+{
+    return w->start_ns + s->phase_ns + (int64_t)(i * s->period_ns);
+}
+
+// first tick at or after the frame's deadline
+int64_t fleet_due_tick(const struct wheel *w, const struct fleet_sensor *s, uint64_t i)
+{
+    return (fleet_due_ns(w, s, i) - w->start_ns + WHEEL_TICK_NS - 1) / WHEEL_TICK_NS;
+}
+
+void wheel_insert(struct wheel *w, struct fleet_sensor *sensors, int index)
+{
+    int slot = (int)(sensors[index].due_tick & (WHEEL_SLOTS - 1));
+    sensors[index].next = w->head[slot];
+    w->head[slot] = index;
+}
+
+void set_nonblocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+// one listening socket per sensor: "unix:<dir>" binds <dir>/sensor-<id>.sock,
+// "tcp:<host>:<base port>" binds base port + id - 1
+int fleet_listen(const char *transport, int id, char *port)
+{
+    int fd;
+    if (strncmp(transport, "unix:", 5) == 0) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/sensor-%d.sock", transport + 5, id) >=
+            (int)sizeof(addr.sun_path)) {
+            fprintf(stderr, "%s: socket path too long\n", transport);
+            return -1;
+        }
+        unlink(addr.sun_path);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(fd, 1) == -1) {
+            perror(addr.sun_path);
+            return -1;
+        }
+        set_nonblocking(fd);
+        snprintf(port, SIM_PORT_LEN, "unix:%s", addr.sun_path);
+        return fd;
+    }
+
+    char host[SIM_PORT_LEN], service[16];
+    snprintf(host, sizeof(host), "%s", transport + 4);
+    char *colon = strrchr(host, ':');
+    if (colon == NULL) {
+        fprintf(stderr, "%s: expected tcp:<host>:<base port>\n", transport);
+        return -1;
+    }
+    *colon = '\0';
+    snprintf(service, sizeof(service), "%d", atoi(colon + 1) + id - 1);
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    int err = getaddrinfo(host, service, &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "%s: %s\n", host, gai_strerror(err));
+        return -1;
+    }
+    int one = 1;
+    fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (fd == -1 || setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == -1 ||
+        bind(fd, res->ai_addr, res->ai_addrlen) == -1 || listen(fd, 1) == -1) {
+        perror(service);
+        freeaddrinfo(res);
+        return -1;
+    }
+    freeaddrinfo(res);
+    set_nonblocking(fd);
+    if (snprintf(port, SIM_PORT_LEN, "tcp:%s:%s", host, service) >= SIM_PORT_LEN) {
+        fprintf(stderr, "%s: host name too long for sensors.conf\n", transport);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int fleet_open(struct fleet_sensor *s, const char *transport, int id)
+{
+    s->fd = s->listen_fd = s->slave = -1;
+    if (strncmp(transport, "unix:", 5) == 0 || strncmp(transport, "tcp:", 4) == 0) {
+        s->listen_fd = fleet_listen(transport, id, s->port);
+        return s->listen_fd == -1 ? -1 : 0;
+    }
+
+    struct termios raw;
+    memset(&raw, 0, sizeof(raw));
+    cfmakeraw(&raw);
+    cfsetispeed(&raw, BAUDRATE_115200);
+    cfsetospeed(&raw, BAUDRATE_115200);
+    if (openpty(&s->fd, &s->slave, s->port, &raw, NULL) == -1) {
+        fprintf(stderr, "openpty for sensor %d: %s (the limit is /proc/sys/kernel/pty/max)\n", id,
+                strerror(errno));
+        return -1;
+    }
+    // a pty nobody reads fills up, its frames are dropped instead of stalling the fleet
+    set_nonblocking(s->fd);
+    return 0;
+}
+
+// never blocks: no client yet or a full buffer loses the frames and the schedule goes on
+void fleet_send(struct fleet_sensor *s, const char *buf, size_t len, uint64_t frames, struct fleet_stats *st)
+{
+    if (s->fd == -1) {
+        s->fd = accept(s->listen_fd, NULL, NULL);
+        if (s->fd == -1) {
+            st->unread += frames;
+            return;
+        }
+        set_nonblocking(s->fd);
+    }
+
+    ssize_t n = write(s->fd, buf, len);
+    if (n == (ssize_t)len) {
+        st->sent += frames;
+        return;
+    }
+    if (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && s->listen_fd != -1) {
+        // the server went away, wait for it to connect again
+        close(s->fd);
+        s->fd = -1;
+    }
+    // frames written whole went out, the one cut short is discarded by the server's parser
+    uint64_t whole = 0;
+    for (ssize_t b = 0; b < n; ++b)
+        whole += buf[b] == '\n';
+    st->sent += whole;
+    st->dropped += frames - whole;
+}
+
+double cpu_seconds()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+void print_fleet_report(const char *what, const struct jitter *j, const struct fleet_stats *st,
+                        const struct fleet_sensor *sensors, int n, long rate)
+{
+    int connected = 0;
+    for (int k = 0; k < n; ++k)
+        connected += sensors[k].fd != -1;
+    print_report(what, j, n * rate);
+    printf("%s: %d of %d sensors connected, %llu frames sent, %llu dropped, %llu with no client, cpu %.2f s\n",
+           what, connected, n, (unsigned long long)st->sent, (unsigned long long)st->dropped,
+           (unsigned long long)st->unread, cpu_seconds());
+    fflush(stdout);
+}
+
+// n sensors at rate Hz each, every one with its own waveform (unless wave >= 0), seed,
+// phase and clock skew within +-skew_ppm; conf_file gets their sensors.conf lines
+int run_fleet(int n, const char *transport, long rate, uint64_t seed, int wave, double cycle_sec,
+              double skew_ppm, uint64_t count, const char *conf_file)
+{
+    // a pty is two descriptors, a socket sensor a listener and a client
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    if (rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < (rlim_t)n * 2 + 16)
+        fprintf(stderr, "warning: %d sensors need %d descriptors, the limit is %llu\n", n, n * 2 + 16,
+                (unsigned long long)rl.rlim_cur);
+
+    struct fleet_sensor *sensors = calloc((size_t)n, sizeof(*sensors));
+    static struct wheel wheel;
+    if (sensors == NULL) {
+        perror("calloc");
+        return -1;
+    }
+
+    uint64_t rng = seed;
+    const double period_ns = 1e9 / rate;
+    for (int k = 0; k < n; ++k) {
+        struct fleet_sensor *s = &sensors[k];
+        if (fleet_open(s, transport, k + 1) == -1) {
+            fprintf(stderr, "%d sensors opened\n", k);
+            return -1;
+        }
+        enum waveform w = wave >= 0 ? (enum waveform)wave : (enum waveform)(next_random(&rng) % WAVE_COUNT);
+        generator_init(&s->gen, w, seed ^ (0x9E3779B97F4A7C15ULL * (uint64_t)(k + 1)), rate, cycle_sec);
+        double skew = ((double)(next_random(&rng) >> 11) / (1ULL << 53) * 2 - 1) * skew_ppm / 1e6;
+        s->period_ns = period_ns * (1 + skew);
+        s->phase_ns = (int64_t)(next_random(&rng) % (uint64_t)period_ns);
+    }
+
+    printf("fleet of %d sensors on %s at %ld Hz each, seed %llu, skew +-%.0f ppm, first port %s\n", n,
+           transport, rate, (unsigned long long)seed, skew_ppm, sensors[0].port);
+    if (conf_file != NULL) {
+        FILE *file = fopen(conf_file, "w");
+        if (file == NULL) {
+            perror(conf_file);
+            return -1;
+        }
+        // larger fleets load the simulator only, the server would ignore the rest
+        int listed = n < SIM_MAX_CONF ? n : SIM_MAX_CONF;
+        if (listed < n)
+            fprintf(stderr, "warning: the server reads at most %d sensors, %s lists the first %d of %d\n",
+                    SIM_MAX_CONF, conf_file, listed, n);
+        fprintf(file, "# id  name  port  baud\n");
+        for (int k = 0; k < listed; ++k)
+            fprintf(file, "%d fleet%d %s 115200\n", k + 1, k + 1, sensors[k].port);
+        fclose(file);
+    }
+    fflush(stdout);
+
+    wheel.start_ns = now_ns();
+    for (int slot = 0; slot < WHEEL_SLOTS; ++slot)
+        wheel.head[slot] = -1;
+    for (int k = 0; k < n; ++k) {
+        sensors[k].due_tick = fleet_due_tick(&wheel, &sensors[k], 0);
+        wheel_insert(&wheel, sensors, k);
+    }
+
+    static struct jitter total, window;
+    struct fleet_stats st_total = {0}, st_window = {0};
+    static char batch[SIM_BATCH * FRAME_MAX_LEN];
+    int64_t window_start = wheel.start_ns;
+    int active = n;
+
+    for (int64_t tick = 0; active > 0 && !stop; ++tick) {
+        int slot = (int)(tick & (WHEEL_SLOTS - 1));
+        if (wheel.head[slot] == -1)
+            continue;
+        sleep_until(wheel.start_ns + tick * WHEEL_TICK_NS);
+        int64_t now = now_ns();
+
+        int index = wheel.head[slot];
+        wheel.head[slot] = -1;
+        while (index != -1) {
+            struct fleet_sensor *s = &sensors[index];
+            int next = s->next;
+            if (s->due_tick > tick) {
+                // a later revolution
+                wheel_insert(&wheel, sensors, index);
+                index = next;
+                continue;
+            }
+
+            // every frame of this sensor due by this tick goes out in one write
+            size_t len = 0;
+            uint64_t frames = 0;
+            do {
+                int64_t late = now - fleet_due_ns(&wheel, s, s->i);
+                jitter_add(&total, now, late, (int64_t)s->period_ns);
+                jitter_add(&window, now, late, (int64_t)s->period_ns);
+                len += frame_encode(batch + len, FRAME_MAX_LEN, (uint32_t)s->i, generator_next(&s->gen, s->i));
+                ++s->i;
+                ++frames;
+            } while (len + FRAME_MAX_LEN <= sizeof(batch) && (count == 0 || s->i < count) &&
+                     fleet_due_tick(&wheel, s, s->i) <= tick);
+            fleet_send(s, batch, len, frames, &st_window);
+
+            if (count == 0 || s->i < count) {
+                s->due_tick = fleet_due_tick(&wheel, s, s->i);
+                wheel_insert(&wheel, sensors, index);
+            } else {
+                --active;
+            }
+            index = next;
+        }
+
+        if (now - window_start >= (int64_t)SIM_REPORT_SEC * 1000000000) {
+            print_fleet_report("window", &window, &st_window, sensors, n, rate);
+            st_total.sent += st_window.sent;
+            st_total.dropped += st_window.dropped;
+            st_total.unread += st_window.unread;
+            memset(&window, 0, sizeof(window));
+            memset(&st_window, 0, sizeof(st_window));
+            window_start = now;
+        }
+    }
+    st_total.sent += st_window.sent;
+    st_total.dropped += st_window.dropped;
+    st_total.unread += st_window.unread;
+    print_fleet_report("total", &total, &st_total, sensors, n, rate);
+
+    // let readers drain their ptys, as in single sensor mode
+    for (int waited = 0; waited < 100; ++waited) {
+        int pending = 0;
+        for (int k = 0; k < n && pending == 0; ++k)
+            if (sensors[k].slave != -1 && ioctl(sensors[k].slave, FIONREAD, &pending) == -1)
+                pending = 0;
+        if (pending == 0)
+            break;
+        usleep(10000);
+    }
+    for (int k = 0; k < n; ++k) {
+        struct fleet_sensor *s = &sensors[k];
+        if (s->fd != -1)
+            close(s->fd);
+        if (s->slave != -1)
+            close(s->slave);
+        if (s->listen_fd != -1) {
+            close(s->listen_fd);
+            if (strncmp(s->port, "unix:", 5) == 0)
+                unlink(s->port + 5);
+        }
+    }
+    free(sensors);
+    return 0;
+}
+#endif
+
+// ---replay--- //
+
+static int compare_trace_samples(const void *a, const void *b)
+{
+    int64_t x = ((const struct trace_sample*)a)->time_ms, y = ((const struct trace_sample*)b)->time_ms;
+    return (x > y) - (x < y);
+}
+
+// local "YYYY-MM-DD HH:MM:SS[.mmm]" to unix ms
+int parse_local_ms(const char *s, int64_t *out)
+{
+    struct tm tm;
+    int ms = 0, n = 0;
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(s, "%4d-%2d-%2d %2d:%2d:%2d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &tm.tm_hour, &tm.tm_min,
+               &tm.tm_sec, &n) != 6)
+        return -1;
+    if (s[n] == '.' && s[n + 1] >= '0' && s[n + 1] <= '9')
+        ms = atoi(s + n + 1) % 1000;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    time_t t = mktime(&tm);
+    if (t == (time_t)-1)
+        return -1;
+    *out = (int64_t)t * 1000 + ms;
+    return 0;
+}
+
+// a trace is a raw export of temperature.db ("sensor_id,date,temp,samples" csv from temp_export
+// or /export) or a lab4 log.txt ("YYYY-MM-DD HH:MM:SS.mmm V.V" records); lines that are neither,
+// like the csv header or empty ring slots, are skipped. Sorted by time, a lab4 ring that
+// wrapped starts anywhere in the file.
+int load_trace(const char *path, struct trace *t)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return -1;
+    }
+    size_t capacity = 1 << 16, skipped = 0;
+    t->count = 0;
+    t->samples = malloc(sizeof(struct trace_sample) * capacity);
+    if (t->samples == NULL) {
+        perror("malloc");
+        fclose(file);
+        return -1;
+    }
+
+    // a lab4 log starts with a binary header page, the records follow it
+    char magic[8];
+    if (fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, LAB4_LOG_MAGIC, sizeof(magic)) == 0)
+        fseek(file, LAB4_LOG_HEADER_SIZE, SEEK_SET);
+    else
+        rewind(file);
+
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL) {
+        // csv rows start with the sensor id, then the date and the value
+        const char *date = line, *value;
+        char *comma = strchr(line, ',');
+        if (comma != NULL) {
+            date = comma + 1;
+            char *temp = strchr(date, ',');
+            if (temp == NULL) {
+                skipped++;
+                continue;
+            }
+            *temp++ = '\0';
+            temp[strcspn(temp, ",\r\n")] = '\0';
+            value = temp;
+        } else {
+            // lab4: the value follows the 23-byte date, the record is padded with spaces
+            if (strlen(line) < 25) {
+                skipped++;
+                continue;
+            }
+            value = line + 24;
+            line[24 + strcspn(line + 24, " \r\n")] = '\0';
+        }
+
+        struct trace_sample sample;
+        if (parse_local_ms(date, &sample.time_ms) == -1 || deci_parse_str(value, &sample.value) == -1) {
+            skipped++;
+            continue;
+        }
+        if (t->count == capacity) {
+            capacity *= 2;
+            struct trace_sample *grown = realloc(t->samples, sizeof(struct trace_sample) * capacity);
+            if (grown == NULL) {
+                perror("realloc");
+                fclose(file);
+                return -1;
+            }
+            t->samples = grown;
+        }
+        t->samples[t->count++] = sample;
+    }
+    fclose(file);
+    if (t->count == 0) {
+        fprintf(stderr, "%s: no samples (%zu lines skipped)\n", path, skipped);
+        return -1;
+    }
+    qsort(t->samples, t->count, sizeof(struct trace_sample), compare_trace_samples);
+    if (skipped > 0)
+        printf("%s: %zu lines skipped\n", path, skipped);
+    return 0;
+}
+
+void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [-r rate] [-s seed] [-w walk|sine|step|spike] [-c cycle seconds] [-n frames] [-p port] [-o file]\n"
+            "       %s -f sensors [-t pty|unix:<dir>|tcp:<host>:<base port>] [-k ppm] [-r rate] [-s seed] [-w wave]\n"
+            "          [-c cycle seconds] [-n frames] [-o sensors.conf]\n"
+            "       %s -R trace [-x speed] [-n frames] [-p port] [-o file]\n"
+            "  -r  frames per second, %d..%d (1)\n"
+            "  -s  random seed, the same seed sends the same samples (1)\n"
+            "  -w  waveform (walk)\n"
+            "  -c  period of sine and step in seconds of sample time (86400)\n"
+            "  -n  stop after this many frames, 0 runs until Ctrl+C (0)\n"
+#ifdef _WIN32
+            "  -p  serial port to write (" PORT_WR ")\n"
+#else
+            "  -p  write to this serial port instead of a new pty\n"
+#endif
+            "  -o  write the pty's slave path to this file for scripts\n"
+            "  -f  emulate this many sensors, 1..%d, each with its own waveform, seed and clock\n"
+            "  -t  fleet transport: one pty, or one listening socket the server connects to, per sensor (pty)\n"
+            "  -k  largest clock skew of a fleet sensor in ppm (50)\n"
+            "  -o  in fleet mode, write the sensors.conf lines of the fleet to this file, the first %d\n"
+            "  -R  replay a raw csv export of temperature.db or a lab4 log.txt, frames carry the recorded times\n"
+            "  -x  replay speed, 1 is real time, 0 as fast as the reader takes it (1)\n",
+            name, name, name, SIM_MIN_RATE, SIM_MAX_RATE, SIM_MAX_FLEET, SIM_MAX_CONF);
+    exit(EXIT_FAILURE);
 }
 
 int main(int argc, char *argv[])
 {
-    srand(time(0));
+    long rate = 1;
+    uint64_t seed = 1;
+    enum waveform wave = WAVE_WALK;
+    double cycle_sec = 86400;
+    uint64_t count = 0;
+    const char *port = NULL;
+    const char *path_file = NULL;
+    int fleet = 0;
+    const char *transport = "pty";
+    double skew_ppm = 50;
+    int wave_set = 0;
+    const char *trace_file = NULL;
+    double speed = 1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i][0] != '-' || argv[i][1] == '\0' || argv[i][2] != '\0' || i + 1 >= argc)
+            usage(argv[0]);
+        const char *value = argv[++i];
+        switch (argv[i - 1][1]) {
+        case 'r': rate = atol(value); break;
+        case 's': seed = strtoull(value, NULL, 10); break;
+        case 'c': cycle_sec = atof(value); break;
+        case 'n': count = strtoull(value, NULL, 10); break;
+        case 'p': port = value; break;
+        case 'o': path_file = value; break;
+        case 'f': fleet = atoi(value); break;
+        case 't': transport = value; break;
+        case 'k': skew_ppm = atof(value); break;
+        case 'R': trace_file = value; break;
+        case 'x': speed = atof(value); break;
+        case 'w': {
+            int w = 0;
+            while (w < WAVE_COUNT && strcmp(value, wave_names[w]) != 0)
+                ++w;
+            if (w == WAVE_COUNT)
+                usage(argv[0]);
+            wave = (enum waveform)w;
+            wave_set = 1;
+            break;
+        }
+        default:
+            usage(argv[0]);
+        }
+    }
+    if (rate < SIM_MIN_RATE || rate > SIM_MAX_RATE || cycle_sec <= 0 || fleet < 0 || fleet > SIM_MAX_FLEET ||
+        skew_ppm < 0 || skew_ppm >= 1e6 || speed < 0 || (fleet > 0 && trace_file != NULL))
+        usage(argv[0]);
+
+    if (fleet > 0) {
+#ifdef _WIN32
+        fprintf(stderr, "fleet mode needs ptys or sockets, it is not available on Windows\n");
+        exit(EXIT_FAILURE);
+#else
+        if (strcmp(transport, "pty") != 0 && strncmp(transport, "unix:", 5) != 0 && strncmp(transport, "tcp:", 4) != 0)
+            usage(argv[0]);
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = on_signal;
+        sigaction(SIGINT, &sa, NULL);
+        sigaction(SIGTERM, &sa, NULL);
+        // a server that disconnects shows up as EPIPE, not as a signal
+        signal(SIGPIPE, SIG_IGN);
+        return run_fleet(fleet, transport, rate, seed, wave_set ? (int)wave : -1, cycle_sec, skew_ppm, count,
+                         path_file) == -1 ? EXIT_FAILURE : 0;
+#endif
+    }
 
     // configure port
     #ifdef _WIN32
+    if (port == NULL)
+        port = PORT_WR;
     HANDLE hSerial = CreateFile(
-        PORT_WR,
+        port,
         GENERIC_WRITE,
         0,
         NULL,
@@ -46,41 +804,140 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
     #else
-    const char* port_wr = PORT_WR;
-    speed_t baud_rate = BAUDRATE_115200;
-    configure_port(port_wr, baud_rate);
-
-    // open port
-    int fd = open(port_wr, O_RDWR | O_NOCTTY | O_NDELAY);
-    if (fd == -1) {
-        perror("open port");
-        exit(EXIT_FAILURE);
+    int fd, slave = -1;
+    char slave_path[256];
+    if (port != NULL) {
+        configure_port(port, BAUDRATE_115200);
+        fd = open(port, O_RDWR | O_NOCTTY);
+        if (fd == -1) {
+            perror("open port");
+            exit(EXIT_FAILURE);
+        }
+        snprintf(slave_path, sizeof(slave_path), "%s", port);
+    } else {
+        // raw like a serial line, the slave stays open here so the pty lives while the server reconnects
+        struct termios raw;
+        memset(&raw, 0, sizeof(raw));
+        cfmakeraw(&raw);
+        cfsetispeed(&raw, BAUDRATE_115200);
+        cfsetospeed(&raw, BAUDRATE_115200);
+        if (openpty(&fd, &slave, slave_path, &raw, NULL) == -1) {
+            perror("openpty");
+            exit(EXIT_FAILURE);
+        }
+    }
+    printf("writing to %s\n", slave_path);
+    if (path_file != NULL) {
+        FILE *file = fopen(path_file, "w");
+        if (file == NULL) {
+            perror(path_file);
+            exit(EXIT_FAILURE);
+        }
+        fprintf(file, "%s\n", slave_path);
+        fclose(file);
     }
     #endif
 
-    // generate random initial temp
-    double temp = init_rand_temp(-50, 50);
-    char data[10];
-    sprintf(data, "%.1f", temp);
+    struct trace trace = {NULL, 0};
+    if (trace_file != NULL) {
+        if (load_trace(trace_file, &trace) == -1)
+            exit(EXIT_FAILURE);
+        int64_t span_ms = trace.samples[trace.count - 1].time_ms - trace.samples[0].time_ms;
+        // the nominal rate only scales the lateness report
+        rate = span_ms > 0 ? (long)((trace.count - 1) * 1000.0 / span_ms * (speed > 0 ? speed : 1)) : 1;
+        if (rate < 1)
+            rate = 1;
+        if (count == 0 || count > trace.count)
+            count = trace.count;
+        printf("replaying %zu samples over %.1f h of %s at %s speed\n", trace.count, span_ms / 3.6e6, trace_file,
+               speed > 0 ? (speed == 1 ? "real" : "accelerated") : "full");
+    } else {
+        printf("%s at %ld Hz, seed %llu\n", wave_names[wave], rate, (unsigned long long)seed);
+    }
+    fflush(stdout);
+#ifdef _WIN32
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+#else
+    // no SA_RESTART: a write blocked on a full pty returns on Ctrl+C
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+#endif
 
-    #ifdef _WIN32
-    while (1) {
+    struct generator gen;
+    generator_init(&gen, wave, seed, rate, cycle_sec);
+    static struct jitter total, window;
+    static char batch[SIM_BATCH * FRAME_MAX_LEN];
+    const int64_t period_ns = 1000000000 / rate;
+    const int64_t start = now_ns();
+    int64_t window_start = start;
+    uint64_t i = 0;
+
+    while ((count == 0 || i < count) && !stop) {
+        sleep_until(frame_due(&trace, start, i, rate, speed));
+        int64_t now = now_ns();
+
+        // every frame that is due by now goes out in one write
+        size_t len = 0;
+        do {
+            int64_t late = now - frame_due(&trace, start, i, rate, speed);
+            jitter_add(&total, now, late, period_ns);
+            jitter_add(&window, now, late, period_ns);
+            if (trace.count)
+                len += frame_encode_at(batch + len, FRAME_MAX_LEN, (uint32_t)i, trace.samples[i].value,
+                                       trace.samples[i].time_ms);
+            else
+                len += frame_encode(batch + len, FRAME_MAX_LEN, (uint32_t)i, generator_next(&gen, i));
+            ++i;
+        } while (len + FRAME_MAX_LEN <= sizeof(batch) && (count == 0 || i < count) &&
+                 frame_due(&trace, start, i, rate, speed) <= now);
+
+        #ifdef _WIN32
         DWORD bytes_written;
-        if (!WriteFile(hSerial, data, strlen(data), &bytes_written, NULL)) {
+        if (!WriteFile(hSerial, batch, (DWORD)len, &bytes_written, NULL)) {
             perror("WriteFile");
             break;
         }
-        temp += rand_temp_change(-0.2, 0.2);
-        sprintf(data, "%.1f", temp);
-        Sleep(PORT_SPEED_MS);
+        #else
+        for (size_t off = 0; off < len; ) {
+            ssize_t n = write(fd, batch + off, len - off);
+            if (n == -1 && errno == EINTR && !stop)
+                continue;
+            if (n == -1) {
+                if (!stop)
+                    perror("write");
+                stop = 1;
+                break;
+            }
+            off += (size_t)n;
+        }
+        #endif
+
+        if (now - window_start >= (int64_t)SIM_REPORT_SEC * 1000000000) {
+            print_report("window", &window, rate);
+            memset(&window, 0, sizeof(window));
+            window_start = now;
+        }
     }
+
+    print_report("total", &total, rate);
+    #ifdef _WIN32
+    CloseHandle(hSerial);
     #else
-    while(1) {
-        write(fd, data, strlen(data));
-        temp += rand_temp_change(-0.2, 0.2);
-        sprintf(data, "%.1f", temp);
-        usleep(PORT_SPEED_MS * 1000);
+    // closing the master drops what the reader has not taken yet, give it a second
+    for (int waited = 0; slave != -1 && waited < 100; ++waited) {
+        int pending = 0;
+        if (ioctl(slave, FIONREAD, &pending) == -1 || pending == 0)
+            break;
+        usleep(10000);
     }
+    close(fd);
+    if (slave != -1)
+        close(slave);
     #endif
+    free(trace.samples);
     return 0;
 }
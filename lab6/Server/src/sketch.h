@@ -0,0 +1,320 @@
+#pragma once
+
+#include "sqlite3.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+// DDSketch: log-spaced bins with 1% relative error, two sketches merge by adding
+// their bin counts, so a span's quantiles come from its buckets without raw samples
+#define SKETCH_ALPHA 0.01
+#define SKETCH_MIN_VALUE 0.01   // smaller magnitudes count as zero
+#define SKETCH_BINS 1024        // covers magnitudes up to ~1e7, larger ones share the last bin
+#define SKETCH_VERSION 1
+
+struct sketch {
+    uint64_t count;
+    double min;
+    double max;
+    uint64_t zero;
+    uint32_t pos[SKETCH_BINS];
+    uint32_t neg[SKETCH_BINS];
+};
+
+static double sketch_log_gamma()
+{
+    static double log_gamma = 0;
+    if (log_gamma == 0)
+        log_gamma = log((1 + SKETCH_ALPHA) / (1 - SKETCH_ALPHA));
+    return log_gamma;
+}
+
+void sketch_init(struct sketch *s)
+{
+    memset(s, 0, sizeof(*s));
+    s->min = INFINITY;
+    s->max = -INFINITY;
+}
+
+static int sketch_index(double magnitude)
+{
+    int i = (int)ceil(log(magnitude / SKETCH_MIN_VALUE) / sketch_log_gamma());
+    if (i < 0)
+        return 0;
+    return i < SKETCH_BINS ? i : SKETCH_BINS - 1;
+}
+
+// value every sample of a bin is reported as, within SKETCH_ALPHA of all of them
+static double sketch_value(int index)
+{
+    double gamma = exp(sketch_log_gamma());
+    return SKETCH_MIN_VALUE * exp(index * sketch_log_gamma()) * 2 / (1 + gamma);
+}
+
+void sketch_add(struct sketch *s, double value)
+{
+    if (value > SKETCH_MIN_VALUE)
+        s->pos[sketch_index(value)]++;
+    else if (value < -SKETCH_MIN_VALUE)
+        s->neg[sketch_index(-value)]++;
+    else
+        s->zero++;
+    s->count++;
+    if (value < s->min)
+        s->min = value;
+    if (value > s->max)
+        s->max = value;
+}
+
+void sketch_merge(struct sketch *s, const struct sketch *other)
+{
+    for (int i = 0; i < SKETCH_BINS; ++i) {
+        s->pos[i] += other->pos[i];
+        s->neg[i] += other->neg[i];
+    }
+    s->zero += other->zero;
+    s->count += other->count;
+    if (other->min < s->min)
+        s->min = other->min;
+    if (other->max > s->max)
+        s->max = other->max;
+}
+
+// q in [0, 1], NAN for an empty sketch
+double sketch_quantile(const struct sketch *s, double q)
+{
+    if (s->count == 0)
+        return NAN;
+    if (q <= 0)
+        return s->min;
+    if (q >= 1)
+        return s->max;
+
+    uint64_t rank = (uint64_t)(q * (s->count - 1));
+    uint64_t seen = 0;
+    double value = s->max;
+    int found = 0;
+    for (int i = SKETCH_BINS - 1; i >= 0 && !found; --i) {
+        seen += s->neg[i];
+        if (seen > rank) {
+            value = -sketch_value(i);
+            found = 1;
+        }
+    }
+    if (!found) {
+        seen += s->zero;
+        if (seen > rank) {
+            value = 0;
+            found = 1;
+        }
+    }
+    for (int i = 0; i < SKETCH_BINS && !found; ++i) {
+        seen += s->pos[i];
+        if (seen > rank) {
+            value = sketch_value(i);
+            found = 1;
+        }
+    }
+
+    if (value < s->min)
+        return s->min;
+    return value > s->max ? s->max : value;
+}
+
+// ---serialization--- //
+
+static size_t put_varint(unsigned char *out, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80) {
+        out[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    out[n++] = (unsigned char)v;
+    return n;
+}
+
+static int get_varint(const unsigned char **in, const unsigned char *end, uint64_t *v)
+{
+    *v = 0;
+    for (int shift = 0; *in < end && shift < 64; shift += 7) {
+        unsigned char b = *(*in)++;
+        *v |= (uint64_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+            return 0;
+    }
+    return -1;
+}
+
+// upper bound of sketch_encode's output
+#define SKETCH_MAX_ENCODED (1 + 16 + 10 + (2 * SKETCH_BINS + 1) * 12)
+
+// version, min, max, non-empty bin count, then (key delta, count) varints in value order:
+// negative bin i is key SKETCH_BINS - 1 - i, zero is SKETCH_BINS, positive bin i is SKETCH_BINS + 1 + i
+size_t sketch_encode(const struct sketch *s, unsigned char *out)
+{
+    size_t n = 0;
+    out[n++] = SKETCH_VERSION;
+    memcpy(out + n, &s->min, sizeof(double));
+    memcpy(out + n + 8, &s->max, sizeof(double));
+    n += 16;
+
+    uint64_t bins = s->zero != 0;
+    for (int i = 0; i < SKETCH_BINS; ++i)
+        bins += (s->pos[i] != 0) + (s->neg[i] != 0);
+    n += put_varint(out + n, bins);
+
+    uint64_t prev = 0;
+    for (int key = 0; key < 2 * SKETCH_BINS + 1; ++key) {
+        uint64_t count;
+        if (key < SKETCH_BINS)
+            count = s->neg[SKETCH_BINS - 1 - key];
+        else if (key == SKETCH_BINS)
+            count = s->zero;
+        else
+            count = s->pos[key - SKETCH_BINS - 1];
+        if (count == 0)
+            continue;
+        n += put_varint(out + n, (uint64_t)key - prev);
+        n += put_varint(out + n, count);
+        prev = (uint64_t)key;
+    }
+    return n;
+}
+
+// merge an encoded sketch into s, -1 if it is malformed
+int sketch_decode_merge(struct sketch *s, const unsigned char *in, size_t size)
+{
+    const unsigned char *end = in + size;
+    if (size < 17 || in[0] != SKETCH_VERSION)
+        return -1;
+    double min, max;
+    memcpy(&min, in + 1, sizeof(double));
+    memcpy(&max, in + 9, sizeof(double));
+    in += 17;
+
+    uint64_t bins, key = 0;
+    if (get_varint(&in, end, &bins) == -1)
+        return -1;
+    for (uint64_t b = 0; b < bins; ++b) {
+        uint64_t delta, count;
+        if (get_varint(&in, end, &delta) == -1 || get_varint(&in, end, &count) == -1)
+            return -1;
+        key += delta;
+        if (key < SKETCH_BINS)
+            s->neg[SKETCH_BINS - 1 - key] += (uint32_t)count;
+        else if (key == SKETCH_BINS)
+            s->zero += count;
+        else if (key <= 2 * SKETCH_BINS)
+            s->pos[key - SKETCH_BINS - 1] += (uint32_t)count;
+        else
+            return -1;
+        s->count += count;
+    }
+    if (min < s->min)
+        s->min = min;
+    if (max > s->max)
+        s->max = max;
+    return 0;
+}
+
+// ---sql functions--- //
+// sketch_add(value) and sketch_merge(blob) aggregate into a blob, sketch_quantile(blob, q)
+// and sketch_count(blob) read one, so rollups and range queries stay plain SQL
+
+static void sql_sketch_add_step(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    (void)argc;
+    struct sketch *s = (struct sketch*)sqlite3_aggregate_context(ctx, sizeof(struct sketch));
+    if (s == NULL || sqlite3_value_type(argv[0]) == SQLITE_NULL)
+        return;
+    if (s->count == 0)
+        sketch_init(s);
+    sketch_add(s, sqlite3_value_double(argv[0]));
+}
+
+static void sql_sketch_merge_step(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    (void)argc;
+    struct sketch *s = (struct sketch*)sqlite3_aggregate_context(ctx, sizeof(struct sketch));
+    if (s == NULL || sqlite3_value_type(argv[0]) != SQLITE_BLOB)
+        return;
+    if (s->count == 0)
+        sketch_init(s);
+    sketch_decode_merge(s, (const unsigned char*)sqlite3_value_blob(argv[0]), (size_t)sqlite3_value_bytes(argv[0]));
+}
+
+static void sql_sketch_final(sqlite3_context *ctx)
+{
+    struct sketch *s = (struct sketch*)sqlite3_aggregate_context(ctx, 0);
+    if (s == NULL || s->count == 0) {
+        sqlite3_result_null(ctx);
+        return;
+    }
+    // scratch of every call its own, connections in other threads run these too
+    unsigned char *buf = (unsigned char*)sqlite3_malloc(SKETCH_MAX_ENCODED);
+    if (buf == NULL) {
+        sqlite3_result_error_nomem(ctx);
+        return;
+    }
+    size_t n = sketch_encode(s, buf);
+    sqlite3_result_blob(ctx, buf, (int)n, sqlite3_free);
+}
+
+// the sketch of a blob argument, NULL (with the result set) when out of memory
+static struct sketch *sql_sketch_decode(sqlite3_context *ctx, sqlite3_value *value, int *valid)
+{
+    struct sketch *s = (struct sketch*)sqlite3_malloc(sizeof(struct sketch));
+    if (s == NULL) {
+        sqlite3_result_error_nomem(ctx);
+        return NULL;
+    }
+    sketch_init(s);
+    *valid = sqlite3_value_type(value) == SQLITE_BLOB &&
+             sketch_decode_merge(s, (const unsigned char*)sqlite3_value_blob(value),
+                                 (size_t)sqlite3_value_bytes(value)) == 0;
+    return s;
+}
+
+static void sql_sketch_quantile(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    (void)argc;
+    int valid;
+    struct sketch *s = sql_sketch_decode(ctx, argv[0], &valid);
+    if (s == NULL)
+        return;
+    if (!valid || s->count == 0)
+        sqlite3_result_null(ctx);
+    else
+        sqlite3_result_double(ctx, sketch_quantile(s, sqlite3_value_double(argv[1])));
+    sqlite3_free(s);
+}
+
+static void sql_sketch_count(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    (void)argc;
+    int valid;
+    struct sketch *s = sql_sketch_decode(ctx, argv[0], &valid);
+    if (s == NULL)
+        return;
+    sqlite3_result_int64(ctx, (sqlite3_int64)s->count);
+    sqlite3_free(s);
+}
+
+int sketch_register(sqlite3 *db)
+{
+    if (sqlite3_create_function(db, "sketch_add", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL,
+                                NULL, sql_sketch_add_step, sql_sketch_final) != SQLITE_OK ||
+        sqlite3_create_function(db, "sketch_merge", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL,
+                                NULL, sql_sketch_merge_step, sql_sketch_final) != SQLITE_OK ||
+        sqlite3_create_function(db, "sketch_quantile", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL,
+                                sql_sketch_quantile, NULL, NULL) != SQLITE_OK ||
+        sqlite3_create_function(db, "sketch_count", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL,
+                                sql_sketch_count, NULL, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Cannot register sketch functions: %s\n", sqlite3_errmsg(db));
+        return -1;
+    }
+    return 0;
+}
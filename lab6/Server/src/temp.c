@@ -1,5 +1,40 @@
 #include "html_response.h"
 #include "json_response.h"
+#include "sensors.h"
+#include "policy.h"
+#include "export.h"
+
+// strips "?sensor=N&span=7d" from the uri, the qt-app passes the sensor as SENSOR_ID instead
+int parse_sensor_id(char *request_uri, int64_t *span)
+{
+    int sensor_id = DEFAULT_SENSOR_ID;
+
+    char *env_sensor = getenv("SENSOR_ID");
+    if (env_sensor != NULL && *env_sensor != '\0') {
+        sensor_id = atoi(env_sensor);
+    }
+
+    if (request_uri == NULL) {
+        return sensor_id;
+    }
+
+    char *query = strchr(request_uri, '?');
+    if (query != NULL) {
+        *query++ = '\0';
+        char *param = strstr(query, "sensor=");
+        if (param != NULL) {
+            sensor_id = atoi(param + strlen("sensor="));
+        }
+        param = strstr(query, "span=");
+        if (param != NULL) {
+            char value[16];
+            snprintf(value, sizeof(value), "%.*s", (int)strcspn(param + strlen("span="), "&"), param + strlen("span="));
+            if (parse_duration(value) > 0)
+                *span = parse_duration(value);
+        }
+    }
+    return sensor_id;
+}
 
 int main()
 {
@@ -10,69 +45,109 @@ int main()
         client_type = "web";
     }
 
+    // "now" is the running server's clock, virtual during soak tests
+    struct vclock server_clock;
+    if (live_read_clock(&server_clock) == 0)
+        vclock_set(&server_clock);
+    else
+        vclock_init();
+
+    char *query = request_uri != NULL ? strchr(request_uri, '?') : NULL;
+    int64_t span = SEC_IN_DAY;
+    int sensor_id = parse_sensor_id(request_uri, &span);
+
+    // exports are streamed as the whole response, without the dashboard around them
+    if (request_uri != NULL && (strcmp(request_uri, "/export") == 0 || strcmp(request_uri, "export") == 0)) {
+        int status = print_export(query != NULL ? query + 1 : NULL, sensor_id, span);
+        db_close_reader();
+        return status;
+    }
+
     if (strcmp(client_type, "web") == 0) {
         print_html_header();
-        print_current_temperature();
-        print_html_navigation();
+        print_current_temperature(sensor_id);
+        print_sensor_navigation(request_uri, sensor_id);
+        print_html_navigation(sensor_id);
     }
 
     if (strcmp(client_type, "web") == 0) {
         if (request_uri == NULL || strcmp(request_uri, "/") == 0) {
         }
         else if (strcmp(request_uri, "/hourly_day") == 0) {
-            print_hourly_day_avg(request_uri);
+            print_hourly_day_avg(request_uri, sensor_id);
         }
         else if (strcmp(request_uri, "/hourly_week") == 0) {
-            print_hourly_week_avg(request_uri);
+            print_hourly_week_avg(request_uri, sensor_id);
         }
         else if (strcmp(request_uri, "/hourly_month") == 0) {
-            print_hourly_month_avg(request_uri);
+            print_hourly_month_avg(request_uri, sensor_id);
         }
         else if (strcmp(request_uri, "/secondly_1min") == 0) {
-            print_secondly_minute(request_uri);
+            print_secondly_minute(request_uri, sensor_id);
         }
         else if (strcmp(request_uri, "/secondly_5min") == 0) {
-            print_secondly_5minutes(request_uri);
+            print_secondly_5minutes(request_uri, sensor_id);
         }
         else if (strcmp(request_uri, "/daily_week") == 0) {
-            print_daily_week(request_uri);
+            print_daily_week(request_uri, sensor_id);
         }
         else if (strcmp(request_uri, "/daily_month") == 0) {
-            print_daily_month(request_uri);
+            print_daily_month(request_uri, sensor_id);
         }
         else if (strcmp(request_uri, "/daily_3month") == 0) {
-            print_daily_3month(request_uri);
+            print_daily_3month(request_uri, sensor_id);
         }
         else if (strcmp(request_uri, "/daily_6month") == 0) {
-            print_daily_6month(request_uri);
+            print_daily_6month(request_uri, sensor_id);
         }
         else if (strcmp(request_uri, "/daily_year") == 0) {
-            print_daily_year(request_uri);
+            print_daily_year(request_uri, sensor_id);
+        }
+        else if (strcmp(request_uri, "/percentiles") == 0) {
+            print_percentiles(sensor_id, span);
+        }
+        else if (strcmp(request_uri, "/window") == 0) {
+            print_window_stats(sensor_id, span);
+        }
+        else if (strcmp(request_uri, "/metrics") == 0) {
+            print_wal_metrics();
         }
     } else if (strcmp(client_type, "qt-app") == 0) {
         if (strcmp(request_uri, "current") == 0) {
-            get_current_temp();
+            get_current_temp(sensor_id);
         }
         else if (strcmp(request_uri, "hourly_day") == 0) {
-            get_hourly_day_avg();
+            get_hourly_day_avg(sensor_id);
         }
         else if (strcmp(request_uri, "hourly_week") == 0) {
-            get_hourly_weekly_avg();
+            get_hourly_weekly_avg(sensor_id);
         }
         else if (strcmp(request_uri, "hourly_month") == 0) {
-            get_hourly_month_avg();
+            get_hourly_month_avg(sensor_id);
         }
         else if (strcmp(request_uri, "daily_week") == 0) {
-            get_daily_week_avg();
+            get_daily_week_avg(sensor_id);
         }
         else if (strcmp(request_uri, "daily_month") == 0) {
-            get_daily_month_avg();
+            get_daily_month_avg(sensor_id);
         }
         else if (strcmp(request_uri, "daily_year") == 0) {
-            get_daily_year_avg();
+            get_daily_year_avg(sensor_id);
         }
         else if (strcmp(request_uri, "current_minute") == 0) {
-            get_last_60_seconds();
+            get_last_60_seconds(sensor_id);
+        }
+        else if (strcmp(request_uri, "percentiles") == 0) {
+            get_percentiles(sensor_id, span);
+        }
+        else if (strcmp(request_uri, "window") == 0) {
+            get_window_stats(sensor_id, span);
+        }
+        else if (strcmp(request_uri, "metrics") == 0) {
+            get_wal_metrics();
+        }
+        else if (strcmp(request_uri, "sensors") == 0) {
+            get_sensors();
         }
     }
 
@@ -80,5 +155,6 @@ int main()
         print_html_footer();
     }
 
+    db_close_reader();
     return 0;
 }
@@ -0,0 +1,69 @@
+#include "sqlite3.h"
+#include "export.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char *argv[])
+{
+    if (argc < 5) {
+        fprintf(stderr, "usage: %s <sensor id> <tier> <from> <to> [csv|bin] [output file]\n"
+                        "  dates as 2026-10-01 or 2026-10-01T12:00:00, rows in [from, to), stdout without a file\n",
+                argv[0]);
+        return 1;
+    }
+
+    vclock_init();
+    const struct policy *p = current_policy();
+    struct export_request req;
+    req.sensor_id = atoi(argv[1]);
+    req.tier = NULL;
+    for (int i = 0; i < p->count; ++i) {
+        if (strcmp(p->tiers[i].name, argv[2]) == 0)
+            req.tier = &p->tiers[i];
+    }
+    if (req.tier == NULL) {
+        fprintf(stderr, "Unknown tier: %s\n", argv[2]);
+        return 1;
+    }
+    req.from = parse_export_date(argv[3]);
+    req.to = parse_export_date(argv[4]);
+    if (req.from == -1 || req.to == -1) {
+        fprintf(stderr, "Bad date range: %s %s\n", argv[3], argv[4]);
+        return 1;
+    }
+    req.format = argc > 5 && strcmp(argv[5], "bin") == 0 ? EXPORT_COLUMNAR : EXPORT_CSV;
+
+    FILE *out = stdout;
+    if (argc > 6) {
+        out = fopen(argv[6], "wb");
+        if (out == NULL) {
+            perror("fopen");
+            return 1;
+        }
+    } else {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    }
+
+    sqlite3 *db;
+    if (sqlite3_open_v2("temperature.db", &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
+        return 1;
+    }
+
+    double t0 = export_now();
+    int64_t rows = export_range(db, &req, out);
+    double sec = export_now() - t0;
+    sqlite3_close(db);
+    if (out != stdout)
+        fclose(out);
+    if (rows == -1)
+        return 1;
+
+    fprintf(stderr, "%lld rows in %.3f s: %.2f M rows/s\n",
+            (long long)rows, sec, sec > 0 ? rows / sec / 1e6 : 0.0);
+    return 0;
+}
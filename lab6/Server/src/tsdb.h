@@ -0,0 +1,577 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#    include <windows.h>
+#    include <direct.h>
+#    include <io.h>
+#else
+#    include <errno.h>
+#    include <fcntl.h>
+#    include <unistd.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#endif
+
+#include "decicelsius.h"
+#include "journal.h"
+#include "kernels.h"
+
+// compressed raw samples, one append-only file of immutable blocks per sensor:
+// [header][bitstream] [header][bitstream] ...
+// timestamps are delta-of-delta coded, decicelsius values as deltas with the same bucket code;
+// blocks of older runs stored doubles XOR'ed with the previous one (Gorilla) and are still read
+#define TSDB_DIR "tsdb"
+#define TSDB_MAGIC 0x32445354u
+#define TSDB_MAGIC_DOUBLE 0x42445354u
+#define TSDB_BLOCK_SAMPLES 4096
+#define TSDB_MAX_SERIES 256
+
+// worst case per sample: 5 + 64 bits of timestamp, 2 + 5 + 6 + 64 bits of a double value
+// in the older blocks, 5 + 32 bits of a decicelsius delta
+#define TSDB_BLOCK_MAX_BYTES (TSDB_BLOCK_SAMPLES * 19 + 16)
+
+struct tsdb_block_header {
+    uint32_t magic;
+    uint32_t count;
+    uint32_t size;          // bytes of bitstream after the header
+    uint32_t crc;           // CRC-32 of the bitstream
+    int64_t first_ms;
+    int64_t last_ms;
+    double min;
+    double max;
+    double sum;
+    uint64_t journal_end;   // journal position after the last sample of the block
+};
+
+_Static_assert(sizeof(struct tsdb_block_header) == 64, "tsdb block header must stay 64 bytes");
+
+struct tsdb_summary {
+    uint64_t count;
+    double min;
+    double max;
+    double sum;
+};
+
+// open block of one sensor, sealed when full or on the hourly rollup
+struct tsdb_series {
+    int sensor_id;
+    int fd;
+    uint32_t count;
+    uint64_t journal_first;
+    uint64_t journal_end;
+    int64_t times[TSDB_BLOCK_SAMPLES];
+    decicelsius values[TSDB_BLOCK_SAMPLES];
+};
+
+struct tsdb {
+    char dir[256];
+    struct tsdb_series *series[TSDB_MAX_SERIES];
+    int count;
+    unsigned long blocks;
+    uint64_t samples;
+    uint64_t bytes;
+    unsigned char block[TSDB_BLOCK_MAX_BYTES];
+};
+
+struct tsdb_reader {
+    const unsigned char *data;
+    size_t size;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE map;
+#else
+    int fd;
+#endif
+};
+
+typedef void (*tsdb_sample_fn)(int64_t time_ms, decicelsius value, void *ctx);
+
+// ---bitstream--- //
+
+struct tsdb_bits {
+    unsigned char *buf;
+    size_t size;
+    size_t bit;
+};
+
+static void tsdb_put(struct tsdb_bits *w, uint64_t value, int n)
+{
+    while (n > 0) {
+        int free = 8 - (int)(w->bit & 7);
+        int take = n < free ? n : free;
+        unsigned chunk = (unsigned)(value >> (n - take)) & ((1u << take) - 1);
+        w->buf[w->bit >> 3] |= (unsigned char)(chunk << (free - take));
+        w->bit += take;
+        n -= take;
+    }
+}
+
+static uint64_t tsdb_get_slow(struct tsdb_bits *r, int n)
+{
+    uint64_t value = 0;
+    while (n > 0) {
+        int avail = 8 - (int)(r->bit & 7);
+        int take = n < avail ? n : avail;
+        unsigned byte = r->bit >> 3 < r->size ? r->buf[r->bit >> 3] : 0;
+        value = (value << take) | ((byte >> (avail - take)) & ((1u << take) - 1));
+        r->bit += take;
+        n -= take;
+    }
+    return value;
+}
+
+// up to 57 bits from one big-endian 8-byte load, byte at a time near the end
+static uint64_t tsdb_get(struct tsdb_bits *r, int n)
+{
+    if (n > 57)
+        return (tsdb_get(r, n - 32) << 32) | tsdb_get(r, 32);
+
+    size_t byte = r->bit >> 3;
+    if (byte + 8 > r->size)
+        return tsdb_get_slow(r, n);
+
+    const unsigned char *p = r->buf + byte;
+    uint64_t word = ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) | ((uint64_t)p[2] << 40) |
+                    ((uint64_t)p[3] << 32) | ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) |
+                    ((uint64_t)p[6] << 8) | (uint64_t)p[7];
+    uint64_t value = (word << (r->bit & 7)) >> (64 - n);
+    r->bit += n;
+    return value;
+}
+
+static int64_t tsdb_sign_extend(uint64_t value, int n)
+{
+    uint64_t sign = 1ULL << (n - 1);
+    return (int64_t)((value ^ sign) - sign);
+}
+
+static double tsdb_bits_double(uint64_t bits)
+{
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// delta-of-delta buckets: '0', '10'+7, '110'+9, '1110'+12, '11110'+32, '11111'+64
+static void tsdb_put_dod(struct tsdb_bits *w, int64_t dod)
+{
+    if (dod == 0) {
+        tsdb_put(w, 0, 1);
+    } else if (dod >= -64 && dod <= 63) {
+        tsdb_put(w, 0x2, 2);
+        tsdb_put(w, (uint64_t)dod, 7);
+    } else if (dod >= -256 && dod <= 255) {
+        tsdb_put(w, 0x6, 3);
+        tsdb_put(w, (uint64_t)dod, 9);
+    } else if (dod >= -2048 && dod <= 2047) {
+        tsdb_put(w, 0xE, 4);
+        tsdb_put(w, (uint64_t)dod, 12);
+    } else if (dod >= INT32_MIN && dod <= INT32_MAX) {
+        tsdb_put(w, 0x1E, 5);
+        tsdb_put(w, (uint64_t)dod, 32);
+    } else {
+        tsdb_put(w, 0x1F, 5);
+        tsdb_put(w, (uint64_t)dod, 64);
+    }
+}
+
+static int64_t tsdb_get_dod(struct tsdb_bits *r)
+{
+    if (tsdb_get(r, 1) == 0) return 0;
+    if (tsdb_get(r, 1) == 0) return tsdb_sign_extend(tsdb_get(r, 7), 7);
+    if (tsdb_get(r, 1) == 0) return tsdb_sign_extend(tsdb_get(r, 9), 9);
+    if (tsdb_get(r, 1) == 0) return tsdb_sign_extend(tsdb_get(r, 12), 12);
+    if (tsdb_get(r, 1) == 0) return tsdb_sign_extend(tsdb_get(r, 32), 32);
+    return (int64_t)tsdb_get(r, 64);
+}
+
+// encode count samples into buf, returns the bitstream size in bytes
+size_t tsdb_encode(const int64_t *times, const decicelsius *values, uint32_t count, unsigned char *buf, size_t size)
+{
+    memset(buf, 0, size);
+    struct tsdb_bits w = {buf, size, 0};
+
+    int64_t prev_delta = 0;
+    tsdb_put(&w, (uint64_t)(uint16_t)values[0], 16);
+
+    // a steady sensor mostly repeats its value or moves by a tenth: 1 or 9 bits
+    for (uint32_t i = 1; i < count; ++i) {
+        int64_t delta = times[i] - times[i - 1];
+        tsdb_put_dod(&w, delta - prev_delta);
+        prev_delta = delta;
+        tsdb_put_dod(&w, (int64_t)values[i] - values[i - 1]);
+    }
+    return (w.bit + 7) / 8;
+}
+
+// decode a block and pass samples within [from_ms, to_ms) to fn
+void tsdb_decode(const struct tsdb_block_header *h, const unsigned char *data,
+                 int64_t from_ms, int64_t to_ms, tsdb_sample_fn fn, void *ctx)
+{
+    struct tsdb_bits r = {(unsigned char*)data, h->size, 0};
+
+    int64_t time = h->first_ms;
+    int64_t delta = 0;
+
+    if (h->magic == TSDB_MAGIC) {
+        int64_t value = tsdb_sign_extend(tsdb_get(&r, 16), 16);
+        for (uint32_t i = 0; i < h->count; ++i) {
+            if (i > 0) {
+                delta += tsdb_get_dod(&r);
+                time += delta;
+                value += tsdb_get_dod(&r);
+            }
+            if (time >= from_ms && time < to_ms)
+                fn(time, (decicelsius)value, ctx);
+        }
+        return;
+    }
+
+    uint64_t bits = tsdb_get(&r, 64);
+    int lead = 0, trail = 0;
+    for (uint32_t i = 0; i < h->count; ++i) {
+        if (i > 0) {
+            delta += tsdb_get_dod(&r);
+            time += delta;
+
+            if (tsdb_get(&r, 1) != 0) {
+                if (tsdb_get(&r, 1) != 0) {
+                    lead = (int)tsdb_get(&r, 5);
+                    int sig = (int)tsdb_get(&r, 6) + 1;
+                    trail = 64 - lead - sig;
+                }
+                bits ^= tsdb_get(&r, 64 - lead - trail) << trail;
+            }
+        }
+        if (time >= from_ms && time < to_ms)
+            fn(time, deci_from_double(tsdb_bits_double(bits)), ctx);
+    }
+}
+
+// ---writer--- //
+
+static int tsdb_magic_known(uint32_t magic)
+{
+    return magic == TSDB_MAGIC || magic == TSDB_MAGIC_DOUBLE;
+}
+
+static int tsdb_header_valid(const struct tsdb_block_header *h, const unsigned char *data, size_t avail)
+{
+    return tsdb_magic_known(h->magic) && h->count > 0 && h->size <= avail &&
+           journal_crc32(data, h->size) == h->crc;
+}
+
+void tsdb_series_path(const char *dir, int sensor_id, char *path, size_t size)
+{
+    snprintf(path, size, "%s/%d.tsd", dir, sensor_id);
+}
+
+int tsdb_open(struct tsdb *db, const char *dir)
+{
+    memset(db, 0, sizeof(*db));
+    snprintf(db->dir, sizeof(db->dir), "%s", dir);
+#ifdef _WIN32
+    _mkdir(dir);
+#else
+    if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+        perror(dir);
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+// open a series file, a torn block left by a crash is cut off
+static struct tsdb_series *tsdb_load_series(struct tsdb *db, int sensor_id)
+{
+    if (db->count >= TSDB_MAX_SERIES) {
+        fprintf(stderr, "tsdb: too many series\n");
+        return NULL;
+    }
+
+    char path[300];
+    tsdb_series_path(db->dir, sensor_id, path, sizeof(path));
+#ifdef _WIN32
+    int fd = _open(path, _O_RDWR | _O_CREAT | _O_BINARY, 0644);
+#else
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+#endif
+    if (fd == -1) {
+        perror(path);
+        return NULL;
+    }
+
+    struct tsdb_series *s = calloc(1, sizeof(*s));
+    if (s == NULL) {
+        perror("calloc (tsdb)");
+        close(fd);
+        return NULL;
+    }
+    s->sensor_id = sensor_id;
+    s->fd = fd;
+
+    // walk the block headers, the last valid one tells how far the journal is sealed
+    long end = 0;
+    struct tsdb_block_header h;
+    while (lseek(fd, end, SEEK_SET) == end && read(fd, &h, sizeof(h)) == (int)sizeof(h)) {
+        if (!tsdb_magic_known(h.magic) || h.size > TSDB_BLOCK_MAX_BYTES ||
+            read(fd, db->block, h.size) != (int)h.size ||
+            !tsdb_header_valid(&h, db->block, h.size)) {
+            break;
+        }
+        s->journal_end = h.journal_end;
+        end += sizeof(h) + h.size;
+    }
+#ifdef _WIN32
+    _chsize(fd, end);
+#else
+    if (ftruncate(fd, end) == -1)
+        perror("ftruncate (tsdb)");
+#endif
+    lseek(fd, end, SEEK_SET);
+
+    db->series[db->count++] = s;
+    return s;
+}
+
+struct tsdb_series *tsdb_series_get(struct tsdb *db, int sensor_id)
+{
+    for (int i = 0; i < db->count; ++i) {
+        if (db->series[i]->sensor_id == sensor_id)
+            return db->series[i];
+    }
+    return tsdb_load_series(db, sensor_id);
+}
+
+// compress the open block and append it, blocks are never rewritten
+int tsdb_seal(struct tsdb *db, struct tsdb_series *s)
+{
+    if (s->count == 0)
+        return 0;
+
+    struct tsdb_block_header h;
+    memset(&h, 0, sizeof(h));
+    h.magic = TSDB_MAGIC;
+    h.count = s->count;
+    h.first_ms = s->times[0];
+    h.last_ms = s->times[s->count - 1];
+    const struct kernels *k = kernels();
+    decicelsius min, max;
+    k->minmax_i16(s->values, s->count, &min, &max);
+    h.min = deci_to_double(min);
+    h.max = deci_to_double(max);
+    h.sum = k->sum_i16(s->values, s->count) / 10.0;
+    h.journal_end = s->journal_end;
+    h.size = (uint32_t)tsdb_encode(s->times, s->values, s->count, db->block, sizeof(db->block));
+    h.crc = journal_crc32(db->block, h.size);
+
+    if (write(s->fd, &h, sizeof(h)) != (int)sizeof(h) ||
+        write(s->fd, db->block, h.size) != (int)h.size) {
+        perror("write (tsdb)");
+        return -1;
+    }
+#ifdef _WIN32
+    _commit(s->fd);
+#else
+    fdatasync(s->fd);
+#endif
+
+    db->blocks++;
+    db->samples += s->count;
+    db->bytes += sizeof(h) + h.size;
+    s->count = 0;
+    return 0;
+}
+
+void tsdb_seal_all(struct tsdb *db)
+{
+    for (int i = 0; i < db->count; ++i)
+        tsdb_seal(db, db->series[i]);
+}
+
+// add one journal record, records already sealed by an earlier run are skipped
+int tsdb_append(struct tsdb *db, int sensor_id, int64_t time_ms, decicelsius value, uint64_t offset)
+{
+    struct tsdb_series *s = tsdb_series_get(db, sensor_id);
+    if (s == NULL)
+        return -1;
+    if (offset < s->journal_end)
+        return 0;
+
+    if (s->count == 0)
+        s->journal_first = offset;
+    s->times[s->count] = time_ms;
+    s->values[s->count] = value;
+    s->count++;
+    s->journal_end = offset + 1;
+
+    if (s->count == TSDB_BLOCK_SAMPLES)
+        return tsdb_seal(db, s);
+    return 0;
+}
+
+// oldest journal position still needed to rebuild the open blocks
+uint64_t tsdb_replay_from(struct tsdb *db, uint64_t applied)
+{
+    uint64_t from = applied;
+    for (int i = 0; i < db->count; ++i) {
+        struct tsdb_series *s = db->series[i];
+        if (s->count > 0 && s->journal_first < from)
+            from = s->journal_first;
+    }
+    return from;
+}
+
+void tsdb_close(struct tsdb *db)
+{
+    tsdb_seal_all(db);
+    for (int i = 0; i < db->count; ++i) {
+        close(db->series[i]->fd);
+        free(db->series[i]);
+    }
+    db->count = 0;
+}
+
+void tsdb_print_stats(struct tsdb *db)
+{
+    printf("tsdb: %lu blocks sealed, %llu samples, %.2f bytes/sample\n",
+           db->blocks, (unsigned long long)db->samples,
+           db->samples ? (double)db->bytes / db->samples : 0.0);
+}
+
+// ---reader--- //
+
+// map a series file read-only, a missing file is an empty series
+int tsdb_reader_open(struct tsdb_reader *r, const char *dir, int sensor_id)
+{
+    memset(r, 0, sizeof(*r));
+    char path[300];
+    tsdb_series_path(dir, sensor_id, path, sizeof(path));
+
+#ifdef _WIN32
+    r->file = CreateFile(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                         OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (r->file == INVALID_HANDLE_VALUE)
+        return 0;
+    LARGE_INTEGER size;
+    GetFileSizeEx(r->file, &size);
+    r->size = (size_t)size.QuadPart;
+    if (r->size == 0)
+        return 0;
+    r->map = CreateFileMapping(r->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (r->map == NULL)
+        return -1;
+    r->data = MapViewOfFile(r->map, FILE_MAP_READ, 0, 0, r->size);
+    if (r->data == NULL)
+        return -1;
+#else
+    r->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (r->fd == -1)
+        return errno == ENOENT ? 0 : -1;
+    struct stat st;
+    if (fstat(r->fd, &st) == -1)
+        return -1;
+    r->size = (size_t)st.st_size;
+    if (r->size == 0)
+        return 0;
+    void *addr = mmap(NULL, r->size, PROT_READ, MAP_SHARED, r->fd, 0);
+    if (addr == MAP_FAILED) {
+        perror("mmap (tsdb)");
+        return -1;
+    }
+    r->data = (const unsigned char*)addr;
+#endif
+    return 0;
+}
+
+void tsdb_reader_close(struct tsdb_reader *r)
+{
+#ifdef _WIN32
+    if (r->data != NULL)
+        UnmapViewOfFile(r->data);
+    if (r->map != NULL)
+        CloseHandle(r->map);
+    if (r->file != NULL && r->file != INVALID_HANDLE_VALUE)
+        CloseHandle(r->file);
+#else
+    if (r->data != NULL)
+        munmap((void*)r->data, r->size);
+    if (r->fd > 0)
+        close(r->fd);
+#endif
+    memset(r, 0, sizeof(*r));
+}
+
+// next block header at *pos or NULL at the end of the valid blocks
+static const struct tsdb_block_header *tsdb_next_block(const struct tsdb_reader *r, size_t *pos)
+{
+    if (*pos + sizeof(struct tsdb_block_header) > r->size)
+        return NULL;
+    const struct tsdb_block_header *h = (const struct tsdb_block_header*)(r->data + *pos);
+    if (!tsdb_magic_known(h->magic) || h->size > r->size - *pos - sizeof(*h))
+        return NULL;
+    *pos += sizeof(*h) + h->size;
+    return h;
+}
+
+// first and last sample time of the sealed blocks, returns how many there are
+uint64_t tsdb_sealed_span(const struct tsdb_reader *r, int64_t *first_ms, int64_t *last_ms)
+{
+    uint64_t blocks = 0;
+    size_t pos = 0;
+    const struct tsdb_block_header *h;
+    while ((h = tsdb_next_block(r, &pos)) != NULL) {
+        if (blocks == 0 || h->first_ms < *first_ms) *first_ms = h->first_ms;
+        if (blocks == 0 || h->last_ms > *last_ms) *last_ms = h->last_ms;
+        blocks++;
+    }
+    return blocks;
+}
+
+// every sample within [from_ms, to_ms), blocks outside the range are not decoded
+void tsdb_scan(const struct tsdb_reader *r, int64_t from_ms, int64_t to_ms, tsdb_sample_fn fn, void *ctx)
+{
+    size_t pos = 0;
+    const struct tsdb_block_header *h;
+    while ((h = tsdb_next_block(r, &pos)) != NULL) {
+        if (h->last_ms < from_ms || h->first_ms >= to_ms)
+            continue;
+        tsdb_decode(h, (const unsigned char*)(h + 1), from_ms, to_ms, fn, ctx);
+    }
+}
+
+static void tsdb_summary_add(int64_t time_ms, decicelsius tenths, void *ctx)
+{
+    (void)time_ms;
+    struct tsdb_summary *sum = (struct tsdb_summary*)ctx;
+    double value = deci_to_double(tenths);
+    if (sum->count == 0 || value < sum->min) sum->min = value;
+    if (sum->count == 0 || value > sum->max) sum->max = value;
+    sum->sum += value;
+    sum->count++;
+}
+
+// count/min/max/sum over [from_ms, to_ms), blocks fully inside use their header only
+void tsdb_aggregate(const struct tsdb_reader *r, int64_t from_ms, int64_t to_ms, struct tsdb_summary *out)
+{
+    memset(out, 0, sizeof(*out));
+    size_t pos = 0;
+    const struct tsdb_block_header *h;
+    while ((h = tsdb_next_block(r, &pos)) != NULL) {
+        if (h->last_ms < from_ms || h->first_ms >= to_ms)
+            continue;
+        if (h->first_ms >= from_ms && h->last_ms < to_ms) {
+            if (out->count == 0 || h->min < out->min) out->min = h->min;
+            if (out->count == 0 || h->max > out->max) out->max = h->max;
+            out->sum += h->sum;
+            out->count += h->count;
+            continue;
+        }
+        tsdb_decode(h, (const unsigned char*)(h + 1), from_ms, to_ms, tsdb_summary_add, out);
+    }
+}
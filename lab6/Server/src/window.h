@@ -0,0 +1,409 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "decicelsius.h"
+
+#ifdef _WIN32
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <unistd.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#endif
+
+// per-minute aggregates of the last WINDOW_MINUTES minutes of every sensor in shared memory:
+// Fenwick trees for sum and count and a max-segment tree pair for min/max, so any window
+// within the horizon is answered with O(log n) reads however wide it is. Minutes are wall-clock
+// minutes (local time as stored in the tables), slot = minute % WINDOW_MINUTES
+#ifdef _WIN32
+#    define WINDOW_NAME "Local\\lab6_temperature_window"
+#else
+#    define WINDOW_NAME "/lab6_temperature_window"
+#endif
+#define WINDOW_MAGIC 0x574E4957u
+#define WINDOW_BITS 16
+#define WINDOW_MINUTES (1 << WINDOW_BITS)   // about 45 days
+#define WINDOW_MAX_SERIES 64
+#define WINDOW_LIMIT (1 << 30)              // |tenths of a degree| kept below this
+
+// min and max are both stored as max-trees of positive codes, 0 is an empty slot,
+// so a freshly mapped (zeroed) segment is an empty index without touching its pages
+#define WINDOW_MIN_CODE(tenths) ((uint32_t)(WINDOW_LIMIT - (tenths)))
+#define WINDOW_MAX_CODE(tenths) ((uint32_t)(WINDOW_LIMIT + (tenths)))
+
+// seq is odd while the writer updates the series (seqlock)
+struct window_series {
+    _Alignas(64) _Atomic uint32_t seq;
+    int32_t sensor_id;
+    int64_t head;                          // newest minute, slots hold (head - WINDOW_MINUTES, head]
+    int64_t sum[WINDOW_MINUTES + 1];       // Fenwick, tenths of a degree, 1-based
+    int64_t count[WINDOW_MINUTES + 1];     // Fenwick
+    uint32_t min[2 * WINDOW_MINUTES];      // segment trees, leaf of slot i at WINDOW_MINUTES + i
+    uint32_t max[2 * WINDOW_MINUTES];
+};
+
+struct window_shm {
+    _Atomic uint32_t magic;
+    _Atomic int32_t series_count;
+    struct window_series series[WINDOW_MAX_SERIES];
+};
+
+struct window {
+    struct window_shm *shm;
+#ifdef _WIN32
+    HANDLE map;
+#else
+    int fd;
+#endif
+};
+
+struct window_stats {
+    int64_t from;     // minutes actually covered, [from, to)
+    int64_t to;
+    int64_t count;
+    double sum;
+    double min;
+    double max;
+};
+
+static int window_map(struct window *w, int create)
+{
+    size_t size = sizeof(struct window_shm);
+#ifdef _WIN32
+    if (create) {
+        w->map = CreateFileMapping(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+                                   (DWORD)((uint64_t)size >> 32), (DWORD)size, WINDOW_NAME);
+    } else {
+        w->map = OpenFileMapping(FILE_MAP_READ, FALSE, WINDOW_NAME);
+    }
+    if (w->map == NULL)
+        return -1;
+    w->shm = MapViewOfFile(w->map, create ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+    if (w->shm == NULL) {
+        CloseHandle(w->map);
+        return -1;
+    }
+#else
+    w->fd = shm_open(WINDOW_NAME, create ? O_RDWR | O_CREAT | O_TRUNC : O_RDONLY, 0644);
+    if (w->fd == -1)
+        return -1;
+    // pages are only backed once a series writes to them
+    if (create && ftruncate(w->fd, (off_t)size) == -1) {
+        perror("ftruncate (window)");
+        close(w->fd);
+        return -1;
+    }
+    w->shm = mmap(NULL, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, w->fd, 0);
+    if (w->shm == MAP_FAILED) {
+        close(w->fd);
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+static void window_unmap(struct window *w)
+{
+#ifdef _WIN32
+    UnmapViewOfFile(w->shm);
+    CloseHandle(w->map);
+#else
+    munmap(w->shm, sizeof(struct window_shm));
+    close(w->fd);
+#endif
+    w->shm = NULL;
+}
+
+// ---trees--- //
+
+static void fenwick_add(int64_t *tree, int slot, int64_t delta)
+{
+    for (int i = slot + 1; i <= WINDOW_MINUTES; i += i & -i)
+        tree[i] += delta;
+}
+
+// sum of slots [0, slot)
+static int64_t fenwick_prefix(const int64_t *tree, int slot)
+{
+    int64_t total = 0;
+    for (int i = slot; i > 0; i -= i & -i)
+        total += tree[i];
+    return total;
+}
+
+static uint32_t max_u32(uint32_t a, uint32_t b)
+{
+    return a > b ? a : b;
+}
+
+static void segment_set(uint32_t *tree, int slot, uint32_t code)
+{
+    int i = WINDOW_MINUTES + slot;
+    tree[i] = code;
+    for (i >>= 1; i >= 1; i >>= 1)
+        tree[i] = max_u32(tree[2 * i], tree[2 * i + 1]);
+}
+
+// max code over slots [from, to)
+static uint32_t segment_max(const uint32_t *tree, int from, int to)
+{
+    uint32_t best = 0;
+    for (int l = from + WINDOW_MINUTES, r = to + WINDOW_MINUTES; l < r; l >>= 1, r >>= 1) {
+        if (l & 1)
+            best = max_u32(best, tree[l++]);
+        if (r & 1)
+            best = max_u32(best, tree[--r]);
+    }
+    return best;
+}
+
+// ---writer--- //
+
+int window_create(struct window *w)
+{
+    if (window_map(w, 1) == -1) {
+        fprintf(stderr, "Cannot create shared memory %s\n", WINDOW_NAME);
+        return -1;
+    }
+    atomic_store_explicit(&w->shm->magic, WINDOW_MAGIC, memory_order_release);
+    return 0;
+}
+
+// series of a sensor, added on first use
+struct window_series *window_series_get(struct window *w, int sensor_id)
+{
+    int count = atomic_load_explicit(&w->shm->series_count, memory_order_relaxed);
+    for (int i = 0; i < count; ++i) {
+        if (w->shm->series[i].sensor_id == sensor_id)
+            return &w->shm->series[i];
+    }
+    if (count >= WINDOW_MAX_SERIES)
+        return NULL;
+
+    struct window_series *s = &w->shm->series[count];
+    s->sensor_id = sensor_id;
+    s->head = 0;
+    atomic_store_explicit(&w->shm->series_count, count + 1, memory_order_release);
+    return s;
+}
+
+static void window_begin(struct window_series *s)
+{
+    uint32_t seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+    atomic_store_explicit(&s->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void window_end(struct window_series *s)
+{
+    uint32_t seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+    atomic_store_explicit(&s->seq, seq + 1, memory_order_release);
+}
+
+static void window_clear_slot(struct window_series *s, int slot)
+{
+    int64_t sum = fenwick_prefix(s->sum, slot + 1) - fenwick_prefix(s->sum, slot);
+    int64_t count = fenwick_prefix(s->count, slot + 1) - fenwick_prefix(s->count, slot);
+    if (count != 0) {
+        fenwick_add(s->sum, slot, -sum);
+        fenwick_add(s->count, slot, -count);
+    }
+    if (s->min[WINDOW_MINUTES + slot] != 0) {
+        segment_set(s->min, slot, 0);
+        segment_set(s->max, slot, 0);
+    }
+}
+
+// move the head to minute, the slots it passes drop what they held WINDOW_MINUTES ago
+static void window_advance(struct window_series *s, int64_t minute)
+{
+    if (minute <= s->head)
+        return;
+    if (s->head == 0) {
+        s->head = minute;
+        return;
+    }
+    if (minute - s->head >= WINDOW_MINUTES) {
+        memset(s->sum, 0, sizeof(s->sum));
+        memset(s->count, 0, sizeof(s->count));
+        memset(s->min, 0, sizeof(s->min));
+        memset(s->max, 0, sizeof(s->max));
+    } else {
+        for (int64_t m = s->head + 1; m <= minute; ++m)
+            window_clear_slot(s, (int)(m % WINDOW_MINUTES));
+    }
+    s->head = minute;
+}
+
+// add a minute's samples, values are tenths of a degree; minutes older than the horizon are ignored
+static void window_add_bucket(struct window_series *s, int64_t minute, int64_t sum, int64_t count,
+                              int32_t min, int32_t max)
+{
+    window_advance(s, minute);
+    if (minute <= s->head - WINDOW_MINUTES || count <= 0)
+        return;
+    int slot = (int)(minute % WINDOW_MINUTES);
+    fenwick_add(s->sum, slot, sum);
+    fenwick_add(s->count, slot, count);
+    segment_set(s->min, slot, max_u32(s->min[WINDOW_MINUTES + slot], WINDOW_MIN_CODE(min)));
+    segment_set(s->max, slot, max_u32(s->max[WINDOW_MINUTES + slot], WINDOW_MAX_CODE(max)));
+}
+
+static int32_t window_tenths(double value)
+{
+    long long tenths = llround(value * 10);
+    if (tenths >= WINDOW_LIMIT)
+        return WINDOW_LIMIT - 1;
+    return tenths <= -WINDOW_LIMIT ? -WINDOW_LIMIT + 1 : (int32_t)tenths;
+}
+
+// one sample, O(log n)
+void window_add(struct window_series *s, int64_t minute, decicelsius tenths)
+{
+    window_begin(s);
+    window_add_bucket(s, minute, tenths, 1, tenths, tenths);
+    window_end(s);
+}
+
+// ---rebuild--- //
+
+// minutes in ascending order are collected into the tree leaves, then both trees are built
+// bottom-up: O(n) for the whole horizon instead of a log n update per minute
+void window_load_begin(struct window_series *s, int64_t head)
+{
+    window_begin(s);
+    memset(s->sum, 0, sizeof(s->sum));
+    memset(s->count, 0, sizeof(s->count));
+    memset(s->min, 0, sizeof(s->min));
+    memset(s->max, 0, sizeof(s->max));
+    s->head = head;
+}
+
+void window_load_bucket(struct window_series *s, int64_t minute, double sum, int64_t count, double min, double max)
+{
+    if (minute > s->head || minute <= s->head - WINDOW_MINUTES || count <= 0)
+        return;
+    int slot = (int)(minute % WINDOW_MINUTES);
+    s->sum[slot + 1] += llround(sum * 10);
+    s->count[slot + 1] += count;
+    s->min[WINDOW_MINUTES + slot] = max_u32(s->min[WINDOW_MINUTES + slot], WINDOW_MIN_CODE(window_tenths(min)));
+    s->max[WINDOW_MINUTES + slot] = max_u32(s->max[WINDOW_MINUTES + slot], WINDOW_MAX_CODE(window_tenths(max)));
+}
+
+void window_load_end(struct window_series *s)
+{
+    for (int i = 1; i <= WINDOW_MINUTES; ++i) {
+        int parent = i + (i & -i);
+        if (parent <= WINDOW_MINUTES) {
+            s->sum[parent] += s->sum[i];
+            s->count[parent] += s->count[i];
+        }
+    }
+    for (int i = WINDOW_MINUTES - 1; i >= 1; --i) {
+        s->min[i] = max_u32(s->min[2 * i], s->min[2 * i + 1]);
+        s->max[i] = max_u32(s->max[2 * i], s->max[2 * i + 1]);
+    }
+    window_end(s);
+}
+
+void window_destroy(struct window *w)
+{
+    window_unmap(w);
+#ifndef _WIN32
+    shm_unlink(WINDOW_NAME);
+#endif
+}
+
+// ---reader--- //
+
+int window_open(struct window *w)
+{
+    if (window_map(w, 0) == -1)
+        return -1;
+    if (atomic_load_explicit(&w->shm->magic, memory_order_acquire) != WINDOW_MAGIC) {
+        window_unmap(w);
+        return -1;
+    }
+    return 0;
+}
+
+void window_close(struct window *w)
+{
+    window_unmap(w);
+}
+
+// slots [from, to) of one contiguous run into out
+static void window_gather(const struct window_series *s, int from, int to, int64_t *sum, int64_t *count,
+                          uint32_t *min, uint32_t *max)
+{
+    *sum += fenwick_prefix(s->sum, to) - fenwick_prefix(s->sum, from);
+    *count += fenwick_prefix(s->count, to) - fenwick_prefix(s->count, from);
+    *min = max_u32(*min, segment_max(s->min, from, to));
+    *max = max_u32(*max, segment_max(s->max, from, to));
+}
+
+// aggregates over minutes [from, to), clamped to what the index holds; 0 or -1 when the sensor
+// has no series; retried until no write overlapped the reads
+int window_query(struct window *w, int sensor_id, int64_t from, int64_t to, struct window_stats *out)
+{
+    const struct window_series *s = NULL;
+    int count = atomic_load_explicit(&w->shm->series_count, memory_order_acquire);
+    for (int i = 0; i < count; ++i) {
+        if (w->shm->series[i].sensor_id == sensor_id) {
+            s = &w->shm->series[i];
+            break;
+        }
+    }
+    if (s == NULL)
+        return -1;
+
+    for (;;) {
+        uint32_t seq = atomic_load_explicit(&((struct window_series*)s)->seq, memory_order_acquire);
+        if (seq & 1)
+            continue;
+
+        int64_t head = s->head;
+        int64_t lo = from > head - WINDOW_MINUTES + 1 ? from : head - WINDOW_MINUTES + 1;
+        int64_t hi = to < head + 1 ? to : head + 1;
+        int64_t sum = 0, n = 0;
+        uint32_t min = 0, max = 0;
+        if (lo < hi) {
+            int a = (int)(lo % WINDOW_MINUTES), b = (int)(hi % WINDOW_MINUTES);
+            if (a < b) {
+                window_gather(s, a, b, &sum, &n, &min, &max);
+            } else {
+                window_gather(s, a, WINDOW_MINUTES, &sum, &n, &min, &max);
+                window_gather(s, 0, b, &sum, &n, &min, &max);
+            }
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&((struct window_series*)s)->seq, memory_order_relaxed) != seq)
+            continue;
+
+        out->from = lo;
+        out->to = hi > lo ? hi : lo;
+        out->count = n;
+        out->sum = sum / 10.0;
+        out->min = n > 0 ? (WINDOW_LIMIT - (int64_t)min) / 10.0 : NAN;
+        out->max = n > 0 ? ((int64_t)max - WINDOW_LIMIT) / 10.0 : NAN;
+        return 0;
+    }
+}
+
+// one-shot query for a CGI request, -1 if the server is not running or has no such sensor
+int window_read(int sensor_id, int64_t from, int64_t to, struct window_stats *out)
+{
+    struct window w;
+    if (window_open(&w) == -1)
+        return -1;
+    int res = window_query(&w, sensor_id, from, to, out);
+    window_close(&w);
+    return res;
+}